@@ -0,0 +1,316 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * Comparator for benchmark result files, turning the bench suite into a
+ * regression gate instead of an eyeballing exercise.
+ *
+ * Results format: a file is any stream of flat JSON objects - the JSON
+ * arrays printed by bench-matrix, fixed-bench, msg-ring-bench etc. work
+ * as-is, as do plain JSON lines. Within an object, fields that look
+ * like rates or costs (ops_per_sec, cycles_per_op, oneway_ns, ...) are
+ * metrics; everything else (workload, config, flags, qd, ...)
+ * identifies the cell. The well-known environment fields "host", "kernel" and
+ * "liburing" are excluded from cell identity so runs from different
+ * hosts or kernels still pair up; emit them once per file with the -m
+ * meta record:
+ *
+ *   ./bench-compare -m > baseline.json
+ *   ./bench-matrix >> baseline.json
+ *   ./fixed-bench >> baseline.json
+ *
+ * Comparison: ./bench-compare [-t pct] [-v] baseline.json new.json
+ * pairs cells by identity and flags metric movements beyond the noise
+ * threshold (default 10%). Metrics whose names contain ns/cycles/cpu
+ * count as lower-is-better, everything else as higher-is-better; only
+ * regressions fail the run (exit 1), improvements print with -v.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <sys/utsname.h>
+
+#include "liburing.h"
+
+#define MAX_RECORDS	4096
+#define MAX_METRICS	16
+#define KEY_LEN		512
+#define NAME_LEN	32
+
+struct metric {
+	char name[NAME_LEN];
+	double value;
+};
+
+struct record {
+	char key[KEY_LEN];
+	struct metric metrics[MAX_METRICS];
+	int nr_metrics;
+	int matched;
+};
+
+static double threshold = 10.0;
+static int verbose;
+
+static int is_env_field(const char *name)
+{
+	return !strcmp(name, "host") || !strcmp(name, "kernel") ||
+	       !strcmp(name, "liburing");
+}
+
+static int lower_is_better(const char *name)
+{
+	return strstr(name, "ns") || strstr(name, "cycles") ||
+	       strstr(name, "cpu");
+}
+
+/*
+ * Numeric fields are only metrics when they look like rates or costs;
+ * numeric knobs (qd, depth, msg_size, ...) stay part of the identity.
+ */
+static int is_metric_field(const char *name)
+{
+	static const char * const pats[] = {
+		"per_sec", "per_op", "per_msg", "iops", "ops", "cycles",
+		"ns", "pct", "seconds", "wakeup", "value",
+	};
+	unsigned i;
+
+	for (i = 0; i < sizeof(pats) / sizeof(pats[0]); i++) {
+		if (strstr(name, pats[i]))
+			return 1;
+	}
+	return 0;
+}
+
+/* parse one flat JSON object at *sp, advancing past it */
+static int parse_record(const char **sp, struct record *rec)
+{
+	const char *s = *sp;
+
+	while (*s && *s != '{')
+		s++;
+	if (!*s)
+		return -1;
+	s++;
+	rec->key[0] = '\0';
+	rec->nr_metrics = 0;
+	rec->matched = 0;
+
+	while (*s && *s != '}') {
+		char name[NAME_LEN], val[KEY_LEN];
+		const char *e;
+		size_t len;
+
+		while (*s && *s != '"' && *s != '}')
+			s++;
+		if (*s != '"')
+			break;
+		e = strchr(++s, '"');
+		if (!e)
+			return -1;
+		len = (size_t) (e - s) < sizeof(name) - 1 ?
+			(size_t) (e - s) : sizeof(name) - 1;
+		memcpy(name, s, len);
+		name[len] = '\0';
+		s = e + 1;
+		while (*s && (*s == ':' || isspace(*s)))
+			s++;
+
+		if (*s == '"') {
+			e = strchr(++s, '"');
+			if (!e)
+				return -1;
+			len = (size_t) (e - s) < sizeof(val) - 1 ?
+				(size_t) (e - s) : sizeof(val) - 1;
+			memcpy(val, s, len);
+			val[len] = '\0';
+			s = e + 1;
+		} else if (*s == '[') {
+			e = strchr(s, ']');
+			if (!e)
+				return -1;
+			len = (size_t) (e - s + 1) < sizeof(val) - 1 ?
+				(size_t) (e - s + 1) : sizeof(val) - 1;
+			memcpy(val, s, len);
+			val[len] = '\0';
+			s = e + 1;
+		} else {
+			for (e = s; *e && *e != ',' && *e != '}'; e++)
+				;
+			len = (size_t) (e - s) < sizeof(val) - 1 ?
+				(size_t) (e - s) : sizeof(val) - 1;
+			memcpy(val, s, len);
+			while (len && isspace(val[len - 1]))
+				len--;
+			val[len] = '\0';
+			s = e;
+
+			if ((isdigit(val[0]) || val[0] == '-') &&
+			    is_metric_field(name)) {
+				if (rec->nr_metrics < MAX_METRICS) {
+					struct metric *m =
+						&rec->metrics[rec->nr_metrics++];
+
+					snprintf(m->name, sizeof(m->name),
+						 "%s", name);
+					m->value = atof(val);
+				}
+				continue;
+			}
+		}
+		if (is_env_field(name))
+			continue;
+		len = strlen(rec->key);
+		snprintf(rec->key + len, sizeof(rec->key) - len, "%s%s=%s",
+			 len ? " " : "", name, val);
+	}
+	if (*s == '}')
+		s++;
+	*sp = s;
+	return 0;
+}
+
+static int load_file(const char *path, struct record *recs, int max)
+{
+	static char buf[4 * 1024 * 1024];
+	const char *s = buf;
+	FILE *f;
+	size_t got;
+	int nr = 0;
+
+	f = fopen(path, "r");
+	if (!f) {
+		perror(path);
+		return -1;
+	}
+	got = fread(buf, 1, sizeof(buf) - 1, f);
+	fclose(f);
+	buf[got] = '\0';
+
+	while (nr < max && !parse_record(&s, &recs[nr])) {
+		/* skip-only and meta-only records carry no metrics */
+		if (recs[nr].nr_metrics)
+			nr++;
+	}
+	return nr;
+}
+
+static struct record *find_record(struct record *recs, int nr, const char *key)
+{
+	int i;
+
+	for (i = 0; i < nr; i++) {
+		if (!strcmp(recs[i].key, key))
+			return &recs[i];
+	}
+	return NULL;
+}
+
+static int print_meta(void)
+{
+	struct utsname u;
+	char host[128] = "unknown";
+
+	uname(&u);
+	gethostname(host, sizeof(host) - 1);
+	printf("{\"host\": \"%s\", \"kernel\": \"%s\", "
+	       "\"liburing\": \"%d.%d\"}\n", host, u.release,
+	       io_uring_major_version(), io_uring_minor_version());
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	static struct record old_recs[MAX_RECORDS], new_recs[MAX_RECORDS];
+	int nr_old, nr_new, regressions = 0, i, j, c;
+
+	while ((c = getopt(argc, argv, "mt:v")) != -1) {
+		switch (c) {
+		case 'm':
+			return print_meta();
+		case 't':
+			threshold = atof(optarg);
+			break;
+		case 'v':
+			verbose = 1;
+			break;
+		default:
+			fprintf(stderr, "Usage: %s [-t pct] [-v] old new\n"
+				"       %s -m\n", argv[0], argv[0]);
+			return 1;
+		}
+	}
+	if (optind + 2 != argc) {
+		fprintf(stderr, "Usage: %s [-t pct] [-v] old new\n", argv[0]);
+		return 1;
+	}
+
+	nr_old = load_file(argv[optind], old_recs, MAX_RECORDS);
+	nr_new = load_file(argv[optind + 1], new_recs, MAX_RECORDS);
+	if (nr_old < 0 || nr_new < 0)
+		return 1;
+
+	for (i = 0; i < nr_new; i++) {
+		struct record *n = &new_recs[i];
+		struct record *o = find_record(old_recs, nr_old, n->key);
+
+		if (!o) {
+			if (verbose)
+				printf("NEW        %s\n", n->key);
+			continue;
+		}
+		o->matched = 1;
+		for (j = 0; j < n->nr_metrics; j++) {
+			struct metric *nm = &n->metrics[j];
+			double ov = 0.0, pct;
+			int k, worse;
+
+			for (k = 0; k < o->nr_metrics; k++) {
+				if (!strcmp(o->metrics[k].name, nm->name))
+					break;
+			}
+			if (k == o->nr_metrics)
+				continue;
+			ov = o->metrics[k].value;
+			if (ov == 0.0)
+				continue;
+			pct = (nm->value - ov) * 100.0 / ov;
+			worse = lower_is_better(nm->name) ? pct > 0.0 :
+							    pct < 0.0;
+			if (worse && pct < 0.0)
+				pct = -pct;
+			else if (worse)
+				;
+			else
+				pct = pct < 0.0 ? -pct : pct;
+			if (pct < threshold) {
+				if (verbose)
+					printf("OK         %s %s %.1f%%\n",
+					       n->key, nm->name, pct);
+				continue;
+			}
+			if (worse) {
+				printf("REGRESSION %s %s: %.0f -> %.0f "
+				       "(%.1f%%)\n", n->key, nm->name, ov,
+				       nm->value, pct);
+				regressions++;
+			} else if (verbose) {
+				printf("IMPROVED   %s %s: %.0f -> %.0f "
+				       "(%.1f%%)\n", n->key, nm->name, ov,
+				       nm->value, pct);
+			}
+		}
+	}
+	for (i = 0; i < nr_old; i++) {
+		if (!old_recs[i].matched && verbose)
+			printf("MISSING    %s\n", old_recs[i].key);
+	}
+
+	if (regressions) {
+		printf("%d regression(s) beyond %.1f%%\n", regressions,
+		       threshold);
+		return 1;
+	}
+	return 0;
+}
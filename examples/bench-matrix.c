@@ -0,0 +1,327 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * Matrix-driven throughput benchmark: runs a set of workloads (NOP
+ * round-trips, 4k random reads, socketpair echo) across the ring
+ * configurations that usually get argued about - plain vs SQPOLL vs
+ * COOP_TASKRUN vs DEFER_TASKRUN, registered ring fd on and off, fixed
+ * vs unfixed read buffers - pinned to one CPU, and emits one JSON array
+ * so runs before and after a kernel or liburing upgrade can be diffed
+ * mechanically.
+ *
+ * Usage: bench-matrix [seconds-per-cell]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <time.h>
+#include <sys/socket.h>
+
+#include "liburing.h"
+
+#define QD		32
+#define BLOCK		4096
+#define FILE_BLOCKS	16384		/* 64M working set */
+#define MSG_LEN		64
+
+static double cell_secs = 0.5;
+static int data_fd = -1;
+static char *read_bufs;
+static int first_record = 1;
+
+struct ring_cfg {
+	const char *name;
+	unsigned flags;
+};
+
+static const struct ring_cfg cfgs[] = {
+	{ "plain",		0 },
+	{ "sqpoll",		IORING_SETUP_SQPOLL },
+	{ "coop_taskrun",	IORING_SETUP_COOP_TASKRUN },
+	{ "defer_taskrun",	IORING_SETUP_SINGLE_ISSUER |
+				IORING_SETUP_DEFER_TASKRUN },
+};
+
+static double now_sec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void emit(const char *workload, const struct ring_cfg *cfg,
+		 int reg_ringfd, unsigned long long ops, double secs)
+{
+	printf("%s\n  {\"workload\": \"%s\", \"config\": \"%s\", "
+	       "\"ring_fd_registered\": %s, \"ops\": %llu, "
+	       "\"seconds\": %.3f, \"ops_per_sec\": %.0f}",
+	       first_record ? "" : ",", workload, cfg->name,
+	       reg_ringfd ? "true" : "false", ops, secs,
+	       secs > 0.0 ? ops / secs : 0.0);
+	first_record = 0;
+}
+
+static void emit_skip(const char *workload, const struct ring_cfg *cfg,
+		      int reg_ringfd, int err)
+{
+	printf("%s\n  {\"workload\": \"%s\", \"config\": \"%s\", "
+	       "\"ring_fd_registered\": %s, \"skipped\": %d}",
+	       first_record ? "" : ",", workload, cfg->name,
+	       reg_ringfd ? "true" : "false", err);
+	first_record = 0;
+}
+
+static int reap_all(struct io_uring *ring, unsigned nr)
+{
+	struct io_uring_cqe *cqes[QD];
+	unsigned got;
+
+	while (nr) {
+		int ret = io_uring_submit_and_wait(ring, nr);
+
+		if (ret < 0)
+			return ret;
+		got = io_uring_peek_batch_cqe(ring, cqes, QD);
+		for (unsigned i = 0; i < got; i++) {
+			if (cqes[i]->res < 0)
+				return cqes[i]->res;
+		}
+		io_uring_cq_advance(ring, got);
+		nr -= got;
+	}
+	return 0;
+}
+
+static int bench_nop(struct io_uring *ring, unsigned long long *ops,
+		     double *secs)
+{
+	double t0 = now_sec(), t;
+	unsigned long long done = 0;
+	int ret;
+
+	do {
+		for (int i = 0; i < QD; i++)
+			io_uring_prep_nop(io_uring_get_sqe(ring));
+		ret = io_uring_submit(ring);
+		if (ret != QD)
+			return ret < 0 ? ret : -EINVAL;
+		ret = reap_all(ring, QD);
+		if (ret)
+			return ret;
+		done += QD;
+		t = now_sec();
+	} while (t - t0 < cell_secs);
+	*ops = done;
+	*secs = t - t0;
+	return 0;
+}
+
+static int bench_randread(struct io_uring *ring, int fixed,
+			  unsigned long long *ops, double *secs)
+{
+	double t0, t;
+	unsigned long long done = 0;
+	unsigned seed = 0x75726e67;
+	int ret;
+
+	if (fixed) {
+		struct iovec iov = {
+			.iov_base	= read_bufs,
+			.iov_len	= (size_t) QD * BLOCK,
+		};
+
+		ret = io_uring_register_buffers(ring, &iov, 1);
+		if (ret)
+			return ret;
+	}
+
+	t0 = now_sec();
+	do {
+		for (int i = 0; i < QD; i++) {
+			struct io_uring_sqe *sqe = io_uring_get_sqe(ring);
+			__u64 off = (__u64) (rand_r(&seed) %
+					     FILE_BLOCKS) * BLOCK;
+
+			if (fixed)
+				io_uring_prep_read_fixed(sqe, data_fd,
+						read_bufs + i * BLOCK,
+						BLOCK, off, 0);
+			else
+				io_uring_prep_read(sqe, data_fd,
+						read_bufs + i * BLOCK,
+						BLOCK, off);
+		}
+		ret = io_uring_submit(ring);
+		if (ret != QD)
+			return ret < 0 ? ret : -EINVAL;
+		ret = reap_all(ring, QD);
+		if (ret)
+			return ret;
+		done += QD;
+		t = now_sec();
+	} while (t - t0 < cell_secs);
+
+	if (fixed)
+		io_uring_unregister_buffers(ring);
+	*ops = done;
+	*secs = t - t0;
+	return 0;
+}
+
+/*
+ * Single-threaded ping-pong over a socketpair, both ends on the same
+ * ring: each loop pushes one message each way, so 'ops' counts messages.
+ */
+static int bench_echo(struct io_uring *ring, unsigned long long *ops,
+		      double *secs)
+{
+	static char ping[MSG_LEN], pong[MSG_LEN];
+	double t0, t = 0.0;
+	unsigned long long done = 0;
+	int sv[2], ret = 0;
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv))
+		return -errno;
+
+	t0 = now_sec();
+	do {
+		struct io_uring_sqe *sqe;
+
+		sqe = io_uring_get_sqe(ring);
+		io_uring_prep_send(sqe, sv[0], ping, MSG_LEN, 0);
+		sqe->flags |= IOSQE_IO_LINK;
+		sqe = io_uring_get_sqe(ring);
+		io_uring_prep_recv(sqe, sv[1], pong, MSG_LEN, MSG_WAITALL);
+		ret = io_uring_submit(ring);
+		if (ret != 2) {
+			ret = ret < 0 ? ret : -EINVAL;
+			break;
+		}
+		ret = reap_all(ring, 2);
+		if (ret)
+			break;
+
+		sqe = io_uring_get_sqe(ring);
+		io_uring_prep_send(sqe, sv[1], pong, MSG_LEN, 0);
+		sqe->flags |= IOSQE_IO_LINK;
+		sqe = io_uring_get_sqe(ring);
+		io_uring_prep_recv(sqe, sv[0], ping, MSG_LEN, MSG_WAITALL);
+		ret = io_uring_submit(ring);
+		if (ret != 2) {
+			ret = ret < 0 ? ret : -EINVAL;
+			break;
+		}
+		ret = reap_all(ring, 2);
+		if (ret)
+			break;
+		done += 2;
+		t = now_sec();
+	} while (t - t0 < cell_secs);
+
+	close(sv[0]);
+	close(sv[1]);
+	*ops = done;
+	*secs = (t ? t : now_sec()) - t0;
+	return ret;
+}
+
+static void run_cell(const char *workload, const struct ring_cfg *cfg,
+		     int reg_ringfd)
+{
+	struct io_uring ring;
+	unsigned long long ops = 0;
+	double secs = 0.0;
+	int ret;
+
+	ret = io_uring_queue_init(QD * 2, &ring, cfg->flags);
+	if (ret) {
+		emit_skip(workload, cfg, reg_ringfd, ret);
+		return;
+	}
+	if (reg_ringfd) {
+		ret = io_uring_register_ring_fd(&ring);
+		if (ret < 0) {
+			io_uring_queue_exit(&ring);
+			emit_skip(workload, cfg, reg_ringfd, ret);
+			return;
+		}
+	}
+
+	if (!strcmp(workload, "nop"))
+		ret = bench_nop(&ring, &ops, &secs);
+	else if (!strcmp(workload, "randread"))
+		ret = bench_randread(&ring, 0, &ops, &secs);
+	else if (!strcmp(workload, "randread_fixed"))
+		ret = bench_randread(&ring, 1, &ops, &secs);
+	else
+		ret = bench_echo(&ring, &ops, &secs);
+
+	io_uring_queue_exit(&ring);
+	if (ret)
+		emit_skip(workload, cfg, reg_ringfd, ret);
+	else
+		emit(workload, cfg, reg_ringfd, ops, secs);
+}
+
+static int setup_data_file(void)
+{
+	char tmpl[] = "/tmp/bench-matrix.XXXXXX";
+	char block[BLOCK];
+	int fd, i;
+
+	fd = mkstemp(tmpl);
+	if (fd < 0)
+		return -errno;
+	unlink(tmpl);
+	memset(block, 0x5a, sizeof(block));
+	for (i = 0; i < FILE_BLOCKS; i++) {
+		if (write(fd, block, sizeof(block)) != sizeof(block)) {
+			close(fd);
+			return -errno;
+		}
+	}
+	return fd;
+}
+
+int main(int argc, char *argv[])
+{
+	static const char * const workloads[] = {
+		"nop", "randread", "randread_fixed", "echo",
+	};
+	cpu_set_t mask;
+
+	if (argc > 1)
+		cell_secs = atof(argv[1]);
+	if (cell_secs <= 0.0)
+		return 1;
+
+	/* pinned-CPU methodology: everything on CPU 0 */
+	CPU_ZERO(&mask);
+	CPU_SET(0, &mask);
+	if (sched_setaffinity(0, sizeof(mask), &mask))
+		perror("sched_setaffinity");
+
+	data_fd = setup_data_file();
+	if (data_fd < 0) {
+		fprintf(stderr, "data file: %d\n", data_fd);
+		return 1;
+	}
+	if (posix_memalign((void **) &read_bufs, BLOCK, (size_t) QD * BLOCK))
+		return 1;
+
+	printf("[");
+	for (unsigned w = 0; w < sizeof(workloads) / sizeof(workloads[0]); w++) {
+		for (unsigned c = 0; c < sizeof(cfgs) / sizeof(cfgs[0]); c++) {
+			run_cell(workloads[w], &cfgs[c], 0);
+			run_cell(workloads[w], &cfgs[c], 1);
+		}
+	}
+	printf("\n]\n");
+
+	free(read_bufs);
+	close(data_fd);
+	return 0;
+}
@@ -0,0 +1,324 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * Buffer-strategy comparison: ring-mapped provided buffers
+ * (io_uring_setup_buf_ring) vs legacy IORING_OP_PROVIDE_BUFFERS vs a
+ * plain per-request buffer, measured as receive throughput against a
+ * saturating writer. test/buf-ring.c proves the mechanisms work; this
+ * answers which one to use and what the legacy path costs.
+ *
+ * For every (transport, strategy, message size, group depth) cell a
+ * forked writer blasts fixed-size messages into one end of a
+ * socketpair - or a loopback TCP connection with -t - while the parent
+ * keeps 'depth' recvs in flight and recycles buffers the way the
+ * strategy under test prescribes. Reported per cell: messages/s and
+ * receiver-side cycles per message (TSC). One JSON record per cell.
+ *
+ * Usage: buf-ring-bench [-t] [seconds-per-cell]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+#include "liburing.h"
+
+#define MAX_DEPTH	64
+#define BGID		7
+
+enum strategy {
+	STRAT_PLAIN,
+	STRAT_BUF_RING,
+	STRAT_PROVIDE,
+};
+
+static const char * const strat_names[] = {
+	"plain", "buf_ring", "provide_buffers",
+};
+
+static const unsigned msg_sizes[] = { 64, 1024, 4096 };
+static const unsigned depths[] = { 8, 64 };
+
+static double cell_secs = 0.3;
+static int use_tcp;
+static int first_record = 1;
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static unsigned long long cycles_now(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	unsigned lo, hi;
+
+	__asm__ __volatile__("rdtsc" : "=a" (lo), "=d" (hi));
+	return ((unsigned long long) hi << 32) | lo;
+#elif defined(__aarch64__)
+	unsigned long long cnt;
+
+	__asm__ __volatile__("mrs %0, cntvct_el0" : "=r" (cnt));
+	return cnt;
+#else
+	return 0;
+#endif
+}
+
+/* a connected (read-end, write-end) pair: socketpair or loopback TCP */
+static int make_conn(int *rfd, int *wfd)
+{
+	if (!use_tcp) {
+		int sv[2];
+
+		if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv))
+			return -errno;
+		*rfd = sv[0];
+		*wfd = sv[1];
+		return 0;
+	} else {
+		struct sockaddr_in addr = { };
+		socklen_t alen = sizeof(addr);
+		int lfd, cfd, afd;
+
+		lfd = socket(AF_INET, SOCK_STREAM, 0);
+		if (lfd < 0)
+			return -errno;
+		addr.sin_family = AF_INET;
+		addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		if (bind(lfd, (struct sockaddr *) &addr, sizeof(addr)) ||
+		    listen(lfd, 1) ||
+		    getsockname(lfd, (struct sockaddr *) &addr, &alen))
+			goto err;
+		cfd = socket(AF_INET, SOCK_STREAM, 0);
+		if (cfd < 0)
+			goto err;
+		if (connect(cfd, (struct sockaddr *) &addr, sizeof(addr))) {
+			close(cfd);
+			goto err;
+		}
+		afd = accept(lfd, NULL, NULL);
+		close(lfd);
+		if (afd < 0) {
+			close(cfd);
+			return -errno;
+		}
+		*rfd = afd;
+		*wfd = cfd;
+		return 0;
+err:
+		close(lfd);
+		return -errno;
+	}
+}
+
+static pid_t start_writer(int wfd, unsigned msg_size)
+{
+	pid_t pid = fork();
+
+	if (!pid) {
+		char *msg = malloc(msg_size);
+
+		signal(SIGPIPE, SIG_DFL);
+		memset(msg, 0x42, msg_size);
+		for (;;) {
+			if (write(wfd, msg, msg_size) < 0)
+				_exit(0);
+		}
+	}
+	close(wfd);
+	return pid;
+}
+
+static void post_recv(struct io_uring *ring, int fd, enum strategy strat,
+		      char *bufs, unsigned msg_size, unsigned slot)
+{
+	struct io_uring_sqe *sqe = io_uring_get_sqe(ring);
+
+	if (strat == STRAT_PLAIN) {
+		io_uring_prep_recv(sqe, fd, bufs + (size_t) slot * msg_size,
+				   msg_size, 0);
+	} else {
+		io_uring_prep_recv(sqe, fd, NULL, msg_size, 0);
+		sqe->flags |= IOSQE_BUFFER_SELECT;
+		sqe->buf_group = BGID;
+	}
+	sqe->user_data = slot;
+}
+
+static int run_cell(enum strategy strat, unsigned msg_size, unsigned depth)
+{
+	struct io_uring_buf_ring *br = NULL;
+	struct io_uring_cqe *cqes[MAX_DEPTH];
+	struct io_uring ring;
+	char *bufs;
+	unsigned long long t0, t, c0, bytes = 0;
+	unsigned i, got;
+	int rfd = -1, wfd = -1, ret = 0;
+	pid_t writer;
+	double secs;
+
+	if (make_conn(&rfd, &wfd) < 0)
+		return -errno;
+	ret = io_uring_queue_init(MAX_DEPTH * 2, &ring, 0);
+	if (ret) {
+		close(rfd);
+		close(wfd);
+		return ret;
+	}
+	bufs = malloc((size_t) depth * msg_size);
+	if (!bufs) {
+		ret = -ENOMEM;
+		goto out_ring;
+	}
+
+	if (strat == STRAT_BUF_RING) {
+		br = io_uring_setup_buf_ring(&ring, depth, BGID, 0, &ret);
+		if (!br)
+			goto out_bufs;
+		for (i = 0; i < depth; i++)
+			io_uring_buf_ring_add(br, bufs + (size_t) i * msg_size,
+					      msg_size, i,
+					      io_uring_buf_ring_mask(depth), i);
+		io_uring_buf_ring_advance(br, depth);
+	} else if (strat == STRAT_PROVIDE) {
+		struct io_uring_sqe *sqe = io_uring_get_sqe(&ring);
+		struct io_uring_cqe *cqe;
+
+		io_uring_prep_provide_buffers(sqe, bufs, msg_size, depth,
+					      BGID, 0);
+		ret = io_uring_submit_and_wait(&ring, 1);
+		if (ret < 0)
+			goto out_bufs;
+		ret = io_uring_peek_cqe(&ring, &cqe);
+		if (ret || cqe->res < 0) {
+			ret = ret ? ret : cqe->res;
+			goto out_bufs;
+		}
+		io_uring_cqe_seen(&ring, cqe);
+		ret = 0;
+	}
+
+	writer = start_writer(wfd, msg_size);
+
+	for (i = 0; i < depth; i++)
+		post_recv(&ring, rfd, strat, bufs, msg_size, i);
+
+	t0 = now_ns();
+	c0 = cycles_now();
+	t = t0;
+	while (t - t0 < (unsigned long long) (cell_secs * 1e9)) {
+		ret = io_uring_submit_and_wait(&ring, 1);
+		if (ret < 0)
+			break;
+		got = io_uring_peek_batch_cqe(&ring, cqes, MAX_DEPTH);
+		for (i = 0; i < got; i++) {
+			int res = cqes[i]->res;
+
+			if (res == -ENOBUFS) {
+				/* all buffers in flight; re-arm and retry */
+				post_recv(&ring, rfd, strat, bufs, msg_size,
+					  (unsigned) cqes[i]->user_data);
+				continue;
+			}
+			if (res <= 0) {
+				ret = res ? res : -ECONNRESET;
+				break;
+			}
+			bytes += (unsigned) res;
+			if (strat == STRAT_BUF_RING) {
+				unsigned bid = cqes[i]->flags >>
+					       IORING_CQE_BUFFER_SHIFT;
+
+				io_uring_buf_ring_add(br,
+					bufs + (size_t) bid * msg_size,
+					msg_size, bid,
+					io_uring_buf_ring_mask(depth), 0);
+				io_uring_buf_ring_advance(br, 1);
+			} else if (strat == STRAT_PROVIDE) {
+				unsigned bid = cqes[i]->flags >>
+					       IORING_CQE_BUFFER_SHIFT;
+				struct io_uring_sqe *sqe =
+					io_uring_get_sqe(&ring);
+
+				io_uring_prep_provide_buffers(sqe,
+					bufs + (size_t) bid * msg_size,
+					msg_size, 1, BGID, bid);
+				sqe->flags |= IOSQE_CQE_SKIP_SUCCESS;
+			}
+			post_recv(&ring, rfd, strat, bufs, msg_size,
+				  (unsigned) cqes[i]->user_data);
+		}
+		io_uring_cq_advance(&ring, got);
+		if (ret < 0)
+			break;
+		t = now_ns();
+	}
+	secs = (t - t0) / 1e9;
+
+	kill(writer, SIGKILL);
+	waitpid(writer, NULL, 0);
+
+	if (ret >= 0 && bytes) {
+		unsigned long long msgs = bytes / msg_size;
+
+		printf("%s\n  {\"transport\": \"%s\", \"strategy\": \"%s\", "
+		       "\"msg_size\": %u, \"depth\": %u, \"msgs_per_sec\": %.0f, "
+		       "\"cycles_per_msg\": %llu}",
+		       first_record ? "" : ",", use_tcp ? "tcp" : "socketpair",
+		       strat_names[strat], msg_size, depth, msgs / secs,
+		       msgs ? (cycles_now() - c0) / msgs : 0);
+		ret = 0;
+	} else {
+		printf("%s\n  {\"transport\": \"%s\", \"strategy\": \"%s\", "
+		       "\"msg_size\": %u, \"depth\": %u, \"skipped\": %d}",
+		       first_record ? "" : ",", use_tcp ? "tcp" : "socketpair",
+		       strat_names[strat], msg_size, depth, ret);
+	}
+	first_record = 0;
+
+	if (br)
+		io_uring_free_buf_ring(&ring, br, depth, BGID);
+out_bufs:
+	free(bufs);
+out_ring:
+	io_uring_queue_exit(&ring);
+	close(rfd);
+	return ret;
+}
+
+int main(int argc, char *argv[])
+{
+	int c;
+
+	while ((c = getopt(argc, argv, "t")) != -1) {
+		if (c == 't')
+			use_tcp = 1;
+		else
+			return 1;
+	}
+	if (optind < argc)
+		cell_secs = atof(argv[optind]);
+	if (cell_secs <= 0.0)
+		return 1;
+
+	signal(SIGPIPE, SIG_IGN);
+	printf("[");
+	for (unsigned s = 0; s < sizeof(msg_sizes) / sizeof(msg_sizes[0]); s++) {
+		/* plain buffers don't have a group depth; run at max once */
+		run_cell(STRAT_PLAIN, msg_sizes[s], MAX_DEPTH);
+		for (unsigned d = 0; d < sizeof(depths) / sizeof(depths[0]); d++) {
+			run_cell(STRAT_BUF_RING, msg_sizes[s], depths[d]);
+			run_cell(STRAT_PROVIDE, msg_sizes[s], depths[d]);
+		}
+	}
+	printf("\n]\n");
+	return 0;
+}
@@ -0,0 +1,214 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * Registered-resource matrix: multi-file 4k random reads across the
+ * 2x2 combination of registered files (IOSQE_FIXED_FILE) and
+ * registered buffers (read_fixed), at several queue depths. The two
+ * registrations remove independent per-I/O costs - fget/fput on the
+ * file side, pin/unpin on the buffer side - so their gains stack, but
+ * tools usually demonstrate one at a time. This shows the whole
+ * matrix so the combined cell argues for itself.
+ *
+ * N files are created, registered once, and read at random offsets;
+ * each cell reports IOPS and cycles per op as one JSON record.
+ *
+ * Usage: fixed-bench [seconds-per-cell]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <time.h>
+
+#include "liburing.h"
+
+#define NR_FILES	4
+#define BLOCK		4096
+#define FILE_BLOCKS	4096		/* 16M per file */
+#define MAX_QD		128
+
+static const unsigned depths[] = { 8, 32, 128 };
+
+static double cell_secs = 0.5;
+static int fds[NR_FILES];
+static char *bufs;
+static int first_record = 1;
+
+static double now_sec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static unsigned long long cycles_now(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	unsigned lo, hi;
+
+	__asm__ __volatile__("rdtsc" : "=a" (lo), "=d" (hi));
+	return ((unsigned long long) hi << 32) | lo;
+#elif defined(__aarch64__)
+	unsigned long long cnt;
+
+	__asm__ __volatile__("mrs %0, cntvct_el0" : "=r" (cnt));
+	return cnt;
+#else
+	return 0;
+#endif
+}
+
+static int setup_file(void)
+{
+	char tmpl[] = "/tmp/fixed-bench.XXXXXX";
+	char block[BLOCK];
+	int fd, i;
+
+	fd = mkstemp(tmpl);
+	if (fd < 0)
+		return -errno;
+	unlink(tmpl);
+	memset(block, 0x5a, sizeof(block));
+	for (i = 0; i < FILE_BLOCKS; i++) {
+		if (write(fd, block, sizeof(block)) != sizeof(block)) {
+			close(fd);
+			return -errno;
+		}
+	}
+	return fd;
+}
+
+static int run_cell(unsigned qd, int fixed_file, int fixed_buf)
+{
+	struct io_uring_cqe *cqes[MAX_QD];
+	struct io_uring ring;
+	unsigned long long done = 0, c0;
+	unsigned seed = 0x75726e67;
+	double t0, t;
+	int ret = 0;
+
+	ret = io_uring_queue_init(qd, &ring, 0);
+	if (ret)
+		goto skip;
+	ret = io_uring_register_files(&ring, fds, NR_FILES);
+	if (ret)
+		goto out_ring;
+	if (fixed_buf) {
+		struct iovec iov = {
+			.iov_base	= bufs,
+			.iov_len	= (size_t) qd * BLOCK,
+		};
+
+		ret = io_uring_register_buffers(&ring, &iov, 1);
+		if (ret)
+			goto out_ring;
+	}
+
+	t0 = now_sec();
+	c0 = cycles_now();
+	do {
+		unsigned i, got;
+
+		for (i = 0; i < qd; i++) {
+			struct io_uring_sqe *sqe = io_uring_get_sqe(&ring);
+			unsigned f = rand_r(&seed) % NR_FILES;
+			__u64 off = (__u64) (rand_r(&seed) %
+					     FILE_BLOCKS) * BLOCK;
+			int fd = fixed_file ? (int) f : fds[f];
+
+			if (fixed_buf)
+				io_uring_prep_read_fixed(sqe, fd,
+						bufs + (size_t) i * BLOCK,
+						BLOCK, off, 0);
+			else
+				io_uring_prep_read(sqe, fd,
+						bufs + (size_t) i * BLOCK,
+						BLOCK, off);
+			if (fixed_file)
+				sqe->flags |= IOSQE_FIXED_FILE;
+		}
+		ret = io_uring_submit_and_wait(&ring, qd);
+		if (ret < 0)
+			break;
+		got = io_uring_peek_batch_cqe(&ring, cqes, qd);
+		for (i = 0; i < got; i++) {
+			if (cqes[i]->res != BLOCK) {
+				ret = cqes[i]->res < 0 ? cqes[i]->res : -EIO;
+				break;
+			}
+		}
+		io_uring_cq_advance(&ring, got);
+		if (ret < 0)
+			break;
+		done += got;
+		t = now_sec();
+	} while (t - t0 < cell_secs);
+
+	if (ret >= 0) {
+		double secs = t - t0;
+
+		printf("%s\n  {\"qd\": %u, \"fixed_file\": %s, "
+		       "\"fixed_buf\": %s, \"iops\": %.0f, "
+		       "\"cycles_per_op\": %llu}",
+		       first_record ? "" : ",", qd,
+		       fixed_file ? "true" : "false",
+		       fixed_buf ? "true" : "false", done / secs,
+		       done ? (cycles_now() - c0) / done : 0);
+		first_record = 0;
+		ret = 0;
+	}
+out_ring:
+	io_uring_queue_exit(&ring);
+	if (ret >= 0)
+		return 0;
+skip:
+	printf("%s\n  {\"qd\": %u, \"fixed_file\": %s, \"fixed_buf\": %s, "
+	       "\"skipped\": %d}",
+	       first_record ? "" : ",", qd, fixed_file ? "true" : "false",
+	       fixed_buf ? "true" : "false", ret);
+	first_record = 0;
+	return ret;
+}
+
+int main(int argc, char *argv[])
+{
+	cpu_set_t mask;
+	unsigned d;
+	int i;
+
+	if (argc > 1)
+		cell_secs = atof(argv[1]);
+	if (cell_secs <= 0.0)
+		return 1;
+
+	CPU_ZERO(&mask);
+	CPU_SET(0, &mask);
+	if (sched_setaffinity(0, sizeof(mask), &mask))
+		perror("sched_setaffinity");
+
+	for (i = 0; i < NR_FILES; i++) {
+		fds[i] = setup_file();
+		if (fds[i] < 0) {
+			fprintf(stderr, "data file: %d\n", fds[i]);
+			return 1;
+		}
+	}
+	if (posix_memalign((void **) &bufs, BLOCK, (size_t) MAX_QD * BLOCK))
+		return 1;
+
+	printf("[");
+	for (d = 0; d < sizeof(depths) / sizeof(depths[0]); d++) {
+		run_cell(depths[d], 0, 0);
+		run_cell(depths[d], 1, 0);
+		run_cell(depths[d], 0, 1);
+		run_cell(depths[d], 1, 1);
+	}
+	printf("\n]\n");
+
+	free(bufs);
+	for (i = 0; i < NR_FILES; i++)
+		close(fds[i]);
+	return 0;
+}
@@ -0,0 +1,351 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * msg_ring cost benchmark: what does delivering work to another ring
+ * actually cost, and how does it compare to waking a worker the
+ * conventional ways? For each CPU placement (same core, and the
+ * nearest/farthest other CPUs when the box has them) this ping-pongs
+ * between two pinned threads using three mechanisms:
+ *
+ *   msg_ring - io_uring_prep_msg_ring() into the peer's ring
+ *   eventfd  - blocking read/write on a pair of eventfds
+ *   futex    - FUTEX_WAIT/WAKE on a pair of shared words
+ *
+ * and reports one-way ns and cycles per delivery. msg_ring also gets
+ * a blast phase - sender streams batched messages, receiver just
+ * drains - for a messages/s throughput figure. One JSON record per
+ * (placement, mechanism) cell.
+ *
+ * Usage: msg-ring-bench [pingpong-iters]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <sys/eventfd.h>
+
+#include "liburing.h"
+
+#define BLAST_MSGS	200000
+#define BLAST_BATCH	32
+
+#define DATA_PING	0x70696e67ULL
+#define DATA_PONG	0x706f6e67ULL
+#define DATA_DONE	0x646f6e65ULL
+
+static unsigned long iters = 50000;
+static int first_record = 1;
+
+enum method {
+	METHOD_MSG_RING,
+	METHOD_EVENTFD,
+	METHOD_FUTEX,
+};
+
+static const char * const method_names[] = {
+	"msg_ring", "eventfd", "futex",
+};
+
+/* shared between sender (main) and responder thread */
+static struct io_uring ring_a, ring_b;
+static int efd_ab = -1, efd_ba = -1;
+static unsigned futex_ab, futex_ba;
+static pthread_barrier_t barrier;
+static int responder_cpu;
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static unsigned long long cycles_now(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	unsigned lo, hi;
+
+	__asm__ __volatile__("rdtsc" : "=a" (lo), "=d" (hi));
+	return ((unsigned long long) hi << 32) | lo;
+#elif defined(__aarch64__)
+	unsigned long long cnt;
+
+	__asm__ __volatile__("mrs %0, cntvct_el0" : "=r" (cnt));
+	return cnt;
+#else
+	return 0;
+#endif
+}
+
+static void pin_to(int cpu)
+{
+	cpu_set_t mask;
+
+	CPU_ZERO(&mask);
+	CPU_SET(cpu, &mask);
+	if (sched_setaffinity(0, sizeof(mask), &mask))
+		perror("sched_setaffinity");
+}
+
+static int futex_wait(unsigned *addr, unsigned val)
+{
+	return (int) syscall(SYS_futex, addr,
+			     FUTEX_WAIT | FUTEX_PRIVATE_FLAG, val, NULL,
+			     NULL, 0);
+}
+
+static int futex_wake(unsigned *addr)
+{
+	return (int) syscall(SYS_futex, addr,
+			     FUTEX_WAKE | FUTEX_PRIVATE_FLAG, 1, NULL,
+			     NULL, 0);
+}
+
+static int send_msg(struct io_uring *src, struct io_uring *dst, __u64 data)
+{
+	struct io_uring_sqe *sqe = io_uring_get_sqe(src);
+	int ret;
+
+	if (!sqe)
+		return -EAGAIN;
+	io_uring_prep_msg_ring(sqe, dst->ring_fd, 0, data, 0);
+	/* only the peer's CQE matters; suppress the local one */
+	sqe->flags |= IOSQE_CQE_SKIP_SUCCESS;
+	ret = io_uring_submit(src);
+	return ret < 0 ? ret : 0;
+}
+
+static void *responder_msg_ring(void *arg)
+{
+	struct io_uring_cqe *cqe;
+	unsigned long long seen = 0;
+
+	pin_to(responder_cpu);
+	pthread_barrier_wait(&barrier);
+
+	for (;;) {
+		if (io_uring_wait_cqe(&ring_b, &cqe))
+			break;
+		if (cqe->user_data == DATA_DONE) {
+			io_uring_cqe_seen(&ring_b, cqe);
+			break;
+		}
+		if (cqe->user_data == DATA_PING) {
+			io_uring_cqe_seen(&ring_b, cqe);
+			if (send_msg(&ring_b, &ring_a, DATA_PONG))
+				break;
+			continue;
+		}
+		/* blast phase: just drain and ack the last one */
+		io_uring_cqe_seen(&ring_b, cqe);
+		if (++seen == BLAST_MSGS)
+			send_msg(&ring_b, &ring_a, DATA_PONG);
+	}
+	return NULL;
+}
+
+static void *responder_eventfd(void *arg)
+{
+	eventfd_t v;
+	unsigned long i;
+
+	pin_to(responder_cpu);
+	pthread_barrier_wait(&barrier);
+	for (i = 0; i < iters; i++) {
+		if (eventfd_read(efd_ab, &v))
+			break;
+		eventfd_write(efd_ba, 1);
+	}
+	return NULL;
+}
+
+static void *responder_futex(void *arg)
+{
+	unsigned i;
+
+	pin_to(responder_cpu);
+	pthread_barrier_wait(&barrier);
+	for (i = 1; i <= iters; i++) {
+		while (__atomic_load_n(&futex_ab, __ATOMIC_ACQUIRE) != i)
+			futex_wait(&futex_ab, i - 1);
+		__atomic_store_n(&futex_ba, i, __ATOMIC_RELEASE);
+		futex_wake(&futex_ba);
+	}
+	return NULL;
+}
+
+static int run_cell(const char *placement, int cpu_a, int cpu_b,
+		    enum method method)
+{
+	static void *(* const responders[])(void *) = {
+		responder_msg_ring, responder_eventfd, responder_futex,
+	};
+	unsigned long long t0, c0, lat_ns, lat_cycles, blast_nsec = 0;
+	pthread_t thread;
+	unsigned long i;
+	int ret = 0;
+
+	pin_to(cpu_a);
+	responder_cpu = cpu_b;
+
+	if (method == METHOD_MSG_RING) {
+		struct io_uring_params p = { };
+
+		ret = io_uring_queue_init(BLAST_BATCH * 2, &ring_a, 0);
+		if (ret)
+			goto skip;
+		p.flags = IORING_SETUP_CQSIZE;
+		p.cq_entries = 4096;
+		ret = io_uring_queue_init_params(BLAST_BATCH * 2, &ring_b, &p);
+		if (ret) {
+			io_uring_queue_exit(&ring_a);
+			goto skip;
+		}
+	} else if (method == METHOD_EVENTFD) {
+		efd_ab = eventfd(0, 0);
+		efd_ba = eventfd(0, 0);
+		if (efd_ab < 0 || efd_ba < 0) {
+			ret = -errno;
+			goto skip;
+		}
+	} else {
+		futex_ab = futex_ba = 0;
+	}
+
+	pthread_barrier_init(&barrier, NULL, 2);
+	pthread_create(&thread, NULL, responders[method], NULL);
+	pthread_barrier_wait(&barrier);
+
+	t0 = now_ns();
+	c0 = cycles_now();
+	if (method == METHOD_MSG_RING) {
+		struct io_uring_cqe *cqe;
+
+		for (i = 0; i < iters; i++) {
+			ret = send_msg(&ring_a, &ring_b, DATA_PING);
+			if (ret)
+				break;
+			ret = io_uring_wait_cqe(&ring_a, &cqe);
+			if (ret)
+				break;
+			io_uring_cqe_seen(&ring_a, cqe);
+		}
+	} else if (method == METHOD_EVENTFD) {
+		eventfd_t v;
+
+		for (i = 0; i < iters; i++) {
+			eventfd_write(efd_ab, 1);
+			if (eventfd_read(efd_ba, &v))
+				break;
+		}
+	} else {
+		for (i = 1; i <= iters; i++) {
+			__atomic_store_n(&futex_ab, (unsigned) i,
+					 __ATOMIC_RELEASE);
+			futex_wake(&futex_ab);
+			while (__atomic_load_n(&futex_ba,
+					       __ATOMIC_ACQUIRE) != i)
+				futex_wait(&futex_ba, i - 1);
+		}
+	}
+	lat_ns = (now_ns() - t0) / (2 * iters);
+	lat_cycles = (cycles_now() - c0) / (2 * iters);
+
+	if (method == METHOD_MSG_RING && !ret) {
+		struct io_uring_cqe *cqe;
+		unsigned long long sent = 0;
+
+		/* blast phase: stream batches, wait for the drain ack */
+		t0 = now_ns();
+		while (sent < BLAST_MSGS) {
+			unsigned batch = 0;
+
+			while (batch < BLAST_BATCH && sent + batch < BLAST_MSGS) {
+				struct io_uring_sqe *sqe =
+					io_uring_get_sqe(&ring_a);
+
+				io_uring_prep_msg_ring(sqe, ring_b.ring_fd, 0,
+						       sent + batch, 0);
+				sqe->flags |= IOSQE_CQE_SKIP_SUCCESS;
+				batch++;
+			}
+			ret = io_uring_submit(&ring_a);
+			if (ret < 0)
+				break;
+			sent += batch;
+		}
+		if (ret >= 0) {
+			ret = io_uring_wait_cqe(&ring_a, &cqe);
+			if (!ret)
+				io_uring_cqe_seen(&ring_a, cqe);
+			blast_nsec = now_ns() - t0;
+		}
+		send_msg(&ring_a, &ring_b, DATA_DONE);
+	}
+
+	pthread_join(thread, NULL);
+	pthread_barrier_destroy(&barrier);
+
+	if (method == METHOD_MSG_RING) {
+		io_uring_queue_exit(&ring_a);
+		io_uring_queue_exit(&ring_b);
+	} else if (method == METHOD_EVENTFD) {
+		close(efd_ab);
+		close(efd_ba);
+		efd_ab = efd_ba = -1;
+	}
+	if (ret < 0)
+		goto skip;
+
+	printf("%s\n  {\"placement\": \"%s\", \"cpus\": [%d, %d], "
+	       "\"method\": \"%s\", \"oneway_ns\": %llu, "
+	       "\"oneway_cycles\": %llu",
+	       first_record ? "" : ",", placement, cpu_a, cpu_b,
+	       method_names[method], lat_ns, lat_cycles);
+	if (blast_nsec)
+		printf(", \"msgs_per_sec\": %.0f",
+		       BLAST_MSGS / (blast_nsec / 1e9));
+	printf("}");
+	first_record = 0;
+	return 0;
+skip:
+	printf("%s\n  {\"placement\": \"%s\", \"cpus\": [%d, %d], "
+	       "\"method\": \"%s\", \"skipped\": %d}",
+	       first_record ? "" : ",", placement, cpu_a, cpu_b,
+	       method_names[method], ret);
+	first_record = 0;
+	return ret;
+}
+
+int main(int argc, char *argv[])
+{
+	long nr_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	enum method m;
+
+	if (argc > 1)
+		iters = strtoul(argv[1], NULL, 0);
+	if (!iters)
+		return 1;
+
+	printf("[");
+	/* same core: sender and responder time-share CPU 0 */
+	for (m = METHOD_MSG_RING; m <= METHOD_FUTEX; m++)
+		run_cell("same_core", 0, 0, m);
+	/* nearest other CPU: usually the SMT sibling or same LLC */
+	if (nr_cpus > 1) {
+		for (m = METHOD_MSG_RING; m <= METHOD_FUTEX; m++)
+			run_cell("near_cpu", 0, 1, m);
+	}
+	/* farthest CPU id: on multi-socket boxes this crosses sockets */
+	if (nr_cpus > 2) {
+		for (m = METHOD_MSG_RING; m <= METHOD_FUTEX; m++)
+			run_cell("far_cpu", 0, (int) nr_cpus - 1, m);
+	}
+	printf("\n]\n");
+	return 0;
+}
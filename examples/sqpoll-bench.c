@@ -0,0 +1,185 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * SQPOLL efficiency sweep: quantifies what sq_thread_idle actually
+ * costs. A long idle keeps the poller thread burning a core between
+ * bursts; a short idle puts it to sleep so submissions hit the
+ * NEED_WAKEUP path in sq_ring_needs_enter() and pay an enter syscall
+ * plus wakeup latency. Neither cost is visible without measuring both
+ * sides at once.
+ *
+ * For each (sq_thread_idle, offered load) cell this runs rate-paced
+ * NOPs for a fixed window and reports achieved IOPS, how many submits
+ * found NEED_WAKEUP set (each of those is an enter syscall), and the
+ * SQPOLL thread's CPU consumption read from /proc/self/task - the
+ * poller shows up as an iou-sqp-* thread of this process. One JSON
+ * record per cell; the efficiency frontier falls out of plotting
+ * cpu_pct against wakeups_per_sec across the idle sweep.
+ *
+ * Usage: sqpoll-bench [seconds-per-cell]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <time.h>
+
+#include "liburing.h"
+
+#define QD	128
+
+static double cell_secs = 2.0;
+static int first_record = 1;
+
+static const unsigned idle_ms[] = { 1, 10, 100, 1000 };
+static const unsigned long long loads[] = { 10000, 100000, 1000000 };
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ * Total CPU ticks (utime+stime) of this process's iou-sqp-* thread, or
+ * -1 if it can't be found.
+ */
+static long long sqpoll_cpu_ticks(void)
+{
+	char path[300], line[512], comm[64];
+	struct dirent *de;
+	DIR *dir;
+	FILE *f;
+	long long ret = -1;
+
+	dir = opendir("/proc/self/task");
+	if (!dir)
+		return -1;
+	while ((de = readdir(dir)) != NULL) {
+		unsigned long long ut, st;
+		char *paren;
+
+		if (de->d_name[0] == '.')
+			continue;
+		snprintf(path, sizeof(path), "/proc/self/task/%s/comm",
+			 de->d_name);
+		f = fopen(path, "r");
+		if (!f)
+			continue;
+		comm[0] = '\0';
+		if (!fgets(comm, sizeof(comm), f)) {
+			fclose(f);
+			continue;
+		}
+		fclose(f);
+		if (strncmp(comm, "iou-sqp", 7))
+			continue;
+
+		snprintf(path, sizeof(path), "/proc/self/task/%s/stat",
+			 de->d_name);
+		f = fopen(path, "r");
+		if (!f)
+			continue;
+		/* fields 14/15 (utime/stime), after the (comm) field */
+		if (fgets(line, sizeof(line), f) &&
+		    (paren = strrchr(line, ')')) != NULL &&
+		    sscanf(paren + 1, " %*c %*d %*d %*d %*d %*d %*u %*u %*u"
+			   " %*u %*u %llu %llu", &ut, &st) == 2)
+			ret = (long long) (ut + st);
+		fclose(f);
+		break;
+	}
+	closedir(dir);
+	return ret;
+}
+
+static int run_cell(unsigned idle, unsigned long long rate)
+{
+	struct io_uring_params p = { };
+	struct io_uring_cqe *cqes[QD];
+	struct io_uring ring;
+	unsigned long long t0, t, interval, next_sched, done = 0, wakeups = 0;
+	unsigned long long inflight = 0;
+	long long cpu0, cpu1;
+	double secs, cpu_pct;
+	long hz;
+	int ret;
+
+	p.flags = IORING_SETUP_SQPOLL;
+	p.sq_thread_idle = idle;
+	ret = io_uring_queue_init_params(QD, &ring, &p);
+	if (ret) {
+		printf("%s\n  {\"idle_ms\": %u, \"rate\": %llu, \"skipped\": %d}",
+		       first_record ? "" : ",", idle, rate, ret);
+		first_record = 0;
+		return ret;
+	}
+
+	interval = 1000000000ULL / rate;
+	cpu0 = sqpoll_cpu_ticks();
+	t0 = now_ns();
+	next_sched = t0;
+	t = t0;
+	while (t - t0 < (unsigned long long) (cell_secs * 1e9)) {
+		unsigned prepped = 0, got;
+
+		while (t >= next_sched && inflight < QD) {
+			struct io_uring_sqe *sqe = io_uring_get_sqe(&ring);
+
+			if (!sqe)
+				break;
+			io_uring_prep_nop(sqe);
+			inflight++;
+			prepped++;
+			next_sched += interval;
+		}
+		if (prepped) {
+			if (IO_URING_READ_ONCE(*ring.sq.kflags) &
+			    IORING_SQ_NEED_WAKEUP)
+				wakeups++;
+			ret = io_uring_submit(&ring);
+			if (ret < 0)
+				break;
+		}
+		got = io_uring_peek_batch_cqe(&ring, cqes, QD);
+		io_uring_cq_advance(&ring, got);
+		inflight -= got;
+		done += got;
+		t = now_ns();
+	}
+	secs = (t - t0) / 1e9;
+	cpu1 = sqpoll_cpu_ticks();
+	io_uring_queue_exit(&ring);
+
+	hz = sysconf(_SC_CLK_TCK);
+	if (cpu0 >= 0 && cpu1 >= cpu0 && hz > 0 && secs > 0.0)
+		cpu_pct = (cpu1 - cpu0) * 100.0 / hz / secs;
+	else
+		cpu_pct = -1.0;
+
+	printf("%s\n  {\"idle_ms\": %u, \"rate\": %llu, \"achieved_iops\": %.0f, "
+	       "\"wakeup_enters\": %llu, \"wakeups_per_sec\": %.0f, "
+	       "\"sqpoll_cpu_pct\": %.1f}",
+	       first_record ? "" : ",", idle, rate, done / secs, wakeups,
+	       wakeups / secs, cpu_pct);
+	first_record = 0;
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc > 1)
+		cell_secs = atof(argv[1]);
+	if (cell_secs <= 0.0)
+		return 1;
+
+	printf("[");
+	for (unsigned i = 0; i < sizeof(idle_ms) / sizeof(idle_ms[0]); i++) {
+		for (unsigned l = 0; l < sizeof(loads) / sizeof(loads[0]); l++)
+			run_cell(idle_ms[i], loads[l]);
+	}
+	printf("\n]\n");
+	return 0;
+}
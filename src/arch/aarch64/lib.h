@@ -45,4 +45,76 @@ static inline long get_page_size(void)
 	return cache_val;
 }
 
+static inline void uring_cpu_relax(void)
+{
+	__asm__ __volatile__("yield");
+}
+
+/*
+ * Single-SQE and CQE-batch clones as paired loads/stores. Left to
+ * itself the compiler tends to split these fixed 64- and 16-byte
+ * copies into small scalar accesses; explicit LDP/STP keeps them at
+ * the widest pairs the core can issue. Callers are ordered by the
+ * load-acquire on the CQ tail (or the store-release on the SQ tail),
+ * so plain pairs are sufficient here.
+ */
+#define URING_ARCH_COPY
+
+static inline void uring_sqe_copy64(void *dst, const void *src)
+{
+#ifdef __ARM_NEON
+	__asm__ __volatile__(
+		"ldp q0, q1, [%1]\n\t"
+		"ldp q2, q3, [%1, #32]\n\t"
+		"stp q0, q1, [%0]\n\t"
+		"stp q2, q3, [%0, #32]"
+		:
+		: "r"(dst), "r"(src)
+		: "v0", "v1", "v2", "v3", "memory");
+#else
+	unsigned long t0, t1, t2, t3;
+
+	__asm__ __volatile__(
+		"ldp %0, %1, [%4]\n\t"
+		"ldp %2, %3, [%4, #16]\n\t"
+		"stp %0, %1, [%5]\n\t"
+		"stp %2, %3, [%5, #16]\n\t"
+		"ldp %0, %1, [%4, #32]\n\t"
+		"ldp %2, %3, [%4, #48]\n\t"
+		"stp %0, %1, [%5, #32]\n\t"
+		"stp %2, %3, [%5, #48]"
+		: "=&r"(t0), "=&r"(t1), "=&r"(t2), "=&r"(t3)
+		: "r"(src), "r"(dst)
+		: "memory");
+#endif
+}
+
+/* copy 'nr' 16-byte CQEs; 64-byte blocks first, then single pairs */
+static inline void uring_cqe_copy(void *dst, const void *src, unsigned nr)
+{
+	char *d = dst;
+	const char *s = src;
+
+	for (; nr >= 4; nr -= 4, d += 64, s += 64)
+		uring_sqe_copy64(d, s);
+	for (; nr; nr--, d += 16, s += 16) {
+		unsigned long t0, t1;
+
+		__asm__ __volatile__(
+			"ldp %0, %1, [%2]\n\t"
+			"stp %0, %1, [%3]"
+			: "=&r"(t0), "=&r"(t1)
+			: "r"(s), "r"(d)
+			: "memory");
+	}
+}
+
+static inline unsigned long long uring_read_cycles(void)
+{
+	unsigned long long val;
+
+	__asm__ __volatile__("mrs %0, cntvct_el0" : "=r" (val));
+	return val;
+}
+
 #endif /* #ifndef LIBURING_ARCH_AARCH64_LIB_H */
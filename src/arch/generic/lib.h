@@ -14,4 +14,19 @@ static inline long get_page_size(void)
 	return page_size;
 }
 
+static inline void uring_cpu_relax(void)
+{
+	__asm__ __volatile__("" ::: "memory");
+}
+
+#include <time.h>
+
+static inline unsigned long long uring_read_cycles(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
 #endif /* #ifndef LIBURING_ARCH_GENERIC_LIB_H */
@@ -76,6 +76,38 @@ static inline int __sys_madvise(void *addr, size_t length, int advice)
 	return (ret < 0) ? -errno : ret;
 }
 
+static inline int __sys_mprotect(void *addr, size_t length, int prot)
+{
+	int ret;
+	ret = mprotect(addr, length, prot);
+	return (ret < 0) ? -errno : ret;
+}
+
+static inline int __sys_pipe2(int *fds, int flags)
+{
+	int ret;
+	ret = pipe2(fds, flags);
+	return (ret < 0) ? -errno : ret;
+}
+
+static inline int __sys_gettid(void)
+{
+	return (int) syscall(__NR_gettid);
+}
+
+static inline int __sys_clock_gettime(int clockid,
+				      struct __kernel_timespec *ts)
+{
+	int ret;
+	ret = syscall(__NR_clock_gettime, clockid, ts);
+	return (ret < 0) ? -errno : ret;
+}
+
+static inline int __sys_sched_yield(void)
+{
+	return (int) syscall(__NR_sched_yield);
+}
+
 static inline int __sys_getrlimit(int resource, struct rlimit *rlim)
 {
 	int ret;
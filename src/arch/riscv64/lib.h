@@ -45,4 +45,168 @@ static inline long get_page_size(void)
 	return cache_val;
 }
 
+static inline void uring_cpu_relax(void)
+{
+	/* Zihintpause "pause", a fence hint nop on cores without it */
+	__asm__ __volatile__(".4byte 0x0100000f");
+}
+
+static inline unsigned long long uring_read_cycles(void)
+{
+	unsigned long long val;
+
+	__asm__ __volatile__("rdtime %0" : "=r" (val));
+	return val;
+}
+
+/*
+ * RVV-accelerated bulk helpers, used when AT_HWCAP advertises the V
+ * extension and scalar loops otherwise. The vector blocks carry
+ * ".option arch, +v" so the library still assembles for plain rv64gc
+ * targets; with V disabled at compile time the compiler never touches
+ * vector state, so the blocks need no vector clobbers.
+ */
+#ifndef COMPAT_HWCAP_ISA_V
+#define COMPAT_HWCAP_ISA_V	(1UL << ('V' - 'A'))
+#endif
+
+static inline int uring_rvv_ok(void)
+{
+	static int cached;
+
+	if (uring_unlikely(!cached)) {
+		unsigned long buf[2], hwcap = 0;
+		int fd;
+
+		fd = __sys_open("/proc/self/auxv", O_RDONLY, 0);
+		if (fd >= 0) {
+			while (__sys_read(fd, buf, sizeof(buf)) ==
+			       (long) sizeof(buf)) {
+				if (buf[0] == AT_HWCAP) {
+					hwcap = buf[1];
+					break;
+				}
+			}
+			__sys_close(fd);
+		}
+		cached = (hwcap & COMPAT_HWCAP_ISA_V) ? 1 : -1;
+	}
+	return cached > 0;
+}
+
+/* 'n' is a multiple of 8 for every caller (16-byte CQEs, 64-byte SQEs) */
+static inline void __uring_copy_words(void *dst, const void *src, size_t n)
+{
+	unsigned long *d = dst;
+	const unsigned long *s = src;
+
+	for (; n >= sizeof(long); n -= sizeof(long))
+		*d++ = *s++;
+}
+
+static inline void __uring_rvv_copy(void *dst, const void *src, size_t n)
+{
+	__asm__ __volatile__(
+		".option push\n\t"
+		".option arch, +v\n"
+		"1:\n\t"
+		"vsetvli t0, %2, e8, m8, ta, ma\n\t"
+		"vle8.v v8, (%1)\n\t"
+		"vse8.v v8, (%0)\n\t"
+		"add %1, %1, t0\n\t"
+		"add %0, %0, t0\n\t"
+		"sub %2, %2, t0\n\t"
+		"bnez %2, 1b\n\t"
+		".option pop"
+		: "+r"(dst), "+r"(src), "+r"(n)
+		:
+		: "t0", "memory");
+}
+
+#define URING_ARCH_COPY
+
+static inline void uring_sqe_copy64(void *dst, const void *src)
+{
+	if (uring_rvv_ok())
+		__uring_rvv_copy(dst, src, 64);
+	else
+		__uring_copy_words(dst, src, 64);
+}
+
+static inline void uring_cqe_copy(void *dst, const void *src, unsigned nr)
+{
+	if (uring_rvv_ok())
+		__uring_rvv_copy(dst, src, (size_t) nr * 16);
+	else
+		__uring_copy_words(dst, src, (size_t) nr * 16);
+}
+
+/*
+ * Batch buf_ring refill for the slab layout: entry i gets address
+ * 'addr + i * stride', length 'len' and bid 'bid_base + i'. Each field
+ * is stored with a 16-byte-strided vector store at its own offset, so
+ * the layout matches struct io_uring_buf regardless of endianness. The
+ * e32/e16 passes reuse the AVL the e64 pass settled on; with LMUL
+ * halved alongside SEW, VLMAX is the same for all three.
+ */
+#define URING_ARCH_BUF_FILL
+
+static inline void uring_buf_fill_seq(void *dst, unsigned long addr,
+				      size_t stride, unsigned int len,
+				      unsigned int bid_base,
+				      unsigned int count)
+{
+	unsigned long cnt = count, bid = bid_base;
+
+	if (!uring_rvv_ok()) {
+		char *p = dst;
+		unsigned int i;
+
+		for (i = 0; i < count; i++, p += 16) {
+			*(unsigned long long *) (void *) p =
+				addr + (unsigned long long) i * stride;
+			*(unsigned int *) (void *) (p + 8) = len;
+			*(unsigned short *) (void *) (p + 12) =
+				(unsigned short) (bid_base + i);
+			*(unsigned short *) (void *) (p + 14) = 0;
+		}
+		return;
+	}
+
+	__asm__ __volatile__(
+		".option push\n\t"
+		".option arch, +v\n"
+		"1:\n\t"
+		"vsetvli t0, %[cnt], e64, m4, ta, ma\n\t"
+		"vid.v v8\n\t"
+		"vmul.vx v8, v8, %[stride]\n\t"
+		"vadd.vx v8, v8, %[addr]\n\t"
+		"vsse64.v v8, (%[dst]), %[ent]\n\t"
+		"vsetvli zero, t0, e32, m2, ta, ma\n\t"
+		"vmv.v.x v4, %[len]\n\t"
+		"addi t1, %[dst], 8\n\t"
+		"vsse32.v v4, (t1), %[ent]\n\t"
+		"vsetvli zero, t0, e16, m1, ta, ma\n\t"
+		"vid.v v2\n\t"
+		"vadd.vx v2, v2, %[bid]\n\t"
+		"addi t1, %[dst], 12\n\t"
+		"vsse16.v v2, (t1), %[ent]\n\t"
+		"vmv.v.i v3, 0\n\t"
+		"addi t1, %[dst], 14\n\t"
+		"vsse16.v v3, (t1), %[ent]\n\t"
+		"mul t2, t0, %[stride]\n\t"
+		"add %[addr], %[addr], t2\n\t"
+		"add %[bid], %[bid], t0\n\t"
+		"slli t2, t0, 4\n\t"
+		"add %[dst], %[dst], t2\n\t"
+		"sub %[cnt], %[cnt], t0\n\t"
+		"bnez %[cnt], 1b\n\t"
+		".option pop"
+		: [dst] "+r"(dst), [addr] "+r"(addr), [bid] "+r"(bid),
+		  [cnt] "+r"(cnt)
+		: [stride] "r"(stride), [len] "r"((unsigned long) len),
+		  [ent] "r"(16UL)
+		: "t0", "t1", "t2", "memory");
+}
+
 #endif /* #ifndef LIBURING_ARCH_RISCV64_LIB_H */
@@ -46,6 +46,53 @@ static inline int __sys_madvise(void *addr, size_t length, int advice)
 	return (int) __do_syscall3(__NR_madvise, addr, length, advice);
 }
 
+static inline int __sys_mprotect(void *addr, size_t length, int prot)
+{
+	return (int) __do_syscall3(__NR_mprotect, addr, length, prot);
+}
+
+static inline int __sys_mlock(const void *addr, size_t length)
+{
+	return (int) __do_syscall2(__NR_mlock, addr, length);
+}
+
+static inline int __sys_mincore(void *addr, size_t length, unsigned char *vec)
+{
+	return (int) __do_syscall3(__NR_mincore, addr, length, vec);
+}
+
+static inline int __sys_clock_gettime(int clockid,
+				      struct __kernel_timespec *ts)
+{
+	/*
+	 * 32-bit archs carry the 64-bit time variant under a separate
+	 * syscall number; __kernel_timespec is the 64-bit layout on both.
+	 */
+#if defined(__NR_clock_gettime64)
+	return (int) __do_syscall2(__NR_clock_gettime64, clockid, ts);
+#else
+	return (int) __do_syscall2(__NR_clock_gettime, clockid, ts);
+#endif
+}
+
+static inline int __sys_mbind(void *addr, unsigned long len, int mode,
+			      const unsigned long *nodemask,
+			      unsigned long maxnode, unsigned flags)
+{
+	return (int) __do_syscall6(__NR_mbind, addr, len, mode, nodemask,
+				   maxnode, flags);
+}
+
+static inline int __sys_sched_yield(void)
+{
+	return (int) __do_syscall0(__NR_sched_yield);
+}
+
+static inline int __sys_getcpu(unsigned *cpu, unsigned *node)
+{
+	return (int) __do_syscall3(__NR_getcpu, cpu, node, NULL);
+}
+
 static inline int __sys_getrlimit(int resource, struct rlimit *rlim)
 {
 	return (int) __do_syscall2(__NR_getrlimit, resource, rlim);
@@ -56,6 +103,16 @@ static inline int __sys_setrlimit(int resource, const struct rlimit *rlim)
 	return (int) __do_syscall2(__NR_setrlimit, resource, rlim);
 }
 
+static inline int __sys_pipe2(int *fds, int flags)
+{
+	return (int) __do_syscall2(__NR_pipe2, fds, flags);
+}
+
+static inline int __sys_gettid(void)
+{
+	return (int) __do_syscall0(__NR_gettid);
+}
+
 static inline int __sys_close(int fd)
 {
 	return (int) __do_syscall1(__NR_close, fd);
@@ -8,4 +8,17 @@ static inline long get_page_size(void)
 	return 4096;
 }
 
+static inline void uring_cpu_relax(void)
+{
+	__asm__ __volatile__("pause");
+}
+
+static inline unsigned long long uring_read_cycles(void)
+{
+	unsigned int lo, hi;
+
+	__asm__ __volatile__("rdtsc" : "=a" (lo), "=d" (hi));
+	return ((unsigned long long) hi << 32) | lo;
+}
+
 #endif /* #ifndef LIBURING_ARCH_X86_LIB_H */
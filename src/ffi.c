@@ -13,3 +13,90 @@
 #ifdef __clang__
 #pragma clang diagnostic pop
 #endif
+
+/*
+ * Batch FFI entry points, see the io_uring_ffi_op block in liburing.h.
+ * Real functions rather than inlines: they exist purely so managed
+ * runtimes can amortize one foreign-call crossing over a whole batch.
+ */
+static void ffi_prep_one(struct io_uring_sqe *sqe,
+			 const struct io_uring_ffi_op *op)
+{
+	io_uring_prep_rw(op->opcode, sqe, op->fd,
+			 (const void *) (uintptr_t) op->addr, op->len,
+			 op->offset);
+	sqe->flags = op->sqe_flags;
+	sqe->rw_flags = (int) op->op_flags;
+	sqe->buf_index = op->buf_index;
+	sqe->user_data = op->user_data;
+}
+
+/*
+ * Preps until the descriptors or the SQ run out, whichever comes first;
+ * returns the number prepped.
+ */
+int io_uring_ffi_prep_batch(struct io_uring *ring,
+			    const struct io_uring_ffi_op *ops, unsigned nr)
+{
+	unsigned i;
+
+	for (i = 0; i < nr; i++) {
+		struct io_uring_sqe *sqe = io_uring_get_sqe(ring);
+
+		if (!sqe)
+			break;
+		ffi_prep_one(sqe, &ops[i]);
+	}
+	return (int) i;
+}
+
+/*
+ * One crossing for the whole cycle: prep every descriptor (flushing
+ * mid-way if the batch exceeds the SQ), submit, wait for 'wait_nr'
+ * completions and copy up to 'nr_cqes' of them into the flat 'cqes'
+ * buffer. Returns the number of CQEs copied, or -errno.
+ */
+int io_uring_ffi_submit_reap(struct io_uring *ring,
+			     const struct io_uring_ffi_op *ops, unsigned nr_ops,
+			     struct io_uring_cqe *cqes, unsigned nr_cqes,
+			     unsigned wait_nr)
+{
+	int shift = !!(ring->flags & IORING_SETUP_CQE32);
+	unsigned prepped = 0, copied;
+	int ret;
+
+	while (prepped < nr_ops) {
+		ret = io_uring_ffi_prep_batch(ring, &ops[prepped],
+					      nr_ops - prepped);
+		prepped += (unsigned) ret;
+		if (prepped == nr_ops)
+			break;
+		/* SQ full; flush to make room, bail if that freed nothing */
+		ret = io_uring_submit(ring);
+		if (ret < 0)
+			return ret;
+		if (!ret)
+			return -EBUSY;
+	}
+	if (wait_nr > nr_cqes)
+		wait_nr = nr_cqes;
+	ret = io_uring_submit_and_wait(ring, wait_nr);
+	if (ret < 0)
+		return ret;
+
+	copied = io_uring_copy_batch_cqe(ring, cqes, nr_cqes);
+	/*
+	 * A batch bigger than the CQ ring can't complete in one go; keep
+	 * draining (overflow flushes included) until 'wait_nr' is met.
+	 */
+	while (copied < wait_nr) {
+		struct io_uring_cqe *cqe;
+
+		ret = io_uring_wait_cqe(ring, &cqe);
+		if (ret < 0)
+			return copied ? (int) copied : ret;
+		copied += io_uring_copy_batch_cqe(ring, &cqes[copied << shift],
+						  nr_cqes - copied);
+	}
+	return (int) copied;
+}
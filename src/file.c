@@ -0,0 +1,1886 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * File and storage engines layered on the core ring: the bounded
+ * copier, the pipe splicer, the O_DIRECT staging engine, the xattr and
+ * bulk statx fetchers, open+read chains, readahead probes, write
+ * coalescing and barriers, and the close sweep and file swap chains.
+ */
+#define _POSIX_C_SOURCE 200112L
+
+#include "lib.h"
+#include "syscall.h"
+#include "liburing.h"
+#include "setup.h"
+
+enum {
+	COPY_KIND_READ	= 0,
+	COPY_KIND_WRITE	= 1,
+};
+
+static __u64 copy_udata(unsigned kind, unsigned slot)
+{
+	return LIBURING_UDATA_COPY | ((__u64) kind << 40) | slot;
+}
+
+static struct io_uring_sqe *copy_get_sqe(struct io_uring_copy *cp)
+{
+	struct io_uring_sqe *sqe;
+
+	sqe = io_uring_get_sqe(cp->ring);
+	if (!sqe) {
+		io_uring_submit(cp->ring);
+		sqe = io_uring_get_sqe(cp->ring);
+	}
+	return sqe;
+}
+
+static int copy_stage_read(struct io_uring_copy *cp, unsigned slot)
+{
+	struct io_uring_copy_slot *s = &cp->slots[slot];
+	unsigned char *buf = cp->bufs + (size_t) slot * cp->block_size +
+			     s->buf_pos;
+	unsigned len = s->len - s->buf_pos;
+	__u64 off = s->off + s->buf_pos;
+	struct io_uring_sqe *sqe;
+
+	sqe = copy_get_sqe(cp);
+	if (!sqe)
+		return -EBUSY;
+	if (cp->fixed)
+		io_uring_prep_read_fixed(sqe, cp->src_fd, buf, len, off,
+					 (int) slot);
+	else
+		io_uring_prep_read(sqe, cp->src_fd, buf, len, off);
+	sqe->user_data = copy_udata(COPY_KIND_READ, slot);
+	cp->inflight++;
+	return 0;
+}
+
+static int copy_stage_write(struct io_uring_copy *cp, unsigned slot)
+{
+	struct io_uring_copy_slot *s = &cp->slots[slot];
+	unsigned char *buf = cp->bufs + (size_t) slot * cp->block_size +
+			     s->buf_pos;
+	__u64 off = cp->dst_off + (s->off + s->buf_pos - cp->src_off);
+	struct io_uring_sqe *sqe;
+
+	sqe = copy_get_sqe(cp);
+	if (!sqe)
+		return -EBUSY;
+	if (cp->fixed)
+		io_uring_prep_write_fixed(sqe, cp->dst_fd, buf, s->wr_len,
+					  off, (int) slot);
+	else
+		io_uring_prep_write(sqe, cp->dst_fd, buf, s->wr_len, off);
+	sqe->user_data = copy_udata(COPY_KIND_WRITE, slot);
+	cp->inflight++;
+	return 0;
+}
+
+/* point an idle slot at the next unclaimed block, if any */
+static int copy_claim_block(struct io_uring_copy *cp, unsigned slot)
+{
+	struct io_uring_copy_slot *s = &cp->slots[slot];
+	__u64 left = cp->len - cp->next;
+
+	if (!left || cp->err)
+		return 0;
+	s->off = cp->src_off + cp->next;
+	s->len = left < cp->block_size ? (unsigned) left : cp->block_size;
+	s->buf_pos = 0;
+	cp->next += s->len;
+	if (copy_stage_read(cp, slot)) {
+		if (!cp->err)
+			cp->err = -EBUSY;
+		return 0;
+	}
+	return 1;
+}
+
+/*
+ * Kick off copying 'len' bytes from (src_fd, src_off) to
+ * (dst_fd, dst_off) on 'ring': the buffer pool is allocated and
+ * registered, the first 'depth' blocks are staged and submitted, and
+ * from then on the application reaps CQEs as usual and passes each
+ * through io_uring_copy_cqe() until it reports completion.
+ */
+__cold int io_uring_copy_file_range_async(struct io_uring *ring,
+				   struct io_uring_copy *cp,
+				   int src_fd, __u64 src_off,
+				   int dst_fd, __u64 dst_off, __u64 len,
+				   unsigned depth, unsigned block_size,
+				   void (*progress)(struct io_uring_copy *cp,
+						    __u64 copied),
+				   void *cb_data)
+{
+	struct iovec *iovs;
+	unsigned i;
+	int ret;
+
+	if (!depth || !block_size || !len)
+		return -EINVAL;
+
+	cp->bufs = uring_ring_malloc(ring, (size_t) depth * block_size);
+	if (!cp->bufs)
+		return -ENOMEM;
+	cp->slots = uring_ring_malloc(ring, depth * sizeof(*cp->slots));
+	if (!cp->slots) {
+		ret = -ENOMEM;
+		goto err_bufs;
+	}
+
+	cp->ring = ring;
+	cp->src_fd = src_fd;
+	cp->dst_fd = dst_fd;
+	cp->src_off = src_off;
+	cp->dst_off = dst_off;
+	cp->len = len;
+	cp->next = 0;
+	cp->done = 0;
+	cp->block_size = block_size;
+	cp->depth = depth;
+	cp->inflight = 0;
+	cp->err = 0;
+	cp->progress = progress;
+	cp->cb_data = cb_data;
+
+	/* registered staging when possible, plain read/write otherwise */
+	iovs = uring_ring_malloc(ring, depth * sizeof(*iovs));
+	if (!iovs) {
+		ret = -ENOMEM;
+		goto err_slots;
+	}
+	for (i = 0; i < depth; i++) {
+		iovs[i].iov_base = cp->bufs + (size_t) i * block_size;
+		iovs[i].iov_len = block_size;
+	}
+	cp->fixed = !io_uring_register_buffers(ring, iovs, depth);
+	uring_ring_free(ring, iovs);
+
+	for (i = 0; i < depth; i++) {
+		if (!copy_claim_block(cp, i))
+			break;
+	}
+	ret = io_uring_submit(ring);
+	if (ret < 0)
+		goto err_reg;
+	return 0;
+err_reg:
+	if (cp->fixed)
+		io_uring_unregister_buffers(ring);
+err_slots:
+	uring_ring_free(ring, cp->slots);
+err_bufs:
+	uring_ring_free(ring, cp->bufs);
+	return ret;
+}
+
+__cold void io_uring_copy_exit(struct io_uring_copy *cp)
+{
+	if (cp->fixed)
+		io_uring_unregister_buffers(cp->ring);
+	uring_ring_free(cp->ring, cp->slots);
+	uring_ring_free(cp->ring, cp->bufs);
+	cp->slots = NULL;
+	cp->bufs = NULL;
+}
+
+/*
+ * Feed one reaped completion through the engine; returns 0 for foreign
+ * cqes, 1 when consumed, and 2 when the engine has gone idle - either
+ * the full range copied (cp->err == 0) or drained after a failure
+ * (cp->err holds the first error; an unexpected EOF reads as -ENODATA).
+ * Short reads and writes resume from where they stopped; each fully
+ * written block bumps cp->done and fires the progress callback. Staged
+ * sqes ride the application's next submit.
+ */
+int io_uring_copy_cqe(struct io_uring_copy *cp,
+		      const struct io_uring_cqe *cqe)
+{
+	struct io_uring_copy_slot *s;
+	unsigned kind, slot;
+
+	if ((cqe->user_data & (0xffffULL << 48)) != LIBURING_UDATA_COPY)
+		return 0;
+	kind = (unsigned) (cqe->user_data >> 40) & 0xff;
+	slot = (unsigned) cqe->user_data;
+	s = &cp->slots[slot];
+	cp->inflight--;
+
+	if (cqe->res < 0) {
+		if (!cp->err)
+			cp->err = cqe->res;
+	} else if (kind == COPY_KIND_READ) {
+		if (!cqe->res) {
+			if (!cp->err)
+				cp->err = -ENODATA;
+		} else {
+			s->wr_len = (unsigned) cqe->res;
+			if (copy_stage_write(cp, slot) && !cp->err)
+				cp->err = -EBUSY;
+		}
+	} else {
+		s->buf_pos += (unsigned) cqe->res;
+		s->wr_len -= (unsigned) cqe->res;
+		if (s->wr_len) {
+			/* short write: push the rest of the read data */
+			if (copy_stage_write(cp, slot) && !cp->err)
+				cp->err = -EBUSY;
+		} else if (s->buf_pos < s->len) {
+			/* short read earlier: fetch the rest of the block */
+			if (copy_stage_read(cp, slot) && !cp->err)
+				cp->err = -EBUSY;
+		} else {
+			cp->done += s->len;
+			if (cp->progress)
+				cp->progress(cp, cp->done);
+			copy_claim_block(cp, slot);
+		}
+	}
+	return cp->inflight ? 1 : 2;
+}
+
+enum {
+	SPLICE_KIND_IN	= 0,
+	SPLICE_KIND_OUT	= 1,
+};
+
+static __u64 splice_udata(unsigned kind, unsigned slot)
+{
+	return LIBURING_UDATA_SPLICE | ((__u64) kind << 40) | slot;
+}
+
+/* drain 'len' bytes still sitting in a slot's pipe into the sink */
+static int splice_stage_out(struct io_uring_splicer *sp, unsigned slot,
+			    unsigned len)
+{
+	struct io_uring_sqe *sqe;
+
+	sqe = io_uring_get_sqe(sp->ring);
+	if (!sqe) {
+		io_uring_submit(sp->ring);
+		sqe = io_uring_get_sqe(sp->ring);
+		if (!sqe)
+			return -EBUSY;
+	}
+	io_uring_prep_splice(sqe, sp->pipes[slot][0], -1, sp->sink_fd, -1,
+			     len, SPLICE_F_NONBLOCK);
+	sqe->user_data = splice_udata(SPLICE_KIND_OUT, slot);
+	return 0;
+}
+
+/*
+ * Build the pipe pool and record the endpoints; nothing is staged yet.
+ * Call io_uring_splice_chunk() up to nr_pipes times to fill the
+ * pipeline, then keep topping it up as io_uring_splice_cqe() retires
+ * chunks, until sp->eof or sp->err. 'chunk' must fit a pipe
+ * (64k default); pass (__u64)-1 as src_off for a non-seekable source.
+ */
+__cold int io_uring_splicer_init(struct io_uring *ring,
+			  struct io_uring_splicer *sp,
+			  int src_fd, __u64 src_off, int sink_fd,
+			  unsigned chunk, unsigned nr_pipes)
+{
+	unsigned i;
+	int ret;
+
+	if (!chunk || !nr_pipes)
+		return -EINVAL;
+
+	sp->pipes = uring_ring_malloc(ring, nr_pipes * sizeof(*sp->pipes));
+	if (!sp->pipes)
+		return -ENOMEM;
+	sp->free_q = uring_ring_malloc(ring, nr_pipes * sizeof(*sp->free_q));
+	if (!sp->free_q) {
+		uring_ring_free(ring, sp->pipes);
+		return -ENOMEM;
+	}
+	sp->in_res = uring_ring_malloc(ring, nr_pipes * sizeof(*sp->in_res));
+	if (!sp->in_res) {
+		uring_ring_free(ring, sp->free_q);
+		uring_ring_free(ring, sp->pipes);
+		return -ENOMEM;
+	}
+	for (i = 0; i < nr_pipes; i++) {
+		ret = __sys_pipe2(sp->pipes[i], O_CLOEXEC);
+		if (ret < 0) {
+			while (i--) {
+				__sys_close(sp->pipes[i][0]);
+				__sys_close(sp->pipes[i][1]);
+			}
+			uring_ring_free(ring, sp->free_q);
+			uring_ring_free(ring, sp->pipes);
+			return ret;
+		}
+		sp->free_q[i] = i;
+	}
+
+	sp->ring = ring;
+	sp->free_nr = nr_pipes;
+	sp->nr_pipes = nr_pipes;
+	sp->chunk = chunk;
+	sp->src_fd = src_fd;
+	sp->sink_fd = sink_fd;
+	sp->err = 0;
+	sp->eof = 0;
+	sp->off = src_off;
+	sp->streamed = 0;
+	return 0;
+}
+
+__cold void io_uring_splicer_exit(struct io_uring_splicer *sp)
+{
+	unsigned i;
+
+	for (i = 0; i < sp->nr_pipes; i++) {
+		__sys_close(sp->pipes[i][0]);
+		__sys_close(sp->pipes[i][1]);
+	}
+	uring_ring_free(sp->ring, sp->in_res);
+	uring_ring_free(sp->ring, sp->free_q);
+	uring_ring_free(sp->ring, sp->pipes);
+	sp->pipes = NULL;
+	sp->free_q = NULL;
+	sp->in_res = NULL;
+}
+
+/*
+ * Stage the next chunk as a linked splice pair through a pooled pipe.
+ * Returns 0 when staged, -ENOSPC with every pipe in flight, -ENODATA
+ * past end of source, or the recorded error; submit as usual. The
+ * sink-side splice runs SPLICE_F_NONBLOCK: by link ordering the data
+ * already sits in the pipe, and a source that returned no data then
+ * surfaces -EAGAIN instead of blocking on the empty pipe.
+ */
+int io_uring_splice_chunk(struct io_uring_splicer *sp)
+{
+	struct io_uring_sqe *sqe;
+	unsigned slot;
+
+	if (sp->err)
+		return sp->err;
+	if (sp->eof)
+		return -ENODATA;
+	if (!sp->free_nr)
+		return -ENOSPC;
+	if (io_uring_sq_space_left(sp->ring) < 2)
+		return -EBUSY;
+	slot = sp->free_q[--sp->free_nr];
+	sp->in_res[slot] = 0;
+
+	sqe = io_uring_get_sqe(sp->ring);
+	io_uring_prep_splice(sqe, sp->src_fd, (int64_t) sp->off,
+			     sp->pipes[slot][1], -1, sp->chunk, 0);
+	sqe->flags |= IOSQE_IO_LINK;
+	sqe->user_data = splice_udata(SPLICE_KIND_IN, slot);
+
+	sqe = io_uring_get_sqe(sp->ring);
+	io_uring_prep_splice(sqe, sp->pipes[slot][0], -1, sp->sink_fd, -1,
+			     sp->chunk, SPLICE_F_NONBLOCK);
+	sqe->user_data = splice_udata(SPLICE_KIND_OUT, slot);
+
+	if (sp->off != (__u64) -1)
+		sp->off += sp->chunk;
+	return 0;
+}
+
+/*
+ * Feed one reaped completion through the pipeline; returns 0 for
+ * foreign cqes, 1 for a completion that leaves the chunk in flight,
+ * and 2 when a chunk retires and its pipe returns to the pool. A
+ * source read of zero sets sp->eof; real failures land in sp->err and
+ * already-staged chunks drain. Partial transfers never strand data: a
+ * short source splice breaks its link, so the cancelled (or short)
+ * sink side is restaged for exactly the bytes left in the pipe.
+ * sp->streamed accumulates bytes that reached the sink.
+ */
+int io_uring_splice_cqe(struct io_uring_splicer *sp,
+			const struct io_uring_cqe *cqe)
+{
+	unsigned kind, slot;
+
+	if ((cqe->user_data & (0xffffULL << 48)) != LIBURING_UDATA_SPLICE)
+		return 0;
+	kind = (unsigned) (cqe->user_data >> 40) & 0xff;
+	slot = (unsigned) cqe->user_data;
+
+	if (kind == SPLICE_KIND_IN) {
+		if (!cqe->res)
+			sp->eof = 1;
+		else if (cqe->res < 0 && !sp->err)
+			sp->err = cqe->res;
+		else if (cqe->res > 0)
+			sp->in_res[slot] = cqe->res;
+		return 1;
+	}
+
+	if (cqe->res > 0) {
+		sp->streamed += (__u64) cqe->res;
+		sp->in_res[slot] -= cqe->res;
+	}
+	if (sp->in_res[slot] > 0) {
+		/*
+		 * Data still in the pipe: the link was cancelled after a
+		 * short source splice, the sink splice came up short, or
+		 * a full sink returned -EAGAIN. Push the rest.
+		 */
+		if (splice_stage_out(sp, slot, sp->in_res[slot]))
+			sp->err = sp->err ? sp->err : -EBUSY;
+		else
+			return 1;
+	} else if (cqe->res == -EAGAIN) {
+		/* empty pipe after a zero-length source: end of stream */
+		sp->eof = 1;
+	} else if (cqe->res < 0 && cqe->res != -ECANCELED && !sp->err) {
+		sp->err = cqe->res;
+	}
+	sp->free_q[sp->free_nr++] = slot;
+	return 2;
+}
+
+enum {
+	DIO_KIND_HEAD	= 0,
+	DIO_KIND_BODY	= 1,
+	DIO_KIND_TAIL	= 2,
+};
+
+static __u64 dio_udata(unsigned kind, unsigned slot)
+{
+	return LIBURING_UDATA_DIO | ((__u64) kind << 40) | slot;
+}
+
+/* per-slot scratch: one head sector followed by one tail sector */
+static unsigned char *dio_scratch(struct io_uring_dio *d, unsigned slot,
+				  unsigned kind)
+{
+	return d->scratch + (size_t) slot * 2 * d->align +
+	       (kind == DIO_KIND_TAIL ? d->align : 0);
+}
+
+/*
+ * Allocate and register the scratch pool: nr_ops slots of two
+ * 'align'-sized sectors each (head and tail fixup), mapped so the pool
+ * itself meets O_DIRECT alignment and registered as one fixed buffer.
+ * 'align' is the device's logical block size and must be a power of
+ * two; up to nr_ops split operations can be in flight at once.
+ */
+__cold int io_uring_dio_init(struct io_uring *ring, struct io_uring_dio *d,
+		      unsigned align, unsigned nr_ops)
+{
+	struct iovec iov;
+	unsigned i;
+	int ret;
+
+	if (!align || (align & (align - 1)) || !nr_ops)
+		return -EINVAL;
+
+	d->map_size = (size_t) nr_ops * 2 * align + align;
+	d->map = __sys_mmap(NULL, d->map_size, PROT_READ | PROT_WRITE,
+			    MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+	if (IS_ERR(d->map))
+		return PTR_ERR(d->map);
+	d->scratch = (unsigned char *)
+		(((uintptr_t) d->map + align - 1) & ~((uintptr_t) align - 1));
+
+	d->ops = uring_ring_malloc(ring, nr_ops * sizeof(*d->ops));
+	d->free_q = uring_ring_malloc(ring, nr_ops * sizeof(*d->free_q));
+	if (!d->ops || !d->free_q) {
+		ret = -ENOMEM;
+		goto err;
+	}
+	for (i = 0; i < nr_ops; i++)
+		d->free_q[i] = i;
+
+	iov.iov_base = d->scratch;
+	iov.iov_len = (size_t) nr_ops * 2 * align;
+	ret = io_uring_register_buffers(ring, &iov, 1);
+	if (ret)
+		goto err;
+
+	d->ring = ring;
+	d->free_nr = nr_ops;
+	d->nr_slots = nr_ops;
+	d->align = align;
+	return 0;
+err:
+	uring_ring_free(ring, d->free_q);
+	uring_ring_free(ring, d->ops);
+	__sys_munmap(d->map, d->map_size);
+	return ret;
+}
+
+__cold void io_uring_dio_exit(struct io_uring_dio *d)
+{
+	io_uring_unregister_buffers(d->ring);
+	uring_ring_free(d->ring, d->free_q);
+	uring_ring_free(d->ring, d->ops);
+	__sys_munmap(d->map, d->map_size);
+	d->ops = NULL;
+	d->free_q = NULL;
+	d->scratch = NULL;
+}
+
+static struct io_uring_sqe *dio_get_sqe(struct io_uring_dio *d)
+{
+	struct io_uring_sqe *sqe;
+
+	sqe = io_uring_get_sqe(d->ring);
+	if (!sqe) {
+		io_uring_submit(d->ring);
+		sqe = io_uring_get_sqe(d->ring);
+	}
+	return sqe;
+}
+
+/* compute the head/body/tail split for (off, len) */
+static void dio_split(struct io_uring_dio *d, struct io_uring_dio_op *op,
+		      void *buf, unsigned len, __u64 off)
+{
+	unsigned mask = d->align - 1;
+	unsigned rest = len;
+
+	op->buf = buf;
+	op->off = off;
+	op->len = len;
+	op->head_skip = (unsigned) (off & mask);
+	op->head_len = 0;
+	if (op->head_skip) {
+		op->head_len = d->align - op->head_skip;
+		if (op->head_len > rest)
+			op->head_len = rest;
+		rest -= op->head_len;
+	}
+	op->body_len = rest & ~mask;
+	op->tail_len = rest - op->body_len;
+	op->pending = 0;
+	op->err = 0;
+	op->res = 0;
+}
+
+/*
+ * Stage an O_DIRECT read of 'len' bytes at 'off' into 'buf': the
+ * aligned body goes straight to 'buf', unaligned head and tail sectors
+ * are read into registered scratch and copied out on completion. The
+ * caller's buffer must itself be aligned for the body portion, i.e.
+ * (buf + head_len) on an 'align' boundary; -EINVAL otherwise. 'op'
+ * must stay valid until io_uring_dio_cqe() reports it complete.
+ * Returns -ENOSPC with all scratch slots in flight; submit as usual.
+ */
+int io_uring_dio_read(struct io_uring_dio *d, struct io_uring_dio_op *op,
+		      int fd, void *buf, unsigned len, __u64 off)
+{
+	struct io_uring_sqe *sqe;
+	unsigned slot;
+
+	if (!len)
+		return -EINVAL;
+	if (!d->free_nr)
+		return -ENOSPC;
+	dio_split(d, op, buf, len, off);
+	if (op->body_len &&
+	    (((uintptr_t) buf + op->head_len) & (d->align - 1)))
+		return -EINVAL;
+	if (io_uring_sq_space_left(d->ring) <
+	    (unsigned) (!!op->head_len + !!op->body_len + !!op->tail_len))
+		return -EBUSY;
+	slot = d->free_q[--d->free_nr];
+	op->slot = slot;
+	op->wr = 0;
+	d->ops[slot] = op;
+
+	if (op->head_len) {
+		sqe = dio_get_sqe(d);
+		io_uring_prep_read_fixed(sqe, fd,
+					 dio_scratch(d, slot, DIO_KIND_HEAD),
+					 d->align, op->off - op->head_skip, 0);
+		sqe->user_data = dio_udata(DIO_KIND_HEAD, slot);
+		op->pending++;
+	}
+	if (op->body_len) {
+		sqe = dio_get_sqe(d);
+		io_uring_prep_read(sqe, fd,
+				   (unsigned char *) buf + op->head_len,
+				   op->body_len, op->off + op->head_len);
+		sqe->user_data = dio_udata(DIO_KIND_BODY, slot);
+		op->pending++;
+	}
+	if (op->tail_len) {
+		sqe = dio_get_sqe(d);
+		io_uring_prep_read_fixed(sqe, fd,
+					 dio_scratch(d, slot, DIO_KIND_TAIL),
+					 d->align,
+					 op->off + op->head_len + op->body_len,
+					 0);
+		sqe->user_data = dio_udata(DIO_KIND_TAIL, slot);
+		op->pending++;
+	}
+	return 0;
+}
+
+/*
+ * Stage an O_DIRECT write of 'len' bytes at 'off' from 'buf'. The
+ * offset and buffer must be aligned; an unaligned length is handled by
+ * copying the tail into scratch and writing it as a zero-padded full
+ * sector, so the file covers [off, off + len) with zeros through the
+ * end of the last sector - ftruncate to the final size afterwards if
+ * that matters. Unaligned offsets would need read-modify-write and are
+ * rejected with -EINVAL.
+ */
+int io_uring_dio_write(struct io_uring_dio *d, struct io_uring_dio_op *op,
+		       int fd, const void *buf, unsigned len, __u64 off)
+{
+	struct io_uring_sqe *sqe;
+	unsigned char *tail;
+	unsigned slot;
+
+	if (!len || (off & (d->align - 1)) ||
+	    ((uintptr_t) buf & (d->align - 1)))
+		return -EINVAL;
+	if (!d->free_nr)
+		return -ENOSPC;
+	dio_split(d, op, (void *) (uintptr_t) buf, len, off);
+	if (io_uring_sq_space_left(d->ring) <
+	    (unsigned) (!!op->body_len + !!op->tail_len))
+		return -EBUSY;
+	slot = d->free_q[--d->free_nr];
+	op->slot = slot;
+	op->wr = 1;
+	d->ops[slot] = op;
+
+	if (op->body_len) {
+		sqe = dio_get_sqe(d);
+		io_uring_prep_write(sqe, fd, buf, op->body_len, off);
+		sqe->user_data = dio_udata(DIO_KIND_BODY, slot);
+		op->pending++;
+	}
+	if (op->tail_len) {
+		tail = dio_scratch(d, slot, DIO_KIND_TAIL);
+		memcpy(tail, (const unsigned char *) buf + op->body_len,
+		       op->tail_len);
+		memset(tail + op->tail_len, 0, d->align - op->tail_len);
+		sqe = dio_get_sqe(d);
+		io_uring_prep_write_fixed(sqe, fd, tail, d->align,
+					  off + op->body_len, 0);
+		sqe->user_data = dio_udata(DIO_KIND_TAIL, slot);
+		op->pending++;
+	}
+	return 0;
+}
+
+/*
+ * Join the parts of a split operation; returns 0 for foreign cqes, 1
+ * while parts remain in flight, and 2 when the operation completes -
+ * op->res then holds 'len' or the first error. Head/tail read fixups
+ * copy their bytes from scratch into the caller's buffer here; a part
+ * transferring less than its share surfaces as -EIO.
+ */
+int io_uring_dio_cqe(struct io_uring_dio *d, const struct io_uring_cqe *cqe)
+{
+	struct io_uring_dio_op *op;
+	unsigned kind, slot, need;
+
+	if ((cqe->user_data & (0xffffULL << 48)) != LIBURING_UDATA_DIO)
+		return 0;
+	kind = (unsigned) (cqe->user_data >> 40) & 0xff;
+	slot = (unsigned) cqe->user_data;
+	op = d->ops[slot];
+
+	switch (kind) {
+	case DIO_KIND_HEAD:
+		need = op->head_skip + op->head_len;
+		break;
+	case DIO_KIND_BODY:
+		need = op->body_len;
+		break;
+	default:
+		need = op->wr ? d->align : op->tail_len;
+		break;
+	}
+
+	if (cqe->res < 0) {
+		if (!op->err)
+			op->err = cqe->res;
+	} else if ((unsigned) cqe->res < need) {
+		if (!op->err)
+			op->err = -EIO;
+	} else if (!op->wr && kind == DIO_KIND_HEAD) {
+		memcpy(op->buf, dio_scratch(d, slot, DIO_KIND_HEAD) +
+			op->head_skip, op->head_len);
+	} else if (!op->wr && kind == DIO_KIND_TAIL) {
+		memcpy((unsigned char *) op->buf + op->head_len +
+			op->body_len, dio_scratch(d, slot, DIO_KIND_TAIL),
+		       op->tail_len);
+	}
+
+	if (--op->pending)
+		return 1;
+	op->res = op->err ? op->err : (int) op->len;
+	d->free_q[d->free_nr++] = slot;
+	return 2;
+}
+
+static __u64 xmeta_udata(unsigned attr, unsigned slot)
+{
+	return LIBURING_UDATA_XMETA | ((__u64) attr << 40) | slot;
+}
+
+static char *xmeta_value_buf(struct io_uring_xmeta *x, unsigned slot,
+			     unsigned attr)
+{
+	return (char *) x->vals +
+	       ((size_t) slot * x->nr_attrs + attr) * x->val_max;
+}
+
+/*
+ * Set up the batch engine for a fixed attr-name list: 'nr_jobs' files
+ * can be in flight at once, each attr value capped at 'val_max' bytes.
+ * 'names' is caller-owned and must outlive the engine.
+ */
+__cold int io_uring_xmeta_init(struct io_uring *ring, struct io_uring_xmeta *x,
+			       const char * const *names, unsigned nr_attrs,
+			       unsigned val_max, unsigned nr_jobs)
+{
+	unsigned i;
+
+	if (!nr_attrs || nr_attrs > IO_URING_XMETA_MAX_ATTRS ||
+	    !val_max || !nr_jobs)
+		return -EINVAL;
+
+	x->vals = uring_ring_malloc(ring, (size_t) nr_jobs * nr_attrs *
+					  val_max);
+	x->jobs = uring_ring_malloc(ring, nr_jobs * sizeof(*x->jobs));
+	x->free_q = uring_ring_malloc(ring, nr_jobs * sizeof(*x->free_q));
+	if (!x->vals || !x->jobs || !x->free_q) {
+		uring_ring_free(ring, x->free_q);
+		uring_ring_free(ring, x->jobs);
+		uring_ring_free(ring, x->vals);
+		return -ENOMEM;
+	}
+	for (i = 0; i < nr_jobs; i++)
+		x->free_q[i] = i;
+
+	x->ring = ring;
+	x->names = names;
+	x->nr_attrs = nr_attrs;
+	x->val_max = val_max;
+	x->free_nr = nr_jobs;
+	x->nr_slots = nr_jobs;
+	return 0;
+}
+
+__cold void io_uring_xmeta_exit(struct io_uring_xmeta *x)
+{
+	uring_ring_free(x->ring, x->free_q);
+	uring_ring_free(x->ring, x->jobs);
+	uring_ring_free(x->ring, x->vals);
+	x->free_q = NULL;
+	x->jobs = NULL;
+	x->vals = NULL;
+}
+
+/*
+ * Fan a file out as one getxattr per configured attr: fgetxattr against
+ * job->fd when it's valid, getxattr against job->path otherwise. 'job'
+ * must stay valid until io_uring_xmeta_cqe() reports it complete.
+ * Returns -ENOSPC with all slots in flight (reap and retry) and -EBUSY
+ * when the SQ can't hold the whole fan-out; submit as usual.
+ */
+int io_uring_xmeta_fetch(struct io_uring_xmeta *x,
+			 struct io_uring_xmeta_job *job)
+{
+	struct io_uring_sqe *sqe;
+	unsigned i, slot;
+
+	if (!x->free_nr)
+		return -ENOSPC;
+	if (io_uring_sq_space_left(x->ring) < x->nr_attrs)
+		return -EBUSY;
+	slot = x->free_q[--x->free_nr];
+	job->pending = x->nr_attrs;
+	job->slot = slot;
+	x->jobs[slot] = job;
+
+	for (i = 0; i < x->nr_attrs; i++) {
+		sqe = io_uring_get_sqe(x->ring);
+		if (job->fd >= 0)
+			io_uring_prep_fgetxattr(sqe, job->fd, x->names[i],
+						xmeta_value_buf(x, slot, i),
+						x->val_max);
+		else
+			io_uring_prep_getxattr(sqe, x->names[i],
+					       xmeta_value_buf(x, slot, i),
+					       job->path, x->val_max);
+		sqe->user_data = xmeta_udata(i, slot);
+	}
+	return 0;
+}
+
+/*
+ * Join a job's fan-out; returns 0 for foreign cqes, 1 while attrs
+ * remain in flight, and 2 when the whole file is done - job->res[]
+ * then holds each attr's value length or error (-ENODATA for an absent
+ * attr, per getxattr). Read the values, then release the slot with
+ * io_uring_xmeta_done().
+ */
+int io_uring_xmeta_cqe(struct io_uring_xmeta *x,
+		       const struct io_uring_cqe *cqe)
+{
+	struct io_uring_xmeta_job *job;
+	unsigned attr, slot;
+
+	if ((cqe->user_data & (0xffffULL << 48)) != LIBURING_UDATA_XMETA)
+		return 0;
+	attr = (unsigned) (cqe->user_data >> 40) & 0xff;
+	slot = (unsigned) cqe->user_data;
+	job = x->jobs[slot];
+
+	job->res[attr] = cqe->res;
+	if (--job->pending)
+		return 1;
+	return 2;
+}
+
+/* the value bytes for attr 'attr' of a completed job */
+const char *io_uring_xmeta_value(struct io_uring_xmeta *x,
+				 const struct io_uring_xmeta_job *job,
+				 unsigned attr)
+{
+	return xmeta_value_buf(x, job->slot, attr);
+}
+
+void io_uring_xmeta_done(struct io_uring_xmeta *x,
+			 struct io_uring_xmeta_job *job)
+{
+	x->free_q[x->free_nr++] = job->slot;
+}
+
+enum {
+	BSTAT_KIND_STAT	= 0,
+	BSTAT_KIND_OPEN	= 1,
+	BSTAT_KIND_CLOSE = 2,
+};
+
+/* struct statx is fixed at 256 bytes by the uapi ABI */
+#define BSTAT_STX_SZ	256
+
+static __u64 bstat_udata(unsigned kind, unsigned slot)
+{
+	return LIBURING_UDATA_BSTAT | ((__u64) kind << 40) | slot;
+}
+
+static unsigned char *bstat_stx(struct io_uring_bstat *b, unsigned slot)
+{
+	return b->stx + (size_t) slot * BSTAT_STX_SZ;
+}
+
+/*
+ * Set up the bulk-stat engine: 'nr_jobs' statx entries can be in
+ * flight at once, all issued with the given statx flags and mask, and
+ * up to 'nr_dirs' directory handles held open for relative lookups.
+ */
+__cold int io_uring_bstat_init(struct io_uring *ring, struct io_uring_bstat *b,
+			       unsigned flags, unsigned mask, unsigned nr_jobs,
+			       unsigned nr_dirs)
+{
+	unsigned i;
+	int ret;
+
+	if (!nr_jobs)
+		return -EINVAL;
+
+	memset(b, 0, sizeof(*b));
+	b->stx = uring_ring_malloc(ring, (size_t) nr_jobs * BSTAT_STX_SZ);
+	b->jobs = uring_ring_malloc(ring, nr_jobs * sizeof(*b->jobs));
+	b->free_q = uring_ring_malloc(ring, nr_jobs * sizeof(*b->free_q));
+	if (nr_dirs) {
+		b->dir_state = uring_ring_malloc(ring, nr_dirs);
+		b->dir_fd = uring_ring_malloc(ring,
+					      nr_dirs * sizeof(*b->dir_fd));
+	}
+	if (!b->stx || !b->jobs || !b->free_q ||
+	    (nr_dirs && (!b->dir_state || !b->dir_fd))) {
+		ret = -ENOMEM;
+		goto err;
+	}
+	if (nr_dirs)
+		memset(b->dir_state, 0, nr_dirs);
+	for (i = 0; i < nr_jobs; i++)
+		b->free_q[i] = i;
+
+	b->ring = ring;
+	b->free_nr = nr_jobs;
+	b->nr_slots = nr_jobs;
+	b->flags = flags;
+	b->mask = mask;
+	b->nr_dirs = nr_dirs;
+	return 0;
+err:
+	uring_ring_free(ring, b->dir_fd);
+	uring_ring_free(ring, b->dir_state);
+	uring_ring_free(ring, b->free_q);
+	uring_ring_free(ring, b->jobs);
+	uring_ring_free(ring, b->stx);
+	return ret;
+}
+
+__cold void io_uring_bstat_exit(struct io_uring_bstat *b)
+{
+	unsigned i;
+
+	for (i = 0; i < b->nr_dirs; i++) {
+		if (b->dir_state[i] == 2)
+			__sys_close(b->dir_fd[i]);
+	}
+	uring_ring_free(b->ring, b->dir_fd);
+	uring_ring_free(b->ring, b->dir_state);
+	uring_ring_free(b->ring, b->free_q);
+	uring_ring_free(b->ring, b->jobs);
+	uring_ring_free(b->ring, b->stx);
+	b->stx = NULL;
+	b->jobs = NULL;
+	b->free_q = NULL;
+	b->dir_state = NULL;
+	b->dir_fd = NULL;
+}
+
+/*
+ * Stage a directory open for relative lookups. Returns the handle; it
+ * becomes usable once its open CQE has passed through
+ * io_uring_bstat_cqe(), poll with io_uring_bstat_dir_ready(). 'path'
+ * must outlive the completion.
+ */
+int io_uring_bstat_opendir(struct io_uring_bstat *b, const char *path)
+{
+	struct io_uring_sqe *sqe;
+	unsigned i;
+
+	for (i = 0; i < b->nr_dirs; i++) {
+		if (!b->dir_state[i])
+			break;
+	}
+	if (i == b->nr_dirs)
+		return -ENOSPC;
+	sqe = io_uring_get_sqe(b->ring);
+	if (!sqe)
+		return -EBUSY;
+	io_uring_prep_openat(sqe, AT_FDCWD, path, O_RDONLY | O_DIRECTORY, 0);
+	sqe->user_data = bstat_udata(BSTAT_KIND_OPEN, i);
+	b->dir_state[i] = 1;
+	b->dir_fd[i] = 0;
+	return (int) i;
+}
+
+/* 1 when usable, 0 while the open is in flight, -errno if it failed */
+int io_uring_bstat_dir_ready(struct io_uring_bstat *b, int dir)
+{
+	if (dir < 0 || (unsigned) dir >= b->nr_dirs)
+		return -EINVAL;
+	if (!b->dir_state[dir] && b->dir_fd[dir] < 0)
+		return b->dir_fd[dir];
+	return b->dir_state[dir] == 2;
+}
+
+/*
+ * Release a directory handle. The slot is reopenable only after the
+ * close CQE is reaped, keeping close and a later open ordered.
+ */
+int io_uring_bstat_closedir(struct io_uring_bstat *b, int dir)
+{
+	struct io_uring_sqe *sqe;
+
+	if (dir < 0 || (unsigned) dir >= b->nr_dirs ||
+	    b->dir_state[dir] != 2)
+		return -EINVAL;
+	sqe = io_uring_get_sqe(b->ring);
+	if (!sqe)
+		return -EBUSY;
+	io_uring_prep_close(sqe, b->dir_fd[dir]);
+	sqe->user_data = bstat_udata(BSTAT_KIND_CLOSE, (unsigned) dir);
+	b->dir_state[dir] = 3;
+	return 0;
+}
+
+/*
+ * Stage one entry: statx of job->name relative to the job->dir
+ * handle's dirfd, or to the cwd for dir -1. The result lands in the
+ * engine's arena; 'job' must
+ * stay valid until io_uring_bstat_cqe() reports it complete. Returns
+ * -ENOSPC with all slots in flight, -EAGAIN while the handle's open is
+ * still in flight, -EBADF for a dead handle and -EBUSY on a full SQ.
+ */
+int io_uring_bstat_stat(struct io_uring_bstat *b,
+			struct io_uring_bstat_job *job)
+{
+	struct io_uring_sqe *sqe;
+	unsigned slot;
+
+	if (!b->free_nr)
+		return -ENOSPC;
+	if (job->dir >= 0) {
+		if ((unsigned) job->dir >= b->nr_dirs)
+			return -EINVAL;
+		if (b->dir_state[job->dir] == 1)
+			return -EAGAIN;
+		if (b->dir_state[job->dir] != 2)
+			return -EBADF;
+	}
+	sqe = io_uring_get_sqe(b->ring);
+	if (!sqe)
+		return -EBUSY;
+	slot = b->free_q[--b->free_nr];
+	job->slot = slot;
+	b->jobs[slot] = job;
+
+	io_uring_prep_statx(sqe,
+			    job->dir >= 0 ? b->dir_fd[job->dir] : AT_FDCWD,
+			    job->name, (int) b->flags, b->mask,
+			    (struct statx *) bstat_stx(b, slot));
+	sqe->user_data = bstat_udata(BSTAT_KIND_STAT, slot);
+	return 0;
+}
+
+/*
+ * Sort an engine cqe: returns 0 for foreign cqes, 1 for engine
+ * bookkeeping (dir opens and closes), and 2 when an entry completes -
+ * job->res holds the statx result and the record is readable through
+ * io_uring_bstat_result() until io_uring_bstat_done() frees the slot.
+ */
+int io_uring_bstat_cqe(struct io_uring_bstat *b,
+		       const struct io_uring_cqe *cqe)
+{
+	struct io_uring_bstat_job *job;
+	unsigned kind, idx;
+
+	if ((cqe->user_data & (0xffffULL << 48)) != LIBURING_UDATA_BSTAT)
+		return 0;
+	kind = (unsigned) (cqe->user_data >> 40) & 0xff;
+	idx = (unsigned) cqe->user_data;
+
+	switch (kind) {
+	case BSTAT_KIND_OPEN:
+		b->dir_fd[idx] = cqe->res;
+		b->dir_state[idx] = cqe->res < 0 ? 0 : 2;
+		return 1;
+	case BSTAT_KIND_CLOSE:
+		b->dir_state[idx] = 0;
+		return 1;
+	default:
+		job = b->jobs[idx];
+		job->res = cqe->res;
+		return 2;
+	}
+}
+
+const struct statx *io_uring_bstat_result(struct io_uring_bstat *b,
+					  const struct io_uring_bstat_job *job)
+{
+	return (const struct statx *) bstat_stx(b, job->slot);
+}
+
+void io_uring_bstat_done(struct io_uring_bstat *b,
+			 struct io_uring_bstat_job *job)
+{
+	b->free_q[b->free_nr++] = job->slot;
+}
+
+/*
+ * Drive a burst of file preallocations through the ring: each spec is
+ * an fallocate (or, with IORING_FILE_PREP_TRUNCATE, an ftruncate to
+ * 'len') and at most 'depth' of them are in flight at once, turning a
+ * serial preallocation storm into one overlapped flight. results[i]
+ * receives each spec's completion result; the call returns the number
+ * of failed specs, 0 when everything succeeded, or a negative error
+ * from driving the ring itself. Rollback of partial failures stays
+ * with the caller - the result vector says exactly which specs need
+ * it. The ring must have no unreaped completions in flight.
+ */
+int io_uring_file_prep_batch(struct io_uring *ring,
+			     const struct io_uring_file_prep *specs,
+			     int *results, unsigned nr, unsigned depth)
+{
+	unsigned staged = 0, done = 0, failed = 0;
+	struct io_uring_sqe *sqe;
+	struct io_uring_cqe *cqe;
+	int ret;
+
+	if (!nr || !depth)
+		return -EINVAL;
+
+	while (done < nr) {
+		while (staged < nr && staged - done < depth) {
+			sqe = io_uring_get_sqe(ring);
+			if (!sqe)
+				break;
+			if (specs[staged].mode == IORING_FILE_PREP_TRUNCATE)
+				io_uring_prep_ftruncate(sqe, specs[staged].fd,
+							(loff_t) specs[staged].len);
+			else
+				io_uring_prep_fallocate(sqe, specs[staged].fd,
+							specs[staged].mode,
+							specs[staged].offset,
+							specs[staged].len);
+			sqe->user_data = staged;
+			staged++;
+		}
+		ret = io_uring_submit_and_wait(ring, 1);
+		if (ret < 0 && ret != -EINTR)
+			return ret;
+		while (!io_uring_peek_cqe(ring, &cqe)) {
+			results[cqe->user_data] = cqe->res;
+			if (cqe->res < 0)
+				failed++;
+			io_uring_cqe_seen(ring, cqe);
+			done++;
+		}
+	}
+	return (int) failed;
+}
+
+enum {
+	RA_KIND_PROBE	= 0,
+	RA_KIND_READ	= 1,
+	RA_KIND_FADVISE	= 2,
+};
+
+static __u64 ra_udata(unsigned kind, unsigned slot)
+{
+	return LIBURING_UDATA_RA | ((__u64) kind << 40) | slot;
+}
+
+static struct io_uring_sqe *ra_get_sqe(struct io_uring_ra *ra)
+{
+	struct io_uring_sqe *sqe;
+
+	sqe = io_uring_get_sqe(ra->ring);
+	if (!sqe) {
+		io_uring_submit(ra->ring);
+		sqe = io_uring_get_sqe(ra->ring);
+	}
+	return sqe;
+}
+
+__cold int io_uring_ra_init(struct io_uring *ring, struct io_uring_ra *ra,
+		     unsigned nr_ops,
+		     unsigned (*fallback)(struct io_uring_ra *ra,
+					  struct io_uring_ra_op *op),
+		     void *cb_data)
+{
+	unsigned i;
+
+	if (!nr_ops)
+		return -EINVAL;
+	ra->ops = uring_ring_malloc(ring, nr_ops * sizeof(*ra->ops));
+	ra->free_q = uring_ring_malloc(ring, nr_ops * sizeof(*ra->free_q));
+	if (!ra->ops || !ra->free_q) {
+		uring_ring_free(ring, ra->ops);
+		uring_ring_free(ring, ra->free_q);
+		return -ENOMEM;
+	}
+	for (i = 0; i < nr_ops; i++)
+		ra->free_q[i] = i;
+	ra->ring = ring;
+	ra->free_nr = nr_ops;
+	ra->nr_slots = nr_ops;
+	ra->fallback = fallback;
+	ra->cb_data = cb_data;
+	memset(&ra->stats, 0, sizeof(ra->stats));
+	return 0;
+}
+
+__cold void io_uring_ra_exit(struct io_uring_ra *ra)
+{
+	uring_ring_free(ra->ring, ra->ops);
+	uring_ring_free(ra->ring, ra->free_q);
+	ra->ops = NULL;
+	ra->free_q = NULL;
+}
+
+/*
+ * Stage the nonblocking probe for (fd, off, len) into 'buf'. 'op' must
+ * stay valid until io_uring_ra_cqe() reports it complete. Returns
+ * -ENOSPC with all op slots in flight; submit as usual.
+ */
+int io_uring_ra_read(struct io_uring_ra *ra, struct io_uring_ra_op *op,
+		     int fd, void *buf, unsigned len, __u64 off)
+{
+	struct io_uring_sqe *sqe;
+	unsigned slot;
+
+	if (!len)
+		return -EINVAL;
+	if (!ra->free_nr)
+		return -ENOSPC;
+	sqe = ra_get_sqe(ra);
+	if (!sqe)
+		return -EBUSY;
+	slot = ra->free_q[--ra->free_nr];
+	op->buf = buf;
+	op->off = off;
+	op->len = len;
+	op->fd = fd;
+	op->slot = slot;
+	op->iov.iov_base = buf;
+	op->iov.iov_len = len;
+	ra->ops[slot] = op;
+
+	io_uring_prep_readv2(sqe, fd, &op->iov, 1, (__u64) off, RWF_NOWAIT);
+	sqe->user_data = ra_udata(RA_KIND_PROBE, slot);
+	ra->stats.probes++;
+	return 0;
+}
+
+/*
+ * Feed one reaped completion through the orchestrator; returns 0 for
+ * foreign cqes, 1 while the operation continues (a miss being punted,
+ * or an fadvise hint retiring), and 2 when it completes with op->res
+ * holding the read result. A cache hit completes on the probe itself;
+ * on -EAGAIN the fallback policy picks any of IORING_RA_FALLBACK_READ
+ * and IORING_RA_FADVISE - with only the hint selected the operation
+ * completes as -EAGAIN for the caller to retry once warmed.
+ */
+int io_uring_ra_cqe(struct io_uring_ra *ra, const struct io_uring_cqe *cqe)
+{
+	struct io_uring_sqe *sqe;
+	struct io_uring_ra_op *op;
+	unsigned kind, slot, actions;
+
+	if ((cqe->user_data & (0xffffULL << 48)) != LIBURING_UDATA_RA)
+		return 0;
+	kind = (unsigned) (cqe->user_data >> 40) & 0xff;
+	slot = (unsigned) cqe->user_data;
+
+	if (kind == RA_KIND_FADVISE)
+		return 1;
+	op = ra->ops[slot];
+
+	if (kind == RA_KIND_PROBE && cqe->res == -EAGAIN) {
+		ra->stats.misses++;
+		actions = ra->fallback ? ra->fallback(ra, op) :
+			  (IORING_RA_FALLBACK_READ | IORING_RA_FADVISE);
+		if (actions & IORING_RA_FADVISE) {
+			sqe = ra_get_sqe(ra);
+			if (sqe) {
+				io_uring_prep_fadvise(sqe, op->fd,
+						      (__u64) op->off, op->len,
+						      POSIX_FADV_WILLNEED);
+				sqe->user_data = ra_udata(RA_KIND_FADVISE,
+							  slot);
+				ra->stats.hints++;
+			}
+		}
+		if (actions & IORING_RA_FALLBACK_READ) {
+			sqe = ra_get_sqe(ra);
+			if (sqe) {
+				io_uring_prep_read(sqe, op->fd, op->buf,
+						   op->len, op->off);
+				sqe->user_data = ra_udata(RA_KIND_READ, slot);
+				ra->stats.fallbacks++;
+				return 1;
+			}
+			op->res = -EBUSY;
+		} else {
+			op->res = -EAGAIN;
+		}
+	} else {
+		if (kind == RA_KIND_PROBE && cqe->res >= 0)
+			ra->stats.hits++;
+		op->res = cqe->res;
+	}
+	ra->free_q[ra->free_nr++] = slot;
+	return 2;
+}
+
+__cold int io_uring_barrier_init(struct io_uring *ring,
+				 struct io_uring_barrier *b,
+				 unsigned max_fds, unsigned depth)
+{
+	struct io_uring_barrier_write *slab;
+	unsigned i;
+
+	if (!max_fds || !depth)
+		return -EINVAL;
+	b->fds = uring_ring_malloc(ring, max_fds * sizeof(*b->fds) +
+			max_fds * depth * sizeof(*slab));
+	if (!b->fds)
+		return -ENOMEM;
+	slab = (struct io_uring_barrier_write *) (b->fds + max_fds);
+	for (i = 0; i < max_fds; i++) {
+		b->fds[i].writes = slab + i * depth;
+		b->fds[i].nr = 0;
+	}
+	b->ring = ring;
+	b->nr_fds = 0;
+	b->max_fds = max_fds;
+	b->depth = depth;
+	return 0;
+}
+
+__cold void io_uring_barrier_exit(struct io_uring_barrier *b)
+{
+	uring_ring_free(b->ring, b->fds);
+	b->fds = NULL;
+}
+
+static struct io_uring_barrier_fd *barrier_bucket(struct io_uring_barrier *b,
+						  int fd)
+{
+	unsigned i;
+
+	for (i = 0; i < b->nr_fds; i++)
+		if (b->fds[i].fd == fd)
+			return &b->fds[i];
+	return NULL;
+}
+
+/*
+ * Record one write for 'fd'; nothing is staged until the fd's barrier
+ * is emitted. 'buf' must stay valid until then. Returns -ENOSPC when
+ * the fd already holds 'depth' writes and -ENFILE with 'max_fds'
+ * distinct fds in play - emit a barrier to make room.
+ */
+int io_uring_barrier_write(struct io_uring_barrier *b, int fd,
+			   const void *buf, unsigned len, __u64 off,
+			   __u64 user_data)
+{
+	struct io_uring_barrier_fd *bf;
+	struct io_uring_barrier_write *w;
+
+	bf = barrier_bucket(b, fd);
+	if (!bf) {
+		if (b->nr_fds == b->max_fds)
+			return -ENFILE;
+		bf = &b->fds[b->nr_fds++];
+		bf->fd = fd;
+	}
+	if (bf->nr == b->depth)
+		return -ENOSPC;
+	w = &bf->writes[bf->nr++];
+	w->user_data = user_data;
+	w->buf = buf;
+	w->off = off;
+	w->len = len;
+	return 0;
+}
+
+/*
+ * Stage the recorded writes for 'fd' as a link chain terminated by an
+ * fsync, scoping the ordering to this file instead of draining the
+ * ring. The chain must land in one submission, so -EBUSY is returned
+ * if the sq cannot hold it even after a flush. A failed write breaks
+ * the link and the fsync then completes with -ECANCELED rather than
+ * falsely acknowledging durability. Returns the number of sqes staged;
+ * with no writes recorded that is a bare, unordered fsync.
+ */
+int io_uring_barrier_fsync(struct io_uring_barrier *b, int fd,
+			   unsigned fsync_flags, __u64 user_data)
+{
+	struct io_uring_barrier_fd *bf;
+	struct io_uring_barrier_write *w;
+	struct io_uring_sqe *sqe;
+	unsigned i, nr = 0;
+
+	bf = barrier_bucket(b, fd);
+	if (bf)
+		nr = bf->nr;
+	if (io_uring_sq_space_left(b->ring) < nr + 1) {
+		int ret = io_uring_submit(b->ring);
+
+		if (ret < 0)
+			return ret;
+		if (io_uring_sq_space_left(b->ring) < nr + 1)
+			return -EBUSY;
+	}
+	for (i = 0; i < nr; i++) {
+		w = &bf->writes[i];
+		sqe = io_uring_get_sqe(b->ring);
+		io_uring_prep_write(sqe, fd, w->buf, w->len, w->off);
+		sqe->flags |= IOSQE_IO_LINK;
+		sqe->user_data = w->user_data;
+	}
+	sqe = io_uring_get_sqe(b->ring);
+	io_uring_prep_fsync(sqe, fd, fsync_flags);
+	sqe->user_data = user_data;
+	if (bf)
+		bf->nr = 0;
+	return nr + 1;
+}
+
+/*
+ * Stage the teardown sweep for fixed-file slot 'slot': cancel
+ * everything in flight on the slot, then close it, as one link chain.
+ * The cancel side completes with 'user_data', the close with bit 63
+ * flipped. Returns -EBUSY if the sq cannot hold the pair after one
+ * flush; 'sw' must stay valid until io_uring_sweep_cqe() reports
+ * completion.
+ */
+int io_uring_sweep_close(struct io_uring *ring, struct io_uring_sweep *sw,
+			 unsigned slot, __u64 user_data)
+{
+	struct io_uring_sqe *sqe;
+
+	if (io_uring_sq_space_left(ring) < 2) {
+		int ret = io_uring_submit(ring);
+
+		if (ret < 0)
+			return ret;
+		if (io_uring_sq_space_left(ring) < 2)
+			return -EBUSY;
+	}
+	sw->udata = user_data;
+	sw->slot = slot;
+	sw->canceled = 0;
+	sw->close_res = 0;
+	sw->seen = 0;
+
+	sqe = io_uring_get_sqe(ring);
+	io_uring_prep_cancel_fd(sqe, (int) slot, IORING_ASYNC_CANCEL_FD_FIXED |
+						 IORING_ASYNC_CANCEL_ALL);
+	sqe->flags |= IOSQE_IO_LINK;
+	sqe->user_data = user_data;
+
+	sqe = io_uring_get_sqe(ring);
+	io_uring_prep_close_direct(sqe, slot);
+	sqe->user_data = user_data ^ (1ULL << 63);
+	return 0;
+}
+
+/*
+ * Feed one reaped completion through the sweep; returns 0 for foreign
+ * cqes, 1 with half the pair seen and 2 once the slot is closed -
+ * sw->canceled then holds the number of ops the cancel swept (each of
+ * which posted its own -ECANCELED cqe) and sw->close_res the close
+ * result.
+ */
+int io_uring_sweep_cqe(struct io_uring_sweep *sw,
+		       const struct io_uring_cqe *cqe)
+{
+	if (cqe->user_data == sw->udata)
+		sw->canceled = cqe->res;
+	else if (cqe->user_data == (sw->udata ^ (1ULL << 63)))
+		sw->close_res = cqe->res;
+	else
+		return 0;
+	return ++sw->seen == 2 ? 2 : 1;
+}
+
+__cold int io_uring_wcoal_init(struct io_uring *ring, struct io_uring_wcoal *wc,
+			       unsigned max_fds, unsigned depth,
+			       unsigned watermark, __u64 udata)
+{
+	struct io_uring_wcoal_run *runs;
+	struct iovec *iovs;
+	unsigned i;
+
+	if (!max_fds || !depth || !watermark || watermark > depth)
+		return -EINVAL;
+	wc->fds = uring_ring_malloc(ring, max_fds * (sizeof(*wc->fds) +
+				    depth * (sizeof(*runs) + sizeof(*iovs))));
+	if (!wc->fds)
+		return -ENOMEM;
+	runs = (struct io_uring_wcoal_run *) (wc->fds + max_fds);
+	iovs = (struct iovec *) (runs + max_fds * depth);
+	for (i = 0; i < max_fds; i++) {
+		wc->fds[i].runs = runs + i * depth;
+		wc->fds[i].iovs = iovs + i * depth;
+		wc->fds[i].nr_runs = 0;
+		wc->fds[i].nr_iovs = 0;
+	}
+	wc->ring = ring;
+	wc->nr_fds = 0;
+	wc->max_fds = max_fds;
+	wc->depth = depth;
+	wc->watermark = watermark;
+	wc->udata = udata;
+	return 0;
+}
+
+__cold void io_uring_wcoal_exit(struct io_uring_wcoal *wc)
+{
+	uring_ring_free(wc->ring, wc->fds);
+	wc->fds = NULL;
+}
+
+static unsigned wcoal_run_len(const struct io_uring_wcoal_run *run,
+			      const struct io_uring_wcoal_fd *wf)
+{
+	unsigned i, len = 0;
+
+	for (i = 0; i < run->iov_nr; i++)
+		len += wf->iovs[run->iov_idx + i].iov_len;
+	return len;
+}
+
+static struct io_uring_wcoal_fd *wcoal_bucket(struct io_uring_wcoal *wc,
+					      int fd)
+{
+	unsigned i;
+
+	for (i = 0; i < wc->nr_fds; i++)
+		if (wc->fds[i].fd == fd)
+			return &wc->fds[i];
+	return NULL;
+}
+
+/* stage one writev per run; sq space was checked by the caller */
+static unsigned wcoal_stage(struct io_uring_wcoal *wc,
+			    struct io_uring_wcoal_fd *wf, unsigned char flags)
+{
+	struct io_uring_sqe *sqe;
+	unsigned i;
+
+	for (i = 0; i < wf->nr_runs; i++) {
+		struct io_uring_wcoal_run *run = &wf->runs[i];
+
+		sqe = io_uring_get_sqe(wc->ring);
+		io_uring_prep_writev(sqe, wf->fd, &wf->iovs[run->iov_idx],
+				     run->iov_nr, run->off);
+		sqe->flags |= flags;
+		sqe->user_data = wc->udata;
+	}
+	i = wf->nr_runs;
+	wf->nr_runs = 0;
+	wf->nr_iovs = 0;
+	return i;
+}
+
+/*
+ * Stage this fd's merged runs and submit, publishing the batch in one
+ * sq flush; the iovec pool is reusable once this returns. Returns the
+ * number of coalesced writev sqes, or -EBUSY if the sq cannot hold
+ * them even after a flush of its backlog.
+ */
+int io_uring_wcoal_flush(struct io_uring_wcoal *wc, int fd)
+{
+	struct io_uring_wcoal_fd *wf;
+	unsigned nr;
+	int ret;
+
+	wf = wcoal_bucket(wc, fd);
+	if (!wf || !wf->nr_runs)
+		return 0;
+	if (io_uring_sq_space_left(wc->ring) < wf->nr_runs) {
+		ret = io_uring_submit(wc->ring);
+		if (ret < 0)
+			return ret;
+		if (io_uring_sq_space_left(wc->ring) < wf->nr_runs)
+			return -EBUSY;
+	}
+	nr = wcoal_stage(wc, wf, 0);
+	ret = io_uring_submit(wc->ring);
+	if (ret < 0)
+		return ret;
+	return nr;
+}
+
+/*
+ * Buffer one write for 'fd', merging it into the previous run when its
+ * offset continues that run's extent. 'buf' must stay valid until the
+ * fd is flushed. Returns 0 while buffering, the flush result once the
+ * watermark tips the fd over, -ENFILE with 'max_fds' distinct fds in
+ * play.
+ */
+int io_uring_wcoal_write(struct io_uring_wcoal *wc, int fd, const void *buf,
+			 unsigned len, __u64 off)
+{
+	struct io_uring_wcoal_fd *wf;
+	struct io_uring_wcoal_run *run;
+	struct iovec *iov;
+
+	if (!len)
+		return -EINVAL;
+	wf = wcoal_bucket(wc, fd);
+	if (!wf) {
+		if (wc->nr_fds == wc->max_fds)
+			return -ENFILE;
+		wf = &wc->fds[wc->nr_fds++];
+		wf->fd = fd;
+	}
+	iov = &wf->iovs[wf->nr_iovs];
+	iov->iov_base = (void *) (uintptr_t) buf;
+	iov->iov_len = len;
+	run = wf->nr_runs ? &wf->runs[wf->nr_runs - 1] : NULL;
+	if (run && run->off + wcoal_run_len(run, wf) == off) {
+		run->iov_nr++;
+	} else {
+		run = &wf->runs[wf->nr_runs++];
+		run->off = off;
+		run->iov_idx = wf->nr_iovs;
+		run->iov_nr = 1;
+	}
+	wf->nr_iovs++;
+	if (wf->nr_iovs >= wc->watermark)
+		return io_uring_wcoal_flush(wc, fd);
+	return 0;
+}
+
+/*
+ * Durability point: flush the fd's runs as a link chain terminated by
+ * an fsync, then submit. Ordering stays scoped to this fd - no
+ * IOSQE_IO_DRAIN. Returns the number of sqes staged including the
+ * fsync, or -EBUSY as for io_uring_wcoal_flush().
+ */
+int io_uring_wcoal_fsync(struct io_uring_wcoal *wc, int fd,
+			 unsigned fsync_flags, __u64 user_data)
+{
+	struct io_uring_wcoal_fd *wf;
+	struct io_uring_sqe *sqe;
+	unsigned nr = 0;
+	int ret;
+
+	wf = wcoal_bucket(wc, fd);
+	if (wf)
+		nr = wf->nr_runs;
+	if (io_uring_sq_space_left(wc->ring) < nr + 1) {
+		ret = io_uring_submit(wc->ring);
+		if (ret < 0)
+			return ret;
+		if (io_uring_sq_space_left(wc->ring) < nr + 1)
+			return -EBUSY;
+	}
+	if (nr)
+		wcoal_stage(wc, wf, IOSQE_IO_LINK);
+	sqe = io_uring_get_sqe(wc->ring);
+	io_uring_prep_fsync(sqe, fd, fsync_flags);
+	sqe->user_data = user_data;
+	ret = io_uring_submit(wc->ring);
+	if (ret < 0)
+		return ret;
+	return nr + 1;
+}
+
+enum {
+	ORC_KIND_OPEN	= 0,
+	ORC_KIND_READ	= 1,
+	ORC_KIND_CLOSE	= 2,
+};
+
+static __u64 orc_udata(unsigned kind, unsigned slot)
+{
+	return LIBURING_UDATA_ORC | ((__u64) kind << 40) | slot;
+}
+
+__cold int io_uring_openread_init(struct io_uring *ring,
+				  struct io_uring_openread *orc,
+				  unsigned nr_slots, int dfd)
+{
+	unsigned i;
+	int ret;
+
+	if (!nr_slots)
+		return -EINVAL;
+	ret = io_uring_register_files_sparse(ring, nr_slots);
+	if (ret)
+		return ret;
+	orc->ops = uring_ring_malloc(ring, nr_slots * sizeof(*orc->ops));
+	orc->free_q = uring_ring_malloc(ring, nr_slots * sizeof(*orc->free_q));
+	if (!orc->ops || !orc->free_q) {
+		uring_ring_free(ring, orc->ops);
+		uring_ring_free(ring, orc->free_q);
+		io_uring_unregister_files(ring);
+		return -ENOMEM;
+	}
+	for (i = 0; i < nr_slots; i++)
+		orc->free_q[i] = i;
+	orc->ring = ring;
+	orc->free_nr = nr_slots;
+	orc->nr_slots = nr_slots;
+	orc->dfd = dfd;
+	return 0;
+}
+
+__cold void io_uring_openread_exit(struct io_uring_openread *orc)
+{
+	io_uring_unregister_files(orc->ring);
+	uring_ring_free(orc->ring, orc->ops);
+	uring_ring_free(orc->ring, orc->free_q);
+	orc->ops = NULL;
+	orc->free_q = NULL;
+}
+
+/*
+ * Stage the openat_direct -> read -> close_direct chain for 'path'.
+ * 'op' and 'path' must stay valid until io_uring_openread_cqe()
+ * reports completion. Returns -ENOSPC with every slot in flight, and
+ * -EBUSY if the sq cannot hold the three-sqe chain even after a flush
+ * (the chain must land in one submission to stay linked).
+ */
+int io_uring_openread(struct io_uring_openread *orc,
+		      struct io_uring_openread_op *op, const char *path,
+		      void *buf, unsigned len, __u64 off)
+{
+	struct io_uring_sqe *sqe;
+	unsigned slot;
+
+	if (!orc->free_nr)
+		return -ENOSPC;
+	if (io_uring_sq_space_left(orc->ring) < 3) {
+		int ret = io_uring_submit(orc->ring);
+
+		if (ret < 0)
+			return ret;
+		if (io_uring_sq_space_left(orc->ring) < 3)
+			return -EBUSY;
+	}
+	slot = orc->free_q[--orc->free_nr];
+	op->path = path;
+	op->buf = buf;
+	op->off = off;
+	op->len = len;
+	op->slot = slot;
+	op->pending = 3;
+	op->opened = 0;
+	op->res = 0;
+	orc->ops[slot] = op;
+
+	sqe = io_uring_get_sqe(orc->ring);
+	io_uring_prep_openat_direct(sqe, orc->dfd, path, O_RDONLY, 0, slot);
+	sqe->flags |= IOSQE_IO_LINK;
+	sqe->user_data = orc_udata(ORC_KIND_OPEN, slot);
+
+	sqe = io_uring_get_sqe(orc->ring);
+	io_uring_prep_read(sqe, slot, buf, len, off);
+	sqe->flags |= IOSQE_FIXED_FILE | IOSQE_IO_LINK;
+	sqe->user_data = orc_udata(ORC_KIND_READ, slot);
+
+	sqe = io_uring_get_sqe(orc->ring);
+	io_uring_prep_close_direct(sqe, slot);
+	sqe->user_data = orc_udata(ORC_KIND_CLOSE, slot);
+	return 0;
+}
+
+/*
+ * Feed one reaped completion through the pipeline; returns 0 for
+ * foreign cqes, 1 while chain cqes are still outstanding and 2 once
+ * the slot has been reclaimed, with op->res holding the bytes read or
+ * the first error. A short read of a small file breaks the link and
+ * cancels the close, so the pipeline restages close_direct itself to
+ * keep the slot from leaking.
+ */
+int io_uring_openread_cqe(struct io_uring_openread *orc,
+			  const struct io_uring_cqe *cqe)
+{
+	struct io_uring_openread_op *op;
+	struct io_uring_sqe *sqe;
+	unsigned kind, slot;
+
+	if ((cqe->user_data & (0xffffULL << 48)) != LIBURING_UDATA_ORC)
+		return 0;
+	kind = (unsigned) (cqe->user_data >> 40) & 0xff;
+	slot = (unsigned) cqe->user_data;
+	op = orc->ops[slot];
+
+	switch (kind) {
+	case ORC_KIND_OPEN:
+		if (cqe->res < 0)
+			op->res = cqe->res;
+		else
+			op->opened = 1;
+		break;
+	case ORC_KIND_READ:
+		if (!op->res)
+			op->res = cqe->res;
+		break;
+	case ORC_KIND_CLOSE:
+		if (cqe->res == -ECANCELED && op->opened) {
+			/* link broken upstream; the slot still holds a file */
+			sqe = io_uring_get_sqe(orc->ring);
+			if (!sqe) {
+				io_uring_submit(orc->ring);
+				sqe = io_uring_get_sqe(orc->ring);
+			}
+			io_uring_prep_close_direct(sqe, slot);
+			sqe->user_data = orc_udata(ORC_KIND_CLOSE, slot);
+			return 1;
+		}
+		break;
+	}
+	if (--op->pending)
+		return 1;
+	orc->free_q[orc->free_nr++] = slot;
+	return 2;
+}
+
+/*
+ * Stage the file-swap chain in one call: ftruncate the standby file,
+ * optionally fallocate it to 'prealloc_len', fsync it, rename
+ * 'new_path' over 'old_path' (both relative to 'dir_fd'), fsync the
+ * directory. Step user_datas are user_data ^ step-index, so the chain
+ * claims the eight user_data values differing only in the low three
+ * bits. Nothing is staged without room for the whole chain; submit as
+ * usual and feed completions to io_uring_file_swap_cqe(). Paths must
+ * outlive the completions.
+ */
+
+/* FALLOC_FL_KEEP_SIZE without dragging in falloc.h for nolibc builds */
+#define FSWAP_FALLOC_KEEP_SIZE	0x01
+
+int io_uring_prep_file_swap(struct io_uring *ring,
+			    struct io_uring_file_swap *fs, int new_fd,
+			    __u64 prealloc_len, int dir_fd,
+			    const char *new_path, const char *old_path,
+			    __u64 user_data)
+{
+	struct io_uring_sqe *sqe;
+	unsigned nr = prealloc_len ? 5 : 4, step = 0;
+
+	if (io_uring_sq_space_left(ring) < nr)
+		return -EBUSY;
+
+	sqe = io_uring_get_sqe(ring);
+	io_uring_prep_ftruncate(sqe, new_fd, 0);
+	sqe->flags |= IOSQE_IO_LINK;
+	sqe->user_data = user_data ^ step++;
+
+	if (prealloc_len) {
+		sqe = io_uring_get_sqe(ring);
+		/* KEEP_SIZE: blocks reserved, the fresh log still reads empty */
+		io_uring_prep_fallocate(sqe, new_fd, FSWAP_FALLOC_KEEP_SIZE, 0,
+					prealloc_len);
+		sqe->flags |= IOSQE_IO_LINK;
+		sqe->user_data = user_data ^ step++;
+	}
+
+	sqe = io_uring_get_sqe(ring);
+	io_uring_prep_fsync(sqe, new_fd, 0);
+	sqe->flags |= IOSQE_IO_LINK;
+	sqe->user_data = user_data ^ step++;
+
+	sqe = io_uring_get_sqe(ring);
+	io_uring_prep_renameat(sqe, dir_fd, new_path, dir_fd, old_path, 0);
+	sqe->flags |= IOSQE_IO_LINK;
+	sqe->user_data = user_data ^ step++;
+
+	sqe = io_uring_get_sqe(ring);
+	io_uring_prep_fsync(sqe, dir_fd, 0);
+	sqe->user_data = user_data ^ step;
+
+	fs->udata = user_data;
+	fs->res = 0;
+	fs->failed_step = -1;
+	fs->nr_steps = nr;
+	fs->seen = 0;
+	return 0;
+}
+
+/*
+ * Feed reaped completions through the decoder. Returns 0 for foreign
+ * cqes, 1 while chain steps are still outstanding, and 2 once all have
+ * arrived - fs->res then holds 0 for a fully persisted swap or the
+ * first real failure, with fs->failed_step naming the step; the
+ * -ECANCELED cascade from a mid-chain failure never masks the root
+ * cause. Don't reuse 'fs' or the paths before seeing 2.
+ */
+int io_uring_file_swap_cqe(struct io_uring_file_swap *fs,
+			   const struct io_uring_cqe *cqe)
+{
+	__u64 step = cqe->user_data ^ fs->udata;
+
+	if (step >= fs->nr_steps)
+		return 0;
+	fs->seen |= 1U << step;
+	if (cqe->res < 0 && cqe->res != -ECANCELED && fs->failed_step < 0) {
+		fs->res = cqe->res;
+		fs->failed_step = (int) step;
+	}
+	return fs->seen == (1U << fs->nr_steps) - 1 ? 2 : 1;
+}
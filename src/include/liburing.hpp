@@ -0,0 +1,288 @@
+/* SPDX-License-Identifier: MIT */
+#ifndef LIB_URING_HPP
+#define LIB_URING_HPP
+
+#if !defined(__cplusplus) || __cplusplus < 202002L
+#error "liburing.hpp requires C++20"
+#endif
+
+#include <liburing.h>
+#include <cstddef>
+#include <span>
+#include <utility>
+
+/*
+ * Thin RAII bindings over the C API. Every method is a one-line inline
+ * forward to the corresponding C call - same codegen, no extra state
+ * beyond the wrapped C structs - so these types only add ownership:
+ * handles are move-only, teardown happens in the destructor, and CQE
+ * results come back through io_uring_result instead of raw negative
+ * errno. The batch idioms (for_each reap, buf-ring recycle) are methods
+ * so the fast path is also the obvious one.
+ */
+
+/* cqe->res (or any negative-errno return) as an expected-style value */
+class io_uring_result {
+public:
+	constexpr explicit io_uring_result(int res) : res_(res) {}
+
+	constexpr bool ok() const { return res_ >= 0; }
+	constexpr explicit operator bool() const { return ok(); }
+	/* valid when ok(): byte count, fd, or opcode-specific value */
+	constexpr int value() const { return res_; }
+	/* valid when !ok(): positive errno */
+	constexpr int error() const { return -res_; }
+	/* the raw C convention, for passing through untranslated */
+	constexpr int raw() const { return res_; }
+
+private:
+	int res_;
+};
+
+/*
+ * Span overloads of the prep helpers; the (pointer, length) pair comes
+ * from one object so they can't disagree. They resolve alongside the C
+ * inlines and compile to the same calls.
+ */
+inline void io_uring_prep_read(struct io_uring_sqe *sqe, int fd,
+			       std::span<std::byte> buf, __u64 offset)
+{
+	io_uring_prep_read(sqe, fd, buf.data(), (unsigned) buf.size(), offset);
+}
+
+inline void io_uring_prep_write(struct io_uring_sqe *sqe, int fd,
+				std::span<const std::byte> buf, __u64 offset)
+{
+	io_uring_prep_write(sqe, fd, buf.data(), (unsigned) buf.size(), offset);
+}
+
+inline void io_uring_prep_recv(struct io_uring_sqe *sqe, int sockfd,
+			       std::span<std::byte> buf, int flags)
+{
+	io_uring_prep_recv(sqe, sockfd, buf.data(), buf.size(), flags);
+}
+
+inline void io_uring_prep_send(struct io_uring_sqe *sqe, int sockfd,
+			       std::span<const std::byte> buf, int flags)
+{
+	io_uring_prep_send(sqe, sockfd, buf.data(), buf.size(), flags);
+}
+
+inline void io_uring_prep_readv(struct io_uring_sqe *sqe, int fd,
+				std::span<const struct iovec> iov, __u64 offset)
+{
+	io_uring_prep_readv(sqe, fd, iov.data(), (unsigned) iov.size(), offset);
+}
+
+inline void io_uring_prep_writev(struct io_uring_sqe *sqe, int fd,
+				 std::span<const struct iovec> iov, __u64 offset)
+{
+	io_uring_prep_writev(sqe, fd, iov.data(), (unsigned) iov.size(), offset);
+}
+
+/* move-only owner of a ring; init() then check valid() */
+class io_uring_ring {
+public:
+	io_uring_ring() = default;
+
+	~io_uring_ring()
+	{
+		if (init_)
+			io_uring_queue_exit(&ring_);
+	}
+
+	io_uring_ring(const io_uring_ring &) = delete;
+	io_uring_ring &operator=(const io_uring_ring &) = delete;
+
+	io_uring_ring(io_uring_ring &&o) noexcept
+		: ring_(o.ring_), init_(std::exchange(o.init_, false)) {}
+
+	io_uring_ring &operator=(io_uring_ring &&o) noexcept
+	{
+		if (this != &o) {
+			if (init_)
+				io_uring_queue_exit(&ring_);
+			ring_ = o.ring_;
+			init_ = std::exchange(o.init_, false);
+		}
+		return *this;
+	}
+
+	io_uring_result init(unsigned entries, unsigned flags = 0)
+	{
+		int ret = io_uring_queue_init(entries, &ring_, flags);
+
+		init_ = ret == 0;
+		return io_uring_result(ret);
+	}
+
+	io_uring_result init(unsigned entries, struct io_uring_params &p)
+	{
+		int ret = io_uring_queue_init_params(entries, &ring_, &p);
+
+		init_ = ret == 0;
+		return io_uring_result(ret);
+	}
+
+	bool valid() const { return init_; }
+	struct io_uring *get() { return &ring_; }
+	struct io_uring *operator->() { return &ring_; }
+
+	struct io_uring_sqe *get_sqe() { return io_uring_get_sqe(&ring_); }
+
+	io_uring_result submit()
+	{
+		return io_uring_result(io_uring_submit(&ring_));
+	}
+
+	io_uring_result submit_and_wait(unsigned wait_nr)
+	{
+		return io_uring_result(io_uring_submit_and_wait(&ring_, wait_nr));
+	}
+
+	io_uring_result wait(struct io_uring_cqe **cqe)
+	{
+		return io_uring_result(io_uring_wait_cqe(&ring_, cqe));
+	}
+
+	void seen(struct io_uring_cqe *cqe) { io_uring_cqe_seen(&ring_, cqe); }
+
+	/*
+	 * Batch reap: hand every ready CQE to 'fn' as (user_data, result)
+	 * and release them in one cq_advance. Returns the number reaped.
+	 */
+	template <typename Fn>
+	unsigned for_each_cqe(Fn &&fn)
+	{
+		struct io_uring_cqe *cqe;
+		unsigned head, seen = 0;
+
+		io_uring_for_each_cqe(&ring_, head, cqe) {
+			seen++;
+			fn(io_uring_cqe_get_data64(cqe),
+			   io_uring_result(cqe->res));
+		}
+		io_uring_cq_advance(&ring_, seen);
+		return seen;
+	}
+
+private:
+	struct io_uring ring_ {};
+	bool init_ = false;
+};
+
+/* move-only owner of a provided-buffer ring (io_uring_setup_buf_ring) */
+class io_uring_bufring {
+public:
+	io_uring_bufring() = default;
+
+	~io_uring_bufring()
+	{
+		if (br_)
+			io_uring_free_buf_ring(ring_, br_, nentries_, bgid_);
+	}
+
+	io_uring_bufring(const io_uring_bufring &) = delete;
+	io_uring_bufring &operator=(const io_uring_bufring &) = delete;
+
+	io_uring_bufring(io_uring_bufring &&o) noexcept
+		: ring_(o.ring_), br_(std::exchange(o.br_, nullptr)),
+		  nentries_(o.nentries_), bgid_(o.bgid_) {}
+
+	io_uring_bufring &operator=(io_uring_bufring &&o) noexcept
+	{
+		if (this != &o) {
+			if (br_)
+				io_uring_free_buf_ring(ring_, br_, nentries_,
+						       bgid_);
+			ring_ = o.ring_;
+			br_ = std::exchange(o.br_, nullptr);
+			nentries_ = o.nentries_;
+			bgid_ = o.bgid_;
+		}
+		return *this;
+	}
+
+	io_uring_result init(io_uring_ring &ring, unsigned nentries, int bgid)
+	{
+		int err = 0;
+
+		ring_ = ring.get();
+		br_ = io_uring_setup_buf_ring(ring_, nentries, bgid, 0, &err);
+		nentries_ = nentries;
+		bgid_ = bgid;
+		return io_uring_result(err);
+	}
+
+	bool valid() const { return br_ != nullptr; }
+	struct io_uring_buf_ring *get() { return br_; }
+	int bgid() const { return bgid_; }
+
+	/* stage one buffer; publish staged entries with commit() */
+	void add(std::span<std::byte> buf, unsigned short bid, int offset)
+	{
+		io_uring_buf_ring_add(br_, buf.data(), (unsigned) buf.size(),
+				      bid, io_uring_buf_ring_mask(nentries_),
+				      offset);
+	}
+
+	void commit(int count) { io_uring_buf_ring_advance(br_, count); }
+
+	/* the recycle idiom: return one consumed buffer in a single step */
+	void recycle(std::span<std::byte> buf, unsigned short bid)
+	{
+		add(buf, bid, 0);
+		commit(1);
+	}
+
+private:
+	struct io_uring *ring_ = nullptr;
+	struct io_uring_buf_ring *br_ = nullptr;
+	unsigned nentries_ = 0;
+	int bgid_ = 0;
+};
+
+/* registered-file table, unregistered on destruction */
+class io_uring_reg_files {
+public:
+	io_uring_reg_files() = default;
+
+	~io_uring_reg_files()
+	{
+		if (ring_)
+			io_uring_unregister_files(ring_);
+	}
+
+	io_uring_reg_files(const io_uring_reg_files &) = delete;
+	io_uring_reg_files &operator=(const io_uring_reg_files &) = delete;
+
+	io_uring_reg_files(io_uring_reg_files &&o) noexcept
+		: ring_(std::exchange(o.ring_, nullptr)) {}
+
+	io_uring_reg_files &operator=(io_uring_reg_files &&o) noexcept
+	{
+		if (this != &o) {
+			if (ring_)
+				io_uring_unregister_files(ring_);
+			ring_ = std::exchange(o.ring_, nullptr);
+		}
+		return *this;
+	}
+
+	io_uring_result init(io_uring_ring &ring, std::span<const int> fds)
+	{
+		int ret = io_uring_register_files(ring.get(), fds.data(),
+						  (unsigned) fds.size());
+
+		if (ret == 0)
+			ring_ = ring.get();
+		return io_uring_result(ret);
+	}
+
+	bool valid() const { return ring_ != nullptr; }
+
+private:
+	struct io_uring *ring_ = nullptr;
+};
+
+#endif /* LIB_URING_HPP */
@@ -21,6 +21,24 @@ after the acquire operation executes. This is implemented using
 :c:func:`smp_acquire__after_ctrl_dep`.
 */
 
+/*
+ * On x86 the seq-cst fence below lowers to mfence, but a locked
+ * read-modify-write to the stack gives the same store/load ordering and
+ * is cheaper on every current micro-architecture; mfence additionally
+ * orders non-temporal accesses, which the SQ/CQ rings never use. The
+ * 64-bit form aims below the 128-byte red zone so the locked op never
+ * touches memory a leaf function may have live. Acquire and release
+ * already lower to plain MOVs under TSO, so only the full barrier gets
+ * the hand-rolled form.
+ */
+#if defined(__x86_64__)
+#define io_uring_smp_mb()					\
+	__asm__ __volatile__("lock; addl $0,-132(%%rsp)" ::: "memory", "cc")
+#elif defined(__i386__)
+#define io_uring_smp_mb()					\
+	__asm__ __volatile__("lock; addl $0,(%%esp)" ::: "memory", "cc")
+#endif
+
 #ifdef __cplusplus
 #include <atomic>
 
@@ -53,10 +71,12 @@ static inline T io_uring_smp_load_acquire(const T *p)
 		std::memory_order_acquire);
 }
 
+#ifndef io_uring_smp_mb
 static inline void io_uring_smp_mb()
 {
 	std::atomic_thread_fence(std::memory_order_seq_cst);
 }
+#endif
 #else
 #include <stdatomic.h>
 
@@ -74,8 +94,10 @@ static inline void io_uring_smp_mb()
 	atomic_load_explicit((_Atomic __typeof__(*(p)) *)(p),	\
 			     memory_order_acquire)
 
+#ifndef io_uring_smp_mb
 #define io_uring_smp_mb()					\
 	atomic_thread_fence(memory_order_seq_cst)
 #endif
+#endif
 
 #endif /* defined(LIBURING_BARRIER_H) */
@@ -0,0 +1,131 @@
+/* SPDX-License-Identifier: MIT */
+#ifndef LIB_URING_ENTER_H
+#define LIB_URING_ENTER_H
+
+#include <liburing.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+/*
+ * Opt-in header-only submit path. io_uring_submit() is an exported
+ * function, so a shared-library caller pays a PLT indirection plus the
+ * argument shuffling of the out-of-line submit chain on every call.
+ * Including this header instead gives io_uring_submit_inline(), which
+ * flushes the SQ and issues io_uring_enter entirely inline, ending in
+ * the raw syscall instruction on x86-64, aarch64 and riscv64 (other
+ * architectures go through libc syscall(2)).
+ *
+ * The inline path handles plain and registered-ring-fd rings only.
+ * SQPOLL and IOPOLL rings, rings running library modes that hook the
+ * submit path (zeroed or write-protected SQEs), and pending CQ
+ * overflow/taskrun work all fall back to io_uring_submit(). Library
+ * instrumentation that observes the out-of-line path - SQE auditing,
+ * inflight accounting, skip lists, stats - does not see submissions
+ * made through here; keep such rings on io_uring_submit().
+ */
+
+static inline int io_uring_enter_inline(unsigned int fd,
+					unsigned int to_submit,
+					unsigned int min_complete,
+					unsigned int flags, sigset_t *sig)
+{
+#if defined(__x86_64__)
+	register long r10 __asm__("r10") = (long) flags;
+	register long r8 __asm__("r8") = (long) (uintptr_t) sig;
+	register long r9 __asm__("r9") = (long) (_NSIG / 8);
+	intptr_t rax;
+
+	__asm__ volatile(
+		"syscall"
+		: "=a"(rax)
+		: "a"(__NR_io_uring_enter), "D"((long) fd),
+		  "S"((long) to_submit), "d"((long) min_complete),
+		  "r"(r10), "r"(r8), "r"(r9)
+		: "rcx", "r11", "memory"
+	);
+	return (int) rax;
+#elif defined(__aarch64__)
+	register long x0 __asm__("x0") = (long) fd;
+	register long x1 __asm__("x1") = (long) to_submit;
+	register long x2 __asm__("x2") = (long) min_complete;
+	register long x3 __asm__("x3") = (long) flags;
+	register long x4 __asm__("x4") = (long) (uintptr_t) sig;
+	register long x5 __asm__("x5") = (long) (_NSIG / 8);
+	register long x8 __asm__("x8") = __NR_io_uring_enter;
+
+	__asm__ volatile(
+		"svc 0"
+		: "+r"(x0)
+		: "r"(x1), "r"(x2), "r"(x3), "r"(x4), "r"(x5), "r"(x8)
+		: "memory", "cc"
+	);
+	return (int) x0;
+#elif defined(__riscv) && __riscv_xlen == 64
+	register long a0 __asm__("a0") = (long) fd;
+	register long a1 __asm__("a1") = (long) to_submit;
+	register long a2 __asm__("a2") = (long) min_complete;
+	register long a3 __asm__("a3") = (long) flags;
+	register long a4 __asm__("a4") = (long) (uintptr_t) sig;
+	register long a5 __asm__("a5") = (long) (_NSIG / 8);
+	register long a7 __asm__("a7") = __NR_io_uring_enter;
+
+	__asm__ volatile(
+		"ecall"
+		: "+r"(a0)
+		: "r"(a1), "r"(a2), "r"(a3), "r"(a4), "r"(a5), "r"(a7)
+		: "memory"
+	);
+	return (int) a0;
+#else
+	long ret;
+
+	ret = syscall(__NR_io_uring_enter, fd, to_submit, min_complete,
+		      flags, sig, _NSIG / 8);
+	return ret < 0 ? -errno : (int) ret;
+#endif
+}
+
+/*
+ * Internal ring state the inline path understands: the registered ring
+ * fd flags pass straight through to io_uring_enter, everything else
+ * means a library mode owns part of the submit path. Kept in sync with
+ * src/int_flags.h.
+ */
+#define IO_URING_INT_ENTER_REG_RING	1U
+#define IO_URING_INT_ENTER_SAFE		(1U | 2U | 4U | 16U)
+
+static inline int io_uring_submit_inline(struct io_uring *ring)
+{
+	struct io_uring_sq *sq = &ring->sq;
+	unsigned tail = sq->sqe_tail;
+	unsigned submitted, flags = 0;
+
+	if (uring_unlikely(ring->flags & (IORING_SETUP_SQPOLL |
+					  IORING_SETUP_IOPOLL)))
+		return io_uring_submit(ring);
+	if (uring_unlikely(ring->int_flags & ~IO_URING_INT_ENTER_SAFE))
+		return io_uring_submit(ring);
+	if (uring_unlikely(IO_URING_READ_ONCE(*sq->kflags) &
+			   (IORING_SQ_CQ_OVERFLOW | IORING_SQ_TASKRUN)))
+		return io_uring_submit(ring);
+
+	if (sq->sqe_head != tail) {
+		sq->sqe_head = tail;
+		/*
+		 * Ensure kernel sees the SQE updates before the tail update;
+		 * non-SQPOLL, so program order suffices.
+		 */
+		IO_URING_WRITE_ONCE(*sq->ktail, tail);
+	}
+	submitted = tail - *sq->khead;
+	if (!submitted)
+		return 0;
+	if (ring->int_flags & IO_URING_INT_ENTER_REG_RING)
+		flags = IORING_ENTER_REGISTERED_RING;
+	return io_uring_enter_inline(ring->enter_ring_fd, submitted, 0,
+				     flags, NULL);
+}
+
+#endif
@@ -0,0 +1,116 @@
+/* SPDX-License-Identifier: MIT */
+#ifndef LIB_URING_GEOMETRY_H
+#define LIB_URING_GEOMETRY_H
+
+#include <liburing.h>
+
+/*
+ * Opt-in ring geometry specialization. The generic inlines reload
+ * ring_mask and re-derive the CQE32/SQE128 shifts on every call even
+ * though both are fixed for the life of a ring; an application whose
+ * geometry is known at build time can declare it here and get variants
+ * with the masks and shifts folded into immediates, dropping a
+ * dependent load from the per-CQE loop.
+ *
+ * Define before including this header:
+ *
+ *	LIBURING_GEOM_SQ_ENTRIES	SQ size, power of two (required)
+ *	LIBURING_GEOM_CQ_ENTRIES	CQ size (default: 2 * SQ)
+ *	LIBURING_GEOM_SQE128		1 for IORING_SETUP_SQE128 rings
+ *	LIBURING_GEOM_CQE32		1 for IORING_SETUP_CQE32 rings
+ *
+ * Call io_uring_geom_verify() once after init: it fails with -EINVAL
+ * if the live ring's geometry differs from the declared one (the
+ * kernel may clamp or round entries), in which case the declared
+ * constants would silently index the wrong slots. SQPOLL rings are
+ * rejected too; the specialized get_sqe elides the acquire-ordered
+ * head load a kernel-side submitter requires. As with liburing/enter.h,
+ * library modes that hook the generic paths do not observe operations
+ * done through these variants.
+ */
+
+#ifndef LIBURING_GEOM_SQ_ENTRIES
+#error "define LIBURING_GEOM_SQ_ENTRIES before including liburing/geometry.h"
+#endif
+#ifndef LIBURING_GEOM_CQ_ENTRIES
+#define LIBURING_GEOM_CQ_ENTRIES	(2 * LIBURING_GEOM_SQ_ENTRIES)
+#endif
+#ifndef LIBURING_GEOM_SQE128
+#define LIBURING_GEOM_SQE128		0
+#endif
+#ifndef LIBURING_GEOM_CQE32
+#define LIBURING_GEOM_CQE32		0
+#endif
+
+#if (LIBURING_GEOM_SQ_ENTRIES) & ((LIBURING_GEOM_SQ_ENTRIES) - 1)
+#error "LIBURING_GEOM_SQ_ENTRIES must be a power of two"
+#endif
+#if (LIBURING_GEOM_CQ_ENTRIES) & ((LIBURING_GEOM_CQ_ENTRIES) - 1)
+#error "LIBURING_GEOM_CQ_ENTRIES must be a power of two"
+#endif
+
+#define LIBURING_GEOM_SQ_MASK	((unsigned) (LIBURING_GEOM_SQ_ENTRIES) - 1)
+#define LIBURING_GEOM_CQ_MASK	((unsigned) (LIBURING_GEOM_CQ_ENTRIES) - 1)
+
+static inline int io_uring_geom_verify(const struct io_uring *ring)
+{
+	if (ring->sq.ring_entries != (LIBURING_GEOM_SQ_ENTRIES) ||
+	    ring->cq.ring_entries != (LIBURING_GEOM_CQ_ENTRIES))
+		return -EINVAL;
+	if (!!(ring->flags & IORING_SETUP_SQE128) != (LIBURING_GEOM_SQE128) ||
+	    !!(ring->flags & IORING_SETUP_CQE32) != (LIBURING_GEOM_CQE32))
+		return -EINVAL;
+	if (ring->flags & IORING_SETUP_SQPOLL)
+		return -EINVAL;
+	return 0;
+}
+
+static inline struct io_uring_sqe *io_uring_get_sqe_geom(struct io_uring *ring)
+{
+	struct io_uring_sq *sq = &ring->sq;
+	unsigned int head, next = sq->sqe_tail + 1;
+
+	head = IO_URING_READ_ONCE(*sq->khead);
+	if (next - head <= (LIBURING_GEOM_SQ_ENTRIES)) {
+		struct io_uring_sqe *sqe;
+
+		sqe = &sq->sqes[(sq->sqe_tail & LIBURING_GEOM_SQ_MASK)
+				<< (LIBURING_GEOM_SQE128)];
+		sq->sqe_tail = next;
+		return sqe;
+	}
+	return NULL;
+}
+
+static inline struct io_uring_cqe *io_uring_peek_cqe_geom(struct io_uring *ring)
+{
+	unsigned head = *ring->cq.khead;
+
+	if (head == io_uring_smp_load_acquire(ring->cq.ktail))
+		return NULL;
+	return &ring->cq.cqes[(head & LIBURING_GEOM_CQ_MASK)
+			      << (LIBURING_GEOM_CQE32)];
+}
+
+static inline unsigned io_uring_peek_batch_cqe_geom(struct io_uring *ring,
+						    struct io_uring_cqe **cqes,
+						    unsigned count)
+{
+	unsigned head = *ring->cq.khead;
+	unsigned ready = io_uring_smp_load_acquire(ring->cq.ktail) - head;
+	unsigned i;
+
+	if (count > ready)
+		count = ready;
+	for (i = 0; i < count; i++, head++)
+		cqes[i] = &ring->cq.cqes[(head & LIBURING_GEOM_CQ_MASK)
+					 << (LIBURING_GEOM_CQE32)];
+	return count;
+}
+
+static inline void io_uring_cq_advance_geom(struct io_uring *ring, unsigned nr)
+{
+	io_uring_smp_store_release(ring->cq.khead, *ring->cq.khead + nr);
+}
+
+#endif
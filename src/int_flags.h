@@ -6,6 +6,11 @@ enum {
 	INT_FLAG_REG_RING	= 1,
 	INT_FLAG_REG_REG_RING	= 2,
 	INT_FLAG_APP_MEM	= 4,
+	INT_FLAG_ZERO_SQES	= 8,
+	INT_FLAG_GUARD		= 16,
+	INT_FLAG_SQE_PROT	= 32,
+	INT_FLAG_SHADOW_SQ	= 64,
+	INT_FLAG_WAIT_SUBMIT	= 128,
 };
 
 #endif
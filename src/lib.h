@@ -38,15 +38,88 @@
 #define __maybe_unused		__attribute__((__unused__))
 #define __hot			__attribute__((__hot__))
 #define __cold			__attribute__((__cold__))
+#define __noinline		__attribute__((__noinline__))
+
+/*
+ * The per-ring feature registries (inflight tracker, wait ops, throttle
+ * buckets, ...) are static tables keyed by the ring pointer. A slot is
+ * claimed by compare-exchanging the key from NULL, so racing
+ * registrations of different rings can never adopt the same slot;
+ * tables whose payload lives inline in the slot park URING_SLOT_BUSY
+ * in the key while the payload is written and release-publish the real
+ * ring last, so a hot-path scan that acquire-loads a matching key also
+ * sees the payload. Releasing a slot clears the payload under BUSY
+ * before storing NULL, keeping free slots clean for the next claim.
+ * Entries are dropped by the owning feature's exit call or, as a
+ * backstop, by io_uring_queue_exit() - a recycled ring address must
+ * never inherit a dead ring's callbacks. Reconfiguring a live entry is
+ * the caller's to serialize against its own use of that ring. The small
+ * fixed caps are deliberate: a full table fails loudly with -ENOSPC
+ * rather than growing, and the miss scan on a hot path stays within a
+ * cache line or two.
+ */
+#define URING_SLOT_BUSY		((struct io_uring *) 1)
+
+struct __kernel_timespec;
 
 #ifdef CONFIG_NOLIBC
 void *__uring_memset(void *s, int c, size_t n);
+void *__uring_memcpy(void *dst, const void *src, size_t n);
 void *__uring_malloc(size_t len);
 void __uring_free(void *p);
+int __uring_clock_gettime(int clockid, struct __kernel_timespec *ts);
 
 #define malloc(LEN)		__uring_malloc(LEN)
 #define free(PTR)		__uring_free(PTR)
 #define memset(PTR, C, LEN)	__uring_memset(PTR, C, LEN)
+#define memcpy(DST, SRC, LEN)	__uring_memcpy(DST, SRC, LEN)
+
+/* vDSO-backed in nolibc builds; libc builds go straight to the syscall */
+#define uring_clock_gettime(CLK, TS)	__uring_clock_gettime(CLK, TS)
+#else
+#define uring_clock_gettime(CLK, TS)	__sys_clock_gettime(CLK, TS)
+#endif
+
+/*
+ * Fixed-size SQE/CQE clones; arch lib.h may provide paired-load
+ * versions (see arch/aarch64/lib.h).
+ */
+#ifndef URING_ARCH_COPY
+static inline void uring_sqe_copy64(void *dst, const void *src)
+{
+	memcpy(dst, src, 64);
+}
+
+static inline void uring_cqe_copy(void *dst, const void *src, unsigned nr)
+{
+	memcpy(dst, src, (size_t) nr * 16);
+}
+#endif
+
+/*
+ * Write 'count' io_uring_buf entries for the slab layout where buffer
+ * 'bid_base + i' lives at 'addr + i * stride'. 'dst' points at the
+ * first entry; the caller handles ring wrap and publishes the tail.
+ * riscv64 provides an RVV version behind hwcap detection.
+ */
+#ifndef URING_ARCH_BUF_FILL
+static inline void uring_buf_fill_seq(void *dst, unsigned long addr,
+				      size_t stride, unsigned int len,
+				      unsigned int bid_base,
+				      unsigned int count)
+{
+	char *p = dst;
+	unsigned int i;
+
+	for (i = 0; i < count; i++, p += 16) {
+		*(unsigned long long *) (void *) p =
+			addr + (unsigned long long) i * stride;
+		*(unsigned int *) (void *) (p + 8) = len;
+		*(unsigned short *) (void *) (p + 12) =
+			(unsigned short) (bid_base + i);
+		*(unsigned short *) (void *) (p + 14) = 0;
+	}
+}
 #endif
 
 #endif /* #ifndef LIBURING_LIB_H */
@@ -0,0 +1,1174 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * Socket-oriented engines layered on the core ring: the zero-copy
+ * sender and tx timestamp plumbing, the inbound connection engine, the
+ * UDP request/reply engine, the DNS resolver, and the connect/sockopt
+ * chain helpers. Everything here drives the ring through the public
+ * submit/complete API in queue.c.
+ */
+#define _POSIX_C_SOURCE 200112L
+
+#include "lib.h"
+#include "syscall.h"
+#include "liburing.h"
+#include "setup.h"
+#include <netinet/in.h>
+#include <linux/errqueue.h>
+#include <linux/net_tstamp.h>
+
+int io_uring_zc_sender_init(struct io_uring *ring,
+			    struct io_uring_zc_sender *zs, unsigned nr,
+			    unsigned copy_threshold,
+			    void (*released)(struct io_uring_zc_sender *zs,
+					     const void *buf, size_t len,
+					     int res, void *user),
+			    void *cb_data)
+{
+	zs->entries = uring_ring_malloc(ring, nr * sizeof(*zs->entries));
+	if (!zs->entries)
+		return -ENOMEM;
+	memset(zs->entries, 0, nr * sizeof(*zs->entries));
+	zs->ring = ring;
+	zs->nr_entries = nr;
+	zs->copy_threshold = copy_threshold;
+	zs->released = released;
+	zs->cb_data = cb_data;
+	return 0;
+}
+
+void io_uring_zc_sender_exit(struct io_uring_zc_sender *zs)
+{
+	uring_ring_free(zs->ring, zs->entries);
+	zs->entries = NULL;
+	zs->nr_entries = 0;
+}
+
+/*
+ * Queue a send of 'buf'. At or above the copy threshold it goes out
+ * zero-copy; below, as a regular copying send whose buffer is already
+ * reusable at completion - the released callback fires either way, once,
+ * when the buffer is truly free. Staged only; submit as usual. Returns
+ * -ENOSPC with all tracking slots in flight, -EBUSY with the SQ full.
+ */
+int io_uring_zc_send(struct io_uring_zc_sender *zs, int sockfd,
+		     const void *buf, size_t len, int flags, void *user)
+{
+	struct io_uring_sqe *sqe;
+	struct io_uring_zc_entry *e;
+	unsigned i;
+
+	for (i = 0; i < zs->nr_entries; i++) {
+		if (!zs->entries[i].in_use)
+			break;
+	}
+	if (i == zs->nr_entries)
+		return -ENOSPC;
+
+	sqe = io_uring_get_sqe(zs->ring);
+	if (!sqe)
+		return -EBUSY;
+
+	if (len >= zs->copy_threshold)
+		io_uring_prep_send_zc(sqe, sockfd, buf, len, flags, 0);
+	else
+		io_uring_prep_send(sqe, sockfd, buf, len, flags);
+	sqe->user_data = LIBURING_UDATA_ZC | i;
+
+	e = &zs->entries[i];
+	e->buf = buf;
+	e->len = len;
+	e->user = user;
+	e->res = 0;
+	e->in_use = 1;
+	return 0;
+}
+
+static void zc_release(struct io_uring_zc_sender *zs,
+		       struct io_uring_zc_entry *e, int res)
+{
+	e->in_use = 0;
+	if (zs->released)
+		zs->released(zs, e->buf, e->len, res, e->user);
+}
+
+/*
+ * Feed one reaped completion through the engine. Returns 1 if the cqe
+ * belonged to this sender and was consumed, 0 otherwise. The send
+ * completion parks its result until the notification arrives; a
+ * completion without IORING_CQE_F_MORE (copying send, error, or cancel)
+ * releases immediately since no notification will follow.
+ */
+int io_uring_zc_cqe(struct io_uring_zc_sender *zs,
+		    const struct io_uring_cqe *cqe)
+{
+	struct io_uring_zc_entry *e;
+	__u64 slot;
+
+	if ((cqe->user_data & (0xffffULL << 48)) != LIBURING_UDATA_ZC)
+		return 0;
+	slot = cqe->user_data & ~(0xffffULL << 48);
+	if (slot >= zs->nr_entries)
+		return 0;
+	e = &zs->entries[slot];
+	if (!e->in_use)
+		return 0;
+
+	if (cqe->flags & IORING_CQE_F_NOTIF) {
+		zc_release(zs, e, e->res);
+		return 1;
+	}
+	if (cqe->flags & IORING_CQE_F_MORE) {
+		e->res = cqe->res;
+		return 1;
+	}
+	zc_release(zs, e, cqe->res);
+	return 1;
+}
+
+/*
+ * Stage a SETSOCKOPT command turning on errqueue TX timestamping for
+ * 'fd': software stamps at send, hardware stamps too when 'hw' is set,
+ * with OPT_ID so each stamp carries the socket's send sequence and
+ * OPT_TSONLY so no payload is looped back. One completion with res 0
+ * confirms it; then every send on the socket queues a timestamp that
+ * io_uring_tx_ts_arm() pulls through the CQ.
+ */
+int io_uring_tx_ts_enable(struct io_uring *ring, int fd, int hw,
+			  __u64 user_data)
+{
+	static const unsigned int sw_flags =
+		SOF_TIMESTAMPING_TX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE |
+		SOF_TIMESTAMPING_OPT_ID | SOF_TIMESTAMPING_OPT_CMSG |
+		SOF_TIMESTAMPING_OPT_TSONLY;
+	static const unsigned int hw_flags = SOF_TIMESTAMPING_TX_SOFTWARE |
+		SOF_TIMESTAMPING_SOFTWARE | SOF_TIMESTAMPING_TX_HARDWARE |
+		SOF_TIMESTAMPING_RAW_HARDWARE | SOF_TIMESTAMPING_OPT_ID |
+		SOF_TIMESTAMPING_OPT_CMSG | SOF_TIMESTAMPING_OPT_TSONLY;
+	const unsigned int *flags = hw ? &hw_flags : &sw_flags;
+	struct io_uring_sqe *sqe;
+
+	sqe = io_uring_get_sqe(ring);
+	if (!sqe)
+		return -EBUSY;
+	io_uring_prep_cmd_sock(sqe, SOCKET_URING_OP_SETSOCKOPT, fd,
+			       SOL_SOCKET, SO_TIMESTAMPING,
+			       (void *) (uintptr_t) flags, sizeof(*flags));
+	sqe->user_data = user_data;
+	return 0;
+}
+
+/*
+ * Stage a one-shot MSG_ERRQUEUE recvmsg pulling the next queued
+ * timestamp through the CQ. 'r' holds the msghdr and control space for
+ * the completion and is decoded with io_uring_tx_ts_decode(); re-arm
+ * after each decode. Pair it with POLLERR polling or simply keep one
+ * armed per socket alongside the zc notif flow.
+ */
+int io_uring_tx_ts_arm(struct io_uring *ring, int fd,
+		       struct io_uring_tx_ts_recv *r, __u64 user_data)
+{
+	struct io_uring_sqe *sqe;
+
+	sqe = io_uring_get_sqe(ring);
+	if (!sqe)
+		return -EBUSY;
+	memset(&r->msg, 0, sizeof(r->msg));
+	r->msg.msg_control = r->control;
+	r->msg.msg_controllen = sizeof(r->control);
+	io_uring_prep_recvmsg(sqe, fd, &r->msg, MSG_ERRQUEUE);
+	sqe->user_data = user_data;
+	return 0;
+}
+
+/*
+ * Decode the completion of an armed errqueue recvmsg: 'res' is the
+ * cqe's result, 'ts' receives up to 'nr' decoded stamps. Returns the
+ * number decoded, 'res' when negative, or -EBADMSG if the control data
+ * held no timestamp. A hardware stamp is preferred over the software
+ * one when the NIC provided both.
+ */
+int io_uring_tx_ts_decode(struct io_uring_tx_ts_recv *r, int res,
+			  struct io_uring_tx_ts *ts, unsigned nr)
+{
+	struct scm_timestamping *tss = NULL;
+	struct cmsghdr *cmsg;
+	unsigned out = 0;
+
+	if (res < 0)
+		return res;
+	if (r->msg.msg_flags & MSG_CTRUNC)
+		return -EBADMSG;
+
+	for (cmsg = CMSG_FIRSTHDR(&r->msg); cmsg && out < nr;
+	     cmsg = CMSG_NXTHDR(&r->msg, cmsg)) {
+		if (cmsg->cmsg_level == SOL_SOCKET &&
+		    cmsg->cmsg_type == SCM_TIMESTAMPING) {
+			tss = (struct scm_timestamping *) CMSG_DATA(cmsg);
+		} else if ((cmsg->cmsg_level == SOL_IP &&
+			    cmsg->cmsg_type == IP_RECVERR) ||
+			   (cmsg->cmsg_level == SOL_IPV6 &&
+			    cmsg->cmsg_type == IPV6_RECVERR)) {
+			struct sock_extended_err *ee =
+				(struct sock_extended_err *) CMSG_DATA(cmsg);
+
+			if (ee->ee_errno != ENOMSG || !tss ||
+			    ee->ee_origin != SO_EE_ORIGIN_TIMESTAMPING)
+				continue;
+			ts[out].key = ee->ee_data;
+			ts[out].type = ee->ee_info;
+			ts[out].hw = tss->ts[2].tv_sec || tss->ts[2].tv_nsec;
+			if (ts[out].hw) {
+				ts[out].ts.tv_sec = tss->ts[2].tv_sec;
+				ts[out].ts.tv_nsec = tss->ts[2].tv_nsec;
+			} else {
+				ts[out].ts.tv_sec = tss->ts[0].tv_sec;
+				ts[out].ts.tv_nsec = tss->ts[0].tv_nsec;
+			}
+			out++;
+			tss = NULL;
+		}
+	}
+	return out ? (int) out : -EBADMSG;
+}
+
+enum {
+	CONN_KIND_ACCEPT	= 0,
+	CONN_KIND_RECV		= 1,
+	CONN_KIND_CLOSE		= 2,
+};
+
+static __u64 conn_udata(unsigned kind, unsigned conn)
+{
+	return LIBURING_UDATA_CONN | ((__u64) kind << 40) | conn;
+}
+
+/*
+ * Grab an sqe, flushing the SQ once if it is full. The engine arms
+ * requests from inside completion handling, so it can't just fail when a
+ * burst fills the queue.
+ */
+static struct io_uring_sqe *conn_get_sqe(struct io_uring_conn_engine *ce)
+{
+	struct io_uring_sqe *sqe;
+
+	sqe = io_uring_get_sqe(ce->ring);
+	if (!sqe) {
+		io_uring_submit(ce->ring);
+		sqe = io_uring_get_sqe(ce->ring);
+	}
+	return sqe;
+}
+
+static int conn_arm_accept(struct io_uring_conn_engine *ce)
+{
+	struct io_uring_sqe *sqe;
+
+	sqe = conn_get_sqe(ce);
+	if (!sqe)
+		return -EBUSY;
+	io_uring_prep_multishot_accept_direct(sqe, ce->listen_fd, NULL, NULL,
+					      0);
+	sqe->user_data = conn_udata(CONN_KIND_ACCEPT, 0);
+	return 0;
+}
+
+static int conn_arm_recv(struct io_uring_conn_engine *ce, unsigned conn)
+{
+	struct io_uring_sqe *sqe;
+
+	sqe = conn_get_sqe(ce);
+	if (!sqe)
+		return -EBUSY;
+	io_uring_prep_recv_multishot(sqe, (int) conn, NULL, 0, 0);
+	sqe->flags |= IOSQE_FIXED_FILE | IOSQE_BUFFER_SELECT;
+	sqe->buf_group = (__u16) ce->bgid;
+	sqe->user_data = conn_udata(CONN_KIND_RECV, conn);
+	return 0;
+}
+
+static void conn_drop(struct io_uring_conn_engine *ce, unsigned conn, int res)
+{
+	struct io_uring_sqe *sqe;
+
+	if (ce->on_close)
+		ce->on_close(ce, conn, res);
+	sqe = conn_get_sqe(ce);
+	if (sqe) {
+		io_uring_prep_close_direct(sqe, conn);
+		sqe->user_data = conn_udata(CONN_KIND_CLOSE, conn);
+	}
+}
+
+/*
+ * Stand up the whole engine on 'ring': a sparse direct-descriptor table
+ * of nr_conns slots, a provided-buffer group of nr_bufs (power of two)
+ * buffers of buf_len bytes, and a multishot accept on listen_fd whose
+ * direct-alloc'ed connections each get a multishot recv armed
+ * automatically. The initial accept is submitted before returning; from
+ * then on the application reaps CQEs as usual and passes each through
+ * io_uring_conn_cqe().
+ */
+__cold int io_uring_conn_engine_init(struct io_uring *ring,
+			      struct io_uring_conn_engine *ce, int listen_fd,
+			      unsigned nr_conns, unsigned nr_bufs,
+			      unsigned buf_len, int bgid,
+			      void (*on_data)(struct io_uring_conn_engine *ce,
+					      unsigned conn, void *data,
+					      unsigned len),
+			      void (*on_close)(struct io_uring_conn_engine *ce,
+					       unsigned conn, int res),
+			      void *cb_data)
+{
+	int ret;
+
+	if (!nr_conns || !nr_bufs || (nr_bufs & (nr_bufs - 1)) || !buf_len)
+		return -EINVAL;
+
+	ret = io_uring_register_files_sparse(ring, nr_conns);
+	if (ret)
+		return ret;
+
+	ce->bufs = uring_ring_malloc(ring, (size_t) nr_bufs * buf_len);
+	if (!ce->bufs) {
+		ret = -ENOMEM;
+		goto err_files;
+	}
+	ce->br = io_uring_setup_buf_ring(ring, nr_bufs, bgid, 0, &ret);
+	if (!ce->br)
+		goto err_bufs;
+	uring_buf_fill_seq(ce->br->bufs, (unsigned long) (uintptr_t) ce->bufs,
+			   buf_len, buf_len, 0, nr_bufs);
+	io_uring_buf_ring_advance(ce->br, (int) nr_bufs);
+
+	ce->ring = ring;
+	ce->buf_len = buf_len;
+	ce->nr_bufs = nr_bufs;
+	ce->nr_conns = nr_conns;
+	ce->bgid = bgid;
+	ce->listen_fd = listen_fd;
+	ce->on_data = on_data;
+	ce->on_close = on_close;
+	ce->cb_data = cb_data;
+
+	ret = conn_arm_accept(ce);
+	if (ret)
+		goto err_br;
+	ret = io_uring_submit(ring);
+	if (ret < 0)
+		goto err_br;
+	return 0;
+err_br:
+	io_uring_free_buf_ring(ring, ce->br, nr_bufs, bgid);
+err_bufs:
+	uring_ring_free(ring, ce->bufs);
+err_files:
+	io_uring_unregister_files(ring);
+	return ret;
+}
+
+__cold void io_uring_conn_engine_exit(struct io_uring_conn_engine *ce)
+{
+	io_uring_free_buf_ring(ce->ring, ce->br, ce->nr_bufs, ce->bgid);
+	io_uring_unregister_files(ce->ring);
+	uring_ring_free(ce->ring, ce->bufs);
+	ce->bufs = NULL;
+	ce->br = NULL;
+}
+
+/*
+ * Feed one reaped completion through the engine; returns 1 when
+ * consumed, 0 for foreign cqes. Accepted connections get their recv
+ * armed, data completions invoke the callback and recycle the buffer on
+ * return, and terminated connections (peer close, error, cancel) invoke
+ * on_close and release their direct slot. Terminated multishots - a
+ * depleted buffer group, a full accept backlog - re-arm themselves.
+ * Armed sqes are staged; the application's next submit publishes them.
+ */
+int io_uring_conn_cqe(struct io_uring_conn_engine *ce,
+		      const struct io_uring_cqe *cqe)
+{
+	unsigned kind, conn;
+
+	if ((cqe->user_data & (0xffffULL << 48)) != LIBURING_UDATA_CONN)
+		return 0;
+	kind = (unsigned) (cqe->user_data >> 40) & 0xff;
+	conn = (unsigned) cqe->user_data;
+
+	switch (kind) {
+	case CONN_KIND_ACCEPT:
+		if (cqe->res >= 0)
+			conn_arm_recv(ce, (unsigned) cqe->res);
+		if (!(cqe->flags & IORING_CQE_F_MORE) &&
+		    cqe->res != -ECANCELED)
+			conn_arm_accept(ce);
+		return 1;
+	case CONN_KIND_RECV:
+		if (cqe->res > 0) {
+			unsigned short bid = (unsigned short)
+				(cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+
+			if (ce->on_data)
+				ce->on_data(ce, conn,
+					    ce->bufs + (size_t) bid *
+						ce->buf_len,
+					    (unsigned) cqe->res);
+			io_uring_buf_ring_add(ce->br,
+					      ce->bufs + (size_t) bid *
+						ce->buf_len,
+					      ce->buf_len, bid,
+					      io_uring_buf_ring_mask(ce->nr_bufs),
+					      0);
+			io_uring_buf_ring_advance(ce->br, 1);
+			if (!(cqe->flags & IORING_CQE_F_MORE))
+				conn_arm_recv(ce, conn);
+		} else if (cqe->res == -ENOBUFS) {
+			conn_arm_recv(ce, conn);
+		} else if (!(cqe->flags & IORING_CQE_F_MORE)) {
+			conn_drop(ce, conn, cqe->res);
+		}
+		return 1;
+	case CONN_KIND_CLOSE:
+		return 1;
+	}
+	return 0;
+}
+
+enum {
+	RESOLVER_KIND_USEND	= 0,
+	RESOLVER_KIND_URECV	= 1,
+	RESOLVER_KIND_ULTO	= 2,
+	RESOLVER_KIND_TSOCK	= 3,
+	RESOLVER_KIND_TCONN	= 4,
+	RESOLVER_KIND_TSEND	= 5,
+	RESOLVER_KIND_TRECV	= 6,
+	RESOLVER_KIND_TLTO	= 7,
+	RESOLVER_KIND_TCLOSE	= 8,
+};
+
+enum {
+	RESOLVER_ST_UDP		= 0,
+	RESOLVER_ST_TSOCK	= 1,
+	RESOLVER_ST_TCONN	= 2,
+	RESOLVER_ST_TSEND	= 3,
+	RESOLVER_ST_TRECV	= 4,
+};
+
+/* tcp length prefix plus the query; a 253-byte name needs 273 */
+#define RESOLVER_QBUF_SZ	512
+#define RESOLVER_RBUF_SZ	1536
+#define RESOLVER_BUF_STRIDE	(RESOLVER_QBUF_SZ + RESOLVER_RBUF_SZ)
+
+static __u64 resolver_udata(unsigned kind, unsigned slot)
+{
+	return LIBURING_UDATA_RESOLVER | ((__u64) kind << 40) | slot;
+}
+
+static unsigned char *resolver_qbuf(struct io_uring_resolver *rv,
+				    unsigned slot)
+{
+	return rv->bufs + (size_t) slot * RESOLVER_BUF_STRIDE;
+}
+
+static unsigned char *resolver_rbuf(struct io_uring_resolver *rv,
+				    unsigned slot)
+{
+	return resolver_qbuf(rv, slot) + RESOLVER_QBUF_SZ;
+}
+
+/* RD query, one question; returns the wire length or -EINVAL */
+static int dns_build_query(unsigned char *q, const char *name,
+			   unsigned txid, unsigned qtype)
+{
+	unsigned off = 12, label;
+
+	memset(q, 0, 12);
+	q[0] = (unsigned char) (txid >> 8);
+	q[1] = (unsigned char) txid;
+	q[2] = 0x01;		/* RD */
+	q[5] = 1;		/* QDCOUNT */
+
+	if (!*name)
+		return -EINVAL;
+	while (*name) {
+		label = 0;
+		while (name[label] && name[label] != '.')
+			label++;
+		if (!label || label > 63 ||
+		    off + label + 6 > RESOLVER_QBUF_SZ - 2)
+			return -EINVAL;
+		q[off++] = (unsigned char) label;
+		memcpy(q + off, name, label);
+		off += label;
+		name += label;
+		if (*name == '.')
+			name++;
+	}
+	q[off++] = 0;
+	q[off++] = (unsigned char) (qtype >> 8);
+	q[off++] = (unsigned char) qtype;
+	q[off++] = 0;
+	q[off++] = 1;		/* IN */
+	return (int) off;
+}
+
+/* step past a possibly-compressed name; returns the next offset or -1 */
+static int dns_skip_name(const unsigned char *r, unsigned len, unsigned off)
+{
+	while (off < len) {
+		unsigned c = r[off];
+
+		if (!c)
+			return (int) off + 1;
+		if ((c & 0xc0) == 0xc0)
+			return off + 2 <= len ? (int) (off + 2) : -1;
+		off += c + 1;
+	}
+	return -1;
+}
+
+/*
+ * Harvest matching A/AAAA records into the job. Returns the address
+ * count, -EAGAIN when the response is truncated (retry over tcp),
+ * -ENOENT on NXDOMAIN or an answer with no matching records, -EIO on
+ * anything malformed.
+ */
+static int dns_parse_response(struct io_uring_resolver_job *job,
+			      const unsigned char *r, unsigned len)
+{
+	unsigned off, qd, an, i;
+	int skip;
+
+	if (len < 12)
+		return -EIO;
+	if (((unsigned) r[0] << 8 | r[1]) != job->txid)
+		return -EIO;
+	if (!(r[2] & 0x80))
+		return -EIO;
+	if (r[2] & 0x02)
+		return -EAGAIN;
+	switch (r[3] & 0x0f) {
+	case 0:
+		break;
+	case 3:
+		return -ENOENT;
+	default:
+		return -EIO;
+	}
+	qd = (unsigned) r[4] << 8 | r[5];
+	an = (unsigned) r[6] << 8 | r[7];
+	off = 12;
+	for (i = 0; i < qd; i++) {
+		skip = dns_skip_name(r, len, off);
+		if (skip < 0 || (unsigned) skip + 4 > len)
+			return -EIO;
+		off = (unsigned) skip + 4;
+	}
+	for (i = 0; i < an && job->nr_addrs < IO_URING_RESOLVER_MAX_ADDRS;
+	     i++) {
+		unsigned type, rdlen, want;
+
+		skip = dns_skip_name(r, len, off);
+		if (skip < 0 || (unsigned) skip + 10 > len)
+			return -EIO;
+		off = (unsigned) skip;
+		type = (unsigned) r[off] << 8 | r[off + 1];
+		rdlen = (unsigned) r[off + 8] << 8 | r[off + 9];
+		off += 10;
+		if (off + rdlen > len)
+			return -EIO;
+		want = job->addr_len == 4 ? 1 : 28;
+		if (type == want && rdlen == job->addr_len)
+			memcpy(job->addrs[job->nr_addrs++], r + off, rdlen);
+		off += rdlen;
+	}
+	return job->nr_addrs ? (int) job->nr_addrs : -ENOENT;
+}
+
+static int resolver_complete(struct io_uring_resolver *rv,
+			     struct io_uring_resolver_job *job, int res)
+{
+	job->res = res;
+	if (job->tcp_fd >= 0) {
+		struct io_uring_sqe *sqe = io_uring_get_sqe(rv->ring);
+
+		if (sqe) {
+			io_uring_prep_close(sqe, job->tcp_fd);
+			sqe->user_data = resolver_udata(RESOLVER_KIND_TCLOSE,
+							job->slot);
+		} else {
+			__sys_close(job->tcp_fd);
+		}
+		job->tcp_fd = -1;
+	}
+	rv->jobs[job->slot] = NULL;
+	rv->free_q[rv->free_nr++] = job->slot;
+	return 2;
+}
+
+static int resolver_start_tcp(struct io_uring_resolver *rv,
+			      struct io_uring_resolver_job *job)
+{
+	struct io_uring_sqe *sqe;
+
+	sqe = io_uring_get_sqe(rv->ring);
+	if (!sqe)
+		return resolver_complete(rv, job, -EBUSY);
+	io_uring_prep_socket(sqe, rv->server.ss_family, SOCK_STREAM, 0, 0);
+	sqe->user_data = resolver_udata(RESOLVER_KIND_TSOCK, job->slot);
+	job->state = RESOLVER_ST_TSOCK;
+	return 1;
+}
+
+static int resolver_tcp_recv(struct io_uring_resolver *rv,
+			     struct io_uring_resolver_job *job)
+{
+	struct io_uring_sqe *sqe;
+
+	if (io_uring_sq_space_left(rv->ring) < 2)
+		return resolver_complete(rv, job, -EBUSY);
+	sqe = io_uring_get_sqe(rv->ring);
+	io_uring_prep_recv(sqe, job->tcp_fd,
+			   resolver_rbuf(rv, job->slot) + job->have,
+			   RESOLVER_RBUF_SZ - job->have, 0);
+	sqe->flags |= IOSQE_IO_LINK;
+	sqe->user_data = resolver_udata(RESOLVER_KIND_TRECV, job->slot);
+	sqe = io_uring_get_sqe(rv->ring);
+	io_uring_prep_link_timeout(sqe, &rv->to, 0);
+	sqe->user_data = resolver_udata(RESOLVER_KIND_TLTO, job->slot);
+	job->state = RESOLVER_ST_TRECV;
+	return 1;
+}
+
+/*
+ * Set up the resolver: up to 'nr_jobs' lookups in flight, all against
+ * the server behind the connected datagram socket 'udp_fd'. 'server'
+ * is the same endpoint again, used only for the tcp fallback connect;
+ * 'ts' bounds each network wait (per leg, not per lookup).
+ */
+__cold int io_uring_resolver_init(struct io_uring *ring,
+				  struct io_uring_resolver *rv, int udp_fd,
+				  const struct sockaddr *server,
+				  socklen_t server_len,
+				  const struct __kernel_timespec *ts,
+				  unsigned nr_jobs)
+{
+	unsigned i;
+
+	if (!nr_jobs || !server || !ts || server_len > sizeof(rv->server))
+		return -EINVAL;
+
+	memset(rv, 0, sizeof(*rv));
+	rv->bufs = uring_ring_malloc(ring,
+				     (size_t) nr_jobs * RESOLVER_BUF_STRIDE);
+	rv->jobs = uring_ring_malloc(ring, nr_jobs * sizeof(*rv->jobs));
+	rv->free_q = uring_ring_malloc(ring, nr_jobs * sizeof(*rv->free_q));
+	if (!rv->bufs || !rv->jobs || !rv->free_q) {
+		uring_ring_free(ring, rv->free_q);
+		uring_ring_free(ring, rv->jobs);
+		uring_ring_free(ring, rv->bufs);
+		return -ENOMEM;
+	}
+	for (i = 0; i < nr_jobs; i++) {
+		rv->free_q[i] = i;
+		rv->jobs[i] = NULL;
+	}
+	memcpy(&rv->server, server, server_len);
+	rv->server_len = server_len;
+	rv->to = *ts;
+	rv->ring = ring;
+	rv->udp_fd = udp_fd;
+	rv->free_nr = nr_jobs;
+	rv->nr_slots = nr_jobs;
+	return 0;
+}
+
+__cold void io_uring_resolver_exit(struct io_uring_resolver *rv)
+{
+	uring_ring_free(rv->ring, rv->free_q);
+	uring_ring_free(rv->ring, rv->jobs);
+	uring_ring_free(rv->ring, rv->bufs);
+	rv->free_q = NULL;
+	rv->jobs = NULL;
+	rv->bufs = NULL;
+}
+
+/*
+ * Stage a lookup: job->name and job->family must be set. Three sqes go
+ * out as one chain - query send, response recv, link timeout - so the
+ * whole udp exchange is armed in one submit. -ENOSPC with all slots
+ * busy, -EBUSY without sq room; 'job' and the name must stay live
+ * until the completing cqe has passed through io_uring_resolver_cqe().
+ */
+int io_uring_resolve(struct io_uring_resolver *rv,
+		     struct io_uring_resolver_job *job)
+{
+	struct io_uring_sqe *sqe;
+	unsigned char *q;
+	unsigned slot, qtype;
+	int qlen;
+
+	if (job->family != AF_INET && job->family != AF_INET6)
+		return -EINVAL;
+	if (!rv->free_nr)
+		return -ENOSPC;
+	if (io_uring_sq_space_left(rv->ring) < 3)
+		return -EBUSY;
+
+	slot = rv->free_q[rv->free_nr - 1];
+	q = resolver_qbuf(rv, slot);
+	rv->txid_seq = (rv->txid_seq + 1) & 0xffff;
+	if (!rv->txid_seq)
+		rv->txid_seq = 1;
+	qtype = job->family == AF_INET6 ? 28 : 1;
+	qlen = dns_build_query(q + 2, job->name, rv->txid_seq, qtype);
+	if (qlen < 0)
+		return qlen;
+	rv->free_nr--;
+	/* tcp length prefix, prepared up front for the fallback */
+	q[0] = (unsigned char) (qlen >> 8);
+	q[1] = (unsigned char) qlen;
+
+	job->res = 0;
+	job->nr_addrs = 0;
+	job->addr_len = job->family == AF_INET6 ? 16 : 4;
+	job->slot = slot;
+	job->state = RESOLVER_ST_UDP;
+	job->txid = rv->txid_seq;
+	job->qlen = (unsigned) qlen;
+	job->have = 0;
+	job->need = 0;
+	job->tcp_fd = -1;
+	job->err = 0;
+	rv->jobs[slot] = job;
+
+	sqe = io_uring_get_sqe(rv->ring);
+	io_uring_prep_send(sqe, rv->udp_fd, q + 2, (unsigned) qlen, 0);
+	sqe->flags |= IOSQE_IO_LINK;
+	sqe->user_data = resolver_udata(RESOLVER_KIND_USEND, slot);
+	sqe = io_uring_get_sqe(rv->ring);
+	io_uring_prep_recv(sqe, rv->udp_fd, resolver_rbuf(rv, slot),
+			   RESOLVER_RBUF_SZ, 0);
+	sqe->flags |= IOSQE_IO_LINK;
+	sqe->user_data = resolver_udata(RESOLVER_KIND_URECV, slot);
+	sqe = io_uring_get_sqe(rv->ring);
+	io_uring_prep_link_timeout(sqe, &rv->to, 0);
+	sqe->user_data = resolver_udata(RESOLVER_KIND_ULTO, slot);
+	return 0;
+}
+
+/*
+ * Sort an engine cqe: 0 for foreign cqes, 1 for internal plumbing
+ * (timeouts, the tcp fallback legs), 2 when a lookup completes -
+ * job->res holds the address count or the error, with timeouts on any
+ * leg collapsed to -ETIMEDOUT. The slot is recycled on completion;
+ * results live in the caller's job. A truncated udp reply re-drives
+ * the query over tcp transparently, re-staging sqes as each leg lands,
+ * so the caller only ever sees the final verdict.
+ */
+int io_uring_resolver_cqe(struct io_uring_resolver *rv,
+			  const struct io_uring_cqe *cqe)
+{
+	struct io_uring_resolver_job *job;
+	struct io_uring_sqe *sqe;
+	unsigned char *r;
+	__u64 ud = cqe->user_data;
+	unsigned kind, slot;
+	int ret;
+
+	if ((ud & (0xffffULL << 48)) != LIBURING_UDATA_RESOLVER) {
+		/* the connect composite flips the top bit for its timeout */
+		ud ^= 1ULL << 63;
+		if ((ud & (0xffffULL << 48)) != LIBURING_UDATA_RESOLVER ||
+		    ((unsigned) (ud >> 40) & 0xff) != RESOLVER_KIND_TCONN)
+			return 0;
+	}
+	kind = (unsigned) (ud >> 40) & 0xff;
+	slot = (unsigned) ud;
+
+	/* link-timeout partners and staged closes carry no job state */
+	if (kind == RESOLVER_KIND_ULTO || kind == RESOLVER_KIND_TLTO ||
+	    kind == RESOLVER_KIND_TCLOSE)
+		return 1;
+	if (slot >= rv->nr_slots || !rv->jobs[slot])
+		return 1;
+	job = rv->jobs[slot];
+
+	switch (kind) {
+	case RESOLVER_KIND_USEND:
+		/* the linked recv lands cancelled; fail the job there */
+		if (cqe->res < 0)
+			job->err = cqe->res;
+		return 1;
+	case RESOLVER_KIND_URECV:
+		if (job->err)
+			return resolver_complete(rv, job, job->err);
+		if (cqe->res == -ECANCELED)
+			return resolver_complete(rv, job, -ETIMEDOUT);
+		if (cqe->res < 0)
+			return resolver_complete(rv, job, cqe->res);
+		r = resolver_rbuf(rv, slot);
+		ret = dns_parse_response(job, r, (unsigned) cqe->res);
+		if (ret != -EAGAIN)
+			return resolver_complete(rv, job, ret);
+		return resolver_start_tcp(rv, job);
+	case RESOLVER_KIND_TSOCK:
+		if (cqe->res < 0)
+			return resolver_complete(rv, job, cqe->res);
+		job->tcp_fd = cqe->res;
+		ret = io_uring_prep_connect_timeout(rv->ring, &job->ct,
+				job->tcp_fd,
+				(const struct sockaddr *) &rv->server,
+				rv->server_len, &rv->to,
+				resolver_udata(RESOLVER_KIND_TCONN, slot));
+		if (ret)
+			return resolver_complete(rv, job, ret);
+		job->state = RESOLVER_ST_TCONN;
+		return 1;
+	case RESOLVER_KIND_TCONN:
+		if (io_uring_connect_cqe(&job->ct, cqe) < 2)
+			return 1;
+		if (job->ct.res < 0)
+			return resolver_complete(rv, job, job->ct.res);
+		sqe = io_uring_get_sqe(rv->ring);
+		if (!sqe)
+			return resolver_complete(rv, job, -EBUSY);
+		io_uring_prep_send(sqe, job->tcp_fd, resolver_qbuf(rv, slot),
+				   job->qlen + 2, 0);
+		sqe->user_data = resolver_udata(RESOLVER_KIND_TSEND, slot);
+		job->state = RESOLVER_ST_TSEND;
+		return 1;
+	case RESOLVER_KIND_TSEND:
+		if (cqe->res < 0)
+			return resolver_complete(rv, job, cqe->res);
+		if ((unsigned) cqe->res != job->qlen + 2)
+			return resolver_complete(rv, job, -EIO);
+		job->have = 0;
+		job->need = 2;
+		return resolver_tcp_recv(rv, job);
+	case RESOLVER_KIND_TRECV:
+		if (cqe->res == -ECANCELED)
+			return resolver_complete(rv, job, -ETIMEDOUT);
+		if (cqe->res <= 0)
+			return resolver_complete(rv, job,
+						 cqe->res ? cqe->res : -EIO);
+		job->have += (unsigned) cqe->res;
+		r = resolver_rbuf(rv, slot);
+		if (job->have >= 2)
+			job->need = 2 + ((unsigned) r[0] << 8 | r[1]);
+		if (job->need > RESOLVER_RBUF_SZ)
+			return resolver_complete(rv, job, -EMSGSIZE);
+		if (job->have < job->need)
+			return resolver_tcp_recv(rv, job);
+		ret = dns_parse_response(job, r + 2, job->need - 2);
+		if (ret == -EAGAIN)
+			ret = -EIO;
+		return resolver_complete(rv, job, ret);
+	}
+	return 1;
+}
+
+enum {
+	UDP_KIND_RECV	= 0,
+	UDP_KIND_SEND	= 1,
+};
+
+static __u64 udp_udata(unsigned kind, unsigned bid)
+{
+	return LIBURING_UDATA_UDP | ((__u64) kind << 40) | bid;
+}
+
+static struct io_uring_sqe *udp_get_sqe(struct io_uring_udp_engine *ue)
+{
+	struct io_uring_sqe *sqe;
+
+	sqe = io_uring_get_sqe(ue->ring);
+	if (!sqe) {
+		io_uring_submit(ue->ring);
+		sqe = io_uring_get_sqe(ue->ring);
+	}
+	return sqe;
+}
+
+static int udp_arm_recv(struct io_uring_udp_engine *ue)
+{
+	struct io_uring_sqe *sqe;
+
+	sqe = udp_get_sqe(ue);
+	if (!sqe)
+		return -EBUSY;
+	io_uring_prep_recvmsg_multishot(sqe, 0, &ue->msg, MSG_TRUNC);
+	sqe->flags |= IOSQE_FIXED_FILE | IOSQE_BUFFER_SELECT;
+	sqe->buf_group = (__u16) ue->bgid;
+	sqe->user_data = udp_udata(UDP_KIND_RECV, 0);
+	return 0;
+}
+
+static void udp_recycle(struct io_uring_udp_engine *ue, unsigned short bid)
+{
+	io_uring_buf_ring_add(ue->br, ue->bufs + (size_t) bid * ue->buf_len,
+			      ue->buf_len, bid,
+			      io_uring_buf_ring_mask(ue->nr_bufs), 0);
+	io_uring_buf_ring_advance(ue->br, 1);
+}
+
+/*
+ * Stand up a UDP responder on 'ring': 'sockfd' is registered as the
+ * single fixed file, a provided-buffer group of nr_bufs (power of two)
+ * buffers of buf_len bytes is set up, and a multishot recvmsg is
+ * submitted before returning. Each buffer must hold the recvmsg
+ * metadata as well: usable payload is buf_len minus
+ * sizeof(struct io_uring_recvmsg_out) plus the source address. From
+ * then on the application reaps CQEs as usual and passes each through
+ * io_uring_udp_cqe().
+ */
+__cold int io_uring_udp_engine_init(struct io_uring *ring,
+			     struct io_uring_udp_engine *ue, int sockfd,
+			     unsigned nr_bufs, unsigned buf_len, int bgid,
+			     int (*on_packet)(struct io_uring_udp_engine *ue,
+					      void *data, unsigned len,
+					      struct sockaddr *src,
+					      socklen_t srclen),
+			     void *cb_data)
+{
+	int ret;
+
+	if (!nr_bufs || (nr_bufs & (nr_bufs - 1)) ||
+	    buf_len <= sizeof(struct io_uring_recvmsg_out) +
+			sizeof(struct sockaddr_storage))
+		return -EINVAL;
+
+	ret = io_uring_register_files(ring, &sockfd, 1);
+	if (ret)
+		return ret;
+
+	ue->bufs = uring_ring_malloc(ring, (size_t) nr_bufs * buf_len);
+	if (!ue->bufs) {
+		ret = -ENOMEM;
+		goto err_files;
+	}
+	ue->slots = uring_ring_malloc(ring, nr_bufs * sizeof(*ue->slots));
+	if (!ue->slots) {
+		ret = -ENOMEM;
+		goto err_bufs;
+	}
+	ue->br = io_uring_setup_buf_ring(ring, nr_bufs, bgid, 0, &ret);
+	if (!ue->br)
+		goto err_slots;
+	uring_buf_fill_seq(ue->br->bufs, (unsigned long) (uintptr_t) ue->bufs,
+			   buf_len, buf_len, 0, nr_bufs);
+	io_uring_buf_ring_advance(ue->br, (int) nr_bufs);
+
+	ue->ring = ring;
+	ue->buf_len = buf_len;
+	ue->nr_bufs = nr_bufs;
+	ue->bgid = bgid;
+	ue->on_packet = on_packet;
+	ue->cb_data = cb_data;
+	memset(&ue->msg, 0, sizeof(ue->msg));
+	ue->msg.msg_namelen = sizeof(struct sockaddr_storage);
+
+	ret = udp_arm_recv(ue);
+	if (ret)
+		goto err_br;
+	ret = io_uring_submit(ring);
+	if (ret < 0)
+		goto err_br;
+	return 0;
+err_br:
+	io_uring_free_buf_ring(ring, ue->br, nr_bufs, bgid);
+err_slots:
+	uring_ring_free(ring, ue->slots);
+err_bufs:
+	uring_ring_free(ring, ue->bufs);
+err_files:
+	io_uring_unregister_files(ring);
+	return ret;
+}
+
+__cold void io_uring_udp_engine_exit(struct io_uring_udp_engine *ue)
+{
+	io_uring_free_buf_ring(ue->ring, ue->br, ue->nr_bufs, ue->bgid);
+	io_uring_unregister_files(ue->ring);
+	uring_ring_free(ue->ring, ue->slots);
+	uring_ring_free(ue->ring, ue->bufs);
+	ue->bufs = NULL;
+	ue->slots = NULL;
+	ue->br = NULL;
+}
+
+/*
+ * Feed one reaped completion through the engine; returns 1 when
+ * consumed, 0 for foreign cqes, and the failure for hard recv errors
+ * (after re-arming). Packets with truncated names or payloads are
+ * dropped and their buffer recycled. When the callback returns a reply
+ * length, the buffer's msghdr slot is pointed at the rewritten payload
+ * and the in-buffer source address and a sendmsg is staged; the buffer
+ * returns to the group when that send completes. A terminated multishot
+ * or depleted buffer group re-arms itself.
+ */
+int io_uring_udp_cqe(struct io_uring_udp_engine *ue,
+		     const struct io_uring_cqe *cqe)
+{
+	struct io_uring_recvmsg_out *o;
+	struct io_uring_udp_slot *slot;
+	struct io_uring_sqe *sqe;
+	unsigned short bid;
+	unsigned char *buf;
+	unsigned kind;
+	int reply;
+
+	if ((cqe->user_data & (0xffffULL << 48)) != LIBURING_UDATA_UDP)
+		return 0;
+	kind = (unsigned) (cqe->user_data >> 40) & 0xff;
+	bid = (unsigned short) cqe->user_data;
+
+	if (kind == UDP_KIND_SEND) {
+		udp_recycle(ue, bid);
+		return 1;
+	}
+
+	if (!(cqe->flags & IORING_CQE_F_MORE))
+		udp_arm_recv(ue);
+	if (cqe->res == -ENOBUFS)
+		return 1;
+	if (!(cqe->flags & IORING_CQE_F_BUFFER) || cqe->res < 0)
+		return cqe->res < 0 ? cqe->res : -EBADMSG;
+
+	bid = (unsigned short) (cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+	buf = ue->bufs + (size_t) bid * ue->buf_len;
+	o = io_uring_recvmsg_validate(buf, cqe->res, &ue->msg);
+	if (!o) {
+		udp_recycle(ue, bid);
+		return -EBADMSG;
+	}
+	if (o->namelen > ue->msg.msg_namelen || (o->flags & MSG_TRUNC)) {
+		udp_recycle(ue, bid);
+		return 1;
+	}
+
+	reply = 0;
+	if (ue->on_packet)
+		reply = ue->on_packet(ue, io_uring_recvmsg_payload(o, &ue->msg),
+				      io_uring_recvmsg_payload_length(o,
+						cqe->res, &ue->msg),
+				      io_uring_recvmsg_name(o),
+				      o->namelen);
+	if (reply <= 0) {
+		udp_recycle(ue, bid);
+		return 1;
+	}
+
+	slot = &ue->slots[bid];
+	slot->iov.iov_base = io_uring_recvmsg_payload(o, &ue->msg);
+	slot->iov.iov_len = (size_t) reply;
+	memset(&slot->msg, 0, sizeof(slot->msg));
+	slot->msg.msg_name = io_uring_recvmsg_name(o);
+	slot->msg.msg_namelen = o->namelen;
+	slot->msg.msg_iov = &slot->iov;
+	slot->msg.msg_iovlen = 1;
+
+	sqe = udp_get_sqe(ue);
+	if (!sqe) {
+		udp_recycle(ue, bid);
+		return -EBUSY;
+	}
+	io_uring_prep_sendmsg(sqe, 0, &slot->msg, 0);
+	sqe->flags |= IOSQE_FIXED_FILE;
+	sqe->user_data = udp_udata(UDP_KIND_SEND, bid);
+	return 1;
+}
+
+/*
+ * Stage 'nr' SOCKET_URING_OP_SETSOCKOPT commands against 'fd' as one
+ * linked chain, so per-connection socket setup rides the ring instead
+ * of stalling an accept burst on blocking setsockopt calls. Linking
+ * gives short-circuit semantics: the first failing option completes
+ * with its error and the rest of the chain is cancelled (-ECANCELED).
+ * Every sqe carries 'user_data'; 'sqe_flags' (e.g. IOSQE_FIXED_FILE for
+ * a direct descriptor, or CQE_SKIP_SUCCESS to only hear about
+ * failures) is OR'ed into each. Nothing is staged unless the SQ has
+ * room for the whole chain; submit as usual afterwards.
+ */
+int io_uring_prep_sockopts(struct io_uring *ring, int fd,
+			   const struct io_uring_sockopt *opts, unsigned nr,
+			   __u64 user_data, unsigned char sqe_flags)
+{
+	struct io_uring_sqe *sqe;
+	unsigned i;
+
+	if (!nr)
+		return -EINVAL;
+	if (io_uring_sq_space_left(ring) < nr)
+		return -EBUSY;
+
+	for (i = 0; i < nr; i++) {
+		sqe = io_uring_get_sqe(ring);
+		io_uring_prep_cmd_sock(sqe, SOCKET_URING_OP_SETSOCKOPT, fd,
+				       opts[i].level, opts[i].optname,
+				       (void *) (uintptr_t) opts[i].optval,
+				       opts[i].optlen);
+		sqe->flags |= sqe_flags;
+		if (i + 1 < nr)
+			sqe->flags |= IOSQE_IO_LINK;
+		sqe->user_data = user_data;
+	}
+	return (int) nr;
+}
+
+/*
+ * Stage a connect linked to a timeout in one call. The timeout's
+ * user_data is derived from the connect's by flipping the top bit, so
+ * the pair stays distinguishable; io_uring_connect_cqe() matches both.
+ * 'ts' must stay valid until the timeout CQE arrives. Nothing is staged
+ * without room for both sqes; submit as usual.
+ */
+int io_uring_prep_connect_timeout(struct io_uring *ring,
+				  struct io_uring_connect_to *ct, int sockfd,
+				  const struct sockaddr *addr,
+				  socklen_t addrlen,
+				  struct __kernel_timespec *ts,
+				  __u64 user_data)
+{
+	struct io_uring_sqe *sqe;
+
+	if (io_uring_sq_space_left(ring) < 2)
+		return -EBUSY;
+
+	sqe = io_uring_get_sqe(ring);
+	io_uring_prep_connect(sqe, sockfd, addr, addrlen);
+	sqe->flags |= IOSQE_IO_LINK;
+	sqe->user_data = user_data;
+
+	sqe = io_uring_get_sqe(ring);
+	io_uring_prep_link_timeout(sqe, ts, 0);
+	sqe->user_data = user_data ^ (1ULL << 63);
+
+	ct->udata = user_data;
+	ct->timeout_udata = user_data ^ (1ULL << 63);
+	ct->res = 0;
+	ct->seen = 0;
+	return 0;
+}
+
+/*
+ * Feed reaped completions through the decoder. Returns 0 for foreign
+ * cqes, 1 when the cqe belonged to this pair but its partner is still
+ * outstanding, and 2 once both have arrived - ct->res then holds the
+ * collapsed result: 0 for a successful connect, -ETIMEDOUT if the
+ * timeout fired first, otherwise the connect's error. Don't tear down
+ * the socket or reuse 'ct' before seeing 2; the partner CQE is still
+ * in flight.
+ */
+int io_uring_connect_cqe(struct io_uring_connect_to *ct,
+			 const struct io_uring_cqe *cqe)
+{
+	if (cqe->user_data == ct->udata) {
+		ct->seen |= 1;
+		ct->res = cqe->res == -ECANCELED ? -ETIMEDOUT : cqe->res;
+	} else if (cqe->user_data == ct->timeout_udata) {
+		ct->seen |= 2;
+	} else {
+		return 0;
+	}
+	return ct->seen == 3 ? 2 : 1;
+}
@@ -4,6 +4,8 @@
 #error "This file should only be compiled for no libc build"
 #endif
 
+#include <elf.h>
+
 #include "lib.h"
 #include "syscall.h"
 
@@ -25,6 +27,25 @@ void *__uring_memset(void *s, int c, size_t n)
 	return s;
 }
 
+void *__uring_memcpy(void *dst, const void *src, size_t n)
+{
+	const unsigned char *s = src;
+	unsigned char *d = dst;
+	size_t i;
+
+	for (i = 0; i < n; i++) {
+		d[i] = s[i];
+
+		/*
+		 * An empty inline ASM to avoid auto-vectorization
+		 * because it's too bloated for liburing.
+		 */
+		__asm__ volatile ("");
+	}
+
+	return dst;
+}
+
 struct uring_heap {
 	size_t		len;
 	char		user_p[] __attribute__((__aligned__));
@@ -53,3 +74,135 @@ void __uring_free(void *p)
 	heap = container_of(p, struct uring_heap, user_p);
 	__sys_munmap(heap, heap->len);
 }
+
+/*
+ * vDSO-backed clock_gettime. Without libc every timestamp the library
+ * takes (timeout preps, coalescing deadlines, governor refills) is a
+ * real syscall; resolving the vDSO entry once from AT_SYSINFO_EHDR
+ * turns them into plain function calls. The resolver walks the vDSO's
+ * dynamic symbol table directly - there's no dynamic linker to ask in
+ * a nolibc build.
+ */
+#if __SIZEOF_POINTER__ == 8
+typedef Elf64_Ehdr uring_elf_ehdr;
+typedef Elf64_Phdr uring_elf_phdr;
+typedef Elf64_Dyn uring_elf_dyn;
+typedef Elf64_Sym uring_elf_sym;
+typedef Elf64_Word uring_elf_word;
+#else
+typedef Elf32_Ehdr uring_elf_ehdr;
+typedef Elf32_Phdr uring_elf_phdr;
+typedef Elf32_Dyn uring_elf_dyn;
+typedef Elf32_Sym uring_elf_sym;
+typedef Elf32_Word uring_elf_word;
+#endif
+
+#if defined(__aarch64__)
+#define VDSO_CLOCK_SYM	"__kernel_clock_gettime"
+#elif __SIZEOF_POINTER__ == 4
+/* 32-bit vDSOs export the 64-bit time_t variant under its own name */
+#define VDSO_CLOCK_SYM	"__vdso_clock_gettime64"
+#else
+#define VDSO_CLOCK_SYM	"__vdso_clock_gettime"
+#endif
+
+typedef int (*uring_vdso_clock_fn)(int clockid,
+				   struct __kernel_timespec *ts);
+
+static uring_vdso_clock_fn uring_vdso_clock;
+static int uring_vdso_resolved;
+
+static unsigned long uring_auxv_sysinfo_ehdr(void)
+{
+	unsigned long buf[2], ret = 0;
+	int fd;
+
+	fd = __sys_open("/proc/self/auxv", O_RDONLY, 0);
+	if (fd < 0)
+		return 0;
+
+	while (__sys_read(fd, buf, sizeof(buf)) == (long) sizeof(buf)) {
+		if (buf[0] == AT_SYSINFO_EHDR) {
+			ret = buf[1];
+			break;
+		}
+	}
+
+	__sys_close(fd);
+	return ret;
+}
+
+static int uring_vdso_streq(const char *a, const char *b)
+{
+	while (*a && *a == *b) {
+		a++;
+		b++;
+	}
+	return *a == *b;
+}
+
+static void *uring_vdso_sym(unsigned long base, const char *name)
+{
+	const uring_elf_ehdr *eh = (void *) base;
+	const uring_elf_phdr *ph = (void *) (base + eh->e_phoff);
+	const uring_elf_dyn *dyn = NULL;
+	const uring_elf_sym *symtab = NULL;
+	const uring_elf_word *hash = NULL;
+	const char *strtab = NULL;
+	unsigned long bias = base;
+	uring_elf_word i, nsym;
+
+	for (i = 0; i < eh->e_phnum; i++) {
+		if (ph[i].p_type == PT_LOAD)
+			bias = base + ph[i].p_offset - ph[i].p_vaddr;
+		else if (ph[i].p_type == PT_DYNAMIC)
+			dyn = (void *) (base + ph[i].p_offset);
+	}
+	if (!dyn)
+		return NULL;
+
+	for (; dyn->d_tag != DT_NULL; dyn++) {
+		switch (dyn->d_tag) {
+		case DT_STRTAB:
+			strtab = (void *) (bias + dyn->d_un.d_ptr);
+			break;
+		case DT_SYMTAB:
+			symtab = (void *) (bias + dyn->d_un.d_ptr);
+			break;
+		case DT_HASH:
+			hash = (void *) (bias + dyn->d_un.d_ptr);
+			break;
+		}
+	}
+	if (!strtab || !symtab || !hash)
+		return NULL;
+
+	/* nchain from the sysv hash equals the symbol count */
+	nsym = hash[1];
+	for (i = 0; i < nsym; i++) {
+		if (symtab[i].st_shndx == SHN_UNDEF)
+			continue;
+		if (uring_vdso_streq(&strtab[symtab[i].st_name], name))
+			return (void *) (bias + symtab[i].st_value);
+	}
+	return NULL;
+}
+
+int __uring_clock_gettime(int clockid, struct __kernel_timespec *ts)
+{
+	if (uring_unlikely(!uring_vdso_resolved)) {
+		unsigned long base = uring_auxv_sysinfo_ehdr();
+
+		/*
+		 * Racing resolvers store the same pointer; the flag flip
+		 * last keeps late readers on the syscall at worst.
+		 */
+		if (base)
+			uring_vdso_clock = uring_vdso_sym(base,
+							  VDSO_CLOCK_SYM);
+		uring_vdso_resolved = 1;
+	}
+	if (uring_vdso_clock)
+		return uring_vdso_clock(clockid, ts);
+	return __sys_clock_gettime(clockid, ts);
+}
@@ -5,6 +5,8 @@
 #include "syscall.h"
 #include "liburing.h"
 #include "int_flags.h"
+#include "setup.h"
+#include "trace.h"
 #include "liburing/compat.h"
 #include "liburing/io_uring.h"
 
@@ -39,15 +41,1424 @@ static inline bool sq_ring_needs_enter(struct io_uring *ring,
 	return false;
 }
 
-static inline bool cq_ring_needs_flush(struct io_uring *ring)
+static inline bool cq_ring_needs_enter(struct io_uring *ring)
+{
+	return (ring->flags & IORING_SETUP_IOPOLL) || cq_ring_needs_flush(ring);
+}
+
+#if defined(LIBURING_STATS) || defined(LIBURING_OPSTATS) || \
+    defined(LIBURING_LATSTATS)
+/*
+ * Plain unsigned increments into a static table, claimed per ring on first
+ * use via ring->stats_id. Only built with -DLIBURING_STATS and/or
+ * -DLIBURING_OPSTATS; default builds compile the hooks out entirely.
+ */
+#define STATS_MAX_RINGS	255
+
+static struct {
+	struct io_uring *ring;
+#ifdef LIBURING_STATS
+	struct io_uring_stats st;
+	struct io_uring_enter_stats ent;
+	struct io_uring_wakeup_stats wake;
+#endif
+#ifdef LIBURING_OPSTATS
+	struct io_uring_op_stat ops[IORING_OP_LAST];
+#endif
+#ifdef LIBURING_LATSTATS
+	struct io_uring_lat_stats lat;
+	unsigned long long flush_ns;
+	unsigned long long enter_ns;
+#endif
+} stats_tab[STATS_MAX_RINGS];
+
+static int ring_stats_idx(struct io_uring *ring)
+{
+	unsigned idx = ring->stats_id;
+
+	if (!idx) {
+		for (idx = 0; idx < STATS_MAX_RINGS; idx++) {
+			struct io_uring *empty = NULL;
+
+			if (__atomic_load_n(&stats_tab[idx].ring,
+					    __ATOMIC_RELAXED) == ring)
+				break;
+			if (!__atomic_compare_exchange_n(&stats_tab[idx].ring,
+							 &empty,
+							 URING_SLOT_BUSY, false,
+							 __ATOMIC_ACQUIRE,
+							 __ATOMIC_RELAXED))
+				continue;
+			memset((char *) &stats_tab[idx] + sizeof(ring), 0,
+			       sizeof(stats_tab[idx]) - sizeof(ring));
+			__atomic_store_n(&stats_tab[idx].ring, ring,
+					 __ATOMIC_RELEASE);
+			break;
+		}
+		if (idx == STATS_MAX_RINGS)
+			return -1;
+		ring->stats_id = idx + 1;
+	} else {
+		idx--;
+	}
+
+	return (int) idx;
+}
+#endif
+
+#ifdef LIBURING_STATS
+static struct io_uring_stats *ring_stats(struct io_uring *ring)
+{
+	int idx = ring_stats_idx(ring);
+
+	if (idx < 0)
+		return NULL;
+	return &stats_tab[idx].st;
+}
+
+#define STAT_INC(ring, field) do {				\
+	struct io_uring_stats *__st = ring_stats(ring);		\
+								\
+	if (__st)						\
+		__st->field++;					\
+} while (0)
+
+#define STAT_ENTER(ring, flags, submit) do {			\
+	STAT_INC(ring, enters);					\
+	if ((flags) & IORING_ENTER_GETEVENTS)			\
+		STAT_INC(ring, getevents_enters);		\
+	if ((flags) & IORING_ENTER_SQ_WAKEUP)			\
+		STAT_INC(ring, sqpoll_wakeups);			\
+	enter_stat_record(ring, flags, submit);			\
+} while (0)
+
+static void enter_stat_record(struct io_uring *ring, unsigned flags,
+			      unsigned submit)
+{
+	struct io_uring_enter_stats *es;
+	int idx = ring_stats_idx(ring);
+	unsigned bucket;
+
+	if (idx < 0)
+		return;
+	es = &stats_tab[idx].ent;
+	if (submit) {
+		if (flags & IORING_ENTER_GETEVENTS)
+			es->both++;
+		else
+			es->submit_only++;
+		bucket = (unsigned) (31 - __builtin_clz(submit));
+		if (bucket >= IO_URING_ENTER_BATCH_BUCKETS)
+			bucket = IO_URING_ENTER_BATCH_BUCKETS - 1;
+		es->batch_hist[bucket]++;
+	} else if (flags & IORING_ENTER_GETEVENTS) {
+		es->getevents_only++;
+	} else {
+		es->neither++;
+	}
+}
+
+static void wake_record(struct io_uring *ring, unsigned mask)
+{
+	int idx = ring_stats_idx(ring);
+	unsigned r;
+
+	if (idx < 0)
+		return;
+	for (r = 0; r < IO_URING_WAKEUP_NR; r++) {
+		if (mask & (1U << r))
+			stats_tab[idx].wake.reasons[r]++;
+	}
+}
+
+#define WAKE_RECORD(ring, mask)	wake_record(ring, mask)
+#else
+#define STAT_INC(ring, field)		do { } while (0)
+#define STAT_ENTER(ring, flags, submit)	do { } while (0)
+#define WAKE_RECORD(ring, mask)		do { (void) (mask); } while (0)
+#endif
+
+#ifdef LIBURING_OPSTATS
+static void opstat_record(struct io_uring *ring, const struct io_uring_cqe *cqe)
+{
+	unsigned op = (unsigned) (cqe->user_data >> 56);
+	struct io_uring_op_stat *os;
+	unsigned bucket;
+	int idx;
+
+	if (op >= IORING_OP_LAST)
+		return;
+	idx = ring_stats_idx(ring);
+	if (idx < 0)
+		return;
+	os = &stats_tab[idx].ops[op];
+	os->count++;
+	if (cqe->res < 0) {
+		os->errors++;
+		return;
+	}
+	/* power-of-16 size classes, see IO_URING_OP_RES_BUCKETS */
+	bucket = 0;
+	if (cqe->res) {
+		bucket = (unsigned) (31 - __builtin_clz((unsigned) cqe->res)) / 4 + 1;
+		if (bucket >= IO_URING_OP_RES_BUCKETS)
+			bucket = IO_URING_OP_RES_BUCKETS - 1;
+	}
+	os->res_hist[bucket]++;
+}
+
+#define OPSTAT_RECORD(ring, cqe)	opstat_record(ring, cqe)
+#else
+#define OPSTAT_RECORD(ring, cqe)	do { } while (0)
+#endif
+
+unsigned long long uring_mono_ns(void)
+{
+	struct __kernel_timespec ts;
+
+	if (uring_clock_gettime(CLOCK_MONOTONIC, &ts))
+		return 0;
+	return (unsigned long long) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+#ifdef LIBURING_LATSTATS
+static void lat_mark(struct io_uring *ring, bool enter)
+{
+	int idx = ring_stats_idx(ring);
+
+	if (idx < 0)
+		return;
+	if (enter)
+		stats_tab[idx].enter_ns = uring_mono_ns();
+	else
+		stats_tab[idx].flush_ns = uring_mono_ns();
+}
+
+/*
+ * 63 - clz(delta) is the log2 bucket; oring in 1 keeps clz defined for a
+ * zero delta and clamps it to bucket 0. No branches per sample.
+ */
+static void lat_reap(struct io_uring *ring, unsigned nr)
+{
+	unsigned long long now = uring_mono_ns();
+	struct io_uring_lat_stats *lat;
+	unsigned long long d;
+	int idx;
+
+	idx = ring_stats_idx(ring);
+	if (idx < 0 || !nr)
+		return;
+	lat = &stats_tab[idx].lat;
+	d = now - stats_tab[idx].flush_ns;
+	lat->submit[63 - __builtin_clzll(d | 1)] += nr;
+	d = now - stats_tab[idx].enter_ns;
+	lat->enter[63 - __builtin_clzll(d | 1)] += nr;
+}
+
+#define LATSTAT_FLUSH(ring)	lat_mark(ring, false)
+#define LATSTAT_ENTER(ring)	lat_mark(ring, true)
+#define LATSTAT_REAP(ring, nr)	lat_reap(ring, nr)
+#else
+#define LATSTAT_FLUSH(ring)	do { } while (0)
+#define LATSTAT_ENTER(ring)	do { } while (0)
+#define LATSTAT_REAP(ring, nr)	do { } while (0)
+#endif
+
+/*
+ * In-flight request trackers, see io_uring_inflight_init() in liburing.h.
+ * Registered the same way as the sqe audit buffers: a static table keyed
+ * by ring, with a global counter keeping the untracked fast path to a
+ * single predicted branch at flush and reap.
+ */
+#define INFLIGHT_MAX_RINGS	8
+
+enum {
+	INFLIGHT_EMPTY	= 0,
+	INFLIGHT_USED	= 1,
+	INFLIGHT_DEAD	= 2,
+};
+
+static struct io_uring_inflight *inflight_tab[INFLIGHT_MAX_RINGS];
+static unsigned inflight_active;
+
+static struct io_uring_inflight *inflight_for(struct io_uring *ring)
+{
+	unsigned i;
+
+	for (i = 0; i < INFLIGHT_MAX_RINGS; i++) {
+		struct io_uring_inflight *t =
+			__atomic_load_n(&inflight_tab[i], __ATOMIC_ACQUIRE);
+
+		if (t && t->ring == ring)
+			return t;
+	}
+	return NULL;
+}
+
+static void inflight_insert(struct io_uring_inflight *t, __u64 user_data,
+			    __u8 opcode, __s32 fd, __u64 now)
+{
+	unsigned mask = t->nr - 1;
+	unsigned slot = (unsigned) (user_data * 0x9e3779b97f4a7c15ULL >> 32);
+	unsigned i;
+
+	for (i = 0; i < t->nr; i++, slot++) {
+		struct io_uring_inflight_req *req = &t->reqs[slot & mask];
+
+		if (req->state == INFLIGHT_USED)
+			continue;
+		req->user_data = user_data;
+		req->flush_ns = now;
+		req->fd = fd;
+		req->opcode = opcode;
+		req->state = INFLIGHT_USED;
+		t->used++;
+		return;
+	}
+	t->overflows++;
+}
+
+static void io_uring_inflight_sqes(struct io_uring *ring, unsigned tail)
+{
+	int shift = !!(ring->flags & IORING_SETUP_SQE128);
+	struct io_uring_sq *sq = &ring->sq;
+	struct io_uring_inflight *t;
+	__u64 now;
+	unsigned i;
+
+	t = inflight_for(ring);
+	if (!t)
+		return;
+	now = uring_mono_ns();
+	for (i = sq->sqe_head; i != tail; i++) {
+		const struct io_uring_sqe *sqe =
+			&sq->sqes[(i & sq->ring_mask) << shift];
+
+		inflight_insert(t, sqe->user_data, sqe->opcode, sqe->fd, now);
+	}
+}
+
+static void io_uring_inflight_cqe(struct io_uring *ring,
+				  const struct io_uring_cqe *cqe)
+{
+	struct io_uring_inflight *t;
+	unsigned mask, slot, i;
+
+	if (cqe->flags & IORING_CQE_F_MORE)
+		return;
+	t = inflight_for(ring);
+	if (!t)
+		return;
+	mask = t->nr - 1;
+	slot = (unsigned) (cqe->user_data * 0x9e3779b97f4a7c15ULL >> 32);
+	for (i = 0; i < t->nr; i++, slot++) {
+		struct io_uring_inflight_req *req = &t->reqs[slot & mask];
+
+		if (req->state == INFLIGHT_EMPTY)
+			return;
+		if (req->state == INFLIGHT_USED &&
+		    req->user_data == cqe->user_data) {
+			req->state = INFLIGHT_DEAD;
+			t->used--;
+			return;
+		}
+	}
+}
+
+#define INFLIGHT_FLUSH(ring, tail) do {					\
+	if (uring_unlikely(IO_URING_READ_ONCE(inflight_active)))	\
+		io_uring_inflight_sqes(ring, tail);			\
+} while (0)
+
+#define INFLIGHT_CQE(ring, cqe) do {					\
+	if (uring_unlikely(IO_URING_READ_ONCE(inflight_active)))	\
+		io_uring_inflight_cqe(ring, cqe);			\
+} while (0)
+
+int io_uring_inflight_init(struct io_uring *ring, struct io_uring_inflight *t,
+			   unsigned nr)
+{
+	unsigned i;
+
+	if (!nr || (nr & (nr - 1)))
+		return -EINVAL;
+
+	t->reqs = uring_ring_malloc(ring, (size_t) nr * sizeof(*t->reqs));
+	if (!t->reqs)
+		return -ENOMEM;
+	memset(t->reqs, 0, (size_t) nr * sizeof(*t->reqs));
+	t->ring = ring;
+	t->nr = nr;
+	t->used = 0;
+	t->overflows = 0;
+
+	for (i = 0; i < INFLIGHT_MAX_RINGS; i++) {
+		struct io_uring_inflight *empty = NULL;
+
+		if (__atomic_compare_exchange_n(&inflight_tab[i], &empty, t,
+						false, __ATOMIC_RELEASE,
+						__ATOMIC_RELAXED)) {
+			__atomic_fetch_add(&inflight_active, 1,
+					   __ATOMIC_RELAXED);
+			return 0;
+		}
+	}
+	uring_ring_free(ring, t->reqs);
+	t->reqs = NULL;
+	return -ENOSPC;
+}
+
+/*
+ * Report every tracked request older than age_ns through cb. Returns how
+ * many were stale; what to do about them - cancel, log, close the fd - is
+ * the caller's call.
+ */
+unsigned io_uring_scan_stale(struct io_uring_inflight *t, __u64 age_ns,
+			     io_uring_stale_fn cb, void *data)
+{
+	__u64 now = uring_mono_ns();
+	unsigned stale = 0;
+	unsigned i;
+
+	for (i = 0; i < t->nr; i++) {
+		const struct io_uring_inflight_req *req = &t->reqs[i];
+
+		if (req->state != INFLIGHT_USED)
+			continue;
+		if (now - req->flush_ns < age_ns)
+			continue;
+		stale++;
+		if (cb)
+			cb(req, data);
+	}
+	return stale;
+}
+
+void io_uring_inflight_exit(struct io_uring_inflight *t)
+{
+	unsigned i;
+
+	for (i = 0; i < INFLIGHT_MAX_RINGS; i++) {
+		if (__atomic_load_n(&inflight_tab[i], __ATOMIC_RELAXED) == t) {
+			__atomic_store_n(&inflight_tab[i], NULL,
+					 __ATOMIC_RELEASE);
+			__atomic_fetch_sub(&inflight_active, 1,
+					   __ATOMIC_RELAXED);
+			break;
+		}
+	}
+	uring_ring_free(t->ring, t->reqs);
+	t->reqs = NULL;
+}
+
+/*
+ * CQE_SKIP_SUCCESS accounting, see io_uring_skip_track_init() in
+ * liburing.h. Same registration scheme as the other trackers: a static
+ * table keyed by ring and a global counter keeping the untracked case
+ * to one predicted branch at flush and reap.
+ */
+#define SKIP_MAX_RINGS	8
+
+static struct io_uring_skip_track *skip_tab[SKIP_MAX_RINGS];
+static unsigned skip_active;
+
+static struct io_uring_skip_track *skip_for(struct io_uring *ring)
+{
+	unsigned i;
+
+	for (i = 0; i < SKIP_MAX_RINGS; i++) {
+		struct io_uring_skip_track *t =
+			__atomic_load_n(&skip_tab[i], __ATOMIC_ACQUIRE);
+
+		if (t && t->ring == ring)
+			return t;
+	}
+	return NULL;
+}
+
+static void io_uring_skip_sqes(struct io_uring *ring, unsigned tail)
+{
+	int shift = !!(ring->flags & IORING_SETUP_SQE128);
+	struct io_uring_sq *sq = &ring->sq;
+	struct io_uring_skip_track *t;
+	unsigned i;
+
+	t = skip_for(ring);
+	if (!t)
+		return;
+	for (i = sq->sqe_head; i != tail; i++) {
+		const struct io_uring_sqe *sqe =
+			&sq->sqes[(i & sq->ring_mask) << shift];
+
+		if (sqe->flags & IOSQE_CQE_SKIP_SUCCESS)
+			t->skip_flagged++;
+	}
+	t->flushed += tail - sq->sqe_head;
+}
+
+static void io_uring_skip_cqe(struct io_uring *ring,
+			      const struct io_uring_cqe *cqe)
+{
+	struct io_uring_skip_track *t;
+
+	if (cqe->flags & IORING_CQE_F_MORE)
+		return;
+	t = skip_for(ring);
+	if (t)
+		t->cqes++;
+}
+
+#define SKIP_FLUSH(ring, tail) do {					\
+	if (uring_unlikely(IO_URING_READ_ONCE(skip_active)))		\
+		io_uring_skip_sqes(ring, tail);				\
+} while (0)
+
+#define SKIP_CQE(ring, cqe) do {					\
+	if (uring_unlikely(IO_URING_READ_ONCE(skip_active)))		\
+		io_uring_skip_cqe(ring, cqe);				\
+} while (0)
+
+int io_uring_skip_track_init(struct io_uring *ring,
+			     struct io_uring_skip_track *t)
+{
+	unsigned i;
+
+	memset(t, 0, sizeof(*t));
+	t->ring = ring;
+	for (i = 0; i < SKIP_MAX_RINGS; i++) {
+		struct io_uring_skip_track *empty = NULL;
+
+		if (__atomic_compare_exchange_n(&skip_tab[i], &empty, t,
+						false, __ATOMIC_RELEASE,
+						__ATOMIC_RELAXED)) {
+			__atomic_fetch_add(&skip_active, 1, __ATOMIC_RELAXED);
+			return 0;
+		}
+	}
+	return -ENOSPC;
+}
+
+/*
+ * Number of CQE-bearing requests still outstanding. Reconciles reaped
+ * CQEs against published sqes: skip-flagged requests are expected to
+ * post nothing, so any reap beyond the expected CQE count is attributed
+ * to skip-flagged failures and remembered in t->skip_failures.
+ */
+unsigned long long io_uring_skip_pending(struct io_uring_skip_track *t)
+{
+	unsigned long long expected = t->flushed - t->skip_flagged;
+
+	if (t->cqes - t->skip_failures > expected)
+		t->skip_failures = t->cqes - expected;
+	return expected - (t->cqes - t->skip_failures);
+}
+
+void io_uring_skip_track_exit(struct io_uring_skip_track *t)
+{
+	unsigned i;
+
+	for (i = 0; i < SKIP_MAX_RINGS; i++) {
+		if (__atomic_load_n(&skip_tab[i], __ATOMIC_RELAXED) == t) {
+			__atomic_store_n(&skip_tab[i], NULL, __ATOMIC_RELEASE);
+			__atomic_fetch_sub(&skip_active, 1, __ATOMIC_RELAXED);
+			break;
+		}
+	}
+}
+
+/*
+ * Iovec arenas with a span in flight, so the batch reap paths can
+ * recycle spans as their completions are reaped. Same shape as the
+ * audit and skip registries: rings without an arena pay one predicted
+ * branch on the zero count.
+ */
+#define ARENA_MAX_RINGS	8
+static struct io_uring_iovec_arena *arena_tab[ARENA_MAX_RINGS];
+static unsigned arena_active;
+
+/*
+ * Retire the span bound to this completion, then pop retired records in
+ * allocation order - a span completing out of order stays accounted
+ * until everything allocated before it is done, which is what keeps
+ * spans contiguous and reclaim O(1) amortized.
+ */
+static int io_uring_iovec_reap(struct io_uring_iovec_arena *a,
+			       const struct io_uring_cqe *cqe)
+{
+	unsigned i;
+
+	if (cqe->flags & IORING_CQE_F_MORE)
+		return 0;
+	for (i = a->rec_head; i != a->rec_tail; i++) {
+		struct io_uring_iovec_rec *rec = &a->recs[i & a->rec_mask];
+
+		if (rec->done || rec->user_data != cqe->user_data)
+			continue;
+		rec->done = 1;
+		while (a->rec_head != a->rec_tail) {
+			rec = &a->recs[a->rec_head & a->rec_mask];
+			if (!rec->done)
+				break;
+			a->head = rec->start + rec->nr;
+			a->rec_head++;
+			a->in_flight--;
+		}
+		if (!a->in_flight)
+			a->head = a->tail = 0;
+		return 1;
+	}
+	return 0;
+}
+
+static void io_uring_arena_cqe(struct io_uring *ring,
+			       const struct io_uring_cqe *cqe)
+{
+	unsigned i;
+
+	for (i = 0; i < ARENA_MAX_RINGS; i++) {
+		struct io_uring_iovec_arena *a =
+			__atomic_load_n(&arena_tab[i], __ATOMIC_ACQUIRE);
+
+		if (a && a->ring == ring)
+			io_uring_iovec_reap(a, cqe);
+	}
+}
+
+#define ARENA_CQE(ring, cqe) do {					\
+	if (uring_unlikely(IO_URING_READ_ONCE(arena_active)))		\
+		io_uring_arena_cqe(ring, cqe);				\
+} while (0)
+
+int io_uring_iovec_arena_init(struct io_uring *ring,
+			      struct io_uring_iovec_arena *a,
+			      unsigned nr_iovecs)
+{
+	unsigned i;
+
+	if (!nr_iovecs || (nr_iovecs & (nr_iovecs - 1)))
+		return -EINVAL;
+	memset(a, 0, sizeof(*a));
+	a->iovs = uring_ring_malloc(ring, nr_iovecs * sizeof(*a->iovs));
+	if (!a->iovs)
+		return -ENOMEM;
+	a->recs = uring_ring_malloc(ring, nr_iovecs * sizeof(*a->recs));
+	if (!a->recs) {
+		uring_ring_free(ring, a->iovs);
+		return -ENOMEM;
+	}
+	a->ring = ring;
+	a->nr_total = nr_iovecs;
+	a->rec_mask = nr_iovecs - 1;
+	for (i = 0; i < ARENA_MAX_RINGS; i++) {
+		struct io_uring_iovec_arena *empty = NULL;
+
+		if (__atomic_compare_exchange_n(&arena_tab[i], &empty, a,
+						false, __ATOMIC_RELEASE,
+						__ATOMIC_RELAXED)) {
+			__atomic_fetch_add(&arena_active, 1, __ATOMIC_RELAXED);
+			return 0;
+		}
+	}
+	uring_ring_free(ring, a->recs);
+	uring_ring_free(ring, a->iovs);
+	return -ENOSPC;
+}
+
+/*
+ * Reserve 'n' contiguous iovecs for the request that will complete as
+ * 'user_data'; the span is recycled when that completion is reaped.
+ * Returns NULL when the arena can't fit the span, which means enough
+ * older requests haven't completed yet - backpressure, not a leak.
+ */
+struct iovec *io_uring_iovec_alloc(struct io_uring_iovec_arena *a, unsigned n,
+				   __u64 user_data)
+{
+	struct io_uring_iovec_rec *rec;
+	unsigned start;
+
+	if (!n || n > a->nr_total ||
+	    a->rec_tail - a->rec_head > a->rec_mask)
+		return NULL;
+	if (a->tail >= a->head) {
+		if (n <= a->nr_total - a->tail)
+			start = a->tail;
+		else if (n < a->head)
+			start = 0;	/* wrap, leaving a tail gap */
+		else
+			return NULL;
+	} else {
+		if (n >= a->head - a->tail)
+			return NULL;
+		start = a->tail;
+	}
+	rec = &a->recs[a->rec_tail & a->rec_mask];
+	rec->user_data = user_data;
+	rec->start = start;
+	rec->nr = n;
+	rec->done = 0;
+	a->rec_tail++;
+	a->tail = start + n;
+	a->in_flight++;
+	return &a->iovs[start];
+}
+
+/*
+ * Recycle the span bound to 'cqe', for callers reaping one cqe at a
+ * time. The batch reap paths do this implicitly; feeding a cqe twice is
+ * harmless. Returns 1 if a span retired, 0 otherwise.
+ */
+int io_uring_iovec_arena_cqe(struct io_uring_iovec_arena *a,
+			     const struct io_uring_cqe *cqe)
+{
+	return io_uring_iovec_reap(a, cqe);
+}
+
+void io_uring_iovec_arena_exit(struct io_uring_iovec_arena *a)
+{
+	unsigned i;
+
+	for (i = 0; i < ARENA_MAX_RINGS; i++) {
+		if (__atomic_load_n(&arena_tab[i], __ATOMIC_RELAXED) == a) {
+			__atomic_store_n(&arena_tab[i], NULL, __ATOMIC_RELEASE);
+			__atomic_fetch_sub(&arena_active, 1, __ATOMIC_RELAXED);
+			break;
+		}
+	}
+	uring_ring_free(a->ring, a->recs);
+	uring_ring_free(a->ring, a->iovs);
+	a->recs = NULL;
+	a->iovs = NULL;
+}
+
+/*
+ * Open a gather over all contiguous free space in the arena; close it
+ * with io_uring_gather_writev() or io_uring_gather_abort(). Nothing is
+ * reserved until the writev is emitted, so only one gather may be open
+ * per arena at a time. Returns the iovec capacity, 0 with a full arena.
+ */
+int io_uring_gather_start(struct io_uring_iovec_arena *a,
+			  struct io_uring_gather *g)
+{
+	g->arena = a;
+	g->nr = 0;
+	if (a->tail >= a->head) {
+		g->iovs = &a->iovs[a->tail];
+		g->cap = a->nr_total - a->tail;
+		if (g->cap <= 1 && a->head > g->cap) {
+			g->iovs = a->iovs;
+			g->cap = a->head - 1;
+		}
+	} else {
+		g->iovs = &a->iovs[a->tail];
+		g->cap = a->head - a->tail - 1;
+	}
+	return (int) g->cap;
+}
+
+/*
+ * Append one buffer to the open gather. A buffer starting where the
+ * previous one ended extends that iovec instead of consuming a new one,
+ * which serialization paths emitting adjacent fragments benefit from.
+ */
+int io_uring_gather_add(struct io_uring_gather *g, const void *buf, size_t len)
+{
+	struct iovec *iov;
+
+	if (g->nr) {
+		iov = &g->iovs[g->nr - 1];
+		if ((char *) iov->iov_base + iov->iov_len == buf) {
+			iov->iov_len += len;
+			return 0;
+		}
+	}
+	if (g->nr == g->cap)
+		return -ENOSPC;
+	iov = &g->iovs[g->nr++];
+	iov->iov_base = (void *) (uintptr_t) buf;
+	iov->iov_len = len;
+	return 0;
+}
+
+/*
+ * Emit the writev for the gathered buffers, binding the iovec span to
+ * 'user_data' until that completion is reaped. Returns the prepared sqe
+ * with user_data already set, or NULL with the SQ full or the gather
+ * empty - the gather is closed either way, nothing stays reserved on
+ * failure.
+ */
+struct io_uring_sqe *io_uring_gather_writev(struct io_uring_gather *g, int fd,
+					    __u64 offset, __u64 user_data)
+{
+	struct io_uring_iovec_arena *a = g->arena;
+	struct io_uring_sqe *sqe;
+	struct iovec *iovs;
+	unsigned nr = g->nr;
+
+	g->nr = 0;
+	if (!nr)
+		return NULL;
+	sqe = io_uring_get_sqe(a->ring);
+	if (!sqe)
+		return NULL;
+	iovs = io_uring_iovec_alloc(a, nr, user_data);
+	/*
+	 * The gather built in place over free space, so the reservation
+	 * can't fail; it can land in the other free zone than the one the
+	 * gather built in, which zones never overlap.
+	 */
+	if (iovs != g->iovs)
+		memcpy(iovs, g->iovs, nr * sizeof(*iovs));
+	io_uring_prep_writev(sqe, fd, iovs, nr, offset);
+	sqe->user_data = user_data;
+	return sqe;
+}
+
+void io_uring_gather_abort(struct io_uring_gather *g)
+{
+	g->nr = 0;
+}
+
+/*
+ * Context slabs with blocks in flight, for automatic recycling in the
+ * batch reap paths. Registry shape as with the arenas above.
+ */
+#define CTXSLAB_MAX_RINGS	8
+static struct io_uring_ctx_slab *ctxslab_tab[CTXSLAB_MAX_RINGS];
+static unsigned ctxslab_active;
+
+static struct io_uring_ctx_class *
+io_uring_ctx_class_of(struct io_uring_ctx_slab *s, const void *ptr)
+{
+	unsigned i;
+
+	for (i = 0; i < s->nr_classes; i++) {
+		struct io_uring_ctx_class *c = &s->classes[i];
+
+		if ((const char *) ptr >= c->base &&
+		    (const char *) ptr < c->base +
+				(size_t) c->block_size * c->nr_blocks)
+			return c;
+	}
+	return NULL;
+}
+
+/*
+ * Promote last batch's limbo blocks to allocatable, called once per
+ * reap batch before any of its cqes recycle. Limbo is what keeps a
+ * block from being handed out again while its final cqe still sits
+ * unprocessed in the same batch.
+ */
+static void io_uring_ctx_epoch(struct io_uring *ring)
+{
+	unsigned i, j;
+
+	for (i = 0; i < CTXSLAB_MAX_RINGS; i++) {
+		struct io_uring_ctx_slab *s =
+			__atomic_load_n(&ctxslab_tab[i], __ATOMIC_ACQUIRE);
+
+		if (!s || s->ring != ring)
+			continue;
+		for (j = 0; j < s->nr_classes; j++) {
+			struct io_uring_ctx_class *c = &s->classes[j];
+
+			if (!c->limbo_head)
+				continue;
+			*(void **) c->limbo_tail = c->free_head;
+			c->free_head = c->limbo_head;
+			c->limbo_head = c->limbo_tail = NULL;
+		}
+	}
+}
+
+static void io_uring_ctx_cqe(struct io_uring *ring,
+			     const struct io_uring_cqe *cqe)
+{
+	void *ptr = io_uring_udata_ptr(cqe->user_data);
+	unsigned i;
+
+	if (cqe->flags & IORING_CQE_F_MORE)
+		return;
+	for (i = 0; i < CTXSLAB_MAX_RINGS; i++) {
+		struct io_uring_ctx_slab *s =
+			__atomic_load_n(&ctxslab_tab[i], __ATOMIC_ACQUIRE);
+		struct io_uring_ctx_class *c;
+
+		if (!s || s->ring != ring)
+			continue;
+		c = io_uring_ctx_class_of(s, ptr);
+		if (!c)
+			continue;
+		*(void **) ptr = c->limbo_head;
+		c->limbo_head = ptr;
+		if (!c->limbo_tail)
+			c->limbo_tail = ptr;
+		return;
+	}
+}
+
+#define CTXSLAB_EPOCH(ring) do {					\
+	if (uring_unlikely(IO_URING_READ_ONCE(ctxslab_active)))		\
+		io_uring_ctx_epoch(ring);				\
+} while (0)
+
+#define CTXSLAB_CQE(ring, cqe) do {					\
+	if (uring_unlikely(IO_URING_READ_ONCE(ctxslab_active)))		\
+		io_uring_ctx_cqe(ring, cqe);				\
+} while (0)
+
+/*
+ * Carve one arena per size class: 'nr_blocks[i]' blocks of 'sizes[i]'
+ * bytes, each rounded up to and aligned on a cacheline. Sizes under a
+ * pointer are bumped to one, the freelist link lives in free blocks.
+ */
+int io_uring_ctx_slab_init(struct io_uring *ring, struct io_uring_ctx_slab *s,
+			   const unsigned *sizes, const unsigned *nr_blocks,
+			   unsigned nr_classes)
+{
+	unsigned i, j;
+	int ret = -ENOMEM;
+
+	if (!nr_classes || nr_classes > IO_URING_CTX_CLASSES)
+		return -EINVAL;
+	memset(s, 0, sizeof(*s));
+	s->ring = ring;
+	s->nr_classes = nr_classes;
+	for (i = 0; i < nr_classes; i++) {
+		struct io_uring_ctx_class *c = &s->classes[i];
+		char *blk;
+
+		if (!sizes[i] || !nr_blocks[i]) {
+			ret = -EINVAL;
+			goto err;
+		}
+		c->block_size = (sizes[i] + 63) & ~63U;
+		c->nr_blocks = nr_blocks[i];
+		c->mem = uring_ring_malloc(ring, (size_t) c->block_size * c->nr_blocks + 63);
+		if (!c->mem)
+			goto err;
+		c->base = (char *) (((uintptr_t) c->mem + 63) & ~(uintptr_t) 63);
+		for (j = 0; j < c->nr_blocks; j++) {
+			blk = c->base + (size_t) j * c->block_size;
+			*(void **) blk = c->free_head;
+			c->free_head = blk;
+		}
+	}
+	for (i = 0; i < CTXSLAB_MAX_RINGS; i++) {
+		struct io_uring_ctx_slab *empty = NULL;
+
+		if (__atomic_compare_exchange_n(&ctxslab_tab[i], &empty, s,
+						false, __ATOMIC_RELEASE,
+						__ATOMIC_RELAXED)) {
+			__atomic_fetch_add(&ctxslab_active, 1,
+					   __ATOMIC_RELAXED);
+			return 0;
+		}
+	}
+	ret = -ENOSPC;
+	i = nr_classes;
+err:
+	while (i--)
+		uring_ring_free(ring, s->classes[i].mem);
+	return ret;
+}
+
+/*
+ * Pop a block from 'size_class'. NULL means the class is exhausted -
+ * every block is in flight or resting out its reap batch - which is
+ * backpressure to surface, not an allocation failure to retry.
+ */
+void *io_uring_ctx_alloc(struct io_uring_ctx_slab *s, unsigned size_class)
+{
+	struct io_uring_ctx_class *c;
+	void *blk;
+
+	if (size_class >= s->nr_classes)
+		return NULL;
+	c = &s->classes[size_class];
+	blk = c->free_head;
+	if (blk)
+		c->free_head = *(void **) blk;
+	return blk;
+}
+
+/*
+ * Immediately return a block, for requests that never reached the ring
+ * or contexts the reap hook shouldn't see again. Unlike auto-recycling
+ * there is no limbo rest: the caller asserts nothing else references
+ * the block.
+ */
+void io_uring_ctx_free(struct io_uring_ctx_slab *s, void *ctx)
+{
+	struct io_uring_ctx_class *c = io_uring_ctx_class_of(s, ctx);
+
+	if (!c)
+		return;
+	*(void **) ctx = c->free_head;
+	c->free_head = ctx;
+}
+
+void io_uring_ctx_slab_exit(struct io_uring_ctx_slab *s)
+{
+	unsigned i;
+
+	for (i = 0; i < CTXSLAB_MAX_RINGS; i++) {
+		if (__atomic_load_n(&ctxslab_tab[i], __ATOMIC_RELAXED) == s) {
+			__atomic_store_n(&ctxslab_tab[i], NULL,
+					 __ATOMIC_RELEASE);
+			__atomic_fetch_sub(&ctxslab_active, 1,
+					   __ATOMIC_RELAXED);
+			break;
+		}
+	}
+	for (i = 0; i < s->nr_classes; i++) {
+		uring_ring_free(s->ring, s->classes[i].mem);
+		s->classes[i].mem = NULL;
+	}
+	s->nr_classes = 0;
+}
+
+/*
+ * Auxiliary-struct pools with structs in flight, recycled in the batch
+ * reap paths. Registry shape as above.
+ */
+#define AUX_MAX_RINGS	8
+static struct io_uring_aux_pool *aux_tab[AUX_MAX_RINGS];
+static unsigned aux_active;
+
+static const unsigned io_uring_aux_sizes[IO_URING_AUX_NR] = {
+	[IO_URING_AUX_MSGHDR]	= sizeof(struct msghdr),
+	[IO_URING_AUX_SOCKADDR]	= sizeof(struct io_uring_aux_sockaddr),
+	[IO_URING_AUX_OPEN_HOW]	= sizeof(struct open_how),
+};
+
+static unsigned io_uring_aux_hash(__u64 user_data)
+{
+	return (unsigned) ((user_data * 0x9e3779b97f4a7c15ULL) >> 32);
+}
+
+static int io_uring_aux_grow_binds(struct io_uring_aux_pool *p)
+{
+	unsigned nr = p->binds ? 2 * (p->bind_mask + 1) : 16;
+	struct io_uring_aux_bind *binds, *old = p->binds;
+	unsigned old_mask = p->bind_mask;
+	unsigned i, idx;
+
+	binds = uring_ring_malloc(p->ring, nr * sizeof(*binds));
+	if (!binds)
+		return -ENOMEM;
+	memset(binds, 0, nr * sizeof(*binds));
+	if (old) {
+		for (i = 0; i <= old_mask; i++) {
+			if (old[i].state != 1)
+				continue;
+			idx = io_uring_aux_hash(old[i].user_data);
+			while (binds[idx & (nr - 1)].state)
+				idx++;
+			binds[idx & (nr - 1)] = old[i];
+		}
+	}
+	p->binds = binds;
+	p->bind_mask = nr - 1;
+	uring_ring_free(p->ring, old);
+	return 0;
+}
+
+int io_uring_aux_init(struct io_uring *ring, struct io_uring_aux_pool *p)
+{
+	unsigned i;
+
+	memset(p, 0, sizeof(*p));
+	p->ring = ring;
+	for (i = 0; i < AUX_MAX_RINGS; i++) {
+		struct io_uring_aux_pool *empty = NULL;
+
+		if (__atomic_compare_exchange_n(&aux_tab[i], &empty, p,
+						false, __ATOMIC_RELEASE,
+						__ATOMIC_RELAXED)) {
+			__atomic_fetch_add(&aux_active, 1, __ATOMIC_RELAXED);
+			return 0;
+		}
+	}
+	return -ENOSPC;
+}
+
+/*
+ * Hand out one struct of 'type', bound to 'user_data' until its
+ * completion is reaped. An empty freelist refills with as many structs
+ * as the type currently has in flight (minimum 8), so steady-state
+ * pools converge on roughly twice the working set and never allocate on
+ * the hot path again. Returns NULL on allocation failure or a bogus
+ * type.
+ */
+void *io_uring_aux_alloc(struct io_uring_aux_pool *p, unsigned type,
+			 __u64 user_data)
+{
+	struct io_uring_aux_bind *bind;
+	unsigned idx, probes;
+	void *ptr;
+
+	if (type >= IO_URING_AUX_NR)
+		return NULL;
+	if (!p->free_head[type]) {
+		unsigned size = (io_uring_aux_sizes[type] + 7) & ~7U;
+		unsigned n = p->in_flight[type] > 8 ? p->in_flight[type] : 8;
+		char *chunk, *blk;
+
+		chunk = uring_ring_malloc(p->ring, sizeof(void *) + (size_t) n * size);
+		if (!chunk)
+			return NULL;
+		*(void **) chunk = p->chunks;
+		p->chunks = chunk;
+		p->chunk_bytes += sizeof(void *) + (size_t) n * size;
+		for (blk = chunk + sizeof(void *); n; n--, blk += size) {
+			*(void **) blk = p->free_head[type];
+			p->free_head[type] = blk;
+		}
+	}
+	if ((p->nr_bound + 1) * 2 > p->bind_mask + 1 &&
+	    io_uring_aux_grow_binds(p))
+		return NULL;
+
+	ptr = p->free_head[type];
+	p->free_head[type] = *(void **) ptr;
+	idx = io_uring_aux_hash(user_data);
+	for (probes = 0; ; probes++, idx++) {
+		bind = &p->binds[idx & p->bind_mask];
+		if (bind->state != 1)
+			break;
+	}
+	bind->user_data = user_data;
+	bind->ptr = ptr;
+	bind->state = 1;
+	bind->type = (unsigned char) type;
+	p->nr_bound++;
+	p->in_flight[type]++;
+	return ptr;
+}
+
+/*
+ * Free the struct bound to this completion, if any. Fed automatically
+ * by the batch reap paths; single-cqe reapers call it themselves.
+ * Returns 1 if a struct was returned to its freelist.
+ */
+int io_uring_aux_cqe(struct io_uring_aux_pool *p,
+		     const struct io_uring_cqe *cqe)
+{
+	struct io_uring_aux_bind *bind;
+	unsigned idx, probes;
+
+	if (!p->nr_bound || (cqe->flags & IORING_CQE_F_MORE))
+		return 0;
+	idx = io_uring_aux_hash(cqe->user_data);
+	for (probes = 0; probes <= p->bind_mask; probes++, idx++) {
+		bind = &p->binds[idx & p->bind_mask];
+		if (!bind->state)
+			return 0;
+		if (bind->state != 1 || bind->user_data != cqe->user_data)
+			continue;
+		*(void **) bind->ptr = p->free_head[bind->type];
+		p->free_head[bind->type] = bind->ptr;
+		p->in_flight[bind->type]--;
+		bind->state = 2;
+		p->nr_bound--;
+		return 1;
+	}
+	return 0;
+}
+
+static void io_uring_aux_reap(struct io_uring *ring,
+			      const struct io_uring_cqe *cqe)
+{
+	unsigned i;
+
+	for (i = 0; i < AUX_MAX_RINGS; i++) {
+		struct io_uring_aux_pool *p =
+			__atomic_load_n(&aux_tab[i], __ATOMIC_ACQUIRE);
+
+		if (p && p->ring == ring)
+			io_uring_aux_cqe(p, cqe);
+	}
+}
+
+#define AUX_CQE(ring, cqe) do {						\
+	if (uring_unlikely(IO_URING_READ_ONCE(aux_active)))		\
+		io_uring_aux_reap(ring, cqe);				\
+} while (0)
+
+void io_uring_aux_exit(struct io_uring_aux_pool *p)
+{
+	void *chunk, *next;
+	unsigned i;
+
+	for (i = 0; i < AUX_MAX_RINGS; i++) {
+		if (__atomic_load_n(&aux_tab[i], __ATOMIC_RELAXED) == p) {
+			__atomic_store_n(&aux_tab[i], NULL, __ATOMIC_RELEASE);
+			__atomic_fetch_sub(&aux_active, 1, __ATOMIC_RELAXED);
+			break;
+		}
+	}
+	for (chunk = p->chunks; chunk; chunk = next) {
+		next = *(void **) chunk;
+		uring_ring_free(p->ring, chunk);
+	}
+	p->chunks = NULL;
+	uring_ring_free(p->ring, p->binds);
+	p->binds = NULL;
+	p->nr_bound = 0;
+}
+
+/* io-wq worker caps stashed by a level-3 trim, for restore */
+#define TRIM_MAX_RINGS	8
+static struct {
+	struct io_uring *ring;
+	unsigned vals[2];
+} trim_saved[TRIM_MAX_RINGS];
+
+/*
+ * Release reclaimable ring-adjacent memory while the ring idles, so an
+ * orchestrator can claw back resident set off-peak without tearing
+ * rings down. Everything released rebuilds lazily under traffic.
+ * Levels nest:
+ *
+ * 1: free the growth chunks of fully idle auxiliary pools; the next
+ *    alloc refills on demand.
+ * 2: also MADV_DONTNEED fully free context slab classes - the pages
+ *    return zeroed on next touch, so the freelist is relinked here.
+ * 3: also cap io-wq workers at one so idle workers wind down and stay
+ *    down; io_uring_trim_restore() reinstates the saved caps.
+ *
+ * Pools with structs in flight are left alone entirely. Returns the
+ *  number of bytes released, or -errno from the worker-cap register.
+ */
+long io_uring_trim(struct io_uring *ring, unsigned level)
+{
+	long released = 0;
+	unsigned i, j, k;
+
+	for (i = 0; level >= 1 && i < AUX_MAX_RINGS; i++) {
+		struct io_uring_aux_pool *p =
+			__atomic_load_n(&aux_tab[i], __ATOMIC_ACQUIRE);
+		void *chunk, *next;
+
+		if (!p || p->ring != ring || p->nr_bound)
+			continue;
+		for (chunk = p->chunks; chunk; chunk = next) {
+			next = *(void **) chunk;
+			uring_ring_free(ring, chunk);
+		}
+		p->chunks = NULL;
+		memset(p->free_head, 0, sizeof(p->free_head));
+		released += (long) p->chunk_bytes;
+		p->chunk_bytes = 0;
+	}
+
+	for (i = 0; level >= 2 && i < CTXSLAB_MAX_RINGS; i++) {
+		struct io_uring_ctx_slab *s =
+			__atomic_load_n(&ctxslab_tab[i], __ATOMIC_ACQUIRE);
+
+		if (!s || s->ring != ring)
+			continue;
+		for (j = 0; j < s->nr_classes; j++) {
+			struct io_uring_ctx_class *c = &s->classes[j];
+			size_t len = (size_t) c->block_size * c->nr_blocks;
+			uintptr_t start, end;
+			unsigned nr_free = 0;
+			void *blk;
+
+			for (blk = c->free_head; blk; blk = *(void **) blk)
+				nr_free++;
+			if (nr_free != c->nr_blocks || c->limbo_head)
+				continue;
+			/*
+			 * The arena is only cacheline aligned; only the
+			 * whole pages inside it can be dropped.
+			 */
+			start = ((uintptr_t) c->base + 4095) & ~(uintptr_t) 4095;
+			end = ((uintptr_t) c->base + len) & ~(uintptr_t) 4095;
+			if (end <= start)
+				continue;
+			if (__sys_madvise((void *) start, end - start,
+					  MADV_DONTNEED))
+				continue;
+			c->free_head = NULL;
+			for (k = 0; k < c->nr_blocks; k++) {
+				blk = c->base + (size_t) k * c->block_size;
+				*(void **) blk = c->free_head;
+				c->free_head = blk;
+			}
+			released += (long) (end - start);
+		}
+	}
+
+	if (level >= 3) {
+		unsigned vals[2] = { 0, 0 };
+		int ret;
+
+		/* a zero reads the current cap without changing it */
+		ret = io_uring_register_iowq_max_workers(ring, vals);
+		if (ret)
+			return ret;
+		for (i = 0; i < TRIM_MAX_RINGS; i++) {
+			struct io_uring *key =
+				__atomic_load_n(&trim_saved[i].ring,
+						__ATOMIC_RELAXED);
+
+			if (key == ring)
+				break;
+			if (key)
+				continue;
+			key = NULL;
+			if (__atomic_compare_exchange_n(&trim_saved[i].ring,
+							&key, URING_SLOT_BUSY,
+							false,
+							__ATOMIC_ACQUIRE,
+							__ATOMIC_RELAXED))
+				break;
+		}
+		if (i == TRIM_MAX_RINGS)
+			return -ENOSPC;
+		trim_saved[i].vals[0] = vals[0];
+		trim_saved[i].vals[1] = vals[1];
+		__atomic_store_n(&trim_saved[i].ring, ring, __ATOMIC_RELEASE);
+		vals[0] = vals[1] = 1;
+		ret = io_uring_register_iowq_max_workers(ring, vals);
+		if (ret) {
+			__atomic_store_n(&trim_saved[i].ring, NULL,
+					 __ATOMIC_RELEASE);
+			return ret;
+		}
+	}
+
+	return released;
+}
+
+/*
+ * Reinstate the io-wq worker caps a level-3 io_uring_trim() saved.
+ * A no-op returning 0 if nothing is stashed for this ring.
+ */
+int io_uring_trim_restore(struct io_uring *ring)
+{
+	unsigned i;
+	int ret;
+
+	for (i = 0; i < TRIM_MAX_RINGS; i++) {
+		if (__atomic_load_n(&trim_saved[i].ring,
+				    __ATOMIC_ACQUIRE) != ring)
+			continue;
+		ret = io_uring_register_iowq_max_workers(ring,
+							 trim_saved[i].vals);
+		if (!ret)
+			__atomic_store_n(&trim_saved[i].ring, NULL,
+					 __ATOMIC_RELEASE);
+		return ret;
+	}
+	return 0;
+}
+
+/*
+ * Action class per negated errno, for io_uring_cqe_classify(). The
+ * default is teardown - an errno this table doesn't know is not one to
+ * guess a retry on - which is the enum's zero value precisely so the
+ * unlisted entries need no initializer.
+ */
+const __u8 io_uring_cqe_class_tab[256] = {
+	[EAGAIN]	= IO_URING_CLASS_RETRY,
+	[EINTR]		= IO_URING_CLASS_RETRY,
+	[EBUSY]		= IO_URING_CLASS_RETRY,
+	[ENOBUFS]	= IO_URING_CLASS_REARM,
+	[ECANCELED]	= IO_URING_CLASS_REARM,
+};
+
+int io_uring_get_op_stats(struct io_uring *ring, struct io_uring_op_stat *tab,
+			  unsigned nr_ops)
+{
+#ifdef LIBURING_OPSTATS
+	int idx = ring_stats_idx(ring);
+
+	if (idx < 0)
+		return -ENOMEM;
+	if (nr_ops > IORING_OP_LAST)
+		nr_ops = IORING_OP_LAST;
+	memcpy(tab, stats_tab[idx].ops, nr_ops * sizeof(*tab));
+	return (int) nr_ops;
+#else
+	return -EOPNOTSUPP;
+#endif
+}
+
+int io_uring_get_stats(struct io_uring *ring, struct io_uring_stats *st)
 {
-	return IO_URING_READ_ONCE(*ring->sq.kflags) &
-				 (IORING_SQ_CQ_OVERFLOW | IORING_SQ_TASKRUN);
+#ifdef LIBURING_STATS
+	struct io_uring_stats *s = ring_stats(ring);
+
+	if (!s)
+		return -ENOMEM;
+	*st = *s;
+	return 0;
+#else
+	return -EOPNOTSUPP;
+#endif
 }
 
-static inline bool cq_ring_needs_enter(struct io_uring *ring)
+int io_uring_get_enter_stats(struct io_uring *ring,
+			     struct io_uring_enter_stats *st)
 {
-	return (ring->flags & IORING_SETUP_IOPOLL) || cq_ring_needs_flush(ring);
+#ifdef LIBURING_STATS
+	int idx = ring_stats_idx(ring);
+
+	if (idx < 0)
+		return -ENOMEM;
+	*st = stats_tab[idx].ent;
+	return 0;
+#else
+	return -EOPNOTSUPP;
+#endif
+}
+
+/*
+ * Pure accumulation, usable regardless of how the library was built: sum
+ * per-ring snapshots into one fleet-wide distribution.
+ */
+void io_uring_merge_enter_stats(struct io_uring_enter_stats *dst,
+				const struct io_uring_enter_stats *src)
+{
+	unsigned i;
+
+	dst->submit_only += src->submit_only;
+	dst->getevents_only += src->getevents_only;
+	dst->both += src->both;
+	dst->neither += src->neither;
+	for (i = 0; i < IO_URING_ENTER_BATCH_BUCKETS; i++)
+		dst->batch_hist[i] += src->batch_hist[i];
+}
+
+int io_uring_get_wakeup_stats(struct io_uring *ring,
+			      struct io_uring_wakeup_stats *st)
+{
+#ifdef LIBURING_STATS
+	int idx = ring_stats_idx(ring);
+
+	if (idx < 0)
+		return -ENOMEM;
+	*st = stats_tab[idx].wake;
+	return 0;
+#else
+	return -EOPNOTSUPP;
+#endif
+}
+
+int io_uring_get_lat_stats(struct io_uring *ring, struct io_uring_lat_stats *st)
+{
+#ifdef LIBURING_LATSTATS
+	int idx = ring_stats_idx(ring);
+
+	if (idx < 0)
+		return -ENOMEM;
+	*st = stats_tab[idx].lat;
+	return 0;
+#else
+	return -EOPNOTSUPP;
+#endif
 }
 
 struct get_data {
@@ -59,18 +1470,789 @@ struct get_data {
 	void *arg;
 };
 
-static int _io_uring_get_cqe(struct io_uring *ring,
+/*
+ * Busy-poll the CQ for a bounded number of cpu-relax iterations before
+ * falling back to io_uring_enter. The window adapts to recent completion
+ * gaps: a spin that finds the wanted completions grows the next window
+ * back towards the configured limit, a wasted spin halves it, so bursty
+ * periods keep spinning while quiet periods quickly revert to blocking.
+ */
+static void cq_spin_for_cqe(struct io_uring *ring, struct get_data *data)
+{
+	struct io_uring_cq *cq = &ring->cq;
+	unsigned budget = cq->spin_cur;
+	struct io_uring_cqe *cqe;
+	unsigned avail;
+
+	while (budget--) {
+		if (__io_uring_peek_cqe(ring, &cqe, &avail))
+			return;
+		if (cqe && avail >= data->wait_nr) {
+			cq->spin_cur += (cq->spin_cur >> 1) + 1;
+			if (cq->spin_cur > cq->spin_limit)
+				cq->spin_cur = cq->spin_limit;
+			return;
+		}
+		uring_cpu_relax();
+	}
+
+	/*
+	 * Halve the window after a wasted spin, but never below one
+	 * iteration: a zero window would fail the enablement check in
+	 * _io_uring_get_cqe and the next burst could never regrow it.
+	 */
+	cq->spin_cur >>= 1;
+	if (!cq->spin_cur)
+		cq->spin_cur = 1;
+}
+
+/*
+ * Hybrid reap for IOPOLL rings: a bounded run of non-blocking
+ * IORING_ENTER_GETEVENTS passes, piggy-backing any pending submissions on
+ * the first, before the generic loop falls back to a blocking wait. The
+ * kernel only moves IOPOLL completions into the CQ when poked, so each
+ * pass is a cheap reap rather than a sleep; polled devices usually have
+ * the data long before a blocking enter would return.
+ */
+/*
+ * LIBURING_SETUP_ZERO_SQES support: bulk-clear the SQE slots an enter
+ * just consumed, so the _pz prep variants find them pre-zeroed when the
+ * indices come around again. Runs of consumed slots are cleared with at
+ * most two memsets (one per ring wrap), which is far cheaper than the
+ * per-field zero stores the generic preps pay. Rings that never set the
+ * flag only see one predicted branch per enter.
+ */
+static void io_uring_zero_consumed_sqes(struct io_uring *ring, unsigned head,
+					unsigned tail)
+{
+	struct io_uring_sq *sq = &ring->sq;
+	int shift = !!(ring->flags & IORING_SETUP_SQE128);
+
+	while (head != tail) {
+		unsigned idx = head & sq->ring_mask;
+		unsigned run = sq->ring_entries - idx;
+
+		if (run > tail - head)
+			run = tail - head;
+		memset(&sq->sqes[idx << shift], 0,
+		       (size_t) run * (sizeof(struct io_uring_sqe) << shift));
+		head += run;
+	}
+}
+
+#define ZERO_SQES_BEGIN(ring, var) do {					\
+	if (uring_unlikely((ring)->int_flags & INT_FLAG_ZERO_SQES))	\
+		(var) = IO_URING_READ_ONCE(*(ring)->sq.khead);		\
+} while (0)
+
+#define ZERO_SQES_END(ring, var) do {					\
+	if (uring_unlikely((ring)->int_flags & INT_FLAG_ZERO_SQES))	\
+		io_uring_zero_consumed_sqes(ring, var,			\
+				IO_URING_READ_ONCE(*(ring)->sq.khead));	\
+} while (0)
+
+static void cq_hybrid_reap(struct io_uring *ring, struct get_data *data)
+{
+	unsigned tries = ring->iopoll_reap_tries;
+	struct io_uring_cqe *cqe;
+	unsigned avail, zero_head = 0;
+	int ret;
+
+	do {
+		unsigned flags = IORING_ENTER_GETEVENTS;
+
+		if (__io_uring_peek_cqe(ring, &cqe, &avail))
+			return;
+		if (cqe && avail >= data->wait_nr)
+			return;
+		if (!tries--)
+			return;
+		/* only called for the SQ_WAKEUP side effect on flags */
+		sq_ring_needs_enter(ring, data->submit, &flags);
+		if (ring->int_flags & INT_FLAG_REG_RING)
+			flags |= IORING_ENTER_REGISTERED_RING;
+		STAT_ENTER(ring, flags, data->submit);
+		ZERO_SQES_BEGIN(ring, zero_head);
+		ret = __sys_io_uring_enter(ring->enter_ring_fd, data->submit,
+					   0, flags, NULL);
+		if (ret < 0)
+			return;
+		ZERO_SQES_END(ring, zero_head);
+		data->submit -= ret;
+	} while (1);
+}
+
+void io_uring_set_iopoll_reap(struct io_uring *ring, unsigned tries)
+{
+	if (tries > 255)
+		tries = 255;
+	ring->iopoll_reap_tries = (__u8) tries;
+}
+
+/*
+ * Pluggable wait strategies, see struct io_uring_wait_ops in liburing.h.
+ * Registered per ring in a small static table like the audit and shadow
+ * registries; wait_ops_active keeps the unregistered case to a single
+ * predicted-not-taken branch per wait. The built-ins live in this TU so
+ * LTO sees through the function pointer for them.
+ */
+#define WAIT_OPS_MAX_RINGS	8
+
+static struct {
+	struct io_uring *ring;
+	struct io_uring_wait_ops ops;
+} wait_ops_tab[WAIT_OPS_MAX_RINGS];
+static unsigned wait_ops_active;
+
+int io_uring_set_wait_ops(struct io_uring *ring,
+			  const struct io_uring_wait_ops *ops)
+{
+	int empty = -1;
+	unsigned i;
+
+	for (i = 0; i < WAIT_OPS_MAX_RINGS; i++) {
+		struct io_uring *key = __atomic_load_n(&wait_ops_tab[i].ring,
+						       __ATOMIC_RELAXED);
+
+		if (key == ring) {
+			if (!ops) {
+				memset(&wait_ops_tab[i].ops, 0,
+				       sizeof(wait_ops_tab[i].ops));
+				__atomic_store_n(&wait_ops_tab[i].ring, NULL,
+						 __ATOMIC_RELEASE);
+				__atomic_fetch_sub(&wait_ops_active, 1,
+						   __ATOMIC_RELAXED);
+			} else {
+				wait_ops_tab[i].ops = *ops;
+			}
+			return 0;
+		}
+		if (!key && empty < 0)
+			empty = (int) i;
+	}
+	if (!ops)
+		return 0;
+	for (i = empty < 0 ? 0 : (unsigned) empty;
+	     i < WAIT_OPS_MAX_RINGS; i++) {
+		struct io_uring *key = NULL;
+
+		if (!__atomic_compare_exchange_n(&wait_ops_tab[i].ring, &key,
+						 URING_SLOT_BUSY, false,
+						 __ATOMIC_ACQUIRE,
+						 __ATOMIC_RELAXED))
+			continue;
+		wait_ops_tab[i].ops = *ops;
+		__atomic_store_n(&wait_ops_tab[i].ring, ring,
+				 __ATOMIC_RELEASE);
+		__atomic_fetch_add(&wait_ops_active, 1, __ATOMIC_RELAXED);
+		return 0;
+	}
+	return -ENOSPC;
+}
+
+static __cold void wait_ops_poll(struct io_uring *ring, struct get_data *data)
+{
+	unsigned i;
+
+	for (i = 0; i < WAIT_OPS_MAX_RINGS; i++) {
+		if (__atomic_load_n(&wait_ops_tab[i].ring,
+				    __ATOMIC_ACQUIRE) == ring) {
+			wait_ops_tab[i].ops.poll(ring, data->wait_nr,
+						 wait_ops_tab[i].ops.arg);
+			return;
+		}
+	}
+}
+
+/*
+ * Built-in sched_yield ladder: give up the cpu a bounded number of
+ * times, re-checking the CQ after each slice, before the generic loop
+ * falls back to a blocking enter. Suits rings sharing a core with the
+ * task that produces their completions.
+ */
+static void wait_poll_yield(struct io_uring *ring, unsigned wait_nr, void *arg)
+{
+	unsigned tries = 16;
+	struct io_uring_cqe *cqe;
+	unsigned avail;
+
+	(void) arg;
+	while (tries--) {
+		if (__io_uring_peek_cqe(ring, &cqe, &avail))
+			return;
+		if (cqe && avail >= wait_nr)
+			return;
+		if (__sys_sched_yield())
+			return;
+	}
+}
+
+const struct io_uring_wait_ops io_uring_wait_ops_yield = {
+	.poll	= wait_poll_yield,
+};
+
+/*
+ * Per-opcode token-bucket admission, see io_uring_set_throttle() in
+ * liburing.h. SQ slots on a shared ring are a commons: one caller
+ * flooding a cheap opcode can starve everyone else's submissions.
+ * Buckets are per ring in a static table like the wait-ops registry;
+ * the admitted path costs one decrement, refill is amortized into the
+ * SQ flush so the hot get_sqe path never reads the clock.
+ */
+#define THROTTLE_MAX_RINGS	8
+#define THROTTLE_MAX_OPS	4
+
+struct uring_throttle_bucket {
+	__u8 opcode;
+	__u8 in_use;
+	__u32 rate;		/* tokens per second */
+	__u32 burst;
+	__u32 tokens;
+	__u64 last_ns;
+	__u64 rejected;
+};
+
+static struct {
+	struct io_uring *ring;
+	struct uring_throttle_bucket b[THROTTLE_MAX_OPS];
+} throttle_tab[THROTTLE_MAX_RINGS];
+static unsigned throttle_active;
+
+static struct uring_throttle_bucket *throttle_find(struct io_uring *ring,
+						   __u8 opcode)
+{
+	unsigned i, j;
+
+	for (i = 0; i < THROTTLE_MAX_RINGS; i++) {
+		if (__atomic_load_n(&throttle_tab[i].ring,
+				    __ATOMIC_ACQUIRE) != ring)
+			continue;
+		for (j = 0; j < THROTTLE_MAX_OPS; j++) {
+			if (throttle_tab[i].b[j].in_use &&
+			    throttle_tab[i].b[j].opcode == opcode)
+				return &throttle_tab[i].b[j];
+		}
+		return NULL;
+	}
+	return NULL;
+}
+
+static void throttle_bucket_refill(struct uring_throttle_bucket *b,
+				   unsigned long long now)
+{
+	unsigned long long add;
+
+	add = (now - b->last_ns) * b->rate / 1000000000ULL;
+	if (!add)
+		return;
+	if (b->tokens + add < b->burst)
+		b->tokens += add;
+	else
+		b->tokens = b->burst;
+	/* advance by what was credited, keeping the sub-token remainder */
+	b->last_ns += add * 1000000000ULL / b->rate;
+}
+
+static void throttle_refill(struct io_uring *ring)
+{
+	unsigned long long now = 0;
+	unsigned i, j;
+
+	for (i = 0; i < THROTTLE_MAX_RINGS; i++) {
+		if (__atomic_load_n(&throttle_tab[i].ring,
+				    __ATOMIC_ACQUIRE) != ring)
+			continue;
+		for (j = 0; j < THROTTLE_MAX_OPS; j++) {
+			if (!throttle_tab[i].b[j].in_use)
+				continue;
+			if (!now)
+				now = uring_mono_ns();
+			throttle_bucket_refill(&throttle_tab[i].b[j], now);
+		}
+		return;
+	}
+}
+
+int io_uring_set_throttle(struct io_uring *ring, __u8 opcode,
+			  unsigned rate, unsigned burst)
+{
+	struct uring_throttle_bucket *b = throttle_find(ring, opcode);
+	int ring_slot = -1, empty = -1;
+	unsigned i, j;
+
+	if (b) {
+		if (!rate) {
+			b->in_use = 0;
+			/* release the ring slot once its last bucket goes */
+			for (i = 0; i < THROTTLE_MAX_RINGS; i++) {
+				if (__atomic_load_n(&throttle_tab[i].ring,
+						    __ATOMIC_RELAXED) != ring)
+					continue;
+				for (j = 0; j < THROTTLE_MAX_OPS; j++)
+					if (throttle_tab[i].b[j].in_use)
+						return 0;
+				__atomic_store_n(&throttle_tab[i].ring, NULL,
+						 __ATOMIC_RELEASE);
+				__atomic_fetch_sub(&throttle_active, 1,
+						   __ATOMIC_RELAXED);
+				return 0;
+			}
+			return 0;
+		}
+		b->rate = rate;
+		b->burst = burst ? burst : 1;
+		if (b->tokens > b->burst)
+			b->tokens = b->burst;
+		return 0;
+	}
+	if (!rate)
+		return 0;
+
+	for (i = 0; i < THROTTLE_MAX_RINGS; i++) {
+		struct io_uring *key = __atomic_load_n(&throttle_tab[i].ring,
+						       __ATOMIC_RELAXED);
+
+		if (key == ring) {
+			ring_slot = (int) i;
+			break;
+		}
+		if (!key && empty < 0)
+			empty = (int) i;
+	}
+	if (ring_slot < 0) {
+		struct io_uring *key;
+
+		for (i = empty < 0 ? 0 : (unsigned) empty;
+		     i < THROTTLE_MAX_RINGS; i++) {
+			key = NULL;
+			if (__atomic_compare_exchange_n(&throttle_tab[i].ring,
+							&key, URING_SLOT_BUSY,
+							false,
+							__ATOMIC_ACQUIRE,
+							__ATOMIC_RELAXED)) {
+				ring_slot = (int) i;
+				break;
+			}
+		}
+		if (ring_slot < 0)
+			return -ENOSPC;
+		b = &throttle_tab[ring_slot].b[0];
+		b->opcode = opcode;
+		b->rate = rate;
+		b->burst = burst ? burst : 1;
+		b->tokens = b->burst;
+		b->last_ns = uring_mono_ns();
+		b->rejected = 0;
+		b->in_use = 1;
+		__atomic_store_n(&throttle_tab[ring_slot].ring, ring,
+				 __ATOMIC_RELEASE);
+		__atomic_fetch_add(&throttle_active, 1, __ATOMIC_RELAXED);
+		return 0;
+	}
+	for (j = 0; j < THROTTLE_MAX_OPS; j++) {
+		b = &throttle_tab[ring_slot].b[j];
+		if (b->in_use)
+			continue;
+		b->opcode = opcode;
+		b->rate = rate;
+		b->burst = burst ? burst : 1;
+		b->tokens = b->burst;
+		b->last_ns = uring_mono_ns();
+		b->rejected = 0;
+		b->in_use = 1;
+		return 0;
+	}
+	return -ENOSPC;
+}
+
+/*
+ * Admission-checked io_uring_get_sqe(): a NULL here with SQ space still
+ * left means the opcode's bucket was dry, not that the ring is full.
+ * Opcodes without a configured bucket pass straight through.
+ */
+struct io_uring_sqe *io_uring_get_sqe_throttled(struct io_uring *ring,
+						__u8 opcode)
+{
+	struct uring_throttle_bucket *b;
+	struct io_uring_sqe *sqe;
+
+	if (uring_likely(!IO_URING_READ_ONCE(throttle_active)))
+		return io_uring_get_sqe(ring);
+	b = throttle_find(ring, opcode);
+	if (!b)
+		return io_uring_get_sqe(ring);
+	if (!b->tokens) {
+		/*
+		 * Second chance off the hot path, so a rejected caller can
+		 * recover without waiting for the next flush to refill.
+		 */
+		throttle_bucket_refill(b, uring_mono_ns());
+		if (!b->tokens) {
+			b->rejected++;
+			return NULL;
+		}
+	}
+	sqe = io_uring_get_sqe(ring);
+	if (sqe)
+		b->tokens--;
+	return sqe;
+}
+
+unsigned long long io_uring_throttle_rejected(struct io_uring *ring,
+					      __u8 opcode)
+{
+	struct uring_throttle_bucket *b = throttle_find(ring, opcode);
+
+	return b ? b->rejected : 0;
+}
+
+/*
+ * Ring liveness watchdog, see io_uring_watchdog_arm() in liburing.h.
+ * One multishot timeout stays in flight under LIBURING_UDATA_WATCHDOG;
+ * every completion of it is a heartbeat, and a beat overdue by more
+ * than interval + grace means the completion side is wedged even
+ * though the SQ still accepts entries. Per-ring slots in a static
+ * table like the wait-ops registry.
+ */
+#define WATCHDOG_MAX_RINGS	8
+
+struct uring_watchdog {
+	struct io_uring *ring;
+	void (*cb)(struct io_uring *ring, void *arg);
+	void *arg;
+	/* the kernel reads this async at prep; it must outlive the SQE */
+	struct __kernel_timespec its;
+	unsigned long long interval_ns;
+	unsigned long long grace_ns;
+	unsigned long long last_beat_ns;
+	bool lapsed;
+	bool multishot;
+};
+
+static struct uring_watchdog watchdog_tab[WATCHDOG_MAX_RINGS];
+static unsigned watchdog_active;
+
+static struct uring_watchdog *watchdog_find(struct io_uring *ring)
+{
+	unsigned i;
+
+	for (i = 0; i < WATCHDOG_MAX_RINGS; i++) {
+		if (__atomic_load_n(&watchdog_tab[i].ring,
+				    __ATOMIC_ACQUIRE) == ring)
+			return &watchdog_tab[i];
+	}
+	return NULL;
+}
+
+static int watchdog_queue_timeout(struct uring_watchdog *w)
+{
+	struct io_uring_sqe *sqe;
+
+	sqe = io_uring_get_sqe(w->ring);
+	if (!sqe)
+		return -EBUSY;
+	io_uring_prep_timeout(sqe, &w->its, 0,
+			      w->multishot ? IORING_TIMEOUT_MULTISHOT : 0);
+	sqe->user_data = LIBURING_UDATA_WATCHDOG;
+	return 0;
+}
+
+int io_uring_watchdog_arm(struct io_uring *ring,
+			  struct __kernel_timespec *interval,
+			  unsigned long long grace_ns,
+			  void (*cb)(struct io_uring *ring, void *arg),
+			  void *arg)
+{
+	struct uring_watchdog *w = watchdog_find(ring);
+	unsigned i;
+	int ret;
+
+	if (w)
+		return -EEXIST;
+	for (i = 0; i < WATCHDOG_MAX_RINGS; i++) {
+		struct io_uring *key = NULL;
+
+		if (__atomic_compare_exchange_n(&watchdog_tab[i].ring, &key,
+						URING_SLOT_BUSY, false,
+						__ATOMIC_ACQUIRE,
+						__ATOMIC_RELAXED)) {
+			w = &watchdog_tab[i];
+			break;
+		}
+	}
+	if (!w)
+		return -ENOSPC;
+	w->cb = cb;
+	w->arg = arg;
+	w->its = *interval;
+	w->interval_ns = (unsigned long long) interval->tv_sec * 1000000000ULL +
+			 interval->tv_nsec;
+	w->grace_ns = grace_ns;
+	w->last_beat_ns = uring_mono_ns();
+	w->lapsed = false;
+	w->multishot = true;
+	/*
+	 * Publish before queueing: watchdog_queue_timeout() reads w->ring,
+	 * and no heartbeat cqe can race in before the submit below.
+	 */
+	__atomic_store_n(&w->ring, ring, __ATOMIC_RELEASE);
+	ret = watchdog_queue_timeout(w);
+	if (!ret) {
+		ret = io_uring_submit(ring);
+		if (ret >= 0)
+			ret = 0;
+	}
+	if (ret) {
+		w->cb = NULL;
+		w->arg = NULL;
+		__atomic_store_n(&w->ring, NULL, __ATOMIC_RELEASE);
+		return ret;
+	}
+	w->last_beat_ns = uring_mono_ns();
+	__atomic_fetch_add(&watchdog_active, 1, __ATOMIC_RELAXED);
+	return 0;
+}
+
+int io_uring_watchdog_disarm(struct io_uring *ring)
+{
+	struct uring_watchdog *w = watchdog_find(ring);
+	struct io_uring_sqe *sqe;
+
+	if (!w)
+		return -ENOENT;
+	/*
+	 * Best effort: the remove and the cancelled timeout both complete
+	 * under the reserved user_data, which io_uring_watchdog_cqe()
+	 * swallows even after the slot is gone.
+	 */
+	sqe = io_uring_get_sqe(ring);
+	if (sqe) {
+		io_uring_prep_timeout_remove(sqe, LIBURING_UDATA_WATCHDOG, 0);
+		sqe->user_data = LIBURING_UDATA_WATCHDOG;
+		io_uring_submit(ring);
+	}
+	w->cb = NULL;
+	w->arg = NULL;
+	__atomic_store_n(&w->ring, NULL, __ATOMIC_RELEASE);
+	__atomic_fetch_sub(&watchdog_active, 1, __ATOMIC_RELAXED);
+	return 0;
+}
+
+int io_uring_watchdog_cqe(struct io_uring *ring,
+			  const struct io_uring_cqe *cqe)
+{
+	struct uring_watchdog *w;
+
+	if (cqe->user_data != LIBURING_UDATA_WATCHDOG)
+		return 0;
+	w = watchdog_find(ring);
+	if (!w)
+		return 1;
+	w->last_beat_ns = uring_mono_ns();
+	w->lapsed = false;
+	if (cqe->res == -EINVAL && w->multishot)
+		/* pre-multishot kernel: fall back to re-arming each beat */
+		w->multishot = false;
+	if (!(cqe->flags & IORING_CQE_F_MORE))
+		watchdog_queue_timeout(w);
+	return 1;
+}
+
+int io_uring_watchdog_check(struct io_uring *ring)
+{
+	struct uring_watchdog *w = watchdog_find(ring);
+	unsigned long long now;
+
+	if (!w)
+		return -ENOENT;
+	now = uring_mono_ns();
+	if (now - w->last_beat_ns <= w->interval_ns + w->grace_ns)
+		return 0;
+	if (!w->lapsed) {
+		w->lapsed = true;
+		if (w->cb)
+			w->cb(ring, w->arg);
+	}
+	return -ETIME;
+}
+
+/*
+ * Batched taskrun flushing, see io_uring_set_taskrun_batch() in
+ * liburing.h. With COOP_TASKRUN the IORING_SQ_TASKRUN flag makes the
+ * peek paths enter eagerly - sometimes once per CQE - to run deferred
+ * task work. The policy holds those taskrun-only enters back until
+ * either 'batch_n' sightings of the flag or 'max_ns' have accrued
+ * since the first deferral, amortizing the syscall; overflow flushes
+ * are never held. Per-ring slots in a static table like the others.
+ */
+#define TR_BATCH_MAX_RINGS	8
+
+static struct uring_tr_batch {
+	struct io_uring *ring;
+	unsigned batch_n;
+	unsigned long long max_ns;
+	/* flag sightings since the last flush */
+	unsigned pending;
+	unsigned long long first_ns;
+	struct io_uring_taskrun_stats st;
+} tr_batch_tab[TR_BATCH_MAX_RINGS];
+static unsigned tr_batch_active;
+
+static struct uring_tr_batch *tr_batch_find(struct io_uring *ring)
+{
+	unsigned i;
+
+	for (i = 0; i < TR_BATCH_MAX_RINGS; i++) {
+		if (__atomic_load_n(&tr_batch_tab[i].ring,
+				    __ATOMIC_ACQUIRE) == ring)
+			return &tr_batch_tab[i];
+	}
+	return NULL;
+}
+
+int io_uring_set_taskrun_batch(struct io_uring *ring, unsigned batch_n,
+			       unsigned long long max_ns)
+{
+	struct uring_tr_batch *t = tr_batch_find(ring);
+	unsigned i;
+
+	if (batch_n <= 1 && !max_ns) {
+		if (t) {
+			memset((char *) t + sizeof(t->ring), 0,
+			       sizeof(*t) - sizeof(t->ring));
+			__atomic_store_n(&t->ring, NULL, __ATOMIC_RELEASE);
+			__atomic_fetch_sub(&tr_batch_active, 1,
+					   __ATOMIC_RELAXED);
+		}
+		return 0;
+	}
+	if (!t) {
+		for (i = 0; i < TR_BATCH_MAX_RINGS; i++) {
+			struct io_uring *key = NULL;
+
+			if (__atomic_compare_exchange_n(&tr_batch_tab[i].ring,
+							&key, URING_SLOT_BUSY,
+							false,
+							__ATOMIC_ACQUIRE,
+							__ATOMIC_RELAXED)) {
+				t = &tr_batch_tab[i];
+				break;
+			}
+		}
+		if (!t)
+			return -ENOSPC;
+		memset((char *) t + sizeof(t->ring), 0,
+		       sizeof(*t) - sizeof(t->ring));
+		t->batch_n = batch_n ? batch_n : 1;
+		t->max_ns = max_ns;
+		__atomic_store_n(&t->ring, ring, __ATOMIC_RELEASE);
+		__atomic_fetch_add(&tr_batch_active, 1, __ATOMIC_RELAXED);
+		return 0;
+	}
+	t->batch_n = batch_n ? batch_n : 1;
+	t->max_ns = max_ns;
+	return 0;
+}
+
+int io_uring_taskrun_batch_stats(struct io_uring *ring,
+				 struct io_uring_taskrun_stats *st)
+{
+	struct uring_tr_batch *t = tr_batch_find(ring);
+
+	if (!t)
+		return -ENOENT;
+	*st = t->st;
+	return 0;
+}
+
+/* true when a taskrun-only flush should keep waiting for more signal */
+static bool taskrun_defer(struct io_uring *ring)
+{
+	struct uring_tr_batch *t = tr_batch_find(ring);
+	unsigned long long now;
+	unsigned kflags;
+
+	if (!t)
+		return false;
+	kflags = IO_URING_READ_ONCE(*ring->sq.kflags);
+	if (kflags & IORING_SQ_CQ_OVERFLOW)
+		goto flush;
+	if (!(kflags & IORING_SQ_TASKRUN))
+		return false;
+	now = uring_mono_ns();
+	if (!t->pending)
+		t->first_ns = now;
+	t->pending++;
+	t->st.signals++;
+	if (t->pending < t->batch_n &&
+	    (!t->max_ns || now - t->first_ns < t->max_ns)) {
+		t->st.deferred++;
+		return true;
+	}
+flush:
+	t->st.flushes++;
+	if (t->pending > t->st.max_batch)
+		t->st.max_batch = t->pending;
+	t->pending = 0;
+	return false;
+}
+
+static unsigned __io_uring_flush_sq(struct io_uring *ring);
+
+static __hot int _io_uring_get_cqe(struct io_uring *ring,
 			     struct io_uring_cqe **cqe_ptr,
 			     struct get_data *data)
 {
 	struct io_uring_cqe *cqe = NULL;
-	bool looped = false;
+	bool looped = false, piggyback = false;
 	int err = 0;
 
+	/*
+	 * LIBURING_SETUP_WAIT_SUBMIT: a wait-side enter carries whatever
+	 * SQEs are sitting in the ring, staged or already flushed, merging
+	 * the submission into the syscall the wait pays for anyway.
+	 */
+	if (uring_unlikely(ring->int_flags & INT_FLAG_WAIT_SUBMIT) &&
+	    !data->submit && data->wait_nr) {
+		data->submit = __io_uring_flush_sq(ring);
+		piggyback = data->submit != 0;
+	}
+
+	/*
+	 * A ring driven by io_uring_submit_cached() may have missed a
+	 * NEED_WAKEUP transition for up to a cache window of submits.
+	 * Blocking for completions is the last safe moment to notice:
+	 * expire the cache and wake the sq thread if it parked with
+	 * entries still pending, or this wait could hang on work the
+	 * kernel never saw.
+	 */
+	if (uring_unlikely(ring->sq_wakeup_cache) && data->wait_nr) {
+		unsigned wake_flags = 0;
+
+		ring->sq_wakeup_cache = 0;
+		if (sq_ring_needs_enter(ring, 1, &wake_flags)) {
+			if (ring->int_flags & INT_FLAG_REG_RING)
+				wake_flags |= IORING_ENTER_REGISTERED_RING;
+			__sys_io_uring_enter(ring->enter_ring_fd, 0, 0,
+					     wake_flags, NULL);
+		}
+	}
+
+	if (ring->cq.spin_cur && data->wait_nr && !data->submit)
+		cq_spin_for_cqe(ring, data);
+	if (uring_unlikely(IO_URING_READ_ONCE(wait_ops_active)) && data->wait_nr)
+		wait_ops_poll(ring, data);
+	if (uring_unlikely(IO_URING_READ_ONCE(watchdog_active)) && data->wait_nr)
+		io_uring_watchdog_check(ring);
+	if (ring->iopoll_reap_tries && data->wait_nr && !data->arg &&
+	    (ring->flags & IORING_SETUP_IOPOLL))
+		cq_hybrid_reap(ring, data);
+
 	do {
 		bool need_enter = false;
 		unsigned flags = 0;
 		unsigned nr_available;
+		unsigned wake = 0, zero_head = 0;
 		int ret;
 
 		ret = __io_uring_peek_cqe(ring, &cqe, &nr_available);
@@ -85,86 +2267,780 @@ static int _io_uring_get_cqe(struct io_uring *ring,
 			 * the kernel. Since there's nothing to submit or
 			 * wait for, don't keep retrying.
 			 */
-			if (looped || !cq_ring_needs_enter(ring)) {
+			if (looped || !cq_ring_needs_enter(ring) ||
+			    (uring_unlikely(IO_URING_READ_ONCE(tr_batch_active)) &&
+			     taskrun_defer(ring))) {
 				if (!err)
 					err = -EAGAIN;
 				break;
 			}
 			need_enter = true;
+			wake |= 1U << IO_URING_WAKEUP_CQ_FLUSH;
 		}
 		if (data->wait_nr > nr_available || need_enter) {
 			flags = IORING_ENTER_GETEVENTS | data->get_flags;
+			if (data->wait_nr > nr_available)
+				wake |= 1U << IO_URING_WAKEUP_WAIT;
 			need_enter = true;
 		}
-		if (sq_ring_needs_enter(ring, data->submit, &flags))
+		if (sq_ring_needs_enter(ring, data->submit, &flags)) {
 			need_enter = true;
+			if (flags & IORING_ENTER_SQ_WAKEUP)
+				wake |= 1U << IO_URING_WAKEUP_SQPOLL;
+			else
+				wake |= 1U << IO_URING_WAKEUP_SUBMIT;
+		}
 		if (!need_enter)
 			break;
 		if (looped && data->has_ts) {
 			struct io_uring_getevents_arg *arg = data->arg;
 
+			/*
+			 * With EXT_ARG_REG 'arg' is a slot offset, not a
+			 * pointer; the slot always carries a timeout.
+			 */
+			if (data->get_flags & IORING_ENTER_EXT_ARG_REG) {
+				if (!cqe && !err)
+					err = -ETIME;
+				break;
+			}
 			if (!cqe && arg->ts && !err)
 				err = -ETIME;
 			break;
 		}
 
-		if (ring->int_flags & INT_FLAG_REG_RING)
-			flags |= IORING_ENTER_REGISTERED_RING;
-		ret = __sys_io_uring_enter2(ring->enter_ring_fd, data->submit,
-					    data->wait_nr, flags, data->arg,
-					    data->sz);
-		if (ret < 0) {
-			if (!err)
-				err = ret;
-			break;
-		}
+		if (ring->int_flags & INT_FLAG_REG_RING)
+			flags |= IORING_ENTER_REGISTERED_RING;
+		STAT_ENTER(ring, flags, data->submit);
+		WAKE_RECORD(ring, wake);
+		if (looped)
+			STAT_INC(ring, cqe_loop_retries);
+		URING_PROBE4(enter, ring->enter_ring_fd, data->submit,
+			     data->wait_nr, flags);
+		LATSTAT_ENTER(ring);
+		ZERO_SQES_BEGIN(ring, zero_head);
+		ret = __sys_io_uring_enter2(ring->enter_ring_fd, data->submit,
+					    data->wait_nr, flags, data->arg,
+					    data->sz);
+		URING_PROBE2(enter_done, ring->enter_ring_fd, ret);
+		if (ret >= 0)
+			ZERO_SQES_END(ring, zero_head);
+		if (ret < 0) {
+			if (!err)
+				err = ret;
+			break;
+		}
+
+		data->submit -= ret;
+		if (cqe)
+			break;
+		if (!looped) {
+			looped = true;
+			err = ret;
+		}
+	} while (1);
+
+	/* the injected submission count isn't the caller's return value */
+	if (piggyback && err > 0)
+		err = 0;
+	*cqe_ptr = cqe;
+	return err;
+}
+
+__hot int __io_uring_get_cqe(struct io_uring *ring, struct io_uring_cqe **cqe_ptr,
+		       unsigned submit, unsigned wait_nr, sigset_t *sigmask)
+{
+	struct get_data data = {
+		.submit		= submit,
+		.wait_nr 	= wait_nr,
+		.get_flags	= 0,
+		.sz		= _NSIG / 8,
+		.arg		= sigmask,
+	};
+
+	return _io_uring_get_cqe(ring, cqe_ptr, &data);
+}
+
+int io_uring_get_events(struct io_uring *ring)
+{
+	int flags = IORING_ENTER_GETEVENTS;
+
+	if (ring->int_flags & INT_FLAG_REG_RING)
+		flags |= IORING_ENTER_REGISTERED_RING;
+	STAT_ENTER(ring, flags, 0);
+	WAKE_RECORD(ring, 1U << IO_URING_WAKEUP_CQ_FLUSH);
+	return __sys_io_uring_enter(ring->enter_ring_fd, 0, 0, flags, NULL);
+}
+
+/*
+ * Submit-and-poll step for IORING_SETUP_IOPOLL rings: flush pending
+ * sqes, then issue nonblocking getevents enters - each one drives the
+ * kernel's completion polling - until completions are visible or
+ * 'budget' polls have been spent. Returns the number of cqes ready to
+ * reap (possibly 0 on an exhausted budget) or a syscall error, and
+ * accounts every enter into 'h' so polled-vs-found efficiency is
+ * visible to the caller's scheduler. Never blocks, so compute can be
+ * interleaved between calls; also usable on non-IOPOLL rings, where a
+ * poll is just an opportunistic completion flush.
+ */
+int io_uring_harvest(struct io_uring *ring, unsigned budget,
+		     struct io_uring_harvest *h)
+{
+	unsigned ready;
+	int ret;
+
+	if (io_uring_sq_ready(ring)) {
+		ret = io_uring_submit(ring);
+		if (ret < 0)
+			return ret;
+		h->submitted += (unsigned) ret;
+	}
+
+	ready = io_uring_cq_ready(ring);
+	while (!ready && budget--) {
+		ret = io_uring_get_events(ring);
+		if (ret < 0 && ret != -EAGAIN && ret != -EINTR)
+			return ret;
+		h->polls++;
+		ready = io_uring_cq_ready(ring);
+	}
+	h->found += ready;
+	if (!ready)
+		h->dry++;
+	return (int) ready;
+}
+
+/*
+ * Flush any overflowed CQEs into the CQ ring and report how many became
+ * visible, so event loops can see CQ pressure building instead of silently
+ * absorbing flush syscalls. The cumulative count is tracked in
+ * ring->sq.overflow_flushed, see io_uring_cq_overflow_flushed().
+ *
+ * Returns the number of overflowed CQEs flushed, 0 if there was no
+ * overflow, or -errno if the flush syscall failed.
+ */
+int io_uring_cq_drain_overflow(struct io_uring *ring)
+{
+	unsigned before;
+	int flushed, ret;
+
+	if (!(IO_URING_READ_ONCE(*ring->sq.kflags) & IORING_SQ_CQ_OVERFLOW))
+		return 0;
+
+	before = io_uring_cq_ready(ring);
+	ret = io_uring_get_events(ring);
+	if (ret < 0)
+		return ret;
+
+	flushed = io_uring_cq_ready(ring) - before;
+	ring->sq.overflow_flushed += flushed;
+	return flushed;
+}
+
+/*
+ * Drain-and-quiesce for bounded-time teardown: one match-any sync
+ * cancel sweeps everything in flight - multishots included, they're
+ * cancelled and disarmed like any other request - then the CQ is
+ * drained to empty, overflow flushes included. The cancel carries the
+ * caller's timeout, so a wedged op can't stall a restart: on -ETIME
+ * whatever did complete is still drained and counted, the caller just
+ * knows the ring wasn't fully quiet. 'ts' NULL means wait however long
+ * the cancel takes. The report (optional) breaks down what happened;
+ * 'leftover' is what was still sitting in the CQ or overflow backlog
+ * when the drain gave up, and is 0 on success by definition.
+ *
+ * Returns 0 with the ring quiet, -ETIME if the cancel timed out, or
+ * -errno (-EINVAL from kernels without sync cancel, 6.0 and older).
+ */
+int io_uring_quiesce(struct io_uring *ring, struct __kernel_timespec *ts,
+		     struct io_uring_quiesce_report *report)
+{
+	unsigned overflow_before = ring->sq.overflow_flushed;
+	struct io_uring_quiesce_report rep = {};
+	struct io_uring_sync_cancel_reg reg;
+	unsigned tries = 32;
+	int ret, err = 0;
+
+	/* push out anything staged so it gets cancelled, not stranded */
+	ret = io_uring_submit(ring);
+	if (ret < 0)
+		err = ret;
+
+	memset(&reg, 0, sizeof(reg));
+	reg.fd = -1;
+	reg.flags = IORING_ASYNC_CANCEL_ANY | IORING_ASYNC_CANCEL_ALL;
+	if (ts) {
+		reg.timeout = *ts;
+	} else {
+		reg.timeout.tv_sec = -1;
+		reg.timeout.tv_nsec = -1;
+	}
+	ret = io_uring_register_sync_cancel(ring, &reg);
+	if (ret >= 0)
+		rep.cancelled = (unsigned) ret;
+	else if (ret != -ENOENT && !err)
+		err = ret;
+
+	/*
+	 * Everything the cancel reached has completed by now; its CQEs
+	 * are in the CQ or the overflow backlog. Bounded pass count so a
+	 * producer that keeps completing (cancel timed out) can't pin us.
+	 */
+	while (tries--) {
+		unsigned drained = io_uring_cq_ready(ring);
+		bool overflowed;
+
+		if (drained) {
+			io_uring_cq_advance(ring, drained);
+			rep.drained += drained;
+		}
+		if (!cq_ring_needs_flush(ring))
+			break;
+		overflowed = IO_URING_READ_ONCE(*ring->sq.kflags) &
+			     IORING_SQ_CQ_OVERFLOW;
+		ret = io_uring_get_events(ring);
+		if (ret < 0) {
+			if (!err)
+				err = ret;
+			break;
+		}
+		if (overflowed)
+			ring->sq.overflow_flushed += io_uring_cq_ready(ring);
+	}
+
+	rep.overflow = ring->sq.overflow_flushed - overflow_before;
+	rep.leftover = io_uring_cq_ready(ring);
+	if (cq_ring_needs_flush(ring))
+		rep.leftover++;
+	if (report)
+		*report = rep;
+	if (!err && rep.leftover)
+		err = -EBUSY;
+	return err;
+}
+
+/*
+ * Fill in an array of IO completions up to count, if any are available.
+ * Returns the amount of IO completions filled.
+ */
+/*
+ * Overflow/taskrun flush for the batch reap paths; out of line so the
+ * hot empty-ring check doesn't drag the enter machinery into its
+ * cachelines.
+ */
+static __cold __noinline void cq_batch_flush(struct io_uring *ring)
+{
+	bool overflowed = IO_URING_READ_ONCE(*ring->sq.kflags) &
+			  IORING_SQ_CQ_OVERFLOW;
+
+	STAT_INC(ring, overflow_flushes);
+	io_uring_get_events(ring);
+	if (overflowed)
+		ring->sq.overflow_flushed += io_uring_cq_ready(ring);
+}
+
+__hot unsigned io_uring_peek_batch_cqe(struct io_uring *ring,
+				 struct io_uring_cqe **cqes, unsigned count)
+{
+	unsigned ready;
+	bool overflow_checked = false;
+	int shift = 0;
+
+	if (ring->flags & IORING_SETUP_CQE32)
+		shift = 1;
+
+again:
+	ready = io_uring_cq_ready(ring);
+	if (ready) {
+		unsigned head = *ring->cq.khead;
+		unsigned mask = ring->cq.ring_mask;
+		unsigned last;
+		int i = 0;
+
+		count = count > ready ? ready : count;
+		last = head + count;
+		CTXSLAB_EPOCH(ring);
+		for (;head != last; head++, i++) {
+			/*
+			 * Stay two entries ahead of the walk, so each cqe
+			 * is in cache by the time the caller touches it.
+			 */
+			if (head + 2 < last)
+				__builtin_prefetch(&ring->cq.cqes[((head + 2) & mask) << shift]);
+			cqes[i] = &ring->cq.cqes[(head & mask) << shift];
+			OPSTAT_RECORD(ring, cqes[i]);
+			INFLIGHT_CQE(ring, cqes[i]);
+			SKIP_CQE(ring, cqes[i]);
+			ARENA_CQE(ring, cqes[i]);
+			CTXSLAB_CQE(ring, cqes[i]);
+			AUX_CQE(ring, cqes[i]);
+		}
+		LATSTAT_REAP(ring, count);
+
+		return count;
+	}
+
+	if (overflow_checked)
+		return 0;
+
+	if (uring_unlikely(cq_ring_needs_flush(ring))) {
+		if (uring_unlikely(IO_URING_READ_ONCE(tr_batch_active)) &&
+		    taskrun_defer(ring))
+			return 0;
+		cq_batch_flush(ring);
+		overflow_checked = true;
+		goto again;
+	}
+
+	return 0;
+}
+
+/*
+ * Stable-group a peeked batch by locality key: the pointer array is
+ * permuted so equal-key cqes sit adjacent, with first-seen key order
+ * and within-key completion order both preserved. Returns the number
+ * of distinct groups, or -EINVAL beyond IO_URING_CQE_GROUP_MAX (chunk
+ * the batch, or use io_uring_peek_batch_grouped() which clamps).
+ */
+int io_uring_cqe_group(struct io_uring_cqe **cqes, unsigned nr,
+		       io_uring_locality_fn key, void *data)
+{
+	struct io_uring_cqe *tmp[IO_URING_CQE_GROUP_MAX];
+	unsigned keys[IO_URING_CQE_GROUP_MAX];
+	unsigned i, j, out = 0, groups = 0;
+
+	if (nr > IO_URING_CQE_GROUP_MAX)
+		return -EINVAL;
+	if (nr < 2)
+		return (int) nr;
+
+	for (i = 0; i < nr; i++)
+		keys[i] = key(cqes[i]->user_data, data);
+	for (i = 0; i < nr; i++) {
+		if (!cqes[i])
+			continue;
+		groups++;
+		tmp[out++] = cqes[i];
+		for (j = i + 1; j < nr; j++) {
+			if (cqes[j] && keys[j] == keys[i]) {
+				tmp[out++] = cqes[j];
+				cqes[j] = NULL;
+			}
+		}
+	}
+	memcpy(cqes, tmp, nr * sizeof(*cqes));
+	return (int) groups;
+}
+
+/*
+ * Peek a batch and hand it back grouped by locality key; 'count' is
+ * clamped to IO_URING_CQE_GROUP_MAX so the grouping cannot fail.
+ * Returns the number of cqes filled, exactly like
+ * io_uring_peek_batch_cqe().
+ */
+unsigned io_uring_peek_batch_grouped(struct io_uring *ring,
+				     struct io_uring_cqe **cqes,
+				     unsigned count, io_uring_locality_fn key,
+				     void *data)
+{
+	unsigned filled;
+
+	if (count > IO_URING_CQE_GROUP_MAX)
+		count = IO_URING_CQE_GROUP_MAX;
+	filled = io_uring_peek_batch_cqe(ring, cqes, count);
+	if (filled > 1)
+		io_uring_cqe_group(cqes, filled, key, data);
+	return filled;
+}
+
+#ifdef LIBURING_SQE_VERIFY
+#include <stdio.h>
+
+static struct io_uring_probe *verify_probe;
+
+/*
+ * Debug-build verification of sqes about to be published to the kernel,
+ * enabled by building the library with -DLIBURING_SQE_VERIFY. A stale or
+ * stomped sqe otherwise only surfaces as an opaque -EINVAL completion; here
+ * it aborts at the flush that would have submitted it, while the sqe
+ * contents are still intact. Release builds compile all of this out.
+ */
+static void io_uring_verify_sqe(struct io_uring *ring,
+				const struct io_uring_sqe *sqe)
+{
+	static const __u8 valid_flags = IOSQE_FIXED_FILE | IOSQE_IO_DRAIN |
+					IOSQE_IO_LINK | IOSQE_IO_HARDLINK |
+					IOSQE_ASYNC | IOSQE_BUFFER_SELECT |
+					IOSQE_CQE_SKIP_SUCCESS;
+
+	if (!verify_probe)
+		verify_probe = io_uring_get_probe_ring(ring);
+
+	if (sqe->opcode >= IORING_OP_LAST ||
+	    (verify_probe &&
+	     !io_uring_opcode_supported(verify_probe, sqe->opcode))) {
+		fprintf(stderr, "liburing: sqe opcode %u unsupported "
+			"(user_data 0x%llx)\n", sqe->opcode,
+			(unsigned long long) sqe->user_data);
+		abort();
+	}
+	if (sqe->flags & ~valid_flags) {
+		fprintf(stderr, "liburing: sqe has invalid flags 0x%x "
+			"(user_data 0x%llx)\n", sqe->flags,
+			(unsigned long long) sqe->user_data);
+		abort();
+	}
+}
+
+static void io_uring_verify_sqes(struct io_uring *ring, unsigned tail)
+{
+	struct io_uring_sq *sq = &ring->sq;
+	int shift = !!(ring->flags & IORING_SETUP_SQE128);
+	unsigned i;
+
+	for (i = sq->sqe_head; i != tail; i++)
+		io_uring_verify_sqe(ring,
+				    &sq->sqes[(i & sq->ring_mask) << shift]);
+}
+#else
+static inline void io_uring_verify_sqes(struct io_uring *ring, unsigned tail)
+{
+}
+#endif
+
+/*
+ * SQE audit shadow buffers, see io_uring_audit_init() in liburing.h. The
+ * registry is a small static table so the flush path can find the audit
+ * for its ring; audit_active keeps the common no-audit case down to one
+ * predicted-not-taken branch per flush.
+ */
+#define AUDIT_MAX_RINGS	8
+
+static struct io_uring_sqe_audit *audit_tab[AUDIT_MAX_RINGS];
+static unsigned audit_active;
+
+static void io_uring_audit_sqes(struct io_uring *ring, unsigned tail)
+{
+	int shift = !!(ring->flags & IORING_SETUP_SQE128);
+	struct io_uring_sq *sq = &ring->sq;
+	struct io_uring_sqe_audit *a = NULL;
+	unsigned i;
+
+	for (i = 0; i < AUDIT_MAX_RINGS; i++) {
+		struct io_uring_sqe_audit *cur =
+			__atomic_load_n(&audit_tab[i], __ATOMIC_ACQUIRE);
+
+		if (cur && cur->ring == ring) {
+			a = cur;
+			break;
+		}
+	}
+	if (!a)
+		return;
+
+	for (i = sq->sqe_head; i != tail; i++) {
+		unsigned slot = a->shadow_tail++ & (a->nr - 1);
+
+		memcpy(&a->sqes[slot << shift],
+		       &sq->sqes[(i & sq->ring_mask) << shift],
+		       sizeof(struct io_uring_sqe) << shift);
+	}
+}
+
+int io_uring_audit_init(struct io_uring *ring, struct io_uring_sqe_audit *a,
+			unsigned nr)
+{
+	int shift = !!(ring->flags & IORING_SETUP_SQE128);
+	unsigned i;
+
+	if (!nr || (nr & (nr - 1)))
+		return -EINVAL;
+
+	a->sqes = uring_ring_malloc(ring, (size_t) nr * (sizeof(struct io_uring_sqe) << shift));
+	if (!a->sqes)
+		return -ENOMEM;
+	memset(a->sqes, 0, (size_t) nr * (sizeof(struct io_uring_sqe) << shift));
+	a->ring = ring;
+	a->nr = nr;
+	a->shadow_tail = 0;
+
+	for (i = 0; i < AUDIT_MAX_RINGS; i++) {
+		struct io_uring_sqe_audit *empty = NULL;
+
+		if (__atomic_compare_exchange_n(&audit_tab[i], &empty, a,
+						false, __ATOMIC_RELEASE,
+						__ATOMIC_RELAXED)) {
+			__atomic_fetch_add(&audit_active, 1,
+					   __ATOMIC_RELAXED);
+			return 0;
+		}
+	}
+	uring_ring_free(ring, a->sqes);
+	a->sqes = NULL;
+	return -ENOSPC;
+}
+
+/*
+ * Walk the shadow buffer newest-first for the last sqe submitted with the
+ * given user_data. The returned pointer is into the shadow buffer and
+ * stays valid until another a->nr sqes have been flushed.
+ */
+const struct io_uring_sqe *io_uring_audit_find(struct io_uring_sqe_audit *a,
+					       __u64 user_data)
+{
+	int shift = !!(a->ring->flags & IORING_SETUP_SQE128);
+	unsigned nr = a->nr < a->shadow_tail ? a->nr : a->shadow_tail;
+	unsigned i;
+
+	for (i = 1; i <= nr; i++) {
+		unsigned slot = (a->shadow_tail - i) & (a->nr - 1);
+		const struct io_uring_sqe *sqe = &a->sqes[slot << shift];
+
+		if (sqe->user_data == user_data)
+			return sqe;
+	}
+	return NULL;
+}
+
+void io_uring_audit_exit(struct io_uring_sqe_audit *a)
+{
+	unsigned i;
+
+	for (i = 0; i < AUDIT_MAX_RINGS; i++) {
+		if (__atomic_load_n(&audit_tab[i], __ATOMIC_RELAXED) == a) {
+			__atomic_store_n(&audit_tab[i], NULL,
+					 __ATOMIC_RELEASE);
+			__atomic_fetch_sub(&audit_active, 1,
+					   __ATOMIC_RELAXED);
+			break;
+		}
+	}
+	uring_ring_free(a->ring, a->sqes);
+	a->sqes = NULL;
+}
+
+/*
+ * LIBURING_SETUP_SHADOW_SQ support: sq->sqes is repointed at a private
+ * heap array at setup, so io_uring_get_sqe() and every prep helper stage
+ * into cache-hot memory the kernel never sees, and the flush publishes
+ * the staged span into the shared mapping with uring_sqe_copy64() right
+ * before the tail store. The shared-mapping pointer is parked in a small
+ * static registry keyed by ring, like the audit shadow buffers above;
+ * the per-flush lookup is off the fast path behind INT_FLAG_SHADOW_SQ.
+ */
+#define SHADOW_MAX_RINGS	8
+
+static struct {
+	struct io_uring *ring;
+	struct io_uring_sqe *ksqes;
+} shadow_tab[SHADOW_MAX_RINGS];
+
+int io_uring_shadow_sq_init(struct io_uring *ring)
+{
+	int shift = !!(ring->flags & IORING_SETUP_SQE128);
+	struct io_uring_sqe *shadow;
+	size_t len;
+	unsigned i;
+
+	for (i = 0; i < SHADOW_MAX_RINGS; i++) {
+		struct io_uring *key = NULL;
+
+		if (__atomic_compare_exchange_n(&shadow_tab[i].ring, &key,
+						URING_SLOT_BUSY, false,
+						__ATOMIC_ACQUIRE,
+						__ATOMIC_RELAXED))
+			break;
+	}
+	if (i == SHADOW_MAX_RINGS)
+		return -ENOSPC;
+
+	len = (size_t) ring->sq.ring_entries *
+	      (sizeof(struct io_uring_sqe) << shift);
+	shadow = uring_ring_malloc(ring, len);
+	if (!shadow) {
+		__atomic_store_n(&shadow_tab[i].ring, NULL, __ATOMIC_RELEASE);
+		return -ENOMEM;
+	}
+	memset(shadow, 0, len);
+
+	shadow_tab[i].ksqes = ring->sq.sqes;
+	__atomic_store_n(&shadow_tab[i].ring, ring, __ATOMIC_RELEASE);
+	ring->sq.sqes = shadow;
+	ring->int_flags |= INT_FLAG_SHADOW_SQ;
+	return 0;
+}
+
+void io_uring_shadow_sq_exit(struct io_uring *ring)
+{
+	unsigned i;
+
+	for (i = 0; i < SHADOW_MAX_RINGS; i++) {
+		if (__atomic_load_n(&shadow_tab[i].ring,
+				    __ATOMIC_RELAXED) != ring)
+			continue;
+		uring_ring_free(ring, ring->sq.sqes);
+		ring->sq.sqes = shadow_tab[i].ksqes;
+		shadow_tab[i].ksqes = NULL;
+		__atomic_store_n(&shadow_tab[i].ring, NULL, __ATOMIC_RELEASE);
+		break;
+	}
+	ring->int_flags &= ~INT_FLAG_SHADOW_SQ;
+}
+
+static void shadow_sq_publish(struct io_uring *ring, unsigned tail)
+{
+	int shift = !!(ring->flags & IORING_SETUP_SQE128);
+	struct io_uring_sq *sq = &ring->sq;
+	struct io_uring_sqe *ksqes = NULL;
+	unsigned i;
 
-		data->submit -= ret;
-		if (cqe)
+	for (i = 0; i < SHADOW_MAX_RINGS; i++) {
+		if (__atomic_load_n(&shadow_tab[i].ring,
+				    __ATOMIC_ACQUIRE) == ring) {
+			ksqes = shadow_tab[i].ksqes;
 			break;
-		if (!looped) {
-			looped = true;
-			err = ret;
 		}
-	} while (1);
+	}
+	if (!ksqes)
+		return;
 
-	*cqe_ptr = cqe;
-	return err;
+	for (i = sq->sqe_head; i != tail; i++) {
+		unsigned idx = (i & sq->ring_mask) << shift;
+
+		uring_sqe_copy64(&ksqes[idx], &sq->sqes[idx]);
+		if (shift)
+			uring_sqe_copy64(&ksqes[idx + 1], &sq->sqes[idx + 1]);
+	}
 }
 
-int __io_uring_get_cqe(struct io_uring *ring, struct io_uring_cqe **cqe_ptr,
-		       unsigned submit, unsigned wait_nr, sigset_t *sigmask)
+/*
+ * Backstop for io_uring_queue_exit(): drop every registry entry still
+ * keyed by 'ring', so a recycled ring address can never inherit a dead
+ * ring's callbacks or counters (see the slot protocol in lib.h).
+ * Features torn down properly have already cleared their slots and
+ * cost nothing here. Pointer-keyed registries go through their own
+ * idempotent exit calls, which also return the ring-owned side
+ * allocations; the caller's structs themselves stay the caller's. The
+ * shadow SQ registry is not walked - its slot owns the heap staging
+ * array and io_uring_queue_exit() tears it down via INT_FLAG_SHADOW_SQ
+ * before calling in here.
+ */
+__cold void uring_queue_registries_drop(struct io_uring *ring)
 {
-	struct get_data data = {
-		.submit		= submit,
-		.wait_nr 	= wait_nr,
-		.get_flags	= 0,
-		.sz		= _NSIG / 8,
-		.arg		= sigmask,
-	};
+	unsigned i;
 
-	return _io_uring_get_cqe(ring, cqe_ptr, &data);
-}
+#if defined(LIBURING_STATS) || defined(LIBURING_OPSTATS) || \
+    defined(LIBURING_LATSTATS)
+	if (ring->stats_id) {
+		__atomic_store_n(&stats_tab[ring->stats_id - 1].ring, NULL,
+				 __ATOMIC_RELEASE);
+		ring->stats_id = 0;
+	}
+#endif
+	for (i = 0; i < INFLIGHT_MAX_RINGS; i++) {
+		struct io_uring_inflight *t =
+			__atomic_load_n(&inflight_tab[i], __ATOMIC_ACQUIRE);
 
-int io_uring_get_events(struct io_uring *ring)
-{
-	int flags = IORING_ENTER_GETEVENTS;
+		if (t && t->ring == ring)
+			io_uring_inflight_exit(t);
+	}
+	for (i = 0; i < SKIP_MAX_RINGS; i++) {
+		struct io_uring_skip_track *t =
+			__atomic_load_n(&skip_tab[i], __ATOMIC_ACQUIRE);
 
-	if (ring->int_flags & INT_FLAG_REG_RING)
-		flags |= IORING_ENTER_REGISTERED_RING;
-	return __sys_io_uring_enter(ring->enter_ring_fd, 0, 0, flags, NULL);
+		if (t && t->ring == ring)
+			io_uring_skip_track_exit(t);
+	}
+	for (i = 0; i < ARENA_MAX_RINGS; i++) {
+		struct io_uring_iovec_arena *a =
+			__atomic_load_n(&arena_tab[i], __ATOMIC_ACQUIRE);
+
+		if (a && a->ring == ring)
+			io_uring_iovec_arena_exit(a);
+	}
+	for (i = 0; i < CTXSLAB_MAX_RINGS; i++) {
+		struct io_uring_ctx_slab *s =
+			__atomic_load_n(&ctxslab_tab[i], __ATOMIC_ACQUIRE);
+
+		if (s && s->ring == ring)
+			io_uring_ctx_slab_exit(s);
+	}
+	for (i = 0; i < AUX_MAX_RINGS; i++) {
+		struct io_uring_aux_pool *p =
+			__atomic_load_n(&aux_tab[i], __ATOMIC_ACQUIRE);
+
+		if (p && p->ring == ring)
+			io_uring_aux_exit(p);
+	}
+	for (i = 0; i < AUDIT_MAX_RINGS; i++) {
+		struct io_uring_sqe_audit *a =
+			__atomic_load_n(&audit_tab[i], __ATOMIC_ACQUIRE);
+
+		if (a && a->ring == ring)
+			io_uring_audit_exit(a);
+	}
+	for (i = 0; i < TRIM_MAX_RINGS; i++) {
+		if (__atomic_load_n(&trim_saved[i].ring,
+				    __ATOMIC_RELAXED) == ring)
+			__atomic_store_n(&trim_saved[i].ring, NULL,
+					 __ATOMIC_RELEASE);
+	}
+	for (i = 0; i < WAIT_OPS_MAX_RINGS; i++) {
+		if (__atomic_load_n(&wait_ops_tab[i].ring,
+				    __ATOMIC_RELAXED) != ring)
+			continue;
+		memset(&wait_ops_tab[i].ops, 0, sizeof(wait_ops_tab[i].ops));
+		__atomic_store_n(&wait_ops_tab[i].ring, NULL,
+				 __ATOMIC_RELEASE);
+		__atomic_fetch_sub(&wait_ops_active, 1, __ATOMIC_RELAXED);
+	}
+	for (i = 0; i < THROTTLE_MAX_RINGS; i++) {
+		if (__atomic_load_n(&throttle_tab[i].ring,
+				    __ATOMIC_RELAXED) != ring)
+			continue;
+		memset(throttle_tab[i].b, 0, sizeof(throttle_tab[i].b));
+		__atomic_store_n(&throttle_tab[i].ring, NULL,
+				 __ATOMIC_RELEASE);
+		__atomic_fetch_sub(&throttle_active, 1, __ATOMIC_RELAXED);
+	}
+	for (i = 0; i < WATCHDOG_MAX_RINGS; i++) {
+		struct uring_watchdog *w = &watchdog_tab[i];
+
+		if (__atomic_load_n(&w->ring, __ATOMIC_RELAXED) != ring)
+			continue;
+		/* no timeout_remove here - the ring is going away anyway */
+		w->cb = NULL;
+		w->arg = NULL;
+		__atomic_store_n(&w->ring, NULL, __ATOMIC_RELEASE);
+		__atomic_fetch_sub(&watchdog_active, 1, __ATOMIC_RELAXED);
+	}
+	for (i = 0; i < TR_BATCH_MAX_RINGS; i++) {
+		struct uring_tr_batch *t = &tr_batch_tab[i];
+
+		if (__atomic_load_n(&t->ring, __ATOMIC_RELAXED) != ring)
+			continue;
+		memset((char *) t + sizeof(t->ring), 0,
+		       sizeof(*t) - sizeof(t->ring));
+		__atomic_store_n(&t->ring, NULL, __ATOMIC_RELEASE);
+		__atomic_fetch_sub(&tr_batch_active, 1, __ATOMIC_RELAXED);
+	}
 }
 
 /*
- * Fill in an array of IO completions up to count, if any are available.
- * Returns the amount of IO completions filled.
+ * Copy up to 'count' completions out of the CQ into a caller-owned
+ * contiguous buffer and advance the CQ head in one step, releasing the
+ * shared ring slots immediately instead of handing out pointers back into
+ * the mmap'ed ring. With IORING_SETUP_CQE32 each completion occupies two
+ * io_uring_cqe slots in 'cqes', matching the ring layout.
+ *
+ * Returns the number of completions copied.
  */
-unsigned io_uring_peek_batch_cqe(struct io_uring *ring,
-				 struct io_uring_cqe **cqes, unsigned count)
+__hot unsigned io_uring_copy_batch_cqe(struct io_uring *ring,
+				 struct io_uring_cqe *cqes, unsigned count)
 {
-	unsigned ready;
 	bool overflow_checked = false;
 	int shift = 0;
+	unsigned ready;
 
 	if (ring->flags & IORING_SETUP_CQE32)
 		shift = 1;
@@ -174,22 +3050,39 @@ again:
 	if (ready) {
 		unsigned head = *ring->cq.khead;
 		unsigned mask = ring->cq.ring_mask;
-		unsigned last;
-		int i = 0;
+		unsigned idx, first;
 
 		count = count > ready ? ready : count;
-		last = head + count;
-		for (;head != last; head++, i++)
-			cqes[i] = &ring->cq.cqes[(head & mask) << shift];
-
+		idx = head & mask;
+		/* at most two contiguous spans, split at the ring wrap */
+		first = ring->cq.ring_entries - idx;
+		if (first > count)
+			first = count;
+		if (!shift) {
+			uring_cqe_copy(cqes, &ring->cq.cqes[idx], first);
+			if (count > first)
+				uring_cqe_copy(&cqes[first], ring->cq.cqes,
+					       count - first);
+		} else {
+			memcpy(cqes, &ring->cq.cqes[idx << shift],
+			       (first * sizeof(*cqes)) << 1);
+			if (count > first)
+				memcpy(&cqes[first << 1], ring->cq.cqes,
+				       ((count - first) * sizeof(*cqes)) << 1);
+		}
+		URING_PROBE2(cq_advance, ring->enter_ring_fd, count);
+		io_uring_cq_advance(ring, count);
 		return count;
 	}
 
 	if (overflow_checked)
 		return 0;
 
-	if (cq_ring_needs_flush(ring)) {
-		io_uring_get_events(ring);
+	if (uring_unlikely(cq_ring_needs_flush(ring))) {
+		if (uring_unlikely(IO_URING_READ_ONCE(tr_batch_active)) &&
+		    taskrun_defer(ring))
+			return 0;
+		cq_batch_flush(ring);
 		overflow_checked = true;
 		goto again;
 	}
@@ -198,15 +3091,32 @@ again:
 }
 
 /*
- * Sync internal state with kernel ring state on the SQ side. Returns the
- * number of pending items in the SQ ring, for the shared ring.
+ * Sync internal state with kernel ring state on the SQ side, publishing at
+ * most 'limit' of the prepared sqes. Anything beyond the limit remains
+ * staged for a later flush. Returns the number of pending items in the SQ
+ * ring, for the shared ring.
  */
-static unsigned __io_uring_flush_sq(struct io_uring *ring)
+static __hot unsigned __io_uring_flush_sq_limit(struct io_uring *ring,
+					  unsigned limit)
 {
 	struct io_uring_sq *sq = &ring->sq;
 	unsigned tail = sq->sqe_tail;
 
+	if (tail - sq->sqe_head > limit)
+		tail = sq->sqe_head + limit;
 	if (sq->sqe_head != tail) {
+		io_uring_verify_sqes(ring, tail);
+		if (uring_unlikely(IO_URING_READ_ONCE(audit_active)))
+			io_uring_audit_sqes(ring, tail);
+		INFLIGHT_FLUSH(ring, tail);
+		SKIP_FLUSH(ring, tail);
+		URING_PROBE2(sq_flush, ring->enter_ring_fd,
+			     tail - sq->sqe_head);
+		LATSTAT_FLUSH(ring);
+		if (uring_unlikely(ring->int_flags & INT_FLAG_SHADOW_SQ))
+			shadow_sq_publish(ring, tail);
+		if (uring_unlikely(IO_URING_READ_ONCE(throttle_active)))
+			throttle_refill(ring);
 		sq->sqe_head = tail;
 		/*
 		 * Ensure kernel sees the SQE updates before the tail update.
@@ -230,6 +3140,11 @@ static unsigned __io_uring_flush_sq(struct io_uring *ring)
 	return tail - *sq->khead;
 }
 
+static unsigned __io_uring_flush_sq(struct io_uring *ring)
+{
+	return __io_uring_flush_sq_limit(ring, ~0U);
+}
+
 /*
  * If we have kernel support for IORING_ENTER_EXT_ARG, then we can use that
  * more efficiently than queueing an internal timeout command.
@@ -274,7 +3189,8 @@ static int io_uring_wait_cqes_new(struct io_uring *ring,
  * handling between two threads.
  */
 static int __io_uring_submit_timeout(struct io_uring *ring, unsigned wait_nr,
-				     struct __kernel_timespec *ts)
+				     struct __kernel_timespec *ts,
+				     unsigned timeout_flags)
 {
 	struct io_uring_sqe *sqe;
 	int ret;
@@ -291,7 +3207,7 @@ static int __io_uring_submit_timeout(struct io_uring *ring, unsigned wait_nr,
 		if (!sqe)
 			return -EAGAIN;
 	}
-	io_uring_prep_timeout(sqe, ts, wait_nr, 0);
+	io_uring_prep_timeout(sqe, ts, wait_nr, timeout_flags);
 	sqe->user_data = LIBURING_UDATA_TIMEOUT;
 	return __io_uring_flush_sq(ring);
 }
@@ -303,10 +3219,10 @@ int io_uring_wait_cqes(struct io_uring *ring, struct io_uring_cqe **cqe_ptr,
 	int to_submit = 0;
 
 	if (ts) {
-		if (ring->features & IORING_FEAT_EXT_ARG)
+		if (ring->quirks & IO_URING_QUIRK_EXT_ARG)
 			return io_uring_wait_cqes_new(ring, cqe_ptr, wait_nr,
 							ts, sigmask);
-		to_submit = __io_uring_submit_timeout(ring, wait_nr, ts);
+		to_submit = __io_uring_submit_timeout(ring, wait_nr, ts, 0);
 		if (to_submit < 0)
 			return to_submit;
 	}
@@ -314,6 +3230,64 @@ int io_uring_wait_cqes(struct io_uring *ring, struct io_uring_cqe **cqe_ptr,
 	return __io_uring_get_cqe(ring, cqe_ptr, to_submit, wait_nr, sigmask);
 }
 
+/*
+ * Like io_uring_wait_cqes(), but 'ts' is an absolute CLOCK_MONOTONIC
+ * deadline rather than a relative timeout, so deadline-driven loops don't
+ * recompute a relative timespec (two clock reads) before every wait. The
+ * EXT_ARG enter path has no way to express an absolute deadline, so this
+ * always uses an internal timeout sqe with IORING_TIMEOUT_ABS; as with
+ * pre-EXT_ARG io_uring_wait_cqes(), applications must never use
+ * LIBURING_UDATA_TIMEOUT as their own user_data, and batch processing
+ * should skip any cqe carrying it.
+ */
+int io_uring_wait_cqes_abs(struct io_uring *ring,
+			   struct io_uring_cqe **cqe_ptr, unsigned wait_nr,
+			   struct __kernel_timespec *ts, sigset_t *sigmask)
+{
+	int ret;
+
+	if (ts) {
+		ret = __io_uring_submit_timeout(ring, wait_nr, ts,
+						IORING_TIMEOUT_ABS);
+		if (ret < 0)
+			return ret;
+		/*
+		 * Submit eagerly so the wait below reports a clean 0 or
+		 * -ETIME instead of folding the submit count into its
+		 * return value.
+		 */
+		ret = io_uring_submit(ring);
+		if (ret < 0)
+			return ret;
+	}
+
+	do {
+		struct io_uring_cqe *cqe;
+
+		ret = __io_uring_get_cqe(ring, cqe_ptr, 0, wait_nr, sigmask);
+		if (ret < 0)
+			break;
+		cqe = *cqe_ptr;
+		if (!cqe || cqe->user_data != LIBURING_UDATA_TIMEOUT)
+			break;
+		/*
+		 * Our timeout completed. On EXT_ARG kernels the generic
+		 * peek doesn't filter it, so consume it here and either
+		 * report the deadline or go fetch the real completions
+		 * that satisfied the wait.
+		 */
+		URING_PROBE2(cq_advance, ring->enter_ring_fd, 1);
+		io_uring_cq_advance(ring, 1);
+		*cqe_ptr = NULL;
+		if (cqe->res < 0) {
+			ret = cqe->res;
+			break;
+		}
+	} while (1);
+
+	return ret;
+}
+
 int io_uring_submit_and_wait_timeout(struct io_uring *ring,
 				     struct io_uring_cqe **cqe_ptr,
 				     unsigned wait_nr,
@@ -323,7 +3297,7 @@ int io_uring_submit_and_wait_timeout(struct io_uring *ring,
 	int to_submit;
 
 	if (ts) {
-		if (ring->features & IORING_FEAT_EXT_ARG) {
+		if (ring->quirks & IO_URING_QUIRK_EXT_ARG) {
 			struct io_uring_getevents_arg arg = {
 				.sigmask	= (unsigned long) sigmask,
 				.sigmask_sz	= _NSIG / 8,
@@ -340,7 +3314,7 @@ int io_uring_submit_and_wait_timeout(struct io_uring *ring,
 
 			return _io_uring_get_cqe(ring, cqe_ptr, &data);
 		}
-		to_submit = __io_uring_submit_timeout(ring, wait_nr, ts);
+		to_submit = __io_uring_submit_timeout(ring, wait_nr, ts, 0);
 		if (to_submit < 0)
 			return to_submit;
 	} else
@@ -349,6 +3323,126 @@ int io_uring_submit_and_wait_timeout(struct io_uring *ring,
 	return __io_uring_get_cqe(ring, cqe_ptr, to_submit, wait_nr, sigmask);
 }
 
+/*
+ * Two-stage waits: 'min_wait_usec' is the batching stage and 'ts' the
+ * hard bound. The kernel returns early during the batching stage only
+ * once 'wait_nr' completions have arrived; when the stage expires the
+ * bar drops to a single completion for the remainder of 'ts'. This is
+ * the batching-vs-latency dial event loops otherwise emulate with a
+ * userspace timer and a second enter. Goes straight through the
+ * EXT_ARG enter path; -EINVAL on kernels without min_timeout support
+ * (see IO_URING_QUIRK_MIN_TIMEOUT), and a zero 'min_wait_usec' falls
+ * back to the plain single-stage wait.
+ */
+static int io_uring_wait_cqes_min(struct io_uring *ring,
+				  struct io_uring_cqe **cqe_ptr,
+				  unsigned wait_nr, unsigned submit,
+				  struct __kernel_timespec *ts,
+				  unsigned min_wait_usec, sigset_t *sigmask)
+{
+	struct io_uring_getevents_arg arg = {
+		.sigmask	= (unsigned long) sigmask,
+		.sigmask_sz	= _NSIG / 8,
+		.min_wait_usec	= min_wait_usec,
+		.ts		= (unsigned long) ts
+	};
+	struct get_data data = {
+		.submit		= submit,
+		.wait_nr	= wait_nr,
+		.get_flags	= IORING_ENTER_EXT_ARG,
+		.sz		= sizeof(arg),
+		.has_ts		= ts != NULL,
+		.arg		= &arg
+	};
+
+	return _io_uring_get_cqe(ring, cqe_ptr, &data);
+}
+
+int io_uring_wait_cqes_min_timeout(struct io_uring *ring,
+				   struct io_uring_cqe **cqe_ptr,
+				   unsigned wait_nr,
+				   struct __kernel_timespec *ts,
+				   unsigned min_wait_usec, sigset_t *sigmask)
+{
+	if (!min_wait_usec)
+		return io_uring_wait_cqes(ring, cqe_ptr, wait_nr, ts, sigmask);
+	if (!(ring->quirks & IO_URING_QUIRK_MIN_TIMEOUT))
+		return -EINVAL;
+	return io_uring_wait_cqes_min(ring, cqe_ptr, wait_nr, 0, ts,
+				      min_wait_usec, sigmask);
+}
+
+int io_uring_submit_and_wait_min_timeout(struct io_uring *ring,
+					 struct io_uring_cqe **cqe_ptr,
+					 unsigned wait_nr,
+					 struct __kernel_timespec *ts,
+					 unsigned min_wait_usec,
+					 sigset_t *sigmask)
+{
+	if (!min_wait_usec)
+		return io_uring_submit_and_wait_timeout(ring, cqe_ptr, wait_nr,
+							ts, sigmask);
+	if (!(ring->quirks & IO_URING_QUIRK_MIN_TIMEOUT))
+		return -EINVAL;
+	return io_uring_wait_cqes_min(ring, cqe_ptr, wait_nr,
+				      __io_uring_flush_sq(ring), ts,
+				      min_wait_usec, sigmask);
+}
+
+/*
+ * Like io_uring_submit_and_wait_timeout(), but takes the wait arguments
+ * from slot 'reg_index' of the region set up with
+ * io_uring_setup_reg_wait(). The kernel reads the slot directly instead
+ * of copying a fresh getevents_arg in on every wait; re-arm the timeout
+ * by updating the slot's ts in place.
+ */
+int io_uring_submit_and_wait_reg(struct io_uring *ring,
+				 struct io_uring_cqe **cqe_ptr,
+				 unsigned wait_nr, int reg_index)
+{
+	struct get_data data = {
+		.submit		= __io_uring_flush_sq(ring),
+		.wait_nr	= wait_nr,
+		.get_flags	= IORING_ENTER_EXT_ARG |
+				  IORING_ENTER_EXT_ARG_REG,
+		.sz		= sizeof(struct io_uring_reg_wait),
+		.has_ts		= true,
+		.arg		= (void *) (uintptr_t) (reg_index *
+					sizeof(struct io_uring_reg_wait)),
+	};
+
+	if (!(ring->quirks & IO_URING_QUIRK_EXT_ARG))
+		return -EINVAL;
+	return _io_uring_get_cqe(ring, cqe_ptr, &data);
+}
+
+/*
+ * Submit prepared sqes, wait until at least 'wait_nr' completions are
+ * available (bounded by 'ts' if given), then fill 'cqes' with up to 'count'
+ * of whatever has arrived by then - typically more than the minimum, since
+ * completions keep landing while the batch is harvested. The entries are
+ * not consumed; call io_uring_cq_advance() once the batch is processed.
+ *
+ * Returns the number of cqes filled in, or -errno. A timeout is not an
+ * error: whatever completed by the deadline is returned.
+ */
+int io_uring_submit_and_wait_batch(struct io_uring *ring,
+				   struct io_uring_cqe **cqes, unsigned count,
+				   unsigned wait_nr,
+				   struct __kernel_timespec *ts,
+				   sigset_t *sigmask)
+{
+	struct io_uring_cqe *cqe;
+	int ret;
+
+	ret = io_uring_submit_and_wait_timeout(ring, &cqe, wait_nr, ts,
+					       sigmask);
+	if (ret < 0 && ret != -ETIME)
+		return ret;
+
+	return (int) io_uring_peek_batch_cqe(ring, cqes, count);
+}
+
 /*
  * See io_uring_wait_cqes() - this function is the same, it just always uses
  * '1' as the wait_nr.
@@ -365,22 +3459,97 @@ int io_uring_wait_cqe_timeout(struct io_uring *ring,
  *
  * Returns number of sqes submitted
  */
-static int __io_uring_submit(struct io_uring *ring, unsigned submitted,
+static size_t io_uring_sqes_len(const struct io_uring *ring)
+{
+	return (size_t) ring->sq.ring_entries *
+	       (sizeof(struct io_uring_sqe) <<
+		!!(ring->flags & IORING_SETUP_SQE128));
+}
+
+/*
+ * Write-protect the SQE array between submissions: with the mode on,
+ * the array sits PROT_READ except while the application is prepping -
+ * io_uring_sqe_open() opens it before a prep batch, and the submit
+ * paths re-protect after the kernel has consumed the batch. A stray
+ * store into the window faults on the spot rather than becoming
+ * garbage I/O. Two mprotect calls per batch; usable whenever the SQE
+ * array is a library mapping (not IORING_SETUP_NO_MMAP), guard pages
+ * or not. SQPOLL is rejected like LIBURING_SETUP_ZERO_SQES is: the
+ * poller reads the array at arbitrary times.
+ */
+int io_uring_sqe_protect(struct io_uring *ring)
+{
+	int ret;
+
+	if (ring->flags & IORING_SETUP_SQPOLL)
+		return -EINVAL;
+	ret = __sys_mprotect(ring->sq.sqes, io_uring_sqes_len(ring),
+			     PROT_READ);
+	if (ret)
+		return ret;
+	ring->int_flags |= INT_FLAG_SQE_PROT;
+	return 0;
+}
+
+/* open the array for a prep batch; the mode stays on */
+int io_uring_sqe_open(struct io_uring *ring)
+{
+	return __sys_mprotect(ring->sq.sqes, io_uring_sqes_len(ring),
+			      PROT_READ | PROT_WRITE);
+}
+
+int io_uring_sqe_unprotect(struct io_uring *ring)
+{
+	int ret;
+
+	ret = __sys_mprotect(ring->sq.sqes, io_uring_sqes_len(ring),
+			     PROT_READ | PROT_WRITE);
+	if (ret)
+		return ret;
+	ring->int_flags &= ~INT_FLAG_SQE_PROT;
+	return 0;
+}
+
+#define SQE_REPROTECT(ring) do {					\
+	if (uring_unlikely((ring)->int_flags & INT_FLAG_SQE_PROT))	\
+		__sys_mprotect((ring)->sq.sqes, io_uring_sqes_len(ring), \
+			       PROT_READ);				\
+} while (0)
+
+static __hot int __io_uring_submit(struct io_uring *ring, unsigned submitted,
 			     unsigned wait_nr, bool getevents)
 {
 	bool cq_needs_enter = getevents || wait_nr || cq_ring_needs_enter(ring);
 	unsigned flags;
+	unsigned wake = 0, zero_head = 0;
 	int ret;
 
 	flags = 0;
 	if (sq_ring_needs_enter(ring, submitted, &flags) || cq_needs_enter) {
-		if (cq_needs_enter)
+		if (flags & IORING_ENTER_SQ_WAKEUP)
+			wake |= 1U << IO_URING_WAKEUP_SQPOLL;
+		else if (!(ring->flags & IORING_SETUP_SQPOLL) && submitted)
+			wake |= 1U << IO_URING_WAKEUP_SUBMIT;
+		if (cq_needs_enter) {
 			flags |= IORING_ENTER_GETEVENTS;
+			if (wait_nr || getevents)
+				wake |= 1U << IO_URING_WAKEUP_WAIT;
+			else
+				wake |= 1U << IO_URING_WAKEUP_CQ_FLUSH;
+		}
 		if (ring->int_flags & INT_FLAG_REG_RING)
 			flags |= IORING_ENTER_REGISTERED_RING;
 
+		STAT_ENTER(ring, flags, submitted);
+		WAKE_RECORD(ring, wake);
+		LATSTAT_ENTER(ring);
+		ZERO_SQES_BEGIN(ring, zero_head);
 		ret = __sys_io_uring_enter(ring->enter_ring_fd, submitted,
 					   wait_nr, flags, NULL);
+		if (ret >= 0)
+			ZERO_SQES_END(ring, zero_head);
+		if (submitted)
+			SQE_REPROTECT(ring);
 	} else
 		ret = submitted;
 
@@ -397,33 +3566,327 @@ static int __io_uring_submit_and_wait(struct io_uring *ring, unsigned wait_nr)
  *
  * Returns number of sqes submitted
  */
-int io_uring_submit(struct io_uring *ring)
+__hot int io_uring_submit(struct io_uring *ring)
 {
 	return __io_uring_submit_and_wait(ring, 0);
 }
 
+/*
+ * Like io_uring_submit(), but submits at most 'nr' of the prepared sqes,
+ * oldest first. The remainder stay staged in the SQ and are picked up by a
+ * later submit, so a caller can prep ahead of time and meter submission
+ * without shadow-buffering sqes.
+ *
+ * Returns number of sqes submitted
+ */
+int io_uring_submit_limit(struct io_uring *ring, unsigned nr)
+{
+	return __io_uring_submit(ring, __io_uring_flush_sq_limit(ring, nr), 0,
+				 false);
+}
+
 /*
  * Like io_uring_submit(), but allows waiting for events as well.
  *
  * Returns number of sqes submitted
  */
-int io_uring_submit_and_wait(struct io_uring *ring, unsigned wait_nr)
+__hot int io_uring_submit_and_wait(struct io_uring *ring, unsigned wait_nr)
 {
 	return __io_uring_submit_and_wait(ring, wait_nr);
 }
 
+/*
+ * How many submits may trust a cached "SQ thread is awake" observation
+ * before io_uring_submit_cached() re-reads the shared flags. This bounds
+ * how long a NEED_WAKEUP transition can go unnoticed.
+ */
+#define SQPOLL_WAKEUP_CACHE_SUBMITS	32
+
+/*
+ * Like io_uring_submit(), but for SQPOLL rings the barrier-heavy
+ * NEED_WAKEUP check in sq_ring_needs_enter() is skipped while a previous
+ * observation of an awake SQ thread is still fresh. The fast path is then
+ * just the SQ tail store done by the flush. Every cache expiry revalidates
+ * the flags, so a sleeping SQ thread is woken within the cache window,
+ * and a blocking cqe wait expires the cache immediately - an application
+ * that stops submitting to wait cannot strand entries behind a parked
+ * SQ thread. For non-SQPOLL rings this is identical to io_uring_submit().
+ *
+ * Returns number of sqes submitted
+ */
+int io_uring_submit_cached(struct io_uring *ring)
+{
+	unsigned flags = 0;
+	unsigned submitted;
+
+	if (!(ring->flags & IORING_SETUP_SQPOLL) || cq_ring_needs_enter(ring))
+		return io_uring_submit(ring);
+
+	submitted = __io_uring_flush_sq(ring);
+	if (!submitted)
+		return 0;
+
+	if (ring->sq_wakeup_cache) {
+		ring->sq_wakeup_cache--;
+		return submitted;
+	}
+
+	if (!sq_ring_needs_enter(ring, submitted, &flags)) {
+		ring->sq_wakeup_cache = SQPOLL_WAKEUP_CACHE_SUBMITS;
+		return submitted;
+	}
+
+	if (ring->int_flags & INT_FLAG_REG_RING)
+		flags |= IORING_ENTER_REGISTERED_RING;
+	return __sys_io_uring_enter(ring->enter_ring_fd, submitted, 0, flags,
+				    NULL);
+}
+
 int io_uring_submit_and_get_events(struct io_uring *ring)
 {
 	return __io_uring_submit(ring, __io_uring_flush_sq(ring), 0, true);
 }
 
 #ifdef LIBURING_INTERNAL
-struct io_uring_sqe *io_uring_get_sqe(struct io_uring *ring)
+__hot struct io_uring_sqe *io_uring_get_sqe(struct io_uring *ring)
 {
 	return _io_uring_get_sqe(ring);
 }
 #endif
 
+/* async-signal-safe string building for io_uring_dump_state() */
+static char *dump_str(char *p, char *end, const char *s)
+{
+	while (*s && p < end)
+		*p++ = *s++;
+	return p;
+}
+
+static char *dump_u32(char *p, char *end, unsigned v)
+{
+	char digits[10];
+	int n = 0;
+
+	do {
+		digits[n++] = '0' + v % 10;
+		v /= 10;
+	} while (v);
+	while (n && p < end)
+		*p++ = digits[--n];
+	return p;
+}
+
+static char *dump_u64(char *p, char *end, unsigned long long v)
+{
+	char digits[20];
+	int n = 0;
+
+	do {
+		digits[n++] = '0' + (char) (v % 10);
+		v /= 10;
+	} while (v);
+	while (n && p < end)
+		*p++ = digits[--n];
+	return p;
+}
+
+static char *dump_hex(char *p, char *end, unsigned v)
+{
+	int shift;
+
+	p = dump_str(p, end, "0x");
+	for (shift = 28; shift > 0 && !(v >> shift); shift -= 4)
+		;
+	for (; shift >= 0 && p < end; shift -= 4)
+		*p++ = "0123456789abcdef"[(v >> shift) & 0xf];
+	return p;
+}
+
+static char *dump_field(char *p, char *end, const char *name, unsigned v)
+{
+	p = dump_str(p, end, name);
+	return dump_u32(p, end, v);
+}
+
+/*
+ * Snapshot the ring's queue cursors, flags and configuration as
+ * compact text into 'buf' - the state otherwise hand-decoded in gdb
+ * when a ring wedges. Only reads memory and writes the caller's
+ * buffer, so it is callable from a signal handler. The sq kflags are
+ * decoded by name (need_wakeup/cq_overflow/taskrun). Returns the
+ * number of bytes written excluding the terminator, or -ENOSPC if
+ * 'buf' was too small (the truncated text is still terminated).
+ */
+int io_uring_dump_state(const struct io_uring *ring, char *buf, unsigned len)
+{
+	char *p = buf, *end = buf + len - 1;
+	unsigned kflags;
+
+	if (!len)
+		return -EINVAL;
+	p = dump_field(p, end, "sq: khead=", IO_URING_READ_ONCE(*ring->sq.khead));
+	p = dump_field(p, end, " ktail=", IO_URING_READ_ONCE(*ring->sq.ktail));
+	p = dump_field(p, end, " sqe_head=", ring->sq.sqe_head);
+	p = dump_field(p, end, " sqe_tail=", ring->sq.sqe_tail);
+	p = dump_field(p, end, " entries=", ring->sq.ring_entries);
+	kflags = IO_URING_READ_ONCE(*ring->sq.kflags);
+	p = dump_str(p, end, " kflags=");
+	p = dump_hex(p, end, kflags);
+	if (kflags & IORING_SQ_NEED_WAKEUP)
+		p = dump_str(p, end, " need_wakeup");
+	if (kflags & IORING_SQ_CQ_OVERFLOW)
+		p = dump_str(p, end, " cq_overflow");
+	if (kflags & IORING_SQ_TASKRUN)
+		p = dump_str(p, end, " taskrun");
+	p = dump_field(p, end, "\ncq: khead=", IO_URING_READ_ONCE(*ring->cq.khead));
+	p = dump_field(p, end, " ktail=", IO_URING_READ_ONCE(*ring->cq.ktail));
+	p = dump_field(p, end, " entries=", ring->cq.ring_entries);
+	if (ring->cq.koverflow)
+		p = dump_field(p, end, " overflow=",
+			       IO_URING_READ_ONCE(*ring->cq.koverflow));
+	if (ring->sq.kdropped)
+		p = dump_field(p, end, " sq_dropped=",
+			       IO_URING_READ_ONCE(*ring->sq.kdropped));
+	p = dump_field(p, end, "\nring: fd=", (unsigned) ring->ring_fd);
+	p = dump_field(p, end, " enter_fd=", (unsigned) ring->enter_ring_fd);
+	p = dump_str(p, end, " flags=");
+	p = dump_hex(p, end, ring->flags);
+	p = dump_str(p, end, " features=");
+	p = dump_hex(p, end, ring->features);
+	p = dump_str(p, end, " int_flags=");
+	p = dump_hex(p, end, ring->int_flags);
+	p = dump_str(p, end, "\n");
+	*p = '\0';
+	return p == end ? -ENOSPC : (int) (p - buf);
+}
+
+/* one Prometheus sample line: name{ring="label"[,extra]} value */
+static char *prom_sample(char *p, char *end, const char *name,
+			 const char *label, const char *extra,
+			 unsigned long long v)
+{
+	p = dump_str(p, end, name);
+	if (label || extra) {
+		p = dump_str(p, end, "{");
+		if (label) {
+			p = dump_str(p, end, "ring=\"");
+			p = dump_str(p, end, label);
+			p = dump_str(p, end, "\"");
+			if (extra)
+				p = dump_str(p, end, ",");
+		}
+		if (extra)
+			p = dump_str(p, end, extra);
+		p = dump_str(p, end, "}");
+	}
+	p = dump_str(p, end, " ");
+	p = dump_u64(p, end, v);
+	return dump_str(p, end, "\n");
+}
+
+/*
+ * Render the ring's counters as Prometheus text exposition into 'buf',
+ * labelled ring="label" when 'label' is non-NULL so several rings can be
+ * concatenated into one scrape. No allocations; callable from a metrics
+ * thread against live rings. Queue-cursor gauges and the kernel's
+ * overflow/drop counters are always emitted; the library counters
+ * (enters, enter shapes, wakeup reasons, the submit batch histogram)
+ * additionally require a -DLIBURING_STATS build and are omitted
+ * otherwise. Returns bytes written excluding the terminator, or -ENOSPC
+ * if 'buf' was too small.
+ */
+int io_uring_format_stats(struct io_uring *ring, const char *label,
+			  char *buf, unsigned len)
+{
+	char *p = buf, *end = buf + len - 1;
+
+	if (!len)
+		return -EINVAL;
+	p = prom_sample(p, end, "liburing_cq_ready", label, NULL,
+			io_uring_cq_ready(ring));
+	p = prom_sample(p, end, "liburing_sq_space_left", label, NULL,
+			io_uring_sq_space_left(ring));
+	p = prom_sample(p, end, "liburing_cq_overflow_total", label, NULL,
+			IO_URING_READ_ONCE(*ring->cq.koverflow));
+	p = prom_sample(p, end, "liburing_sq_dropped_total", label, NULL,
+			IO_URING_READ_ONCE(*ring->sq.kdropped));
+
+#ifdef LIBURING_STATS
+	{
+		static const char * const wake_names[IO_URING_WAKEUP_NR] = {
+			"reason=\"submit\"", "reason=\"sqpoll\"",
+			"reason=\"wait\"", "reason=\"cq_flush\"",
+		};
+		int idx = ring_stats_idx(ring);
+		unsigned long long cum = 0;
+		char le[32];
+		unsigned i;
+
+		if (idx < 0)
+			goto out;
+		p = prom_sample(p, end, "liburing_enters_total", label, NULL,
+				stats_tab[idx].st.enters);
+		p = prom_sample(p, end, "liburing_getevents_enters_total",
+				label, NULL, stats_tab[idx].st.getevents_enters);
+		p = prom_sample(p, end, "liburing_sqpoll_wakeups_total", label,
+				NULL, stats_tab[idx].st.sqpoll_wakeups);
+		p = prom_sample(p, end, "liburing_cqe_loop_retries_total",
+				label, NULL, stats_tab[idx].st.cqe_loop_retries);
+		p = prom_sample(p, end, "liburing_overflow_flushes_total",
+				label, NULL, stats_tab[idx].st.overflow_flushes);
+
+		p = prom_sample(p, end, "liburing_enters_shape_total", label,
+				"shape=\"submit_only\"",
+				stats_tab[idx].ent.submit_only);
+		p = prom_sample(p, end, "liburing_enters_shape_total", label,
+				"shape=\"getevents_only\"",
+				stats_tab[idx].ent.getevents_only);
+		p = prom_sample(p, end, "liburing_enters_shape_total", label,
+				"shape=\"both\"", stats_tab[idx].ent.both);
+		p = prom_sample(p, end, "liburing_enters_shape_total", label,
+				"shape=\"neither\"",
+				stats_tab[idx].ent.neither);
+
+		for (i = 0; i < IO_URING_WAKEUP_NR; i++)
+			p = prom_sample(p, end, "liburing_wakeups_total", label,
+					wake_names[i],
+					stats_tab[idx].wake.reasons[i]);
+
+		/* cumulative histogram of to_submit per submitting enter */
+		for (i = 0; i < IO_URING_ENTER_BATCH_BUCKETS; i++) {
+			char *q = le, *qend = le + sizeof(le) - 1;
+
+			cum += stats_tab[idx].ent.batch_hist[i];
+			q = dump_str(q, qend, "le=\"");
+			q = dump_u64(q, qend, (2ULL << i) - 1);
+			q = dump_str(q, qend, "\"");
+			*q = '\0';
+			p = prom_sample(p, end, "liburing_submit_batch_bucket",
+					label, le, cum);
+		}
+		p = prom_sample(p, end, "liburing_submit_batch_bucket", label,
+				"le=\"+Inf\"", cum);
+		p = prom_sample(p, end, "liburing_submit_batch_count", label,
+				NULL, cum);
+	}
+out:
+#endif
+	*p = '\0';
+	return p == end ? -ENOSPC : (int) (p - buf);
+}
+
+/*
+ * Configure a busy-poll window for CQE waits on this ring. Before a wait
+ * resorts to io_uring_enter, it spins on the CQ for up to 'max_spins'
+ * cpu-relax iterations, with the effective window adapted from whether
+ * recent spins paid off. Pass 0 (the default) to always enter directly.
+ */
+void io_uring_set_wait_spin(struct io_uring *ring, unsigned max_spins)
+{
+	ring->cq.spin_limit = max_spins;
+	ring->cq.spin_cur = max_spins;
+}
+
 int __io_uring_sqring_wait(struct io_uring *ring)
 {
 	int flags = IORING_ENTER_SQ_WAIT;
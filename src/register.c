@@ -5,22 +5,126 @@
 #include "syscall.h"
 #include "liburing.h"
 #include "int_flags.h"
+#include "setup.h"
 #include "liburing/compat.h"
 #include "liburing/io_uring.h"
 
+/*
+ * Registration journal for ring state handoff, see
+ * io_uring_state_track(). Tracked rings record the reconstructible
+ * shape of their registrations as a side effect of the register
+ * syscalls they already make; registration is a cold path, so untracked
+ * rings pay one counter check per call.
+ */
+#define STATE_MAX_RINGS	8
+
+struct uring_state_journal {
+	struct io_uring *ring;
+	unsigned nr_files;
+	unsigned nr_bufs;
+	struct io_uring_buf_reg *buf_rings;
+	unsigned nr_buf_rings;
+	unsigned cap_buf_rings;
+	/* a lost record would make saved blobs lie; fail save instead */
+	int broken;
+};
+
+static struct uring_state_journal state_tab[STATE_MAX_RINGS];
+static int state_active;
+
+static struct uring_state_journal *uring_state_find(struct io_uring *ring)
+{
+	int i;
+
+	for (i = 0; i < STATE_MAX_RINGS; i++) {
+		if (__atomic_load_n(&state_tab[i].ring,
+				    __ATOMIC_ACQUIRE) == ring)
+			return &state_tab[i];
+	}
+	return NULL;
+}
+
+static void uring_state_record(struct io_uring *ring, unsigned int opcode,
+			       const void *arg, unsigned int nr_args)
+{
+	struct uring_state_journal *j = uring_state_find(ring);
+	const struct io_uring_rsrc_register *rr = arg;
+	const struct io_uring_buf_reg *br = arg;
+	unsigned i;
+
+	if (!j)
+		return;
+
+	switch (opcode) {
+	case IORING_REGISTER_FILES:
+		j->nr_files = nr_args;
+		break;
+	case IORING_REGISTER_FILES2:
+		j->nr_files = rr->nr;
+		break;
+	case IORING_UNREGISTER_FILES:
+		j->nr_files = 0;
+		break;
+	case IORING_REGISTER_BUFFERS:
+		j->nr_bufs = nr_args;
+		break;
+	case IORING_REGISTER_BUFFERS2:
+		j->nr_bufs = rr->nr;
+		break;
+	case IORING_UNREGISTER_BUFFERS:
+		j->nr_bufs = 0;
+		break;
+	case IORING_REGISTER_PBUF_RING:
+		if (j->nr_buf_rings == j->cap_buf_rings) {
+			unsigned cap = j->cap_buf_rings ?
+					2 * j->cap_buf_rings : 4;
+			struct io_uring_buf_reg *grown;
+
+			grown = uring_ring_malloc(ring, cap * sizeof(*grown));
+			if (!grown) {
+				j->broken = 1;
+				return;
+			}
+			memcpy(grown, j->buf_rings,
+			       j->nr_buf_rings * sizeof(*grown));
+			uring_ring_free(ring, j->buf_rings);
+			j->buf_rings = grown;
+			j->cap_buf_rings = cap;
+		}
+		j->buf_rings[j->nr_buf_rings] = *br;
+		/* the backing memory is process-local, only geometry moves */
+		j->buf_rings[j->nr_buf_rings].ring_addr = 0;
+		j->nr_buf_rings++;
+		break;
+	case IORING_UNREGISTER_PBUF_RING:
+		for (i = 0; i < j->nr_buf_rings; i++) {
+			if (j->buf_rings[i].bgid == br->bgid) {
+				j->buf_rings[i] =
+					j->buf_rings[--j->nr_buf_rings];
+				break;
+			}
+		}
+		break;
+	}
+}
+
 static inline int do_register(struct io_uring *ring, unsigned int opcode,
 			      const void *arg, unsigned int nr_args)
 {
-	int fd;
+	unsigned int reg_opcode = opcode;
+	int fd, ret;
 
 	if (ring->int_flags & INT_FLAG_REG_REG_RING) {
-		opcode |= IORING_REGISTER_USE_REGISTERED_RING;
+		reg_opcode |= IORING_REGISTER_USE_REGISTERED_RING;
 		fd = ring->enter_ring_fd;
 	} else {
 		fd = ring->ring_fd;
 	}
 
-	return __sys_io_uring_register(fd, opcode, arg, nr_args);
+	ret = __sys_io_uring_register(fd, reg_opcode, arg, nr_args);
+	if (ret >= 0 && uring_unlikely(IO_URING_READ_ONCE(state_active)))
+		uring_state_record(ring, opcode, arg, nr_args);
+	return ret;
 }
 
 int io_uring_register_buffers_update_tag(struct io_uring *ring, unsigned off,
@@ -73,6 +177,292 @@ int io_uring_unregister_buffers(struct io_uring *ring)
 	return do_register(ring, IORING_UNREGISTER_BUFFERS, NULL, 0);
 }
 
+int io_uring_buf_table_init(struct io_uring *ring,
+			    struct io_uring_buf_table *bt, unsigned nr)
+{
+	int ret;
+
+	bt->iovs = uring_ring_malloc(ring, nr * sizeof(*bt->iovs));
+	if (!bt->iovs)
+		return -ENOMEM;
+	bt->dirty = uring_ring_malloc(ring, nr);
+	if (!bt->dirty) {
+		uring_ring_free(ring, bt->iovs);
+		return -ENOMEM;
+	}
+	memset(bt->iovs, 0, nr * sizeof(*bt->iovs));
+	memset(bt->dirty, 0, nr);
+
+	ret = io_uring_register_buffers_sparse(ring, nr);
+	if (ret) {
+		uring_ring_free(ring, bt->iovs);
+		uring_ring_free(ring, bt->dirty);
+		return ret;
+	}
+
+	bt->ring = ring;
+	bt->nr = nr;
+	return 0;
+}
+
+void io_uring_buf_table_exit(struct io_uring_buf_table *bt)
+{
+	io_uring_unregister_buffers(bt->ring);
+	uring_ring_free(bt->ring, bt->iovs);
+	uring_ring_free(bt->ring, bt->dirty);
+	bt->iovs = NULL;
+	bt->dirty = NULL;
+	bt->nr = 0;
+}
+
+/*
+ * Stage a buffer for slot 'idx'; a NULL addr clears the slot. Nothing
+ * reaches the kernel until io_uring_buf_table_flush(), so a batch of
+ * neighbouring updates costs one register syscall, not one each.
+ */
+int io_uring_buf_table_set(struct io_uring_buf_table *bt, unsigned idx,
+			   void *addr, size_t len)
+{
+	if (idx >= bt->nr)
+		return -EINVAL;
+	bt->iovs[idx].iov_base = addr;
+	bt->iovs[idx].iov_len = len;
+	bt->dirty[idx] = 1;
+	return 0;
+}
+
+/*
+ * Push staged updates to the kernel, one update syscall per contiguous
+ * dirty run. Returns the number of slots updated, or -errno; on error the
+ * remaining slots stay dirty for a retry.
+ */
+int io_uring_buf_table_flush(struct io_uring_buf_table *bt)
+{
+	unsigned i = 0, updated = 0;
+	int ret;
+
+	while (i < bt->nr) {
+		unsigned j;
+
+		if (!bt->dirty[i]) {
+			i++;
+			continue;
+		}
+		j = i + 1;
+		while (j < bt->nr && bt->dirty[j])
+			j++;
+		ret = io_uring_register_buffers_update_tag(bt->ring, i,
+							   &bt->iovs[i], NULL,
+							   j - i);
+		if (ret < 0)
+			return ret;
+		memset(&bt->dirty[i], 0, j - i);
+		updated += j - i;
+		i = j;
+	}
+
+	return (int) updated;
+}
+
+/*
+ * P2P buffer hints for the DMA readiness audit below. Purely
+ * library-side bookkeeping - the kernel takes no such attribute - in a
+ * small per-ring table, same shape as the state journal above.
+ */
+#define P2P_MAX_RINGS	8
+#define P2P_MAX_BUFS	1024
+
+struct uring_p2p_hints {
+	struct io_uring *ring;
+	unsigned long long map[P2P_MAX_BUFS / 64];
+};
+
+static struct uring_p2p_hints p2p_tab[P2P_MAX_RINGS];
+
+static struct uring_p2p_hints *p2p_find(struct io_uring *ring)
+{
+	int i;
+
+	for (i = 0; i < P2P_MAX_RINGS; i++) {
+		if (__atomic_load_n(&p2p_tab[i].ring,
+				    __ATOMIC_ACQUIRE) == ring)
+			return &p2p_tab[i];
+	}
+	return NULL;
+}
+
+/*
+ * Hint buffer slot 'index' as a P2PDMA/GPU-direct target; the audit
+ * counts its failures separately. Clearing the last hint on a ring
+ * releases its table slot.
+ */
+int io_uring_buf_set_p2p(struct io_uring *ring, unsigned index, int p2p)
+{
+	struct uring_p2p_hints *h = p2p_find(ring);
+	unsigned i;
+
+	if (index >= P2P_MAX_BUFS)
+		return -EINVAL;
+	if (!h) {
+		if (!p2p)
+			return 0;
+		for (i = 0; i < P2P_MAX_RINGS; i++) {
+			struct io_uring *key = NULL;
+
+			if (__atomic_compare_exchange_n(&p2p_tab[i].ring,
+							&key, URING_SLOT_BUSY,
+							false,
+							__ATOMIC_ACQUIRE,
+							__ATOMIC_RELAXED)) {
+				h = &p2p_tab[i];
+				break;
+			}
+		}
+		if (!h)
+			return -ENOSPC;
+		memset(h->map, 0, sizeof(h->map));
+		__atomic_store_n(&h->ring, ring, __ATOMIC_RELEASE);
+	}
+	if (p2p) {
+		h->map[index / 64] |= 1ULL << (index % 64);
+		return 0;
+	}
+	h->map[index / 64] &= ~(1ULL << (index % 64));
+	for (i = 0; i < P2P_MAX_BUFS / 64; i++) {
+		if (h->map[i])
+			return 0;
+	}
+	__atomic_store_n(&h->ring, NULL, __ATOMIC_RELEASE);
+	return 0;
+}
+
+int io_uring_buf_is_p2p(struct io_uring *ring, unsigned index)
+{
+	struct uring_p2p_hints *h = p2p_find(ring);
+
+	if (index >= P2P_MAX_BUFS)
+		return 0;
+	return h && (h->map[index / 64] >> (index % 64)) & 1;
+}
+
+/* one mincore batch sized for the stack; loops over larger buffers */
+#define DMA_VEC_PAGES	512
+
+static int dma_count_resident(const void *base, size_t len,
+			      unsigned long page, unsigned long long *resident)
+{
+	unsigned char vec[DMA_VEC_PAGES];
+	unsigned long addr = (unsigned long) base & ~(page - 1);
+	unsigned long end = ((unsigned long) base + len + page - 1) &
+			    ~(page - 1);
+	int ret;
+
+	while (addr < end) {
+		unsigned long chunk = end - addr, i, nr;
+
+		if (chunk > DMA_VEC_PAGES * page)
+			chunk = DMA_VEC_PAGES * page;
+		ret = __sys_mincore((void *) (uintptr_t) addr, chunk, vec);
+		if (ret < 0)
+			return ret;
+		nr = chunk / page;
+		for (i = 0; i < nr; i++)
+			*resident += vec[i] & 1;
+		addr += chunk;
+	}
+	return 0;
+}
+
+/*
+ * Audit the iovec array backing a buffer registration against a
+ * device's DMA limits; see liburing.h for the full contract. Returns
+ * the number of failing iovecs - 0 means the zero-copy route is clean
+ * and startup asserts can rely on it - or -errno when the audit itself
+ * cannot run. 'lim' and 'rep' may each be NULL.
+ */
+int io_uring_buf_verify_dma(struct io_uring *ring, const struct iovec *iovs,
+			    unsigned nr, const struct io_uring_dma_limits *lim,
+			    unsigned flags, struct io_uring_dma_report *rep)
+{
+	unsigned long page = get_page_size();
+	struct uring_p2p_hints *h = p2p_find(ring);
+	struct io_uring_dma_report r;
+	unsigned i, failed = 0;
+	int ret;
+
+	memset(&r, 0, sizeof(r));
+	for (i = 0; i < nr; i++) {
+		unsigned char *base = iovs[i].iov_base;
+		size_t len = iovs[i].iov_len;
+		unsigned long long pages, res = 0;
+		int bad = 0, cold = 0;
+
+		if (!len)
+			continue;
+		pages = ((((unsigned long) base + len + page - 1) &
+			  ~(page - 1)) -
+			 ((unsigned long) base & ~(page - 1))) / page;
+
+		if (lim && lim->align &&
+		    ((unsigned long) base % lim->align || len % lim->align)) {
+			r.misaligned++;
+			bad = 1;
+		}
+		if (lim && lim->max_seg && len > lim->max_seg)
+			r.split_segs += (len + lim->max_seg - 1) /
+					lim->max_seg - 1;
+
+		ret = dma_count_resident(base, len, page, &res);
+		if (ret)
+			return ret;
+		r.resident += res;
+
+		if (flags & IO_URING_DMA_TOUCH) {
+			volatile unsigned char *p = base;
+			unsigned char *e = base + len;
+
+			/* first byte, then one per page boundary */
+			*p = *p;
+			p = (unsigned char *)
+				(((unsigned long) base & ~(page - 1)) + page);
+			for (; (unsigned char *) p < e; p += page)
+				*p = *p;
+			r.touched += pages;
+		}
+		if (flags & IO_URING_DMA_MLOCK) {
+			if (__sys_mlock(base, len) < 0)
+				cold = 1;
+			else
+				r.locked += len;
+		} else {
+			unsigned long long post = res;
+
+			if (res < pages && (flags & IO_URING_DMA_TOUCH)) {
+				post = 0;
+				ret = dma_count_resident(base, len, page,
+							 &post);
+				if (ret)
+					return ret;
+			}
+			if (post < pages)
+				cold = 1;
+		}
+		if (cold) {
+			r.cold++;
+			bad = 1;
+		}
+		if (bad) {
+			failed++;
+			if (h && i < P2P_MAX_BUFS &&
+			    (h->map[i / 64] >> (i % 64)) & 1)
+				r.p2p_violations++;
+		}
+	}
+	if (rep)
+		*rep = r;
+	return (int) failed;
+}
+
 int io_uring_register_files_update_tag(struct io_uring *ring, unsigned off,
 					const int *files, const __u64 *tags,
 					unsigned nr_files)
@@ -195,6 +585,161 @@ int io_uring_unregister_files(struct io_uring *ring)
 	return do_register(ring, IORING_UNREGISTER_FILES, NULL, 0);
 }
 
+int io_uring_file_table_init(struct io_uring *ring,
+			     struct io_uring_file_table *ft, unsigned nr)
+{
+	unsigned i;
+	int ret;
+
+	ft->fds = uring_ring_malloc(ring, nr * sizeof(*ft->fds));
+	ft->dirty = uring_ring_malloc(ring, nr);
+	ft->free_q = uring_ring_malloc(ring, nr * sizeof(*ft->free_q));
+	if (!ft->fds || !ft->dirty || !ft->free_q) {
+		ret = -ENOMEM;
+		goto err;
+	}
+
+	ret = io_uring_register_files_sparse(ring, nr);
+	if (ret)
+		goto err;
+
+	for (i = 0; i < nr; i++) {
+		ft->fds[i] = -1;
+		ft->free_q[i] = i;
+	}
+	memset(ft->dirty, 0, nr);
+	ft->free_head = 0;
+	ft->free_count = nr;
+	ft->ring = ring;
+	ft->nr = nr;
+	return 0;
+err:
+	uring_ring_free(ring, ft->fds);
+	uring_ring_free(ring, ft->dirty);
+	uring_ring_free(ring, ft->free_q);
+	return ret;
+}
+
+void io_uring_file_table_exit(struct io_uring_file_table *ft)
+{
+	io_uring_unregister_files(ft->ring);
+	uring_ring_free(ft->ring, ft->fds);
+	uring_ring_free(ft->ring, ft->dirty);
+	uring_ring_free(ft->ring, ft->free_q);
+	ft->fds = NULL;
+	ft->dirty = NULL;
+	ft->free_q = NULL;
+	ft->nr = 0;
+}
+
+/*
+ * Claim a slot for 'fd' and stage the update. Returns the slot index for
+ * IOSQE_FIXED_FILE use, or -ENFILE when the table is full. The update
+ * reaches the kernel at the next io_uring_file_table_flush().
+ */
+int io_uring_file_slot_get(struct io_uring_file_table *ft, int fd)
+{
+	unsigned idx;
+
+	if (!ft->free_count)
+		return -ENFILE;
+	idx = ft->free_q[ft->free_head];
+	ft->free_head = (ft->free_head + 1) % ft->nr;
+	ft->free_count--;
+	ft->fds[idx] = fd;
+	ft->dirty[idx] = 1;
+	return (int) idx;
+}
+
+/*
+ * Release a slot, staging the kernel-side clear. The slot goes to the
+ * back of the FIFO, so it won't be reissued until every other free slot
+ * has cycled through - by which time requests against the old fd have
+ * long completed.
+ */
+int io_uring_file_slot_put(struct io_uring_file_table *ft, unsigned idx)
+{
+	if (idx >= ft->nr || ft->fds[idx] == -1)
+		return -EINVAL;
+	ft->fds[idx] = -1;
+	ft->dirty[idx] = 1;
+	ft->free_q[(ft->free_head + ft->free_count) % ft->nr] = idx;
+	ft->free_count++;
+	return 0;
+}
+
+/*
+ * Like io_uring_file_table_flush(), but pushes the staged runs through
+ * the ring as IORING_OP_FILES_UPDATE sqes instead of blocking register
+ * syscalls, so table maintenance overlaps data-path I/O rather than
+ * stalling the submission loop. One sqe is prepped per contiguous dirty
+ * run, each tagged with 'user_data'; the caller submits and must check
+ * every completion's res, re-staging the slots with
+ * io_uring_file_slot_get()/put() if an update failed. Returns the number
+ * of sqes prepped, or -EBUSY if the SQ filled up first (remaining runs
+ * stay dirty). Buffer registration has no SQE-based equivalent in the
+ * kernel, so io_uring_buf_table_flush() stays a syscall.
+ */
+int io_uring_file_table_flush_async(struct io_uring_file_table *ft,
+				    __u64 user_data)
+{
+	unsigned i = 0, prepped = 0;
+
+	while (i < ft->nr) {
+		struct io_uring_sqe *sqe;
+		unsigned j;
+
+		if (!ft->dirty[i]) {
+			i++;
+			continue;
+		}
+		j = i + 1;
+		while (j < ft->nr && ft->dirty[j])
+			j++;
+		sqe = io_uring_get_sqe(ft->ring);
+		if (!sqe)
+			return prepped ? (int) prepped : -EBUSY;
+		io_uring_prep_files_update(sqe, &ft->fds[i], j - i, i);
+		sqe->user_data = user_data;
+		memset(&ft->dirty[i], 0, j - i);
+		prepped++;
+		i = j;
+	}
+
+	return (int) prepped;
+}
+
+/*
+ * Push staged slot changes, one update syscall per contiguous dirty run.
+ * Returns the number of slots updated or -errno; failed runs stay dirty.
+ */
+int io_uring_file_table_flush(struct io_uring_file_table *ft)
+{
+	unsigned i = 0, updated = 0;
+	int ret;
+
+	while (i < ft->nr) {
+		unsigned j;
+
+		if (!ft->dirty[i]) {
+			i++;
+			continue;
+		}
+		j = i + 1;
+		while (j < ft->nr && ft->dirty[j])
+			j++;
+		ret = io_uring_register_files_update(ft->ring, i, &ft->fds[i],
+						     j - i);
+		if (ret < 0)
+			return ret;
+		memset(&ft->dirty[i], 0, j - i);
+		updated += j - i;
+		i = j;
+	}
+
+	return (int) updated;
+}
+
 int io_uring_register_eventfd(struct io_uring *ring, int event_fd)
 {
 	return do_register(ring, IORING_REGISTER_EVENTFD, &event_fd, 1);
@@ -221,6 +766,34 @@ int io_uring_register_personality(struct io_uring *ring)
 	return do_register(ring, IORING_REGISTER_PERSONALITY, NULL, 0);
 }
 
+/*
+ * Register 'nr' personalities for the calling task's current credentials
+ * in one go, filling 'ids' with the assigned personality ids. Each
+ * registration snapshots the creds at call time, so callers juggling
+ * multiple identities switch creds and call again for the next batch. On
+ * failure everything registered by this call is unregistered again and
+ * the error returned, so a cold-start loop doesn't leak ids halfway.
+ */
+int io_uring_register_personalities(struct io_uring *ring, unsigned nr,
+				    int *ids)
+{
+	unsigned i;
+	int ret;
+
+	for (i = 0; i < nr; i++) {
+		ret = io_uring_register_personality(ring);
+		if (ret < 0)
+			goto err;
+		ids[i] = ret;
+	}
+
+	return 0;
+err:
+	while (i--)
+		io_uring_unregister_personality(ring, ids[i]);
+	return ret;
+}
+
 int io_uring_unregister_personality(struct io_uring *ring, int id)
 {
 	return do_register(ring, IORING_UNREGISTER_PERSONALITY, NULL, id);
@@ -238,6 +811,25 @@ int io_uring_enable_rings(struct io_uring *ring)
 	return do_register(ring, IORING_REGISTER_ENABLE_RINGS, NULL, 0);
 }
 
+/*
+ * Apply restrictions to a ring started with IORING_SETUP_R_DISABLED and
+ * enable it in one call, the common lockdown sequence. If enabling
+ * fails the restrictions remain registered - the kernel has no way to
+ * withdraw them - and the ring stays disabled.
+ */
+int io_uring_register_restrictions_enable(struct io_uring *ring,
+					  struct io_uring_restriction *res,
+					  unsigned int nr_res)
+{
+	int ret;
+
+	ret = io_uring_register_restrictions(ring, res, nr_res);
+	if (ret)
+		return ret;
+
+	return io_uring_enable_rings(ring);
+}
+
 int io_uring_register_iowq_aff(struct io_uring *ring, size_t cpusz,
 			       const cpu_set_t *mask)
 {
@@ -257,6 +849,88 @@ int io_uring_register_iowq_max_workers(struct io_uring *ring, unsigned int *val)
 	return do_register(ring, IORING_REGISTER_IOWQ_MAX_WORKERS, val, 2);
 }
 
+/*
+ * Query the current bounded/unbounded io-wq worker caps without changing
+ * them; the register opcode treats zeroes as "no change" and writes the
+ * previous values back.
+ */
+int io_uring_get_iowq_max_workers(struct io_uring *ring, unsigned int *val)
+{
+	val[0] = val[1] = 0;
+	return io_uring_register_iowq_max_workers(ring, val);
+}
+
+int io_uring_iowq_governor_init(struct io_uring *ring,
+				struct io_uring_iowq_governor *g,
+				const unsigned *min, const unsigned *max)
+{
+	unsigned vals[2];
+	int ret;
+
+	if (!min[0] || !min[1] || min[0] > max[0] || min[1] > max[1])
+		return -EINVAL;
+
+	/* the register op writes the previous caps back into its array */
+	vals[0] = min[0];
+	vals[1] = min[1];
+	ret = io_uring_register_iowq_max_workers(ring, vals);
+	if (ret)
+		return ret;
+
+	g->cur[0] = min[0];
+	g->cur[1] = min[1];
+	g->ring = ring;
+	g->min[0] = min[0];
+	g->min[1] = min[1];
+	g->max[0] = max[0];
+	g->max[1] = max[1];
+	return 0;
+}
+
+/*
+ * Adjust the worker caps from one observation interval: 'punts[0]' and
+ * 'punts[1]' are the caller's counts of requests punted to the bounded
+ * and unbounded class, 'submits' the total submissions. A class eating
+ * more than an eighth of submissions doubles its cap (up to max); one
+ * seeing no punts decays by a quarter (down to min). Returns 1 if the
+ * caps changed, 0 if not, -errno on registration failure.
+ */
+int io_uring_iowq_governor_step(struct io_uring_iowq_governor *g,
+				const unsigned *punts, unsigned submits)
+{
+	unsigned want[2], vals[2];
+	int i, ret;
+
+	if (!submits)
+		return 0;
+
+	for (i = 0; i < 2; i++) {
+		want[i] = g->cur[i];
+		if (punts[i] > submits / 8) {
+			want[i] = g->cur[i] * 2;
+			if (want[i] > g->max[i])
+				want[i] = g->max[i];
+		} else if (!punts[i]) {
+			want[i] = g->cur[i] - g->cur[i] / 4;
+			if (want[i] < g->min[i])
+				want[i] = g->min[i];
+		}
+	}
+
+	if (want[0] == g->cur[0] && want[1] == g->cur[1])
+		return 0;
+
+	vals[0] = want[0];
+	vals[1] = want[1];
+	ret = io_uring_register_iowq_max_workers(g->ring, vals);
+	if (ret)
+		return ret;
+
+	g->cur[0] = want[0];
+	g->cur[1] = want[1];
+	return 1;
+}
+
 int io_uring_register_ring_fd(struct io_uring *ring)
 {
 	struct io_uring_rsrc_update up = {
@@ -272,7 +946,7 @@ int io_uring_register_ring_fd(struct io_uring *ring)
 	if (ret == 1) {
 		ring->enter_ring_fd = up.offset;
 		ring->int_flags |= INT_FLAG_REG_RING;
-		if (ring->features & IORING_FEAT_REG_REG_RING) {
+		if (ring->quirks & IO_URING_QUIRK_REG_REG_RING) {
 			ring->int_flags |= INT_FLAG_REG_REG_RING;
 		}
 	}
@@ -300,7 +974,7 @@ int io_uring_unregister_ring_fd(struct io_uring *ring)
 
 int io_uring_close_ring_fd(struct io_uring *ring)
 {
-	if (!(ring->features & IORING_FEAT_REG_REG_RING))
+	if (!(ring->quirks & IO_URING_QUIRK_REG_REG_RING))
 		return -EOPNOTSUPP;
 	if (!(ring->int_flags & INT_FLAG_REG_RING))
 		return -EINVAL;
@@ -340,31 +1014,1276 @@ int io_uring_buf_ring_head(struct io_uring *ring, int buf_group, unsigned *head)
 	return 0;
 }
 
-int io_uring_register_sync_cancel(struct io_uring *ring,
-				  struct io_uring_sync_cancel_reg *reg)
+/*
+ * Seed or resync a head cache from the kernel's view; one register
+ * syscall. See io_uring_buf_ring_available_cached().
+ */
+int io_uring_buf_ring_sync_head(struct io_uring *ring, int buf_group,
+				struct io_uring_buf_ring_cache *cache)
 {
-	return do_register(ring, IORING_REGISTER_SYNC_CANCEL, reg, 1);
+	unsigned head;
+	int ret;
+
+	ret = io_uring_buf_ring_head(ring, buf_group, &head);
+	if (ret)
+		return ret;
+
+	cache->head = (unsigned short) head;
+	return 0;
 }
 
-int io_uring_register_file_alloc_range(struct io_uring *ring,
-					unsigned off, unsigned len)
+/*
+ * Arm a depletion guard on an already-populated buf ring: the head cache
+ * is seeded from the kernel (one syscall), after which depth checks are
+ * userspace reads. 'low_mark' is the posted-depth at or below which the
+ * guard fires.
+ */
+int io_uring_buf_refill_init(struct io_uring *ring,
+			     struct io_uring_buf_refill *rf,
+			     struct io_uring_buf_ring *br, int buf_group,
+			     unsigned int nentries, unsigned short low_mark,
+			     void (*replenish)(struct io_uring_buf_refill *rf,
+					       void *data), void *data)
 {
-	struct io_uring_file_index_range range = {
-		.off = off,
-		.len = len
-	};
+	int ret;
 
-	return do_register(ring, IORING_REGISTER_FILE_ALLOC_RANGE, &range, 0);
+	ret = io_uring_buf_ring_sync_head(ring, buf_group, &rf->cache);
+	if (ret)
+		return ret;
+
+	rf->ring = ring;
+	rf->br = br;
+	rf->low_mark = low_mark;
+	rf->mask = (unsigned short) io_uring_buf_ring_mask(nentries);
+	rf->reserve = NULL;
+	rf->reserve_len = 0;
+	rf->reserve_nr = 0;
+	rf->reserve_bid = 0;
+	rf->replenish = replenish;
+	rf->cb_data = data;
+	memset(&rf->stats, 0, sizeof(rf->stats));
+	rf->stats.min_depth = (__u32) io_uring_buf_refill_depth(rf);
+	return 0;
 }
 
-int io_uring_register_napi(struct io_uring *ring, struct io_uring_napi *napi)
+/*
+ * Hand the guard an emergency reserve: 'nr' spare buffers of 'buf_len'
+ * bytes each, contiguous at 'base', registering as bids starting at
+ * 'base_bid' (which must not collide with the working set). The reserve
+ * is posted in full the first time the watermark trips and is then
+ * spent; once its buffers cycle back through CQEs they join the working
+ * set, and the replenish callback is expected to rebuild the reserve.
+ */
+void io_uring_buf_refill_set_reserve(struct io_uring_buf_refill *rf,
+				     void *base, unsigned int buf_len,
+				     unsigned short nr, unsigned short base_bid)
 {
-	return __sys_io_uring_register(ring->ring_fd,
-				IORING_REGISTER_NAPI, napi, 1);
+	rf->reserve = base;
+	rf->reserve_len = buf_len;
+	rf->reserve_nr = nr;
+	rf->reserve_bid = base_bid;
 }
 
-int io_uring_unregister_napi(struct io_uring *ring, struct io_uring_napi *napi)
+/*
+ * Account 'count' completions whose buffers the application is holding
+ * on to (not yet recycled). At or below the watermark the reserve is
+ * posted and the replenish callback runs. Returns the number of reserve
+ * buffers posted, or 0 when depth is still healthy.
+ */
+int io_uring_buf_refill_consumed(struct io_uring_buf_refill *rf,
+				 unsigned count)
 {
-	return __sys_io_uring_register(ring->ring_fd,
-				IORING_UNREGISTER_NAPI, napi, 1);
+	unsigned short i, nr;
+
+	io_uring_buf_ring_consumed(&rf->cache, count);
+#ifdef LIBURING_BUFSTATS
+	rf->stats.consumed += count;
+	if ((__u32) io_uring_buf_refill_depth(rf) < rf->stats.min_depth)
+		rf->stats.min_depth = (__u32) io_uring_buf_refill_depth(rf);
+#endif
+	if (io_uring_buf_refill_depth(rf) > rf->low_mark)
+		return 0;
+
+	nr = rf->reserve_nr;
+	for (i = 0; i < nr; i++)
+		io_uring_buf_ring_add(rf->br,
+				      rf->reserve + (size_t) i * rf->reserve_len,
+				      rf->reserve_len,
+				      (unsigned short) (rf->reserve_bid + i),
+				      rf->mask, i);
+	if (nr) {
+		io_uring_buf_ring_advance(rf->br, nr);
+		rf->reserve_nr = 0;
+	}
+	if (rf->replenish)
+		rf->replenish(rf, rf->cb_data);
+	return nr;
+}
+
+/*
+ * Account a refill batch of 'count' buffers the application posted back
+ * to the group. Pure metrics; call next to the tail advance.
+ */
+void io_uring_buf_refill_returned(struct io_uring_buf_refill *rf,
+				  unsigned count)
+{
+#ifdef LIBURING_BUFSTATS
+	rf->stats.refill_batches++;
+	rf->stats.refill_bufs += count;
+#endif
+}
+
+/*
+ * Account a completion that failed with -ENOBUFS against this group.
+ */
+void io_uring_buf_refill_enobufs(struct io_uring_buf_refill *rf)
+{
+#ifdef LIBURING_BUFSTATS
+	rf->stats.enobufs++;
+#endif
+}
+
+/*
+ * Snapshot the group's occupancy counters. min_depth resets to the
+ * current depth so each query reports the low-water mark of its own
+ * interval. -EOPNOTSUPP unless built with -DLIBURING_BUFSTATS.
+ */
+int io_uring_buf_ring_get_stats(struct io_uring_buf_refill *rf,
+				struct io_uring_buf_stats *st)
+{
+#ifdef LIBURING_BUFSTATS
+	rf->stats.depth = (__u32) io_uring_buf_refill_depth(rf);
+	*st = rf->stats;
+	rf->stats.min_depth = rf->stats.depth;
+	return 0;
+#else
+	return -EOPNOTSUPP;
+#endif
+}
+
+/*
+ * Build a fixed-buffer arena: one slab split into size classes
+ * ('buf_sizes' ascending, 'buf_counts' slices each), with every slice
+ * registered as its own fixed buffer in a single
+ * io_uring_register_buffers() call so buf_index maps 1:1 to a slice.
+ * Per-class LIFO free stacks keep allocation O(1) and reuse warm
+ * buffers first.
+ */
+__cold int io_uring_fixed_arena_init(struct io_uring *ring,
+				     struct io_uring_fixed_arena *fa,
+				     const unsigned *buf_sizes,
+				     const unsigned *buf_counts,
+				     unsigned nr_classes)
+{
+	size_t slab_size = 0, head_size;
+	unsigned nr_slots = 0;
+	struct iovec *iovs;
+	char *p;
+	unsigned i, j, slot;
+	int ret;
+
+	if (!nr_classes)
+		return -EINVAL;
+	for (i = 0; i < nr_classes; i++) {
+		if (!buf_sizes[i] || !buf_counts[i])
+			return -EINVAL;
+		slab_size += (size_t) buf_sizes[i] * buf_counts[i];
+		nr_slots += buf_counts[i];
+	}
+
+	head_size = nr_classes * sizeof(*fa->classes) +
+		    nr_slots * sizeof(unsigned);
+	fa->classes = uring_ring_malloc(ring, head_size);
+	if (!fa->classes)
+		return -ENOMEM;
+	fa->slab = uring_ring_malloc(ring, slab_size);
+	if (!fa->slab) {
+		ret = -ENOMEM;
+		goto err_classes;
+	}
+	iovs = uring_ring_malloc(ring, nr_slots * sizeof(*iovs));
+	if (!iovs) {
+		ret = -ENOMEM;
+		goto err_slab;
+	}
+
+	p = fa->slab;
+	slot = 0;
+	for (i = 0; i < nr_classes; i++) {
+		struct io_uring_fixed_class *cl = &fa->classes[i];
+
+		cl->base = p;
+		cl->buf_size = buf_sizes[i];
+		cl->first_slot = slot;
+		cl->nr = buf_counts[i];
+		cl->free_q = (unsigned *) (fa->classes + nr_classes) + slot;
+		cl->free_nr = buf_counts[i];
+		for (j = 0; j < buf_counts[i]; j++) {
+			iovs[slot + j].iov_base = p + (size_t) j * buf_sizes[i];
+			iovs[slot + j].iov_len = buf_sizes[i];
+			cl->free_q[j] = slot + j;
+		}
+		slot += buf_counts[i];
+		p += (size_t) buf_sizes[i] * buf_counts[i];
+	}
+
+	ret = io_uring_register_buffers(ring, iovs, nr_slots);
+	uring_ring_free(ring, iovs);
+	if (ret)
+		goto err_slab;
+
+	fa->ring = ring;
+	fa->nr_classes = nr_classes;
+	fa->nr_slots = nr_slots;
+	return 0;
+err_slab:
+	uring_ring_free(ring, fa->slab);
+err_classes:
+	uring_ring_free(ring, fa->classes);
+	return ret;
+}
+
+__cold int io_uring_fixed_arena_exit(struct io_uring_fixed_arena *fa)
+{
+	int ret;
+
+	ret = io_uring_unregister_buffers(fa->ring);
+	if (ret)
+		return ret;
+
+	uring_ring_free(fa->ring, fa->slab);
+	uring_ring_free(fa->ring, fa->classes);
+	fa->slab = NULL;
+	fa->classes = NULL;
+	return 0;
+}
+
+/*
+ * Allocate a registered buffer of at least 'len' bytes from the
+ * smallest size class that fits. Fills in the address and the buf_index
+ * to pass to the _fixed prep helpers. -ENOENT if 'len' exceeds the
+ * largest class, -ENOMEM if every fitting class is empty.
+ */
+int io_uring_fixed_alloc(struct io_uring_fixed_arena *fa, unsigned len,
+			 struct io_uring_fixed_buf *buf)
+{
+	unsigned i;
+
+	for (i = 0; i < fa->nr_classes; i++) {
+		struct io_uring_fixed_class *cl = &fa->classes[i];
+		unsigned slot;
+
+		if (cl->buf_size < len)
+			continue;
+		if (!cl->free_nr)
+			continue;
+		slot = cl->free_q[--cl->free_nr];
+		buf->addr = cl->base +
+			(size_t) (slot - cl->first_slot) * cl->buf_size;
+		buf->buf_index = slot;
+		return 0;
+	}
+
+	if (fa->nr_classes &&
+	    fa->classes[fa->nr_classes - 1].buf_size < len)
+		return -ENOENT;
+	return -ENOMEM;
+}
+
+/*
+ * Return an arena buffer. The caller must be done issuing I/O against
+ * its buf_index.
+ */
+int io_uring_fixed_free(struct io_uring_fixed_arena *fa,
+			const struct io_uring_fixed_buf *buf)
+{
+	unsigned i;
+
+	for (i = 0; i < fa->nr_classes; i++) {
+		struct io_uring_fixed_class *cl = &fa->classes[i];
+
+		if (buf->buf_index < cl->first_slot ||
+		    buf->buf_index >= cl->first_slot + cl->nr)
+			continue;
+		if (cl->free_nr >= cl->nr)
+			return -EINVAL;
+		cl->free_q[cl->free_nr++] = buf->buf_index;
+		return 0;
+	}
+	return -EINVAL;
+}
+
+/*
+ * Grow the chosen array to 'cap' entries of 'esz' bytes; extents and
+ * runs both grow this way. The shift loops stand in for memmove, which
+ * nolibc builds don't have.
+ */
+static void *extent_grow(struct io_uring_extent_map *em, void *old,
+			 unsigned nr, unsigned cap, size_t esz)
+{
+	void *grown;
+
+	grown = uring_ring_malloc(em->ring, cap * esz);
+	if (!grown)
+		return NULL;
+	memcpy(grown, old, nr * esz);
+	uring_ring_free(em->ring, old);
+	return grown;
+}
+
+__cold int io_uring_extent_map_init(struct io_uring *ring,
+				    struct io_uring_extent_map *em,
+				    unsigned table_size, size_t chunk_size)
+{
+	int ret;
+
+	if (!chunk_size)
+		chunk_size = IO_URING_EXTENT_CHUNK_DFL;
+	if (!table_size || (chunk_size & (chunk_size - 1)))
+		return -EINVAL;
+
+	memset(em, 0, sizeof(*em));
+	ret = io_uring_register_buffers_sparse(ring, table_size);
+	if (ret)
+		return ret;
+	em->ring = ring;
+	em->table_size = table_size;
+	em->chunk_size = chunk_size;
+	return 0;
+}
+
+__cold void io_uring_extent_map_exit(struct io_uring_extent_map *em)
+{
+	io_uring_unregister_buffers(em->ring);
+	uring_ring_free(em->ring, em->extents);
+	uring_ring_free(em->ring, em->runs);
+	em->extents = NULL;
+	em->runs = NULL;
+	em->nr = em->nr_runs = 0;
+}
+
+/* claim 'nr' contiguous slots, preferring 'want' when it is exact */
+static int extent_claim_slots(struct io_uring_extent_map *em, unsigned nr,
+			      int want)
+{
+	unsigned i, first;
+
+	for (i = 0; i < em->nr_runs; i++) {
+		struct io_uring_extent_run *r = &em->runs[i];
+
+		if (r->nr < nr)
+			continue;
+		if (want >= 0 && r->first != (unsigned) want)
+			continue;
+		first = r->first;
+		r->first += nr;
+		r->nr -= nr;
+		if (!r->nr) {
+			for (; i + 1 < em->nr_runs; i++)
+				em->runs[i] = em->runs[i + 1];
+			em->nr_runs--;
+		}
+		return (int) first;
+	}
+	if (want >= 0 && (unsigned) want != em->next_slot)
+		return -1;
+	if (em->next_slot + nr > em->table_size)
+		return want >= 0 ? -1 : -ENOSPC;
+	first = em->next_slot;
+	em->next_slot += nr;
+	return (int) first;
+}
+
+static int extent_release_slots(struct io_uring_extent_map *em,
+				unsigned first, unsigned nr)
+{
+	unsigned i, j;
+
+	/* the slot high-water mark shrinks for free */
+	if (first + nr == em->next_slot) {
+		em->next_slot = first;
+		return 0;
+	}
+	if (em->nr_runs == em->cap_runs) {
+		unsigned cap = em->cap_runs ? 2 * em->cap_runs : 8;
+		void *grown = extent_grow(em, em->runs, em->nr_runs, cap,
+					  sizeof(*em->runs));
+
+		if (!grown)
+			return -ENOMEM;
+		em->runs = grown;
+		em->cap_runs = cap;
+	}
+	for (i = 0; i < em->nr_runs && em->runs[i].first < first; i++)
+		;
+	for (j = em->nr_runs; j > i; j--)
+		em->runs[j] = em->runs[j - 1];
+	em->runs[i].first = first;
+	em->runs[i].nr = nr;
+	em->nr_runs++;
+	/* merge with the neighbours where the runs now touch */
+	if (i + 1 < em->nr_runs &&
+	    em->runs[i].first + em->runs[i].nr == em->runs[i + 1].first) {
+		em->runs[i].nr += em->runs[i + 1].nr;
+		for (j = i + 1; j + 1 < em->nr_runs; j++)
+			em->runs[j] = em->runs[j + 1];
+		em->nr_runs--;
+	}
+	if (i && em->runs[i - 1].first + em->runs[i - 1].nr ==
+		 em->runs[i].first) {
+		em->runs[i - 1].nr += em->runs[i].nr;
+		for (j = i; j + 1 < em->nr_runs; j++)
+			em->runs[j] = em->runs[j + 1];
+		em->nr_runs--;
+	}
+	return 0;
+}
+
+/* index of the first extent with base >= 'ptr', i.e. insertion point */
+static unsigned extent_lower_bound(struct io_uring_extent_map *em,
+				   const void *ptr)
+{
+	unsigned lo = 0, hi = em->nr;
+
+	while (lo < hi) {
+		unsigned mid = lo + (hi - lo) / 2;
+
+		if ((char *) em->extents[mid].base < (char *) ptr)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+static int extent_update_slots(struct io_uring_extent_map *em, unsigned first,
+			       char *base, size_t len)
+{
+	unsigned nr = (len + em->chunk_size - 1) / em->chunk_size;
+	struct iovec *iovs;
+	unsigned i;
+	int ret;
+
+	iovs = uring_ring_malloc(em->ring, nr * sizeof(*iovs));
+	if (!iovs)
+		return -ENOMEM;
+	for (i = 0; i < nr; i++) {
+		iovs[i].iov_base = base ? base + (size_t) i * em->chunk_size :
+					  NULL;
+		iovs[i].iov_len = !base ? 0 :
+				  len >= em->chunk_size ? em->chunk_size : len;
+		if (base)
+			len -= iovs[i].iov_len;
+	}
+	ret = io_uring_register_buffers_update_tag(em->ring, first, iovs,
+						   NULL, nr);
+	uring_ring_free(em->ring, iovs);
+	return ret < 0 ? ret : 0;
+}
+
+/*
+ * Register extent [base, base + len) as chunk_size'd slots, one update
+ * syscall regardless of extent size. An extent starting exactly where a
+ * chunk-aligned neighbour ends coalesces into that neighbour's record
+ * when its slot run can extend in place, so an arena growing
+ * contiguously stays one record no matter how many extents built it.
+ * Overlapping an existing extent returns -EEXIST, a full slot table
+ * -ENOSPC.
+ */
+int io_uring_extent_add(struct io_uring_extent_map *em, void *base,
+			size_t len)
+{
+	unsigned nr = (len + em->chunk_size - 1) / em->chunk_size;
+	struct io_uring_extent *e;
+	unsigned i, j;
+	int first, ret;
+
+	if (!base || !len)
+		return -EINVAL;
+	i = extent_lower_bound(em, base);
+	if (i < em->nr &&
+	    (char *) base + len > (char *) em->extents[i].base)
+		return -EEXIST;
+	if (i && (char *) em->extents[i - 1].base +
+		 em->extents[i - 1].len > (char *) base)
+		return -EEXIST;
+
+	/* contiguous growth: extend the predecessor's slot run */
+	if (i) {
+		e = &em->extents[i - 1];
+		if ((char *) e->base + e->len == (char *) base &&
+		    !(e->len & (em->chunk_size - 1))) {
+			first = extent_claim_slots(em, nr,
+					(int) (e->first_slot + e->nr_slots));
+			if (first >= 0) {
+				ret = extent_update_slots(em, first, base,
+							  len);
+				if (ret) {
+					extent_release_slots(em, first, nr);
+					return ret;
+				}
+				e->len += len;
+				e->nr_slots += nr;
+				return 0;
+			}
+		}
+	}
+
+	if (em->nr == em->cap) {
+		unsigned cap = em->cap ? 2 * em->cap : 16;
+		void *grown = extent_grow(em, em->extents, em->nr, cap,
+					  sizeof(*em->extents));
+
+		if (!grown)
+			return -ENOMEM;
+		em->extents = grown;
+		em->cap = cap;
+	}
+	first = extent_claim_slots(em, nr, -1);
+	if (first < 0)
+		return first;
+	ret = extent_update_slots(em, first, base, len);
+	if (ret) {
+		extent_release_slots(em, first, nr);
+		return ret;
+	}
+	for (j = em->nr; j > i; j--)
+		em->extents[j] = em->extents[j - 1];
+	e = &em->extents[i];
+	e->base = base;
+	e->len = len;
+	e->first_slot = first;
+	e->nr_slots = nr;
+	em->nr++;
+	return 0;
+}
+
+/* drop the extent starting at 'base', clearing its registered slots */
+int io_uring_extent_del(struct io_uring_extent_map *em, void *base)
+{
+	struct io_uring_extent *e;
+	unsigned i, first, nr;
+	int ret;
+
+	i = extent_lower_bound(em, base);
+	if (i == em->nr || em->extents[i].base != base)
+		return -ENOENT;
+	e = &em->extents[i];
+	first = e->first_slot;
+	nr = e->nr_slots;
+	ret = extent_update_slots(em, first, NULL, (size_t) nr *
+				  em->chunk_size);
+	if (ret)
+		return ret;
+	for (; i + 1 < em->nr; i++)
+		em->extents[i] = em->extents[i + 1];
+	em->nr--;
+	return extent_release_slots(em, first, nr);
+}
+
+/*
+ * Translate [ptr, ptr + len) to the buf_index to pass alongside ptr to
+ * io_uring_prep_read_fixed() and friends. -ENOENT when no extent
+ * covers the range, -ERANGE when it straddles a chunk boundary and
+ * needs splitting into two requests.
+ */
+int io_uring_extent_lookup(struct io_uring_extent_map *em, const void *ptr,
+			   size_t len, unsigned *buf_index)
+{
+	struct io_uring_extent *e;
+	size_t off, chunk_off;
+	unsigned i;
+
+	i = extent_lower_bound(em, ptr);
+	if (i == em->nr || em->extents[i].base != (void *) ptr) {
+		if (!i)
+			return -ENOENT;
+		i--;
+	}
+	e = &em->extents[i];
+	off = (size_t) ((char *) ptr - (char *) e->base);
+	if (off >= e->len || len > e->len - off)
+		return -ENOENT;
+	chunk_off = off & (em->chunk_size - 1);
+	if (chunk_off + len > em->chunk_size)
+		return -ERANGE;
+	*buf_index = e->first_slot + (unsigned) (off / em->chunk_size);
+	return 0;
+}
+
+int io_uring_register_sync_cancel(struct io_uring *ring,
+				  struct io_uring_sync_cancel_reg *reg)
+{
+	return do_register(ring, IORING_REGISTER_SYNC_CANCEL, reg, 1);
+}
+
+/*
+ * Synchronously cancel everything in flight against 'fd' with a single
+ * syscall, the connection-teardown fast path. 'flags' is OR'ed into the
+ * cancel flags, e.g. IORING_ASYNC_CANCEL_FD_FIXED for a direct
+ * descriptor. Returns what the kernel reports for the match-all cancel;
+ * -ENOENT means nothing was in flight.
+ */
+int io_uring_sync_cancel_fd_all(struct io_uring *ring, int fd,
+				unsigned int flags)
+{
+	struct io_uring_sync_cancel_reg reg;
+
+	memset(&reg, 0, sizeof(reg));
+	reg.fd = fd;
+	reg.flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL | flags;
+	reg.timeout.tv_sec = -1;
+	reg.timeout.tv_nsec = -1;
+	return io_uring_register_sync_cancel(ring, &reg);
+}
+
+/*
+ * Cancel a batch of targets with per-target result reporting: results[i]
+ * receives the outcome for regs[i]. The kernel takes one target per
+ * sync-cancel op, so this is one syscall per target, not per batch -
+ * teardown storms wanting a single transition should pack an fd plus
+ * IORING_ASYNC_CANCEL_ALL into one target, or use
+ * io_uring_sync_cancel_fd_all(). Returns the number of targets that
+ * cancelled cleanly.
+ */
+int io_uring_register_sync_cancel_batch(struct io_uring *ring,
+					struct io_uring_sync_cancel_reg *regs,
+					int *results, unsigned nr)
+{
+	unsigned i, done = 0;
+
+	for (i = 0; i < nr; i++) {
+		results[i] = io_uring_register_sync_cancel(ring, &regs[i]);
+		if (results[i] >= 0)
+			done++;
+	}
+
+	return (int) done;
+}
+
+int io_uring_register_file_alloc_range(struct io_uring *ring,
+					unsigned off, unsigned len)
+{
+	struct io_uring_file_index_range range = {
+		.off = off,
+		.len = len
+	};
+
+	return do_register(ring, IORING_REGISTER_FILE_ALLOC_RANGE, &range, 0);
+}
+
+int io_uring_register_region(struct io_uring *ring,
+			     struct io_uring_mem_region_reg *reg)
+{
+	return do_register(ring, IORING_REGISTER_MEM_REGION, reg, 1);
+}
+
+/*
+ * Split a fixed-file table of table_size slots into nr_groups disjoint
+ * alloc ranges, one per logical group (remainder slots go to the last
+ * group). No range is installed until the first
+ * io_uring_file_ranges_switch(); the kernel default of the full table
+ * stays in effect until then.
+ */
+int io_uring_file_ranges_init(struct io_uring *ring,
+			      struct io_uring_file_ranges *fr,
+			      unsigned table_size, unsigned nr_groups)
+{
+	unsigned i, per_group;
+
+	if (!nr_groups || table_size < nr_groups)
+		return -EINVAL;
+
+	fr->ranges = uring_ring_malloc(ring, nr_groups * sizeof(*fr->ranges));
+	if (!fr->ranges)
+		return -ENOMEM;
+
+	per_group = table_size / nr_groups;
+	for (i = 0; i < nr_groups; i++) {
+		fr->ranges[i].off = i * per_group;
+		fr->ranges[i].len = per_group;
+		fr->ranges[i].resv = 0;
+	}
+	fr->ranges[nr_groups - 1].len += table_size % nr_groups;
+
+	fr->ring = ring;
+	fr->nr = nr_groups;
+	fr->active = -1;
+	return 0;
+}
+
+/*
+ * Make the given group's range the active alloc range. Switching to the
+ * group that is already installed is free; batching submissions per
+ * group keeps the register syscall off the per-request path.
+ */
+int io_uring_file_ranges_switch(struct io_uring_file_ranges *fr,
+				unsigned group)
+{
+	int ret;
+
+	if (group >= fr->nr)
+		return -EINVAL;
+	if ((int) group == fr->active)
+		return 0;
+
+	ret = io_uring_register_file_alloc_range(fr->ring,
+						 fr->ranges[group].off,
+						 fr->ranges[group].len);
+	if (ret)
+		return ret;
+
+	fr->active = (int) group;
+	return 0;
+}
+
+void io_uring_file_ranges_exit(struct io_uring_file_ranges *fr)
+{
+	uring_ring_free(fr->ring, fr->ranges);
+	fr->ranges = NULL;
+	fr->nr = 0;
+	fr->active = -1;
+}
+
+int io_uring_register_napi(struct io_uring *ring, struct io_uring_napi *napi)
+{
+	return __sys_io_uring_register(ring->ring_fd,
+				IORING_REGISTER_NAPI, napi, 1);
+}
+
+int io_uring_unregister_napi(struct io_uring *ring, struct io_uring_napi *napi)
+{
+	return __sys_io_uring_register(ring->ring_fd,
+				IORING_UNREGISTER_NAPI, napi, 1);
+}
+
+static unsigned long long napi_now_ns(void)
+{
+	struct __kernel_timespec ts;
+
+	uring_clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void accept_gov_refill(struct io_uring_accept_gov *g)
+{
+	unsigned long long now = napi_now_ns();
+	unsigned long long earned;
+
+	if (!g->rate)
+		return;
+	earned = (now - g->last_ns) * g->rate / 1000000000ULL;
+	if (!earned)
+		return;
+	g->tokens = earned > g->burst - g->tokens ?
+			g->burst : g->tokens + (unsigned) earned;
+	g->last_ns = now;
+}
+
+static int accept_gov_arm(struct io_uring_accept_gov *g)
+{
+	struct io_uring_sqe *sqe;
+
+	sqe = io_uring_get_sqe(g->ring);
+	if (!sqe)
+		return -EBUSY;
+	memcpy(sqe, &g->tmpl, sizeof(*sqe));
+	g->paused = 0;
+	return 1;
+}
+
+/*
+ * Take over a prep'ed multishot accept sqe as the governed accept:
+ * 'accept_sqe' becomes the re-arm template (its user_data is the match
+ * key) and is left staged for the caller's next submit. Admission
+ * pauses at 'high_mark' in-flight connections and resumes at
+ * 'low_mark'; 'rate' accepts/sec (0 for unlimited) with bursts up to
+ * 'burst' bounds the accept rate independently.
+ */
+int io_uring_accept_gov_init(struct io_uring *ring,
+			     struct io_uring_accept_gov *g,
+			     const struct io_uring_sqe *accept_sqe,
+			     unsigned high_mark, unsigned low_mark,
+			     unsigned rate, unsigned burst)
+{
+	if (low_mark > high_mark || (rate && !burst))
+		return -EINVAL;
+
+	memcpy(&g->tmpl, accept_sqe, sizeof(g->tmpl));
+	g->ring = ring;
+	g->inflight = 0;
+	g->high_mark = high_mark;
+	g->low_mark = low_mark;
+	g->rate = rate;
+	g->burst = burst;
+	g->tokens = burst;
+	g->last_ns = napi_now_ns();
+	g->paused = 0;
+	return 0;
+}
+
+/*
+ * Run one reaped completion through the governor. Returns 0 for
+ * foreign cqes; 1 for accept completions, which the caller still
+ * handles (the accepted descriptor is its business). A successful
+ * accept charges a token and counts in-flight; crossing the high mark
+ * or draining the bucket pauses the multishot via sync cancel, which
+ * terminates it within this CQ batch.
+ */
+int io_uring_accept_gov_cqe(struct io_uring_accept_gov *g,
+			    const struct io_uring_cqe *cqe)
+{
+	if (cqe->user_data != g->tmpl.user_data)
+		return 0;
+
+	if (cqe->res >= 0) {
+		g->inflight++;
+		accept_gov_refill(g);
+		if (g->tokens)
+			g->tokens--;
+		if (!g->paused &&
+		    (g->inflight >= g->high_mark || (g->rate && !g->tokens))) {
+			struct io_uring_sync_cancel_reg reg;
+
+			memset(&reg, 0, sizeof(reg));
+			reg.addr = g->tmpl.user_data;
+			reg.timeout.tv_sec = -1;
+			reg.timeout.tv_nsec = -1;
+			io_uring_register_sync_cancel(g->ring, &reg);
+			g->paused = 1;
+		}
+		return 1;
+	}
+
+	/*
+	 * Terminated: our own cancel (stay paused) or a transient kernel
+	 * condition. Re-arm the latter so the listener doesn't die.
+	 */
+	if (!(cqe->flags & IORING_CQE_F_MORE) && !g->paused &&
+	    cqe->res != -ECANCELED)
+		accept_gov_arm(g);
+	return 1;
+}
+
+/*
+ * Note one governed connection retired. Resumes the accept once
+ * in-flight drops to the low mark and the bucket allows it; returns 1
+ * if a re-arm was staged (publish with the next submit), else 0.
+ */
+int io_uring_accept_gov_done(struct io_uring_accept_gov *g)
+{
+	if (g->inflight)
+		g->inflight--;
+	if (!g->paused || g->inflight > g->low_mark)
+		return 0;
+	accept_gov_refill(g);
+	if (g->rate && !g->tokens)
+		return 0;
+	return accept_gov_arm(g) > 0;
+}
+
+/*
+ * Periodic poke for rate-limited governors: refills the bucket and
+ * resumes a paused accept when tokens and the in-flight count allow.
+ * Call once per CQ batch; returns 1 if a re-arm was staged.
+ */
+int io_uring_accept_gov_tick(struct io_uring_accept_gov *g)
+{
+	if (!g->paused || g->inflight >= g->high_mark)
+		return 0;
+	accept_gov_refill(g);
+	if (g->rate && !g->tokens)
+		return 0;
+	if (g->inflight > g->low_mark)
+		return 0;
+	return accept_gov_arm(g) > 0;
+}
+
+int io_uring_napi_tuner_init(struct io_uring *ring,
+			     struct io_uring_napi_tuner *t, unsigned min_to,
+			     unsigned max_to, unsigned sample_window)
+{
+	struct io_uring_napi napi;
+	int ret;
+
+	if (!min_to || min_to > max_to || !sample_window)
+		return -EINVAL;
+
+	memset(&napi, 0, sizeof(napi));
+	napi.busy_poll_to = min_to;
+	ret = io_uring_register_napi(ring, &napi);
+	if (ret)
+		return ret;
+
+	memset(t, 0, sizeof(*t));
+	t->ring = ring;
+	t->min_to = min_to;
+	t->max_to = max_to;
+	t->sample_window = sample_window;
+	t->cur_to = min_to;
+	return 0;
+}
+
+/*
+ * Feed one sample - call once per reaped completion batch. Every
+ * 'sample_window' samples the tuner matches busy_poll_to to the average
+ * completion inter-arrival gap, clamped to [min_to, max_to], and
+ * re-registers only when the target drifts more than 25% from the
+ * current setting. Returns 1 if the NAPI parameters were re-registered,
+ * 0 if not, -errno if re-registration failed.
+ */
+int io_uring_napi_tuner_sample(struct io_uring_napi_tuner *t)
+{
+	unsigned long long now = napi_now_ns();
+	unsigned long long avg_ns;
+	unsigned target;
+	struct io_uring_napi napi;
+	int ret;
+
+	if (t->last_ns)
+		t->gap_sum_ns += now - t->last_ns;
+	t->last_ns = now;
+
+	if (++t->nr_samples < t->sample_window)
+		return 0;
+
+	avg_ns = t->gap_sum_ns / t->nr_samples;
+	t->nr_samples = 0;
+	t->gap_sum_ns = 0;
+
+	target = (unsigned) (avg_ns / 1000);
+	if (target < t->min_to)
+		target = t->min_to;
+	else if (target > t->max_to)
+		target = t->max_to;
+
+	/* hysteresis: ignore drift within a quarter of the current value */
+	if (target >= t->cur_to - t->cur_to / 4 &&
+	    target <= t->cur_to + t->cur_to / 4)
+		return 0;
+
+	memset(&napi, 0, sizeof(napi));
+	napi.busy_poll_to = target;
+	napi.prefer_busy_poll = t->prefer_busy_poll;
+	ret = io_uring_register_napi(t->ring, &napi);
+	if (ret)
+		return ret;
+
+	t->cur_to = target;
+	return 1;
+}
+
+int io_uring_napi_tuner_exit(struct io_uring_napi_tuner *t)
+{
+	struct io_uring_napi napi;
+
+	memset(&napi, 0, sizeof(napi));
+	return io_uring_unregister_napi(t->ring, &napi);
+}
+
+__cold int io_uring_state_track(struct io_uring *ring)
+{
+	struct uring_state_journal *j;
+	int i;
+
+	if (uring_state_find(ring))
+		return -EEXIST;
+	j = NULL;
+	for (i = 0; i < STATE_MAX_RINGS; i++) {
+		struct io_uring *key = NULL;
+
+		if (__atomic_compare_exchange_n(&state_tab[i].ring, &key,
+						URING_SLOT_BUSY, false,
+						__ATOMIC_ACQUIRE,
+						__ATOMIC_RELAXED)) {
+			j = &state_tab[i];
+			break;
+		}
+	}
+	if (!j)
+		return -ENOSPC;
+	memset((char *) j + sizeof(j->ring), 0, sizeof(*j) - sizeof(j->ring));
+	__atomic_store_n(&j->ring, ring, __ATOMIC_RELEASE);
+	__atomic_fetch_add(&state_active, 1, __ATOMIC_RELAXED);
+	return 0;
+}
+
+__cold void io_uring_state_untrack(struct io_uring *ring)
+{
+	struct uring_state_journal *j = uring_state_find(ring);
+
+	if (!j)
+		return;
+	uring_ring_free(ring, j->buf_rings);
+	memset((char *) j + sizeof(j->ring), 0, sizeof(*j) - sizeof(j->ring));
+	__atomic_store_n(&j->ring, NULL, __ATOMIC_RELEASE);
+	__atomic_fetch_sub(&state_active, 1, __ATOMIC_RELAXED);
+}
+
+/*
+ * io_uring_queue_exit() backstop for this TU's registries: unhook the
+ * state journal and the P2P hint map so a recycled ring address starts
+ * clean. Both drops are idempotent with the regular teardown paths.
+ */
+__cold void uring_register_registries_drop(struct io_uring *ring)
+{
+	int i;
+
+	io_uring_state_untrack(ring);
+	for (i = 0; i < P2P_MAX_RINGS; i++) {
+		if (__atomic_load_n(&p2p_tab[i].ring,
+				    __ATOMIC_RELAXED) == ring)
+			__atomic_store_n(&p2p_tab[i].ring, NULL,
+					 __ATOMIC_RELEASE);
+	}
+}
+
+/*
+ * Serialize the reconstructible configuration of 'ring' into 'buf'.
+ * The params image is rebuilt from the live ring pointers, so geometry
+ * saves work even for untracked rings; registration shape needs
+ * io_uring_state_track() from before the first registration. A NULL
+ * 'buf' returns the required size. Returns bytes written or -errno.
+ */
+ssize_t io_uring_state_save(struct io_uring *ring, void *buf, size_t len)
+{
+	struct uring_state_journal *j = uring_state_find(ring);
+	struct io_uring_state_hdr *hdr = buf;
+	struct io_uring_sq *sq = &ring->sq;
+	struct io_uring_cq *cq = &ring->cq;
+	struct io_uring_params *p;
+	size_t need;
+
+	if (j && j->broken)
+		return -ENOMEM;
+	need = sizeof(*hdr);
+	if (j)
+		need += j->nr_buf_rings * sizeof(struct io_uring_buf_reg);
+	if (!buf)
+		return need;
+	if (len < need)
+		return -ENOSPC;
+
+	memset(hdr, 0, sizeof(*hdr));
+	hdr->magic = IO_URING_STATE_MAGIC;
+	hdr->version = IO_URING_STATE_VERSION;
+	if (j) {
+		hdr->nr_files = j->nr_files;
+		hdr->nr_bufs = j->nr_bufs;
+		hdr->nr_buf_rings = j->nr_buf_rings;
+		memcpy(hdr + 1, j->buf_rings,
+		       j->nr_buf_rings * sizeof(struct io_uring_buf_reg));
+	}
+
+	p = &hdr->params;
+	p->flags = ring->flags;
+	p->features = ring->features;
+	p->sq_entries = sq->ring_entries;
+	p->cq_entries = cq->ring_entries;
+	p->sq_off.head = (char *) sq->khead - (char *) sq->ring_ptr;
+	p->sq_off.tail = (char *) sq->ktail - (char *) sq->ring_ptr;
+	p->sq_off.ring_mask = (char *) sq->kring_mask - (char *) sq->ring_ptr;
+	p->sq_off.ring_entries = (char *) sq->kring_entries -
+				 (char *) sq->ring_ptr;
+	p->sq_off.flags = (char *) sq->kflags - (char *) sq->ring_ptr;
+	p->sq_off.dropped = (char *) sq->kdropped - (char *) sq->ring_ptr;
+	if (!(ring->flags & IORING_SETUP_NO_SQARRAY))
+		p->sq_off.array = (char *) sq->array - (char *) sq->ring_ptr;
+	else
+		/* unused as a pointer; sized so mmap reproduces ring_sz */
+		p->sq_off.array = sq->ring_sz -
+				  sq->ring_entries * sizeof(unsigned);
+	p->cq_off.head = (char *) cq->khead - (char *) cq->ring_ptr;
+	p->cq_off.tail = (char *) cq->ktail - (char *) cq->ring_ptr;
+	p->cq_off.ring_mask = (char *) cq->kring_mask - (char *) cq->ring_ptr;
+	p->cq_off.ring_entries = (char *) cq->kring_entries -
+				 (char *) cq->ring_ptr;
+	p->cq_off.overflow = (char *) cq->koverflow - (char *) cq->ring_ptr;
+	p->cq_off.cqes = (char *) cq->cqes - (char *) cq->ring_ptr;
+	if (cq->kflags)
+		p->cq_off.flags = (char *) cq->kflags - (char *) cq->ring_ptr;
+	return need;
+}
+
+static int uring_state_validate(const void *buf, size_t len)
+{
+	const struct io_uring_state_hdr *hdr = buf;
+
+	if (len < sizeof(*hdr))
+		return -EINVAL;
+	if (hdr->magic != IO_URING_STATE_MAGIC ||
+	    hdr->version != IO_URING_STATE_VERSION)
+		return -EINVAL;
+	if (len < sizeof(*hdr) +
+		  hdr->nr_buf_rings * sizeof(struct io_uring_buf_reg))
+		return -EINVAL;
+	return 0;
+}
+
+/*
+ * Read back provided-buffer ring record 'idx' from a saved blob, for
+ * the successor to replay through io_uring_setup_buf_ring() with its
+ * own memory. Returns 0, -ENOENT past the last record, or -EINVAL for
+ * a malformed blob.
+ */
+int io_uring_state_buf_ring(const void *buf, size_t len, unsigned idx,
+			    struct io_uring_buf_reg *reg)
+{
+	const struct io_uring_state_hdr *hdr = buf;
+	const struct io_uring_buf_reg *recs;
+	int ret;
+
+	ret = uring_state_validate(buf, len);
+	if (ret)
+		return ret;
+	if (idx >= hdr->nr_buf_rings)
+		return -ENOENT;
+	recs = (const void *) (hdr + 1);
+	*reg = recs[idx];
+	return 0;
+}
+
+static int uring_state_replay_tables(struct io_uring *ring,
+				     const struct io_uring_state_hdr *hdr)
+{
+	int ret = 0;
+
+	if (hdr->nr_files)
+		ret = io_uring_register_files_sparse(ring, hdr->nr_files);
+	if (!ret && hdr->nr_bufs)
+		ret = io_uring_register_buffers_sparse(ring, hdr->nr_bufs);
+	return ret;
+}
+
+/*
+ * Build a fresh ring from a saved blob: same entries, flags and CQ
+ * sizing, with the registered file and buffer tables re-registered
+ * sparse at their old sizes for the app to refill. Ring modes that
+ * depend on process-local resources the blob can't carry (app-provided
+ * memory, fd-only rings) are dropped from the flag set.
+ */
+__cold int io_uring_queue_init_state(const void *buf, size_t len,
+				     struct io_uring *ring)
+{
+	const struct io_uring_state_hdr *hdr = buf;
+	struct io_uring_params p;
+	int ret;
+
+	ret = uring_state_validate(buf, len);
+	if (ret)
+		return ret;
+
+	memset(&p, 0, sizeof(p));
+	p.flags = hdr->params.flags & ~(IORING_SETUP_NO_MMAP |
+					IORING_SETUP_REGISTERED_FD_ONLY);
+	p.flags |= IORING_SETUP_CQSIZE;
+	p.cq_entries = hdr->params.cq_entries;
+
+	ret = io_uring_queue_init_params(hdr->params.sq_entries, ring, &p);
+	if (ret)
+		return ret;
+
+	ret = uring_state_replay_tables(ring, hdr);
+	if (ret) {
+		io_uring_queue_exit(ring);
+		return ret;
+	}
+	return 0;
+}
+
+/*
+ * Reattach a ring fd passed from the predecessor (SCM_RIGHTS or
+ * pidfd_getfd) using the params image in the blob. Registrations are
+ * still live in the kernel ring, so nothing is replayed.
+ */
+__cold int io_uring_queue_mmap_state(int fd, const void *buf, size_t len,
+				     struct io_uring *ring)
+{
+	const struct io_uring_state_hdr *hdr = buf;
+	struct io_uring_params p;
+	int ret;
+
+	ret = uring_state_validate(buf, len);
+	if (ret)
+		return ret;
+	p = hdr->params;
+	ret = io_uring_queue_mmap(fd, &p, ring);
+	if (ret)
+		return ret;
+	/* queue_mmap only maps; finish what ring setup would have set */
+	ring->flags = p.flags;
+	ring->features = p.features;
+	ring->ring_fd = ring->enter_ring_fd = fd;
+	return 0;
+}
+
+/*
+ * Checkpoint bracket for CRIU-style snapshots: an io_uring fd cannot be
+ * dumped, so the ring has to be gone before the checkpointer walks the
+ * fd table. io_uring_pause() quiesces in-flight I/O (match-any cancel
+ * plus CQ drain, see io_uring_quiesce()), serializes the
+ * reconstructible state into 'buf' and closes the ring. In-flight
+ * requests do not survive the pause - that is the fail-fast contract;
+ * an app that cannot stand losing them should not checkpoint. A NULL
+ * 'buf' returns the blob size without touching the ring. 'ts' bounds
+ * the cancel wait; a still-busy ring fails with -EBUSY and is left
+ * usable. Returns bytes written or -errno.
+ */
+ssize_t io_uring_pause(struct io_uring *ring, struct __kernel_timespec *ts,
+		       void *buf, size_t len)
+{
+	ssize_t ret;
+
+	if (!buf)
+		return io_uring_state_save(ring, NULL, 0);
+
+	ret = io_uring_quiesce(ring, ts, NULL);
+	if (ret)
+		return ret;
+	ret = io_uring_state_save(ring, buf, len);
+	if (ret < 0)
+		return ret;
+	io_uring_state_untrack(ring);
+	io_uring_queue_exit(ring);
+	return ret;
+}
+
+/*
+ * Rebuild a paused ring after restore. With 'mem' the shared mappings
+ * are carved from the caller's buffer via io_uring_queue_init_mem()
+ * (blob geometry, same hugepage workflow) and the blob's registration
+ * tables are replayed sparse for the app to refill; without it this is
+ * io_uring_queue_init_state(). Returns bytes consumed from 'mem', 0
+ * for library-managed memory, or -errno.
+ */
+__cold ssize_t io_uring_resume(const void *buf, size_t len,
+			       struct io_uring *ring, void *mem, size_t mem_len)
+{
+	const struct io_uring_state_hdr *hdr = buf;
+	struct io_uring_params p;
+	ssize_t used;
+	int ret;
+
+	if (!mem)
+		return io_uring_queue_init_state(buf, len, ring);
+
+	ret = uring_state_validate(buf, len);
+	if (ret)
+		return ret;
+
+	memset(&p, 0, sizeof(p));
+	p.flags = hdr->params.flags & ~IORING_SETUP_REGISTERED_FD_ONLY;
+	p.flags |= IORING_SETUP_CQSIZE;
+	p.cq_entries = hdr->params.cq_entries;
+
+	used = io_uring_queue_init_mem(hdr->params.sq_entries, ring, &p,
+				       mem, mem_len);
+	if (used < 0)
+		return used;
+	ret = uring_state_replay_tables(ring, hdr);
+	if (ret) {
+		io_uring_queue_exit(ring);
+		return ret;
+	}
+	return used;
 }
@@ -0,0 +1,679 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * Submission and completion scheduling engines: coalesced submits, the
+ * multishot rearm pool, short-transfer continuation, io-wq worker
+ * quotas, the multi-consumer CQ claim, completion dispatch, the event
+ * loop, and the multi-threaded SQ front end.
+ */
+#define _POSIX_C_SOURCE 200112L
+
+#include "lib.h"
+#include "syscall.h"
+#include "liburing.h"
+#include "setup.h"
+
+/*
+ * Set up submit coalescing over 'ring'. io_uring_coalesce_submit() then
+ * defers the enter syscall until either 'watermark' sqes are pending or
+ * the oldest deferred sqe has been waiting for 'max_delay_ns'. Use
+ * io_uring_coalesce_flush() at ordering barriers where deferral isn't
+ * acceptable.
+ */
+void io_uring_coalesce_init(struct io_uring *ring,
+			    struct io_uring_submit_coalesce *sc,
+			    unsigned watermark,
+			    unsigned long long max_delay_ns)
+{
+	sc->ring = ring;
+	sc->watermark = watermark;
+	sc->max_delay_ns = max_delay_ns;
+	sc->oldest_ns = 0;
+}
+
+/*
+ * Submit pending sqes if the coalescing watermark or time bound has been
+ * hit, otherwise leave them staged. Returns the number of sqes submitted,
+ * 0 if submission was deferred, or -errno.
+ */
+int io_uring_coalesce_submit(struct io_uring_submit_coalesce *sc)
+{
+	unsigned pending = io_uring_sq_ready(sc->ring);
+	unsigned long long now;
+
+	if (!pending)
+		return 0;
+	if (pending < sc->watermark) {
+		now = uring_mono_ns();
+		if (!sc->oldest_ns) {
+			sc->oldest_ns = now;
+			return 0;
+		}
+		if (now - sc->oldest_ns < sc->max_delay_ns)
+			return 0;
+	}
+
+	sc->oldest_ns = 0;
+	return io_uring_submit(sc->ring);
+}
+
+/*
+ * Unconditionally submit anything the coalescer has deferred.
+ */
+int io_uring_coalesce_flush(struct io_uring_submit_coalesce *sc)
+{
+	sc->oldest_ns = 0;
+	return io_uring_submit(sc->ring);
+}
+
+int io_uring_ms_init(struct io_uring *ring, struct io_uring_multishot *ms,
+		     unsigned nr)
+{
+	ms->entries = uring_ring_malloc(ring, nr * sizeof(*ms->entries));
+	if (!ms->entries)
+		return -ENOMEM;
+	memset(ms->entries, 0, nr * sizeof(*ms->entries));
+	ms->ring = ring;
+	ms->nr_entries = nr;
+	return 0;
+}
+
+void io_uring_ms_exit(struct io_uring_multishot *ms)
+{
+	uring_ring_free(ms->ring, ms->entries);
+	ms->entries = NULL;
+	ms->nr_entries = 0;
+}
+
+/*
+ * Take a snapshot of a prep'ed multishot sqe as the re-arm template. The
+ * request is armed at the next io_uring_ms_submit(); the caller must not
+ * submit the original sqe itself. Returns the slot id on success, -ENOSPC
+ * if all slots are taken. The sqe's user_data is the key completions are
+ * matched on, so it must be unique among registered entries.
+ */
+int io_uring_ms_register(struct io_uring_multishot *ms,
+			 const struct io_uring_sqe *sqe)
+{
+	unsigned i;
+
+	for (i = 0; i < ms->nr_entries; i++) {
+		struct io_uring_ms_entry *e = &ms->entries[i];
+
+		if (e->in_use)
+			continue;
+		uring_sqe_copy64(&e->sqe, sqe);
+		e->in_use = 1;
+		e->pending = 1;
+		return (int) i;
+	}
+
+	return -ENOSPC;
+}
+
+void io_uring_ms_unregister(struct io_uring_multishot *ms, int id)
+{
+	if (id >= 0 && (unsigned) id < ms->nr_entries) {
+		ms->entries[id].in_use = 0;
+		ms->entries[id].pending = 0;
+	}
+}
+
+/*
+ * Feed one reaped completion through the lifecycle tracker. If it belongs
+ * to a registered entry and signals termination (no IORING_CQE_F_MORE),
+ * the entry is queued for re-arm and 1 is returned; the caller can then
+ * skip its own handling of the teardown. A cqe with -ECANCELED drops the
+ * registration instead, as cancellation reflects caller intent. Returns 0
+ * for completions the tracker doesn't act on.
+ */
+int io_uring_ms_cqe(struct io_uring_multishot *ms,
+		    const struct io_uring_cqe *cqe)
+{
+	unsigned i;
+
+	if (cqe->flags & IORING_CQE_F_MORE)
+		return 0;
+
+	for (i = 0; i < ms->nr_entries; i++) {
+		struct io_uring_ms_entry *e = &ms->entries[i];
+
+		if (!e->in_use || e->sqe.user_data != cqe->user_data)
+			continue;
+		if (cqe->res == -ECANCELED) {
+			e->in_use = 0;
+			return 0;
+		}
+		e->pending = 1;
+		return 1;
+	}
+
+	return 0;
+}
+
+/*
+ * Re-prep every terminated entry from its template, then submit them along
+ * with whatever else the caller has queued. Returns what io_uring_submit()
+ * returns; entries that didn't fit in the SQ stay pending for the next
+ * call.
+ */
+int io_uring_ms_submit(struct io_uring_multishot *ms)
+{
+	unsigned i;
+
+	for (i = 0; i < ms->nr_entries; i++) {
+		struct io_uring_ms_entry *e = &ms->entries[i];
+		struct io_uring_sqe *sqe;
+
+		if (!e->in_use || !e->pending)
+			continue;
+		sqe = io_uring_get_sqe(ms->ring);
+		if (!sqe)
+			break;
+		uring_sqe_copy64(sqe, &e->sqe);
+		e->pending = 0;
+	}
+
+	return io_uring_submit(ms->ring);
+}
+
+int io_uring_cont_init(struct io_uring *ring, struct io_uring_cont *c,
+		       unsigned nr)
+{
+	c->entries = uring_ring_malloc(ring, nr * sizeof(*c->entries));
+	if (!c->entries)
+		return -ENOMEM;
+	memset(c->entries, 0, nr * sizeof(*c->entries));
+	c->ring = ring;
+	c->nr_entries = nr;
+	return 0;
+}
+
+void io_uring_cont_exit(struct io_uring_cont *c)
+{
+	uring_ring_free(c->ring, c->entries);
+	c->entries = NULL;
+	c->nr_entries = 0;
+}
+
+/*
+ * Mark a prep'ed sqe "complete fully": its snapshot seeds re-preps of
+ * the remainder until the transfer is whole. Only single-buffer
+ * read/write/send/recv (plus the fixed-buffer variants) have the
+ * addr/off/len shape a remainder can be computed from; vectored and
+ * linked requests are the caller's problem. user_data is the key
+ * completions are matched on, so it must be unique among armed entries.
+ * Returns the slot id, -EINVAL for an opcode that can't be continued,
+ * -ENOSPC with all slots armed.
+ */
+int io_uring_cont_arm(struct io_uring_cont *c, const struct io_uring_sqe *sqe)
+{
+	unsigned i;
+
+	switch (sqe->opcode) {
+	case IORING_OP_READ:
+	case IORING_OP_WRITE:
+	case IORING_OP_READ_FIXED:
+	case IORING_OP_WRITE_FIXED:
+	case IORING_OP_SEND:
+	case IORING_OP_RECV:
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	for (i = 0; i < c->nr_entries; i++) {
+		struct io_uring_cont_entry *e = &c->entries[i];
+
+		if (e->in_use)
+			continue;
+		uring_sqe_copy64(&e->sqe, sqe);
+		e->done = 0;
+		e->pending = 0;
+		e->in_use = 1;
+		return (int) i;
+	}
+
+	return -ENOSPC;
+}
+
+static int io_uring_cont_stage(struct io_uring_cont *c,
+			       struct io_uring_cont_entry *e)
+{
+	struct io_uring_sqe *sqe;
+
+	sqe = io_uring_get_sqe(c->ring);
+	if (!sqe)
+		return -EBUSY;
+	uring_sqe_copy64(sqe, &e->sqe);
+	sqe->addr += e->done;
+	sqe->len -= e->done;
+	switch (sqe->opcode) {
+	case IORING_OP_READ:
+	case IORING_OP_WRITE:
+	case IORING_OP_READ_FIXED:
+	case IORING_OP_WRITE_FIXED:
+		/* current-position I/O keeps off at -1, the file position
+		 * already advanced with the bytes done */
+		if (sqe->off != (__u64) -1)
+			sqe->off += e->done;
+		break;
+	}
+	return 0;
+}
+
+/*
+ * Feed one reaped completion through the engine. A short success on an
+ * armed entry is swallowed: the remainder is staged to ride the
+ * caller's next submit (or the next io_uring_cont_submit() if the SQ is
+ * full right now) and 1 is returned so the caller skips the cqe. The
+ * final completion - full, zero-length or an error - returns 0 for the
+ * caller to handle, with '*total' set to the bytes accumulated across
+ * the whole chain when 'total' is non-NULL. Untracked cqes return 0
+ * with '*total' untouched.
+ */
+int io_uring_cont_cqe(struct io_uring_cont *c, const struct io_uring_cqe *cqe,
+		      __u64 *total)
+{
+	unsigned i;
+
+	if (cqe->flags & IORING_CQE_F_MORE)
+		return 0;
+
+	for (i = 0; i < c->nr_entries; i++) {
+		struct io_uring_cont_entry *e = &c->entries[i];
+
+		if (!e->in_use || e->sqe.user_data != cqe->user_data)
+			continue;
+		if (cqe->res <= 0) {
+			/* error or EOF: nothing left to continue */
+			e->in_use = 0;
+			if (total)
+				*total = e->done;
+			return 0;
+		}
+		e->done += (__u64) cqe->res;
+		if (e->done >= e->sqe.len) {
+			e->in_use = 0;
+			if (total)
+				*total = e->done;
+			return 0;
+		}
+		e->pending = io_uring_cont_stage(c, e) != 0;
+		return 1;
+	}
+
+	return 0;
+}
+
+/*
+ * Stage every remainder that found the SQ full at reap time, then
+ * submit along with whatever else is queued. Mirrors
+ * io_uring_ms_submit(); entries that still don't fit stay pending.
+ */
+int io_uring_cont_submit(struct io_uring_cont *c)
+{
+	unsigned i;
+
+	for (i = 0; i < c->nr_entries; i++) {
+		struct io_uring_cont_entry *e = &c->entries[i];
+
+		if (!e->in_use || !e->pending)
+			continue;
+		if (io_uring_cont_stage(c, e))
+			break;
+		e->pending = 0;
+	}
+
+	return io_uring_submit(c->ring);
+}
+
+/* opcodes that commonly punt to an io-wq worker instead of going inline */
+static bool wq_quota_punt_prone(__u8 opcode)
+{
+	switch (opcode) {
+	case IORING_OP_READV:
+	case IORING_OP_WRITEV:
+	case IORING_OP_READ_FIXED:
+	case IORING_OP_WRITE_FIXED:
+	case IORING_OP_READ:
+	case IORING_OP_WRITE:
+	case IORING_OP_FSYNC:
+	case IORING_OP_SYNC_FILE_RANGE:
+	case IORING_OP_FALLOCATE:
+	case IORING_OP_FTRUNCATE:
+	case IORING_OP_OPENAT:
+	case IORING_OP_OPENAT2:
+	case IORING_OP_STATX:
+	case IORING_OP_UNLINKAT:
+	case IORING_OP_RENAMEAT:
+	case IORING_OP_MKDIRAT:
+	case IORING_OP_SYMLINKAT:
+	case IORING_OP_LINKAT:
+		return true;
+	default:
+		return false;
+	}
+}
+
+/*
+ * Cap the shared pool at 'bounded'/'unbounded' workers (applied via
+ * the first ring - the wq is shared) and set each ring's fair share.
+ * 'rings' stays caller-owned and must outlive the coordinator.
+ */
+__cold int io_uring_wq_quota_init(struct io_uring_wq_quota *qc,
+				  struct io_uring **rings, unsigned nr,
+				  unsigned bounded, unsigned unbounded)
+{
+	unsigned vals[2] = { bounded, unbounded };
+	int ret;
+
+	if (!nr || !bounded)
+		return -EINVAL;
+	ret = io_uring_register_iowq_max_workers(rings[0], vals);
+	if (ret)
+		return ret;
+	qc->punts = uring_ring_malloc(rings[0], nr * (sizeof(*qc->punts) + sizeof(*qc->throttled)));
+	if (!qc->punts)
+		return -ENOMEM;
+	memset(qc->punts, 0, nr * (sizeof(*qc->punts) +
+				   sizeof(*qc->throttled)));
+	qc->throttled = (__u64 *) (qc->punts + nr);
+	qc->rings = rings;
+	qc->nr = nr;
+	qc->pool = bounded + unbounded;
+	qc->share = (qc->pool + nr - 1) / nr;
+	qc->total = 0;
+	return 0;
+}
+
+__cold void io_uring_wq_quota_exit(struct io_uring_wq_quota *qc)
+{
+	uring_ring_free(qc->rings[0], qc->punts);
+	qc->punts = NULL;
+}
+
+/*
+ * Ask to submit one op with 'opcode' on ring 'idx'. Returns 0 with
+ * the op charged (pair with io_uring_wq_quota_done() on completion),
+ * or -EAGAIN when the shared pool is saturated and this ring already
+ * holds its fair share - resubmit after some of its ops complete.
+ * Opcodes that execute inline are always admitted and never charged.
+ */
+int io_uring_wq_quota_try(struct io_uring_wq_quota *qc, unsigned idx,
+			  __u8 opcode)
+{
+	if (!wq_quota_punt_prone(opcode))
+		return 0;
+	if (qc->total >= qc->pool && qc->punts[idx] >= qc->share) {
+		qc->throttled[idx]++;
+		return -EAGAIN;
+	}
+	qc->punts[idx]++;
+	qc->total++;
+	return 0;
+}
+
+/* one charged op on ring 'idx' completed */
+void io_uring_wq_quota_done(struct io_uring_wq_quota *qc, unsigned idx,
+			    __u8 opcode)
+{
+	if (!wq_quota_punt_prone(opcode))
+		return;
+	if (qc->punts[idx])
+		qc->punts[idx]--;
+	if (qc->total)
+		qc->total--;
+}
+
+__cold int io_uring_mc_init(struct io_uring *ring, struct io_uring_mc_cq *mc)
+{
+	/* big cqes would need a doubled copy stride; not supported here */
+	if (ring->flags & IORING_SETUP_CQE32)
+		return -EINVAL;
+	mc->ring = ring;
+	mc->resv = *ring->cq.khead;
+	mc->commit = mc->resv;
+	return 0;
+}
+
+/*
+ * Claim up to 'nr' completions for this worker. The cqes are copied
+ * into 'out' - the shared ring slots are recycled once the claim
+ * commits, so pointers into the cq cannot outlive this call. Ranges
+ * commit in reservation order; a claimant briefly waits for its
+ * predecessor's copy, which is bounded by one block's memcpy. Safe to
+ * call from any number of threads; returns the number of cqes copied,
+ * 0 with the cq empty.
+ */
+int io_uring_mc_claim(struct io_uring_mc_cq *mc, struct io_uring_cqe *out,
+		      unsigned nr)
+{
+	struct io_uring *ring = mc->ring;
+	unsigned head, tail, avail, n, mask, i;
+
+	for (;;) {
+		head = __atomic_load_n(&mc->resv, __ATOMIC_RELAXED);
+		tail = io_uring_smp_load_acquire(ring->cq.ktail);
+		avail = tail - head;
+		if (!avail)
+			return 0;
+		n = avail < nr ? avail : nr;
+		if (__atomic_compare_exchange_n(&mc->resv, &head, head + n,
+						true, __ATOMIC_ACQUIRE,
+						__ATOMIC_RELAXED))
+			break;
+	}
+	mask = ring->cq.ring_mask;
+	for (i = 0; i < n; i++)
+		out[i] = ring->cq.cqes[(head + i) & mask];
+	/*
+	 * Commit strictly in reservation order: wait for the predecessor,
+	 * free our slots, then release the new commit point. The release
+	 * pairs with the acquire above so the successor's khead store is
+	 * ordered after ours and khead never moves backwards.
+	 */
+	while (__atomic_load_n(&mc->commit, __ATOMIC_ACQUIRE) != head)
+		uring_cpu_relax();
+	io_uring_smp_store_release(ring->cq.khead, head + n);
+	__atomic_store_n(&mc->commit, head + n, __ATOMIC_RELEASE);
+	return (int) n;
+}
+
+__cold int io_uring_loop_init(struct io_uring *ring, struct io_uring_loop *loop)
+{
+	if (!(ring->flags & IORING_SETUP_DEFER_TASKRUN))
+		return -EINVAL;
+	loop->ring = ring;
+	loop->owner = __sys_gettid();
+	loop->running = 0;
+	return 0;
+}
+
+/*
+ * One loop turn: flush pending deferred task work, hand back up to
+ * 'nr' cqes, publish staged sqes, and - with nothing ready - submit
+ * and idle-wait in a single enter. 'ts' bounds the idle wait; NULL
+ * blocks until a completion, a zero timespec just polls. Returns the
+ * number of cqes written to 'cqes' (the caller advances the cq ring),
+ * 0 on an idle timeout, -EDEADLK when called off the owner thread
+ * (elided with NDEBUG) and -EBUSY on a reentrant turn.
+ */
+int io_uring_loop_run(struct io_uring_loop *loop, struct io_uring_cqe **cqes,
+		      unsigned nr, struct __kernel_timespec *ts)
+{
+	struct io_uring *ring = loop->ring;
+	struct io_uring_cqe *cqe;
+	unsigned filled;
+	int ret;
+
+#ifndef NDEBUG
+	if (__sys_gettid() != loop->owner)
+		return -EDEADLK;
+#endif
+	if (loop->running)
+		return -EBUSY;
+	loop->running = 1;
+
+	/* deferred task work is what moves the cq tail; run it first */
+	if (cq_ring_needs_flush(ring)) {
+		ret = io_uring_get_events(ring);
+		if (ret < 0 && ret != -EAGAIN && ret != -EINTR)
+			goto out;
+	}
+	filled = io_uring_peek_batch_cqe(ring, cqes, nr);
+	if (filled) {
+		/* publish staged sqes before handing the batch back */
+		if (io_uring_sq_ready(ring)) {
+			ret = io_uring_submit(ring);
+			if (ret < 0)
+				goto out;
+		}
+		loop->running = 0;
+		return filled;
+	}
+	/* idle: submit and wait in one enter; the wait flushes task work */
+	ret = io_uring_submit_and_wait_timeout(ring, &cqe, 1, ts, NULL);
+	if (ret < 0 && ret != -ETIME && ret != -EAGAIN && ret != -EINTR)
+		goto out;
+	ret = (int) io_uring_peek_batch_cqe(ring, cqes, nr);
+out:
+	loop->running = 0;
+	return ret;
+}
+
+void io_uring_dispatch_init(struct io_uring *ring, struct io_uring_dispatch *d)
+{
+	memset(d, 0, sizeof(*d));
+	d->ring = ring;
+}
+
+int io_uring_dispatch_register(struct io_uring_dispatch *d, unsigned idx,
+			       io_uring_dispatch_fn fn, void *data)
+{
+	if (idx >= IO_URING_DISPATCH_MAX)
+		return -EINVAL;
+	d->handlers[idx] = fn;
+	d->handler_data[idx] = data;
+	return 0;
+}
+
+/*
+ * Walk available completions, routing each cqe to the handler whose index
+ * is encoded in the low bits of user_data, then retire the whole batch
+ * with a single CQ advance. Unhandled indexes are skipped but still
+ * consumed. 'max' bounds the number processed, 0 means no bound.
+ *
+ * Returns the number of completions dispatched.
+ */
+unsigned io_uring_dispatch_completions(struct io_uring_dispatch *d,
+				       unsigned max)
+{
+	struct io_uring *ring = d->ring;
+	struct io_uring_cqe *cqe;
+	unsigned head, nr = 0;
+
+	io_uring_for_each_cqe(ring, head, cqe) {
+		unsigned idx = cqe->user_data & (IO_URING_DISPATCH_MAX - 1);
+
+		if (d->handlers[idx])
+			d->handlers[idx](ring, cqe, d->handler_data[idx]);
+		if (++nr == max)
+			break;
+	}
+	io_uring_cq_advance(ring, nr);
+	return nr;
+}
+
+/*
+ * Set up multi-producer submission for 'ring'. The SQ accounting in struct
+ * io_uring_sq assumes a single submitter; with an io_uring_sq_mt attached,
+ * any number of threads can reserve slots through io_uring_sq_mt_get_sqe()
+ * and mark them filled with io_uring_sq_mt_publish(), while one designated
+ * submitter periodically calls io_uring_sq_mt_flush() followed by
+ * io_uring_submit(). io_uring_get_sqe() must not be mixed with this mode.
+ */
+int io_uring_sq_mt_init(struct io_uring *ring, struct io_uring_sq_mt *mt)
+{
+	mt->ring = ring;
+	mt->tail = ring->sq.sqe_tail;
+	mt->published = uring_ring_malloc(ring, ring->sq.ring_entries);
+	if (!mt->published)
+		return -ENOMEM;
+	memset(mt->published, 0, ring->sq.ring_entries);
+	return 0;
+}
+
+void io_uring_sq_mt_exit(struct io_uring_sq_mt *mt)
+{
+	uring_ring_free(mt->ring, mt->published);
+	mt->published = NULL;
+	mt->ring = NULL;
+}
+
+/*
+ * Reserve one sqe slot with a lock-free cursor update. Safe to call from
+ * any thread. The returned sqe is invisible to the submitter until it has
+ * been published. Returns NULL if the ring is full.
+ */
+struct io_uring_sqe *io_uring_sq_mt_get_sqe(struct io_uring_sq_mt *mt)
+{
+	struct io_uring_sq *sq = &mt->ring->sq;
+	unsigned head, tail;
+	int shift = 0;
+
+	if (mt->ring->flags & IORING_SETUP_SQE128)
+		shift = 1;
+
+	do {
+		tail = IO_URING_READ_ONCE(mt->tail);
+		head = io_uring_smp_load_acquire(sq->khead);
+		if (tail - head >= sq->ring_entries)
+			return NULL;
+	} while (!atomic_compare_exchange_weak_explicit(
+			(_Atomic unsigned *)&mt->tail, &tail, tail + 1,
+			memory_order_relaxed, memory_order_relaxed));
+
+	return &sq->sqes[(tail & sq->ring_mask) << shift];
+}
+
+/*
+ * Mark a reserved sqe as filled in. The store pairs with the acquire load
+ * in io_uring_sq_mt_flush(), so all sqe field writes done before publishing
+ * are visible to the submitter.
+ */
+void io_uring_sq_mt_publish(struct io_uring_sq_mt *mt,
+			    struct io_uring_sqe *sqe)
+{
+	struct io_uring_sq *sq = &mt->ring->sq;
+	unsigned idx = sqe - sq->sqes;
+
+	if (mt->ring->flags & IORING_SETUP_SQE128)
+		idx >>= 1;
+	io_uring_smp_store_release(&mt->published[idx & sq->ring_mask],
+				   (unsigned char) 1);
+}
+
+/*
+ * Advance the single-submitter SQ tail over the contiguous run of published
+ * slots, making them eligible for the next io_uring_submit(). Must only be
+ * called by the submitter thread. Returns the number of sqes collected.
+ */
+unsigned io_uring_sq_mt_flush(struct io_uring_sq_mt *mt)
+{
+	struct io_uring_sq *sq = &mt->ring->sq;
+	unsigned mask = sq->ring_mask;
+	unsigned tail = sq->sqe_tail;
+	unsigned count = 0;
+
+	while (tail != IO_URING_READ_ONCE(mt->tail)) {
+		unsigned idx = tail & mask;
+
+		if (!io_uring_smp_load_acquire(&mt->published[idx]))
+			break;
+		mt->published[idx] = 0;
+		tail++;
+		count++;
+	}
+	sq->sqe_tail = tail;
+	return count;
+}
@@ -12,6 +12,107 @@
 #define KERN_MAX_ENTRIES	32768
 #define KERN_MAX_CQ_ENTRIES	(2 * KERN_MAX_ENTRIES)
 
+/*
+ * Per-ring allocation hooks, see io_uring_set_alloc_hooks(). Managed
+ * runtimes route the library's internal allocations through their own
+ * accounted allocators; unhooked rings take the malloc fast path after
+ * one counter check.
+ */
+#define ALLOC_MAX_RINGS	8
+
+struct uring_alloc_hooks {
+	struct io_uring *ring;
+	/* named *_fn to stay clear of the nolibc malloc/free macros */
+	io_uring_alloc_fn alloc_fn;
+	io_uring_free_fn free_fn;
+	void *user;
+};
+
+static struct uring_alloc_hooks alloc_tab[ALLOC_MAX_RINGS];
+static int alloc_active;
+
+static struct uring_alloc_hooks *uring_alloc_find(struct io_uring *ring)
+{
+	int i;
+
+	for (i = 0; i < ALLOC_MAX_RINGS; i++) {
+		if (__atomic_load_n(&alloc_tab[i].ring,
+				    __ATOMIC_ACQUIRE) == ring)
+			return &alloc_tab[i];
+	}
+	return NULL;
+}
+
+void *uring_ring_malloc(struct io_uring *ring, size_t len)
+{
+	if (uring_unlikely(IO_URING_READ_ONCE(alloc_active))) {
+		struct uring_alloc_hooks *h = uring_alloc_find(ring);
+
+		if (h)
+			return h->alloc_fn(len, h->user);
+	}
+	return malloc(len);
+}
+
+void uring_ring_free(struct io_uring *ring, void *ptr)
+{
+	if (uring_unlikely(IO_URING_READ_ONCE(alloc_active))) {
+		struct uring_alloc_hooks *h = uring_alloc_find(ring);
+
+		if (h) {
+			h->free_fn(ptr, h->user);
+			return;
+		}
+	}
+	free(ptr);
+}
+
+__cold int io_uring_set_alloc_hooks(struct io_uring *ring,
+				    io_uring_alloc_fn alloc_fn,
+				    io_uring_free_fn free_fn, void *user)
+{
+	struct uring_alloc_hooks *h;
+	int i;
+
+	if (!alloc_fn || !free_fn)
+		return -EINVAL;
+	if (uring_alloc_find(ring))
+		return -EEXIST;
+	h = NULL;
+	for (i = 0; i < ALLOC_MAX_RINGS; i++) {
+		struct io_uring *key = NULL;
+
+		if (__atomic_compare_exchange_n(&alloc_tab[i].ring, &key,
+						URING_SLOT_BUSY, false,
+						__ATOMIC_ACQUIRE,
+						__ATOMIC_RELAXED)) {
+			h = &alloc_tab[i];
+			break;
+		}
+	}
+	if (!h)
+		return -ENOSPC;
+	h->alloc_fn = alloc_fn;
+	h->free_fn = free_fn;
+	h->user = user;
+	__atomic_store_n(&h->ring, ring, __ATOMIC_RELEASE);
+	__atomic_fetch_add(&alloc_active, 1, __ATOMIC_RELAXED);
+	return 0;
+}
+
+__cold void io_uring_clear_alloc_hooks(struct io_uring *ring)
+{
+	struct uring_alloc_hooks *h = uring_alloc_find(ring);
+
+	if (!h)
+		return;
+	h->alloc_fn = NULL;
+	h->free_fn = NULL;
+	h->user = NULL;
+	__atomic_store_n(&h->ring, NULL, __ATOMIC_RELEASE);
+	__atomic_fetch_sub(&alloc_active, 1, __ATOMIC_RELAXED);
+}
+
 static inline int __fls(int x)
 {
 	if (!x)
@@ -59,12 +160,74 @@ static int get_sq_cq_entries(unsigned entries, struct io_uring_params *p,
 	return 0;
 }
 
-static void io_uring_unmap_rings(struct io_uring_sq *sq, struct io_uring_cq *cq)
+/*
+ * Hardened mappings put a PROT_NONE page on both sides of each ring
+ * region, so a linear overflow out of adjacent heap faults instead of
+ * scribbling over SQEs the kernel is about to act on. The kernel won't
+ * place a ring mapping at a caller-chosen address (hints, MAP_FIXED and
+ * mremap are all rejected for ring fds), so the guards have to be laid
+ * down first: reserve guard+ring+guard as one PROT_NONE span, punch the
+ * interior back out, and let the top-down unmapped-area search drop the
+ * ring into the hole - it's the highest gap that fits, exactly. The
+ * result is verified, and the whole sandwich comes off again with one
+ * munmap spanning all three mappings.
+ */
+static void *io_uring_mmap_guarded(size_t size, int fd, off_t offset,
+				   int guard)
+{
+	unsigned long page_size;
+	void *base, *ptr;
+	size_t len;
+
+	if (!guard)
+		return __sys_mmap(0, size, PROT_READ | PROT_WRITE,
+				  MAP_SHARED | MAP_POPULATE, fd, offset);
+
+	page_size = get_page_size();
+	len = (size + page_size - 1) & ~(page_size - 1);
+	base = __sys_mmap(0, len + 2 * page_size, PROT_NONE,
+			  MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (IS_ERR(base))
+		return base;
+	__sys_munmap((char *) base + page_size, len);
+	ptr = __sys_mmap(0, size, PROT_READ | PROT_WRITE,
+			 MAP_SHARED | MAP_POPULATE, fd, offset);
+	if (IS_ERR(ptr)) {
+		__sys_munmap(base, page_size);
+		__sys_munmap((char *) base + page_size + len, page_size);
+		return ptr;
+	}
+	if (ptr != (char *) base + page_size) {
+		/* another thread raced into the hole; don't ship unguarded */
+		__sys_munmap(ptr, size);
+		__sys_munmap(base, page_size);
+		__sys_munmap((char *) base + page_size + len, page_size);
+		return ERR_PTR(-ENOMEM);
+	}
+	return ptr;
+}
+
+static void io_uring_munmap_guarded(void *ptr, size_t size, int guard)
+{
+	unsigned long page_size;
+
+	if (!guard) {
+		__sys_munmap(ptr, size);
+		return;
+	}
+	page_size = get_page_size();
+	__sys_munmap((char *) ptr - page_size,
+		     ((size + page_size - 1) & ~(page_size - 1)) +
+		     2 * page_size);
+}
+
+static void io_uring_unmap_rings(struct io_uring_sq *sq, struct io_uring_cq *cq,
+				 int guard)
 {
 	if (sq->ring_sz)
-		__sys_munmap(sq->ring_ptr, sq->ring_sz);
+		io_uring_munmap_guarded(sq->ring_ptr, sq->ring_sz, guard);
 	if (cq->ring_ptr && cq->ring_sz && cq->ring_ptr != sq->ring_ptr)
-		__sys_munmap(cq->ring_ptr, cq->ring_sz);
+		io_uring_munmap_guarded(cq->ring_ptr, cq->ring_sz, guard);
 }
 
 static void io_uring_setup_ring_pointers(struct io_uring_params *p,
@@ -95,8 +258,103 @@ static void io_uring_setup_ring_pointers(struct io_uring_params *p,
 	cq->ring_entries = *cq->kring_entries;
 }
 
+/*
+ * Major * 100 + minor of the running kernel, parsed once per process
+ * from /proc/sys/kernel/osrelease (uname without the libc dependency),
+ * or 0 if it can't be read. Version-derived quirks must only enable
+ * extra fast paths, never gate correctness: backport kernels can carry
+ * features their version string predates.
+ */
+static int uring_kernel_version(void)
+{
+	static int cached;
+	char buf[16];
+	int fd, maj = 0, min = 0, i = 0;
+	ssize_t n;
+
+	if (cached)
+		return cached > 0 ? cached : 0;
+
+	fd = __sys_open("/proc/sys/kernel/osrelease", O_RDONLY, 0);
+	if (fd < 0) {
+		cached = -1;
+		return 0;
+	}
+	n = __sys_read(fd, buf, sizeof(buf) - 1);
+	__sys_close(fd);
+	if (n <= 0) {
+		cached = -1;
+		return 0;
+	}
+	buf[n] = '\0';
+	while (buf[i] >= '0' && buf[i] <= '9')
+		maj = maj * 10 + (buf[i++] - '0');
+	if (buf[i] == '.') {
+		i++;
+		while (buf[i] >= '0' && buf[i] <= '9')
+			min = min * 10 + (buf[i++] - '0');
+	}
+	cached = maj ? maj * 100 + min : -1;
+	return cached > 0 ? cached : 0;
+}
+
+/*
+ * Whether getevents_arg.min_wait_usec is understood, probed once per
+ * process with a zero-timeout EXT_ARG enter: kernels without two-stage
+ * wait support reject a non-zero value in what used to be a padding
+ * field with -EINVAL. Unlike a version check, the probe follows
+ * backports and still works where /proc isn't readable, so it can gate
+ * an API (io_uring_wait_cqes_min_timeout() refuses without it) and not
+ * just a fast path.
+ */
+static int uring_probe_min_timeout(struct io_uring *ring, int fd)
+{
+	static int cached;
+	struct io_uring_getevents_arg arg = { .min_wait_usec = 1 };
+	struct __kernel_timespec ts = { };
+	unsigned flags = IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG;
+	int ret;
+
+	if (cached)
+		return cached > 0;
+	/* a ring created disabled can't enter; leave the result unknown */
+	if (ring->flags & IORING_SETUP_R_DISABLED)
+		return 0;
+	if (ring->flags & IORING_SETUP_REGISTERED_FD_ONLY)
+		flags |= IORING_ENTER_REGISTERED_RING;
+	arg.ts = (unsigned long) &ts;
+	ret = __sys_io_uring_enter2(fd, 0, 0, flags, (void *) &arg,
+				    sizeof(arg));
+	cached = ret < 0 ? -1 : 1;
+	return cached > 0;
+}
+
+/*
+ * Fold features, compile-time assumptions, the kernel version and any
+ * capability probes into the per-ring quirk bits, see IO_URING_QUIRK_*
+ * in liburing.h.
+ */
+static void io_uring_resolve_quirks(struct io_uring *ring, int fd)
+{
+	__u8 q = 0;
+
+	if (io_uring_feature_assumed(IORING_FEAT_EXT_ARG) ||
+	    (ring->features & IORING_FEAT_EXT_ARG))
+		q |= IO_URING_QUIRK_EXT_ARG;
+	if (io_uring_feature_assumed(IORING_FEAT_REG_REG_RING) ||
+	    (ring->features & IORING_FEAT_REG_REG_RING))
+		q |= IO_URING_QUIRK_REG_REG_RING;
+	if (uring_kernel_version() >= 519)
+		q |= IO_URING_QUIRK_TASKRUN_FLAG;
+	if ((q & IO_URING_QUIRK_EXT_ARG) &&
+	    uring_probe_min_timeout(ring, fd))
+		q |= IO_URING_QUIRK_MIN_TIMEOUT;
+	ring->quirks = q;
+}
+
 static int io_uring_mmap(int fd, struct io_uring_params *p,
-			 struct io_uring_sq *sq, struct io_uring_cq *cq)
+			 struct io_uring_sq *sq, struct io_uring_cq *cq,
+			 int guard)
 {
 	size_t size;
 	int ret;
@@ -113,18 +371,16 @@ static int io_uring_mmap(int fd, struct io_uring_params *p,
 			sq->ring_sz = cq->ring_sz;
 		cq->ring_sz = sq->ring_sz;
 	}
-	sq->ring_ptr = __sys_mmap(0, sq->ring_sz, PROT_READ | PROT_WRITE,
-				  MAP_SHARED | MAP_POPULATE, fd,
-				  IORING_OFF_SQ_RING);
+	sq->ring_ptr = io_uring_mmap_guarded(sq->ring_sz, fd,
+					     IORING_OFF_SQ_RING, guard);
 	if (IS_ERR(sq->ring_ptr))
 		return PTR_ERR(sq->ring_ptr);
 
 	if (p->features & IORING_FEAT_SINGLE_MMAP) {
 		cq->ring_ptr = sq->ring_ptr;
 	} else {
-		cq->ring_ptr = __sys_mmap(0, cq->ring_sz, PROT_READ | PROT_WRITE,
-					  MAP_SHARED | MAP_POPULATE, fd,
-					  IORING_OFF_CQ_RING);
+		cq->ring_ptr = io_uring_mmap_guarded(cq->ring_sz, fd,
+						     IORING_OFF_CQ_RING, guard);
 		if (IS_ERR(cq->ring_ptr)) {
 			ret = PTR_ERR(cq->ring_ptr);
 			cq->ring_ptr = NULL;
@@ -135,12 +391,12 @@ static int io_uring_mmap(int fd, struct io_uring_params *p,
 	size = sizeof(struct io_uring_sqe);
 	if (p->flags & IORING_SETUP_SQE128)
 		size += 64;
-	sq->sqes = __sys_mmap(0, size * p->sq_entries, PROT_READ | PROT_WRITE,
-			      MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+	sq->sqes = io_uring_mmap_guarded(size * p->sq_entries, fd,
+					 IORING_OFF_SQES, guard);
 	if (IS_ERR(sq->sqes)) {
 		ret = PTR_ERR(sq->sqes);
 err:
-		io_uring_unmap_rings(sq, cq);
+		io_uring_unmap_rings(sq, cq, guard);
 		return ret;
 	}
 
@@ -157,8 +413,13 @@ err:
 __cold int io_uring_queue_mmap(int fd, struct io_uring_params *p,
 			       struct io_uring *ring)
 {
+	int ret;
+
 	memset(ring, 0, sizeof(*ring));
-	return io_uring_mmap(fd, p, &ring->sq, &ring->cq);
+	ret = io_uring_mmap(fd, p, &ring->sq, &ring->cq, 0);
+	if (!ret)
+		io_uring_resolve_quirks(ring, fd);
+	return ret;
 }
 
 /*
@@ -199,12 +460,63 @@ __cold int io_uring_ring_dontfork(struct io_uring *ring)
 /* FIXME */
 static size_t huge_page_size = 2 * 1024 * 1024;
 
+/* THP advice constants, missing from older libc headers */
+#ifndef MADV_HUGEPAGE
+#define MADV_HUGEPAGE	14
+#endif
+#ifndef MADV_COLLAPSE
+#define MADV_COLLAPSE	25
+#endif
+#ifndef MADV_POPULATE_WRITE
+#define MADV_POPULATE_WRITE	23
+#endif
+
+/*
+ * The hugetlb-with-fallback strategy from io_uring_alloc_huge() below,
+ * for application memory: buffer arenas allocated here get the same TLB
+ * behavior as the rings without duplicating the mmap logic. '*size' is
+ * updated to the length actually mapped, which the caller owes
+ * io_uring_mem_free() - partial munmap of a hugetlb mapping fails.
+ */
+__cold void *io_uring_mem_alloc(size_t *size, unsigned flags)
+{
+	unsigned long page_size = get_page_size();
+	size_t len;
+	void *ptr;
+
+	if (!*size)
+		return NULL;
+	if (!(flags & IO_URING_MEM_NO_HUGETLB)) {
+		len = (*size + huge_page_size - 1) & ~(huge_page_size - 1);
+		ptr = __sys_mmap(NULL, len, PROT_READ | PROT_WRITE,
+				 MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB,
+				 -1, 0);
+		if (!IS_ERR(ptr)) {
+			*size = len;
+			return ptr;
+		}
+	}
+	len = (*size + page_size - 1) & ~(page_size - 1);
+	ptr = __sys_mmap(NULL, len, PROT_READ | PROT_WRITE,
+			 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (IS_ERR(ptr))
+		return NULL;
+	*size = len;
+	return ptr;
+}
+
+__cold void io_uring_mem_free(void *ptr, size_t size)
+{
+	if (ptr)
+		__sys_munmap(ptr, size);
+}
+
 /*
  * Returns negative for error, or number of bytes used in the buffer on success
  */
 static int io_uring_alloc_huge(unsigned entries, struct io_uring_params *p,
 			       struct io_uring_sq *sq, struct io_uring_cq *cq,
-			       void *buf, size_t buf_size)
+			       void *buf, size_t buf_size, int no_hugetlb)
 {
 	unsigned long page_size = get_page_size();
 	unsigned sq_entries, cq_entries;
@@ -238,6 +550,9 @@ static int io_uring_alloc_huge(unsigned entries, struct io_uring_params *p,
 		return -ENOMEM;
 
 	if (buf) {
+		/* page alignment is the hard contract; see io_uring_mem_alignment() */
+		if ((unsigned long) buf & (page_size - 1))
+			return -EINVAL;
 		if (mem_used > buf_size)
 			return -ENOMEM;
 		ptr = buf;
@@ -245,6 +560,8 @@ static int io_uring_alloc_huge(unsigned entries, struct io_uring_params *p,
 		int map_hugetlb = 0;
 		if (sqes_mem <= page_size)
 			buf_size = page_size;
+		else if (no_hugetlb)
+			buf_size = sqes_mem;
 		else {
 			buf_size = huge_page_size;
 			map_hugetlb = MAP_HUGETLB;
@@ -266,6 +583,8 @@ static int io_uring_alloc_huge(unsigned entries, struct io_uring_params *p,
 		int map_hugetlb = 0;
 		if (ring_mem <= page_size)
 			buf_size = page_size;
+		else if (no_hugetlb)
+			buf_size = (ring_mem + page_size - 1) & ~(page_size - 1);
 		else {
 			buf_size = huge_page_size;
 			map_hugetlb = MAP_HUGETLB;
@@ -285,17 +604,68 @@ static int io_uring_alloc_huge(unsigned entries, struct io_uring_params *p,
 	cq->ring_ptr = (void *) sq->ring_ptr;
 	p->sq_off.user_addr = (unsigned long) sq->sqes;
 	p->cq_off.user_addr = (unsigned long) sq->ring_ptr;
+
+	/*
+	 * The library touches caller memory too sparsely for khugepaged to
+	 * ever collapse it, so caller slabs stayed 4k mappings no matter how
+	 * carefully they were aligned. Advise the carve and, when the caller
+	 * honored huge alignment, collapse it eagerly. Best effort: kernels
+	 * without MADV_COLLAPSE still pick up the advice on later faults.
+	 */
+	if (buf) {
+		__sys_madvise(buf, mem_used, MADV_HUGEPAGE);
+		if (!((unsigned long) buf & (huge_page_size - 1)))
+			__sys_madvise(buf, mem_used, MADV_COLLAPSE);
+	}
 	return (int) mem_used;
 }
 
+/*
+ * Fault in every page of the shared ring regions with plain reads, so the
+ * cost is paid at setup rather than under first traffic.
+ */
+/*
+ * One MADV_POPULATE_WRITE faults a whole region in at once; kernels
+ * without it (pre-5.14) fall back to touching a byte per page.
+ */
+static void pretouch_region(void *ptr, size_t len)
+{
+	unsigned long page_size = get_page_size();
+	size_t i;
+
+	if (!__sys_madvise(ptr, len, MADV_POPULATE_WRITE))
+		return;
+	for (i = 0; i < len; i += page_size)
+		(void) ((volatile unsigned char *) ptr)[i];
+}
+
+static void io_uring_pretouch(struct io_uring *ring)
+{
+	size_t sqe_size = sizeof(struct io_uring_sqe);
+
+	if (ring->flags & IORING_SETUP_SQE128)
+		sqe_size += 64;
+	pretouch_region(ring->sq.sqes, sqe_size * ring->sq.ring_entries);
+	pretouch_region(ring->sq.ring_ptr, ring->sq.ring_sz);
+	if (ring->cq.ring_ptr != ring->sq.ring_ptr)
+		pretouch_region(ring->cq.ring_ptr, ring->cq.ring_sz);
+}
+
 int __io_uring_queue_init_params(unsigned entries, struct io_uring *ring,
 				 struct io_uring_params *p, void *buf,
-				 size_t buf_size)
+				 size_t buf_size, unsigned lib_flags)
 {
+	bool pretouch = lib_flags & LIBURING_SETUP_PRETOUCH;
+	bool no_hugetlb = lib_flags & LIBURING_SETUP_NO_HUGETLB;
+	bool guard = lib_flags & LIBURING_SETUP_GUARD_PAGES;
 	int fd, ret = 0;
 	unsigned *sq_array;
 	unsigned sq_entries, index;
 
+	/* guard pages wrap library mappings; app memory isn't ours to move */
+	if (guard && (p->flags & IORING_SETUP_NO_MMAP))
+		return -EINVAL;
+
 	memset(ring, 0, sizeof(*ring));
 
 	/*
@@ -308,7 +678,7 @@ int __io_uring_queue_init_params(unsigned entries, struct io_uring *ring,
 
 	if (p->flags & IORING_SETUP_NO_MMAP) {
 		ret = io_uring_alloc_huge(entries, p, &ring->sq, &ring->cq,
-						buf, buf_size);
+						buf, buf_size, no_hugetlb);
 		if (ret < 0)
 			return ret;
 		if (buf)
@@ -320,17 +690,19 @@ int __io_uring_queue_init_params(unsigned entries, struct io_uring *ring,
 		if ((p->flags & IORING_SETUP_NO_MMAP) &&
 		    !(ring->int_flags & INT_FLAG_APP_MEM)) {
 			__sys_munmap(ring->sq.sqes, 1);
-			io_uring_unmap_rings(&ring->sq, &ring->cq);
+			io_uring_unmap_rings(&ring->sq, &ring->cq, 0);
 		}
 		return fd;
 	}
 
 	if (!(p->flags & IORING_SETUP_NO_MMAP)) {
-		ret = io_uring_queue_mmap(fd, p, ring);
+		ret = io_uring_mmap(fd, p, &ring->sq, &ring->cq, guard);
 		if (ret) {
 			__sys_close(fd);
 			return ret;
 		}
+		if (guard)
+			ring->int_flags |= INT_FLAG_GUARD;
 	} else {
 		io_uring_setup_ring_pointers(p, &ring->sq, &ring->cq);
 	}
@@ -347,6 +719,7 @@ int __io_uring_queue_init_params(unsigned entries, struct io_uring *ring,
 	}
 	ring->features = p->features;
 	ring->flags = p->flags;
+	io_uring_resolve_quirks(ring, fd);
 	ring->enter_ring_fd = fd;
 	if (p->flags & IORING_SETUP_REGISTERED_FD_ONLY) {
 		ring->ring_fd = -1;
@@ -355,25 +728,30 @@ int __io_uring_queue_init_params(unsigned entries, struct io_uring *ring,
 		ring->ring_fd = fd;
 	}
 
+	if (pretouch)
+		io_uring_pretouch(ring);
+
 	return ret;
 }
 
-static int io_uring_queue_init_try_nosqarr(unsigned entries, struct io_uring *ring,
+static __cold int io_uring_queue_init_try_nosqarr(unsigned entries, struct io_uring *ring,
 					   struct io_uring_params *p, void *buf,
-					   size_t buf_size)
+					   size_t buf_size, unsigned lib_flags)
 {
 	unsigned flags = p->flags;
 	int ret;
 
 	p->flags |= IORING_SETUP_NO_SQARRAY;
-	ret = __io_uring_queue_init_params(entries, ring, p, buf, buf_size);
+	ret = __io_uring_queue_init_params(entries, ring, p, buf, buf_size,
+					   lib_flags);
 
 	/* don't fallback if explicitly asked for NOSQARRAY */
 	if (ret != -EINVAL || (flags & IORING_SETUP_NO_SQARRAY))
 		return ret;
 
 	p->flags = flags;
-	return __io_uring_queue_init_params(entries, ring, p, buf, buf_size);
+	return __io_uring_queue_init_params(entries, ring, p, buf, buf_size,
+					    lib_flags);
 }
 
 /*
@@ -394,121 +772,638 @@ int io_uring_queue_init_mem(unsigned entries, struct io_uring *ring,
 {
 	/* should already be set... */
 	p->flags |= IORING_SETUP_NO_MMAP;
-	return io_uring_queue_init_try_nosqarr(entries, ring, p, buf, buf_size);
+	return io_uring_queue_init_try_nosqarr(entries, ring, p, buf, buf_size,
+					       0);
 }
 
-int io_uring_queue_init_params(unsigned entries, struct io_uring *ring,
-			       struct io_uring_params *p)
+/*
+ * Carve 'nr_rings' rings for the same configuration out of one caller
+ * buffer, the intended use being a single hugepage-backed slab shared by
+ * all the rings a process creates at startup. Each ring's slice is
+ * page-rounded by the allocator, so adjacent rings never share a
+ * cacheline for their khead/ktail words. 'p' is a template and is left
+ * untouched; size the slab with io_uring_memory_size_params() times
+ * nr_rings. On failure every ring set up so far is torn down again.
+ * Returns -errno on error, or the number of bytes consumed from the
+ * buffer on success.
+ */
+int io_uring_queue_init_mem_pool(unsigned entries, struct io_uring *rings,
+				 unsigned nr_rings, struct io_uring_params *p,
+				 unsigned lib_flags, void *buf,
+				 size_t buf_size)
 {
+	size_t off = 0;
+	unsigned i;
 	int ret;
 
-	ret = io_uring_queue_init_try_nosqarr(entries, ring, p, NULL, 0);
-	return ret >= 0 ? 0 : ret;
+	for (i = 0; i < nr_rings; i++) {
+		struct io_uring_params lp = *p;
+
+		lp.flags |= IORING_SETUP_NO_MMAP;
+		/* prefaulted once for the whole slab below */
+		ret = io_uring_queue_init_try_nosqarr(entries, &rings[i], &lp,
+						      (char *) buf + off,
+						      buf_size - off,
+						      lib_flags &
+						      ~LIBURING_SETUP_PRETOUCH);
+		if (ret < 0)
+			goto err;
+		off += (size_t) ret;
+	}
+
+	/*
+	 * All the rings live in one contiguous slab; one populate call
+	 * covers every sq/cq/sqes slice instead of a syscall (or a fault
+	 * per page) for each ring.
+	 */
+	if (lib_flags & LIBURING_SETUP_PRETOUCH)
+		pretouch_region(buf, off);
+
+	return (int) off;
+err:
+	while (i--)
+		io_uring_queue_exit(&rings[i]);
+	return ret;
 }
 
 /*
- * Returns -errno on error, or zero on success. On success, 'ring'
- * contains the necessary information to read/write to the rings.
+ * Grow (or shrink) the CQ of a live ring via IORING_REGISTER_RESIZE_RINGS,
+ * without tearing the ring down or losing in-flight I/O: the kernel swaps
+ * in the new rings and carries the queue state over, we remap them and
+ * drop the old mappings. Only plain mmap'ed rings with a real ring fd can
+ * be resized; application-memory (IORING_SETUP_NO_MMAP) layouts are the
+ * caller's and are rejected with -EINVAL. The kernel returns -EINVAL both
+ * when it predates resize support and for rings it cannot safely swap
+ * under - current kernels require IORING_SETUP_DEFER_TASKRUN.
  */
-__cold int io_uring_queue_init(unsigned entries, struct io_uring *ring,
-			       unsigned flags)
+int io_uring_resize_cq(struct io_uring *ring, unsigned cq_entries)
 {
+	struct io_uring_sq old_sq = ring->sq;
+	struct io_uring_cq old_cq = ring->cq;
 	struct io_uring_params p;
+	size_t sqe_size;
+	int ret;
+
+	if (ring->ring_fd < 0 || (ring->flags & IORING_SETUP_NO_MMAP))
+		return -EINVAL;
 
 	memset(&p, 0, sizeof(p));
-	p.flags = flags;
+	p.flags = IORING_SETUP_CQSIZE | IORING_SETUP_CLAMP;
+	p.sq_entries = ring->sq.ring_entries;
+	p.cq_entries = cq_entries;
+	ret = __sys_io_uring_register(ring->ring_fd,
+				      IORING_REGISTER_RESIZE_RINGS, &p, 1);
+	if (ret < 0)
+		return ret;
 
-	return io_uring_queue_init_params(entries, ring, &p);
+	/*
+	 * The kernel filled in the new ring offsets; map the new rings with
+	 * the ring's own flags/features driving the geometry, then drop the
+	 * old mappings.
+	 */
+	p.flags = ring->flags;
+	p.features = ring->features;
+	ret = io_uring_mmap(ring->ring_fd, &p, &ring->sq, &ring->cq,
+			    ring->int_flags & INT_FLAG_GUARD);
+	if (ret) {
+		ring->sq = old_sq;
+		ring->cq = old_cq;
+		return ret;
+	}
+
+	sqe_size = sizeof(struct io_uring_sqe);
+	if (ring->flags & IORING_SETUP_SQE128)
+		sqe_size += 64;
+	io_uring_munmap_guarded(old_sq.sqes, sqe_size * old_sq.ring_entries,
+				ring->int_flags & INT_FLAG_GUARD);
+	io_uring_unmap_rings(&old_sq, &old_cq,
+			     ring->int_flags & INT_FLAG_GUARD);
+	return 0;
 }
 
-__cold void io_uring_queue_exit(struct io_uring *ring)
+/*
+ * Set up a new ring sharing the source ring's backend - its SQPOLL thread
+ * and io-wq - via IORING_SETUP_ATTACH_WQ, replicating the flags that must
+ * match for the shared poller to drive both rings. The source must still
+ * expose a real ring fd; rings set up with IORING_SETUP_REGISTERED_FD_ONLY
+ * have nothing to attach to and fail with -EINVAL.
+ */
+__cold int io_uring_queue_clone(struct io_uring *src, struct io_uring *dst,
+				unsigned entries)
 {
-	struct io_uring_sq *sq = &ring->sq;
-	struct io_uring_cq *cq = &ring->cq;
-	size_t sqe_size;
+	struct io_uring_params p;
 
-	if (!sq->ring_sz) {
-		sqe_size = sizeof(struct io_uring_sqe);
-		if (ring->flags & IORING_SETUP_SQE128)
-			sqe_size += 64;
-		__sys_munmap(sq->sqes, sqe_size * sq->ring_entries);
-		io_uring_unmap_rings(sq, cq);
-	} else {
-		if (!(ring->int_flags & INT_FLAG_APP_MEM)) {
-			__sys_munmap(sq->sqes,
-				*sq->kring_entries * sizeof(struct io_uring_sqe));
-			io_uring_unmap_rings(sq, cq);
-		}
-	}
+	if (src->ring_fd < 0)
+		return -EINVAL;
 
-	/*
-	 * Not strictly required, but frees up the slot we used now rather
-	 * than at process exit time.
-	 */
-	if (ring->int_flags & INT_FLAG_REG_RING)
-		io_uring_unregister_ring_fd(ring);
-	if (ring->ring_fd != -1)
-		__sys_close(ring->ring_fd);
+	memset(&p, 0, sizeof(p));
+	p.flags = src->flags & (IORING_SETUP_IOPOLL | IORING_SETUP_SQPOLL |
+				IORING_SETUP_SQE128 | IORING_SETUP_CQE32 |
+				IORING_SETUP_COOP_TASKRUN |
+				IORING_SETUP_TASKRUN_FLAG |
+				IORING_SETUP_SINGLE_ISSUER |
+				IORING_SETUP_DEFER_TASKRUN);
+	p.flags |= IORING_SETUP_ATTACH_WQ;
+	p.wq_fd = (__u32) src->ring_fd;
+
+	return io_uring_queue_init_params(entries, dst, &p);
 }
 
-__cold struct io_uring_probe *io_uring_get_probe_ring(struct io_uring *ring)
+static struct io_uring_caps uring_caps;
+static int uring_caps_valid;
+
+/*
+ * Capture the kernel capability snapshot through 'ring': the features
+ * word, the probe opcode bitmap, and the io-wq worker limits. The result
+ * is process-wide state since all rings see the same kernel; repeat calls
+ * are no-ops. Racing callers at worst fill the snapshot twice with the
+ * same data. Returns -errno if the probe itself isn't supported.
+ */
+__cold int io_uring_load_caps(struct io_uring *ring)
 {
 	struct io_uring_probe *probe;
-	size_t len;
-	int r;
+	unsigned int vals[2] = { 0, 0 };
+	int i;
 
-	len = sizeof(*probe) + 256 * sizeof(struct io_uring_probe_op);
-	probe = malloc(len);
+	if (uring_caps_valid)
+		return 0;
+
+	probe = io_uring_get_probe_ring(ring);
 	if (!probe)
-		return NULL;
-	memset(probe, 0, len);
+		return -EOPNOTSUPP;
 
-	r = io_uring_register_probe(ring, probe, 256);
-	if (r >= 0)
-		return probe;
+	uring_caps.features = ring->features;
+	uring_caps.last_op = probe->last_op;
+	for (i = 0; i < probe->ops_len; i++) {
+		if (probe->ops[i].flags & IO_URING_OP_SUPPORTED)
+			uring_caps.op_mask[i >> 6] |= 1ULL << (i & 63);
+	}
+	io_uring_free_probe(probe);
 
-	free(probe);
-	return NULL;
+	/* passing zeroes queries the current limits without changing them */
+	if (!io_uring_register_iowq_max_workers(ring, vals)) {
+		uring_caps.max_workers[0] = vals[0];
+		uring_caps.max_workers[1] = vals[1];
+	}
+
+	uring_caps_valid = 1;
+	return 0;
 }
 
-__cold struct io_uring_probe *io_uring_get_probe(void)
+const struct io_uring_caps *io_uring_get_caps(void)
 {
-	struct io_uring ring;
-	struct io_uring_probe *probe;
-	int r;
-
-	r = io_uring_queue_init(2, &ring, 0);
-	if (r < 0)
-		return NULL;
-
-	probe = io_uring_get_probe_ring(&ring);
-	io_uring_queue_exit(&ring);
-	return probe;
+	return uring_caps_valid ? &uring_caps : NULL;
 }
 
-__cold void io_uring_free_probe(struct io_uring_probe *probe)
+/*
+ * Like io_uring_queue_init_params(), with 'lib_flags' carrying the
+ * LIBURING_SETUP_* options the library acts on itself. They live in
+ * their own namespace so io_uring_params->flags stays entirely the
+ * kernel's to define.
+ */
+int io_uring_queue_init_params_lib(unsigned entries, struct io_uring *ring,
+				   struct io_uring_params *p,
+				   unsigned lib_flags)
 {
-	free(probe);
+	bool reg_ring = lib_flags & LIBURING_SETUP_REGISTER_RING_FD;
+	bool load_caps = lib_flags & LIBURING_SETUP_LOAD_CAPS;
+	bool zero_sqes = lib_flags & LIBURING_SETUP_ZERO_SQES;
+	bool shadow_sq = lib_flags & LIBURING_SETUP_SHADOW_SQ;
+	bool wait_submit = lib_flags & LIBURING_SETUP_WAIT_SUBMIT;
+	int ret;
+
+	/* no safe point to clear SQEs the poller reads asynchronously */
+	if (zero_sqes && (p->flags & IORING_SETUP_SQPOLL))
+		return -EINVAL;
+
+	ret = io_uring_queue_init_try_nosqarr(entries, ring, p, NULL, 0,
+					      lib_flags);
+	if (ret < 0)
+		return ret;
+
+	if (zero_sqes) {
+		size_t sqe_size = sizeof(struct io_uring_sqe) <<
+				  !!(ring->flags & IORING_SETUP_SQE128);
+
+		/* app-provided ring memory isn't necessarily clear */
+		memset(ring->sq.sqes, 0, ring->sq.ring_entries * sqe_size);
+		ring->int_flags |= INT_FLAG_ZERO_SQES;
+	}
+
+	/*
+	 * Staging is transparent to the application, so a failed setup
+	 * (no memory, registry full) just leaves preps on the shared
+	 * mapping; a performance fallback, not an error.
+	 */
+	if (shadow_sq)
+		io_uring_shadow_sq_init(ring);
+	if (wait_submit)
+		ring->int_flags |= INT_FLAG_WAIT_SUBMIT;
+
+	/*
+	 * Kernels without IORING_REGISTER_RING_FDS simply leave the ring on
+	 * the regular fd path; that's a performance fallback, not an error.
+	 */
+	if (reg_ring && !(ring->int_flags & INT_FLAG_REG_RING))
+		io_uring_register_ring_fd(ring);
+	/* best effort, old kernels simply leave the snapshot unset */
+	if (load_caps)
+		io_uring_load_caps(ring);
+	return 0;
 }
 
-static size_t npages(size_t size, long page_size)
+int io_uring_queue_init_params(unsigned entries, struct io_uring *ring,
+			       struct io_uring_params *p)
 {
-	size--;
-	size /= page_size;
-	return __fls((int) size);
+	return io_uring_queue_init_params_lib(entries, ring, p, 0);
 }
 
-#define KRING_SIZE	320
+/*
+ * NUMA memory policy constants from <linux/mempolicy.h>, which nolibc
+ * builds can't pull in.
+ */
+#ifndef MPOL_BIND
+#define MPOL_BIND	2
+#endif
+#ifndef MPOL_MF_MOVE
+#define MPOL_MF_MOVE	(1 << 1)
+#endif
 
-static size_t rings_size(struct io_uring_params *p, unsigned entries,
-			 unsigned cq_entries, long page_size)
+static int io_uring_bind_node(struct io_uring *ring, int node)
 {
-	size_t pages, sq_size, cq_size;
+	unsigned long nodemask;
+	size_t sqe_size = sizeof(struct io_uring_sqe);
+	int ret;
 
-	cq_size = sizeof(struct io_uring_cqe);
-	if (p->flags & IORING_SETUP_CQE32)
-		cq_size += sizeof(struct io_uring_cqe);
-	cq_size *= cq_entries;
+	if (node < 0 || node >= (int) (8 * sizeof(nodemask)))
+		return -EINVAL;
+	nodemask = 1UL << node;
+
+	if (ring->flags & IORING_SETUP_SQE128)
+		sqe_size += 64;
+	ret = __sys_mbind(ring->sq.sqes, sqe_size * ring->sq.ring_entries,
+			  MPOL_BIND, &nodemask, 8 * sizeof(nodemask),
+			  MPOL_MF_MOVE);
+	if (ret < 0)
+		return ret;
+	ret = __sys_mbind(ring->sq.ring_ptr, ring->sq.ring_sz, MPOL_BIND,
+			  &nodemask, 8 * sizeof(nodemask), MPOL_MF_MOVE);
+	if (ret < 0)
+		return ret;
+	if (ring->cq.ring_ptr != ring->sq.ring_ptr)
+		ret = __sys_mbind(ring->cq.ring_ptr, ring->cq.ring_sz,
+				  MPOL_BIND, &nodemask, 8 * sizeof(nodemask),
+				  MPOL_MF_MOVE);
+	return ret;
+}
+
+/*
+ * Like io_uring_queue_init_params(), but binds the SQ/CQ rings and the SQE
+ * array to the given NUMA node (IO_URING_NUMA_LOCAL picks the node the
+ * calling thread runs on). The kernel allocates ring pages before we can
+ * state a preference, so existing pages are migrated with MPOL_MF_MOVE and
+ * anything faulted later follows the policy. Application-provided memory
+ * (IORING_SETUP_NO_MMAP with a buffer) is the caller's to place.
+ */
+__cold int io_uring_queue_init_params_numa(unsigned entries,
+					   struct io_uring *ring,
+					   struct io_uring_params *p, int node)
+{
+	int ret;
+
+	ret = io_uring_queue_init_params(entries, ring, p);
+	if (ret < 0)
+		return ret;
+
+	if (node == IO_URING_NUMA_LOCAL) {
+		unsigned cpu, n;
+
+		ret = __sys_getcpu(&cpu, &n);
+		if (ret < 0)
+			goto err;
+		node = (int) n;
+	}
+
+	ret = io_uring_bind_node(ring, node);
+	if (ret < 0)
+		goto err;
+	return 0;
+err:
+	io_uring_queue_exit(ring);
+	return ret;
+}
+
+/*
+ * Resolve a ring configuration into a template by setting up and tearing
+ * down one throwaway ring: whatever flags the kernel accepted (including
+ * the opportunistic IORING_SETUP_NO_SQARRAY upgrade) are captured, along
+ * with the library-interpreted options, so rings spawned from the
+ * template skip every fallback path.
+ */
+__cold int io_uring_template_init(struct io_uring_template *t, unsigned entries,
+				  struct io_uring_params *p, unsigned lib_flags)
+{
+	struct io_uring_params lp = *p;
+	struct io_uring ring;
+	int ret;
+
+	ret = io_uring_queue_init_params_lib(entries, &ring, &lp, lib_flags);
+	if (ret < 0)
+		return ret;
+
+	memset(t, 0, sizeof(*t));
+	t->entries = entries;
+	t->params = *p;
+	t->params.flags = ring.flags;
+	t->lib_flags = lib_flags & (LIBURING_SETUP_PRETOUCH |
+				    LIBURING_SETUP_NO_HUGETLB |
+				    LIBURING_SETUP_REGISTER_RING_FD |
+				    LIBURING_SETUP_LOAD_CAPS);
+	io_uring_queue_exit(&ring);
+	return 0;
+}
+
+int io_uring_queue_init_template(const struct io_uring_template *t,
+				 struct io_uring *ring)
+{
+	struct io_uring_params p = t->params;
+	int ret;
+
+	ret = __io_uring_queue_init_params(t->entries, ring, &p, NULL, 0,
+					   t->lib_flags);
+	if (ret < 0)
+		return ret;
+
+	if (t->lib_flags & LIBURING_SETUP_REGISTER_RING_FD)
+		io_uring_register_ring_fd(ring);
+	if (t->lib_flags & LIBURING_SETUP_LOAD_CAPS)
+		io_uring_load_caps(ring);
+	return 0;
+}
+
+/*
+ * Set up a ring from a tuning profile rather than raw flags, walking a
+ * per-profile list of flag sets from strongest to plainest until the
+ * kernel accepts one. Every attempt also asks for a registered ring fd,
+ * which is its own graceful fallback. Only -EINVAL triggers degradation;
+ * real failures (-ENOMEM, -EPERM, ...) are returned as-is.
+ */
+__cold int io_uring_queue_init_profile(unsigned entries, struct io_uring *ring,
+				       enum io_uring_setup_profile profile)
+{
+	static const unsigned latency_flags[] = {
+		IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN,
+		IORING_SETUP_COOP_TASKRUN | IORING_SETUP_TASKRUN_FLAG,
+		IORING_SETUP_COOP_TASKRUN,
+		0,
+	};
+	static const unsigned throughput_flags[] = {
+		IORING_SETUP_COOP_TASKRUN | IORING_SETUP_SUBMIT_ALL,
+		IORING_SETUP_COOP_TASKRUN,
+		0,
+	};
+	const unsigned *sets;
+	unsigned i, nr_sets, extra = 0, cq_entries = 0;
+	int ret = -EINVAL;
+
+	switch (profile) {
+	case IO_URING_PROFILE_LOW_LATENCY:
+		sets = latency_flags;
+		nr_sets = sizeof(latency_flags) / sizeof(latency_flags[0]);
+		break;
+	case IO_URING_PROFILE_THROUGHPUT:
+		sets = throughput_flags;
+		nr_sets = sizeof(throughput_flags) / sizeof(throughput_flags[0]);
+		extra = IORING_SETUP_CQSIZE | IORING_SETUP_CLAMP;
+		cq_entries = entries > KERN_MAX_CQ_ENTRIES / 4 ?
+				KERN_MAX_CQ_ENTRIES : entries * 4;
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	for (i = 0; i < nr_sets; i++) {
+		struct io_uring_params p;
+
+		memset(&p, 0, sizeof(p));
+		p.flags = sets[i] | extra;
+		p.cq_entries = cq_entries;
+		ret = io_uring_queue_init_params_lib(entries, ring, &p,
+					LIBURING_SETUP_REGISTER_RING_FD);
+		if (ret != -EINVAL)
+			return ret;
+	}
+
+	return ret;
+}
+
+#define SETUP_PROBE_BATCH	32
+
+static unsigned long long setup_probe_mono_ns(void)
+{
+	struct __kernel_timespec ts;
+
+	if (uring_clock_gettime(CLOCK_MONOTONIC, &ts))
+		return 0;
+	return (unsigned long long) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static unsigned long long setup_probe_run(struct io_uring *ring,
+					  unsigned probe_msec)
+{
+	unsigned long long t0, t, done = 0;
+	unsigned i;
+	int ret;
+
+	t0 = setup_probe_mono_ns();
+	do {
+		for (i = 0; i < SETUP_PROBE_BATCH; i++)
+			io_uring_prep_nop(io_uring_get_sqe(ring));
+		ret = io_uring_submit_and_wait(ring, SETUP_PROBE_BATCH);
+		if (ret < 0)
+			return 0;
+		io_uring_cq_advance(ring, io_uring_cq_ready(ring));
+		done += SETUP_PROBE_BATCH;
+		t = setup_probe_mono_ns();
+	} while (t - t0 < probe_msec * 1000000ULL);
+
+	return done * 1000000000ULL / (t - t0);
+}
+
+/*
+ * Measure the candidate setup flag combinations on the running kernel
+ * and fill 'res' best-first; see the header for the contract. The
+ * candidates cover the task-running variants that have regressed or
+ * flipped ranking across kernel lines; combinations the kernel rejects
+ * are kept in the output (supported == 0) so callers can log them.
+ */
+__cold int io_uring_probe_setup_flags(struct io_uring_setup_probe *res,
+				      unsigned nr, unsigned probe_msec)
+{
+	static const unsigned candidates[] = {
+		0,
+		IORING_SETUP_COOP_TASKRUN,
+		IORING_SETUP_COOP_TASKRUN | IORING_SETUP_TASKRUN_FLAG,
+		IORING_SETUP_SINGLE_ISSUER,
+		IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN,
+	};
+	unsigned nr_cand = sizeof(candidates) / sizeof(candidates[0]);
+	unsigned i, j;
+
+	if (!res || !nr)
+		return -EINVAL;
+	if (!probe_msec)
+		probe_msec = 10;
+	if (nr > nr_cand)
+		nr = nr_cand;
+
+	for (i = 0; i < nr; i++) {
+		struct io_uring_setup_probe p = {
+			.flags	= candidates[i],
+		};
+		struct io_uring ring;
+
+		if (!io_uring_queue_init(SETUP_PROBE_BATCH, &ring,
+					 candidates[i])) {
+			p.supported = 1;
+			p.nops_per_sec = setup_probe_run(&ring, probe_msec);
+			io_uring_queue_exit(&ring);
+		}
+
+		/* insertion sort, fastest first; unsupported sink to 0 */
+		for (j = i; j > 0 &&
+		     res[j - 1].nops_per_sec < p.nops_per_sec; j--)
+			res[j] = res[j - 1];
+		res[j] = p;
+	}
+
+	return (int) nr;
+}
+
+/*
+ * Returns -errno on error, or zero on success. On success, 'ring'
+ * contains the necessary information to read/write to the rings.
+ */
+__cold int io_uring_queue_init(unsigned entries, struct io_uring *ring,
+			       unsigned flags)
+{
+	struct io_uring_params p;
+
+	memset(&p, 0, sizeof(p));
+	p.flags = flags;
+
+	return io_uring_queue_init_params(entries, ring, &p);
+}
+
+__cold void io_uring_queue_exit(struct io_uring *ring)
+{
+	struct io_uring_sq *sq = &ring->sq;
+	struct io_uring_cq *cq = &ring->cq;
+	size_t sqe_size;
+
+	/* repoint sq->sqes at the shared mapping before unmapping it */
+	if (ring->int_flags & INT_FLAG_SHADOW_SQ)
+		io_uring_shadow_sq_exit(ring);
+
+	if (!sq->ring_sz) {
+		sqe_size = sizeof(struct io_uring_sqe);
+		if (ring->flags & IORING_SETUP_SQE128)
+			sqe_size += 64;
+		__sys_munmap(sq->sqes, sqe_size * sq->ring_entries);
+		io_uring_unmap_rings(sq, cq, 0);
+	} else {
+		if (!(ring->int_flags & INT_FLAG_APP_MEM)) {
+			io_uring_munmap_guarded(sq->sqes,
+				*sq->kring_entries * sizeof(struct io_uring_sqe),
+				ring->int_flags & INT_FLAG_GUARD);
+			io_uring_unmap_rings(sq, cq,
+					     ring->int_flags & INT_FLAG_GUARD);
+		}
+	}
+
+	/*
+	 * Not strictly required, but frees up the slot we used now rather
+	 * than at process exit time.
+	 */
+	if (ring->int_flags & INT_FLAG_REG_RING)
+		io_uring_unregister_ring_fd(ring);
+	if (ring->ring_fd != -1)
+		__sys_close(ring->ring_fd);
+
+	/*
+	 * Drop any registry entries still keyed by this ring so a future
+	 * ring allocated at the same address starts clean. The alloc
+	 * hooks go last: the other drops free ring-owned memory through
+	 * them.
+	 */
+	uring_queue_registries_drop(ring);
+	uring_register_registries_drop(ring);
+	io_uring_clear_alloc_hooks(ring);
+}
+
+/*
+ * Probe buffers stay on plain malloc even for rings with alloc hooks:
+ * io_uring_free_probe() takes no ring, so hooked memory could never be
+ * routed back through the matching free hook.
+ */
+__cold struct io_uring_probe *io_uring_get_probe_ring(struct io_uring *ring)
+{
+	struct io_uring_probe *probe;
+	size_t len;
+	int r;
+
+	len = sizeof(*probe) + 256 * sizeof(struct io_uring_probe_op);
+	probe = malloc(len);
+	if (!probe)
+		return NULL;
+	memset(probe, 0, len);
+
+	r = io_uring_register_probe(ring, probe, 256);
+	if (r >= 0)
+		return probe;
+
+	free(probe);
+	return NULL;
+}
+
+__cold struct io_uring_probe *io_uring_get_probe(void)
+{
+	struct io_uring ring;
+	struct io_uring_probe *probe;
+	int r;
+
+	r = io_uring_queue_init(2, &ring, 0);
+	if (r < 0)
+		return NULL;
+
+	probe = io_uring_get_probe_ring(&ring);
+	io_uring_queue_exit(&ring);
+	return probe;
+}
+
+__cold void io_uring_free_probe(struct io_uring_probe *probe)
+{
+	free(probe);
+}
+
+static size_t npages(size_t size, long page_size)
+{
+	size--;
+	size /= page_size;
+	return __fls((int) size);
+}
+
+#define KRING_SIZE	320
+
+static size_t rings_size(struct io_uring_params *p, unsigned entries,
+			 unsigned cq_entries, long page_size)
+{
+	size_t pages, sq_size, cq_size;
+
+	cq_size = sizeof(struct io_uring_cqe);
+	if (p->flags & IORING_SETUP_CQE32)
+		cq_size += sizeof(struct io_uring_cqe);
+	cq_size *= cq_entries;
 	cq_size += KRING_SIZE;
 	cq_size = (cq_size + 63) & ~63UL;
 	pages = (size_t) 1 << npages(cq_size, page_size);
@@ -521,6 +1416,68 @@ static size_t rings_size(struct io_uring_params *p, unsigned entries,
 	return pages * page_size;
 }
 
+/*
+ * Report the memory footprint of a ring configuration without creating a
+ * ring, applying the same entry clamping and rounding the kernel and
+ * io_uring_queue_init_mem() use. Lets capacity planners size a hugepage
+ * budget for thousands of rings without trial mmaps. Sizes reflect the
+ * flags as passed: the init paths opportunistically upgrade rings to
+ * IORING_SETUP_NO_SQARRAY, so set that flag here to plan for kernels that
+ * accept it, or leave it off for the worst case. Returns 0 with 'sz'
+ * filled in, or -errno for an invalid configuration.
+ */
+__cold int io_uring_memory_size_params(unsigned entries,
+				       struct io_uring_params *p,
+				       struct io_uring_mem_size *sz)
+{
+	unsigned long page_size = get_page_size();
+	unsigned sq_entries, cq_entries;
+	size_t sqes_mem, mem_used;
+	int ret;
+
+	ret = get_sq_cq_entries(entries, p, &sq_entries, &cq_entries);
+	if (ret)
+		return ret;
+
+	sz->cq_bytes = cq_entries * sizeof(struct io_uring_cqe);
+	if (p->flags & IORING_SETUP_CQE32)
+		sz->cq_bytes *= 2;
+	sz->cq_bytes += KRING_SIZE;
+	sz->sq_bytes = 0;
+	if (!(p->flags & IORING_SETUP_NO_SQARRAY))
+		sz->sq_bytes = sq_entries * sizeof(unsigned);
+	sz->sqe_bytes = sq_entries * sizeof(struct io_uring_sqe);
+	if (p->flags & IORING_SETUP_SQE128)
+		sz->sqe_bytes *= 2;
+
+	/* mirrors the carve-up io_uring_alloc_huge() does for app memory */
+	sqes_mem = (sz->sqe_bytes + page_size - 1) & ~(page_size - 1);
+	mem_used = sqes_mem + sz->cq_bytes - KRING_SIZE + sz->sq_bytes;
+	sz->mem_bytes = (mem_used + page_size - 1) & ~(page_size - 1);
+	return 0;
+}
+
+__cold int io_uring_memory_size(unsigned entries, unsigned flags,
+				struct io_uring_mem_size *sz)
+{
+	struct io_uring_params p;
+
+	memset(&p, 0, sizeof(p));
+	p.flags = flags;
+	return io_uring_memory_size_params(entries, &p, sz);
+}
+
+/*
+ * Alignment caller-provided ring memory wants for huge mappings: buffers
+ * passed to io_uring_queue_init_mem() at this alignment are collapsed to
+ * transparent huge pages, anything page-aligned is merely accepted. Pairs
+ * with io_uring_memory_size_params() when sizing an allocator slab.
+ */
+__cold size_t io_uring_mem_alignment(void)
+{
+	return huge_page_size;
+}
+
 /*
  * Return the required ulimit -l memlock memory required for a given ring
  * setup, in bytes. May return -errno on error. On newer (5.12+) kernels,
@@ -671,6 +1628,124 @@ struct io_uring_buf_ring *io_uring_setup_buf_ring(struct io_uring *ring,
 	return br;
 }
 
+/*
+ * Map and register a region of 'nentries' wait-argument slots for
+ * IORING_ENTER_EXT_ARG_REG waits. A timed wait normally marshals a
+ * fresh io_uring_getevents_arg through the enter syscall and the
+ * kernel copies it in every time; slots registered here are pinned
+ * once and then selected by index, so an event loop re-arms its
+ * timeout by patching ts in place. One region per ring, and the kernel
+ * only accepts wait-argument regions while the ring is still disabled -
+ * create the ring with IORING_SETUP_R_DISABLED, register here, then
+ * io_uring_enable_rings(). Returns the slot array, or NULL with *err
+ * set. Pass to io_uring_free_reg_wait() after the ring is torn down.
+ *
+ * Some kernels accept the region but keep registered waits themselves
+ * disabled; there the first io_uring_submit_and_wait_reg() fails with
+ * -EINVAL and the caller should fall back to
+ * io_uring_submit_and_wait_timeout().
+ */
+__cold struct io_uring_reg_wait *io_uring_setup_reg_wait(struct io_uring *ring,
+							 unsigned nentries,
+							 int *err)
+{
+	struct io_uring_reg_wait *reg;
+	size_t size = nentries * sizeof(*reg);
+	unsigned long page_size = get_page_size();
+	struct io_uring_region_desc rd;
+	struct io_uring_mem_region_reg mr;
+	int ret;
+
+	size = (size + page_size - 1) & ~(page_size - 1);
+	reg = __sys_mmap(NULL, size, PROT_READ | PROT_WRITE,
+			 MAP_SHARED | MAP_POPULATE | MAP_ANONYMOUS, -1, 0);
+	if (IS_ERR(reg)) {
+		*err = PTR_ERR(reg);
+		return NULL;
+	}
+	memset(reg, 0, size);
+
+	memset(&rd, 0, sizeof(rd));
+	rd.user_addr = (__u64) (uintptr_t) reg;
+	rd.size = size;
+	rd.flags = IORING_MEM_REGION_TYPE_USER;
+	memset(&mr, 0, sizeof(mr));
+	mr.region_uptr = (__u64) (uintptr_t) &rd;
+	mr.flags = IORING_MEM_REGION_REG_WAIT_ARG;
+
+	ret = io_uring_register_region(ring, &mr);
+	if (ret) {
+		__sys_munmap(reg, size);
+		*err = ret;
+		return NULL;
+	}
+	return reg;
+}
+
+__cold void io_uring_free_reg_wait(struct io_uring_reg_wait *reg,
+				   unsigned nentries)
+{
+	size_t size = nentries * sizeof(*reg);
+	unsigned long page_size = get_page_size();
+
+	size = (size + page_size - 1) & ~(page_size - 1);
+	__sys_munmap(reg, size);
+}
+
+/*
+ * Like io_uring_setup_buf_ring(), but backs rings spanning more than one
+ * regular page with a hugetlb mapping so large provided-buffer rings stop
+ * costing a TLB miss per io_uring_buf_ring_add(). Falls back to regular
+ * pages when the hugepage pool is empty. The mapping is dedicated and
+ * page-aligned either way, so a ring never straddles into foreign data.
+ * '*map_size' receives the bytes actually mapped and must be handed back
+ * to io_uring_free_buf_ring_sized(); hugetlb mappings are rounded up to
+ * the huge page size and can't be unmapped by entry count alone.
+ */
+struct io_uring_buf_ring *io_uring_setup_buf_ring_huge(struct io_uring *ring,
+						       unsigned int nentries,
+						       int bgid,
+						       unsigned int flags,
+						       size_t *map_size,
+						       int *ret)
+{
+#if !defined(__hppa__)
+	size_t ring_size = nentries * sizeof(struct io_uring_buf);
+
+	if (ring_size > (size_t) get_page_size()) {
+		struct io_uring_buf_reg reg;
+		struct io_uring_buf_ring *br;
+		size_t huge_size;
+		int lret;
+
+		huge_size = (ring_size + huge_page_size - 1) &
+				~(huge_page_size - 1);
+		br = __sys_mmap(NULL, huge_size, PROT_READ | PROT_WRITE,
+				MAP_ANONYMOUS | MAP_PRIVATE | MAP_HUGETLB,
+				-1, 0);
+		if (!IS_ERR(br)) {
+			memset(&reg, 0, sizeof(reg));
+			reg.ring_addr = (unsigned long) (uintptr_t) br;
+			reg.ring_entries = nentries;
+			reg.bgid = bgid;
+
+			lret = io_uring_register_buf_ring(ring, &reg, flags);
+			if (lret) {
+				__sys_munmap(br, huge_size);
+				*ret = lret;
+				return NULL;
+			}
+			io_uring_buf_ring_init(br);
+			*map_size = huge_size;
+			*ret = 0;
+			return br;
+		}
+	}
+#endif
+	*map_size = nentries * sizeof(struct io_uring_buf);
+	return io_uring_setup_buf_ring(ring, nentries, bgid, flags, ret);
+}
+
 int io_uring_free_buf_ring(struct io_uring *ring, struct io_uring_buf_ring *br,
 			   unsigned int nentries, int bgid)
 {
@@ -683,3 +1758,670 @@ int io_uring_free_buf_ring(struct io_uring *ring, struct io_uring_buf_ring *br,
 	__sys_munmap(br, nentries * sizeof(struct io_uring_buf));
 	return 0;
 }
+
+int io_uring_free_buf_ring_sized(struct io_uring *ring,
+				 struct io_uring_buf_ring *br,
+				 size_t map_size, int bgid)
+{
+	int ret;
+
+	ret = io_uring_unregister_buf_ring(ring, bgid);
+	if (ret)
+		return ret;
+
+	__sys_munmap(br, map_size);
+	return 0;
+}
+
+/*
+ * Set up one buf ring per size class, all backed by a single slab, and
+ * provide every buffer to the kernel. 'buf_sizes'/'buf_counts' describe
+ * 'nr' classes (sizes ascending, counts a power of two as buf rings
+ * require); class i registers as group bgid_base + i. Buffer ids map
+ * 1:1 to slab slices, so recycling needs no lookaside table.
+ */
+__cold int io_uring_buf_tiers_init(struct io_uring *ring,
+				   struct io_uring_buf_tiers *bt,
+				   const unsigned *buf_sizes,
+				   const unsigned *buf_counts, unsigned nr,
+				   unsigned short bgid_base)
+{
+	size_t slab_size = 0;
+	char *p;
+	unsigned i, j;
+	int ret;
+
+	if (!nr)
+		return -EINVAL;
+	for (i = 0; i < nr; i++) {
+		if (!buf_sizes[i] || !buf_counts[i] ||
+		    (buf_counts[i] & (buf_counts[i] - 1)) ||
+		    buf_counts[i] > 32768)
+			return -EINVAL;
+		slab_size += (size_t) buf_sizes[i] * buf_counts[i];
+	}
+
+	bt->tiers = uring_ring_malloc(ring, nr * sizeof(*bt->tiers));
+	if (!bt->tiers)
+		return -ENOMEM;
+	bt->slab = uring_ring_malloc(ring, slab_size);
+	if (!bt->slab) {
+		uring_ring_free(ring, bt->tiers);
+		return -ENOMEM;
+	}
+
+	p = bt->slab;
+	for (i = 0; i < nr; i++) {
+		struct io_uring_buf_tier *t = &bt->tiers[i];
+
+		t->br = io_uring_setup_buf_ring(ring, buf_counts[i],
+						bgid_base + i, 0, &ret);
+		if (!t->br)
+			goto err;
+		t->bufs = p;
+		t->buf_size = buf_sizes[i];
+		t->nr_bufs = (unsigned short) buf_counts[i];
+		t->mask = (unsigned short) io_uring_buf_ring_mask(buf_counts[i]);
+		t->pending = 0;
+		t->bgid = (unsigned short) (bgid_base + i);
+		for (j = 0; j < buf_counts[i]; j++)
+			io_uring_buf_ring_add(t->br,
+					      p + (size_t) j * t->buf_size,
+					      t->buf_size, (unsigned short) j,
+					      t->mask, (int) j);
+		io_uring_buf_ring_advance(t->br, (int) buf_counts[i]);
+		p += (size_t) t->buf_size * t->nr_bufs;
+	}
+
+	bt->ring = ring;
+	bt->nr = nr;
+	bt->bgid_base = bgid_base;
+	return 0;
+err:
+	while (i--)
+		io_uring_free_buf_ring(ring, bt->tiers[i].br,
+				       bt->tiers[i].nr_bufs,
+				       bt->tiers[i].bgid);
+	uring_ring_free(ring, bt->slab);
+	uring_ring_free(ring, bt->tiers);
+	return ret;
+}
+
+__cold void io_uring_buf_tiers_exit(struct io_uring_buf_tiers *bt)
+{
+	unsigned i;
+
+	for (i = 0; i < bt->nr; i++)
+		io_uring_free_buf_ring(bt->ring, bt->tiers[i].br,
+				       bt->tiers[i].nr_bufs,
+				       bt->tiers[i].bgid);
+	uring_ring_free(bt->ring, bt->slab);
+	uring_ring_free(bt->ring, bt->tiers);
+	bt->tiers = NULL;
+	bt->slab = NULL;
+	bt->nr = 0;
+}
+
+/*
+ * Attach shadow accounting to a buf ring covering 'nr_bids' buffer ids.
+ * Buffers must then go in through io_uring_buf_shadow_add() and be
+ * claimed per CQE with io_uring_buf_shadow_claim() for the ownership
+ * view to stay truthful.
+ */
+__cold int io_uring_buf_shadow_init(struct io_uring *ring,
+				    struct io_uring_buf_shadow *bs,
+				    struct io_uring_buf_ring *br, int bgid,
+				    unsigned int nentries, unsigned int nr_bids)
+{
+	size_t words = (nr_bids + 8 * sizeof(unsigned long) - 1) /
+			(8 * sizeof(unsigned long));
+
+	if (!nr_bids)
+		return -EINVAL;
+
+	bs->posted = uring_ring_malloc(ring, 2 * words * sizeof(unsigned long));
+	if (!bs->posted)
+		return -ENOMEM;
+	memset(bs->posted, 0, 2 * words * sizeof(unsigned long));
+	bs->seen = bs->posted + words;
+	bs->posted_nr = 0;
+	bs->seen_nr = 0;
+	bs->nr = nr_bids;
+	bs->nentries = nentries;
+	bs->bgid = bgid;
+	bs->ring = ring;
+	bs->br = br;
+	return 0;
+}
+
+/*
+ * Drain-and-verify teardown: refuses with -EBUSY while any buffer is
+ * still held outside the ring, otherwise unregisters and unmaps the
+ * ring via io_uring_free_buf_ring() and drops the shadow state.
+ */
+__cold int io_uring_buf_shadow_free(struct io_uring_buf_shadow *bs)
+{
+	int ret;
+
+	if (io_uring_buf_ring_outstanding(bs))
+		return -EBUSY;
+
+	ret = io_uring_free_buf_ring(bs->ring, bs->br, bs->nentries,
+				     bs->bgid);
+	if (ret)
+		return ret;
+
+	uring_ring_free(bs->ring, bs->posted);
+	bs->posted = NULL;
+	bs->seen = NULL;
+	return 0;
+}
+
+/*
+ * Register one shared slab of total_bufs slices of buf_len bytes as a
+ * provided-buffer group on every ring in 'rings', same bgid everywhere.
+ * Slices are split evenly: ring i posts global slice ids
+ * [i * per, (i + 1) * per), so a bid names its slab position no matter
+ * which ring completes against it. total_bufs must split into a
+ * power-of-two per-ring count, and at most 65536 slices are
+ * addressable (bids are 16 bits).
+ */
+__cold int io_uring_shared_bufs_init(struct io_uring **rings,
+				     unsigned nr_rings,
+				     struct io_uring_shared_bufs *sb,
+				     unsigned total_bufs, unsigned buf_len,
+				     int bgid)
+{
+	unsigned per, i, j;
+	int ret;
+
+	if (!nr_rings || !buf_len || total_bufs % nr_rings)
+		return -EINVAL;
+	per = total_bufs / nr_rings;
+	if (!per || (per & (per - 1)) || total_bufs > 65536)
+		return -EINVAL;
+
+	/* shared across rings; account the slab to the first one */
+	sb->rings = uring_ring_malloc(rings[0], nr_rings * (sizeof(*sb->rings) +
+							    sizeof(*sb->brs)));
+	if (!sb->rings)
+		return -ENOMEM;
+	sb->brs = (struct io_uring_buf_ring **) (sb->rings + nr_rings);
+	sb->slab = uring_ring_malloc(rings[0], (size_t) total_bufs * buf_len);
+	if (!sb->slab) {
+		uring_ring_free(rings[0], sb->rings);
+		return -ENOMEM;
+	}
+
+	sb->buf_len = buf_len;
+	sb->bufs_per_ring = per;
+	sb->nr_rings = nr_rings;
+	sb->bgid = bgid;
+
+	for (i = 0; i < nr_rings; i++) {
+		struct io_uring_buf_ring *br;
+
+		br = io_uring_setup_buf_ring(rings[i], per, bgid, 0, &ret);
+		if (!br)
+			goto err;
+		sb->rings[i] = rings[i];
+		sb->brs[i] = br;
+		for (j = 0; j < per; j++) {
+			unsigned short bid = (unsigned short) (i * per + j);
+
+			io_uring_buf_ring_add(br,
+					sb->slab + (size_t) bid * buf_len,
+					buf_len, bid,
+					io_uring_buf_ring_mask(per), (int) j);
+		}
+		io_uring_buf_ring_advance(br, (int) per);
+	}
+	return 0;
+err:
+	while (i--)
+		io_uring_free_buf_ring(sb->rings[i], sb->brs[i], per, bgid);
+	uring_ring_free(rings[0], sb->slab);
+	uring_ring_free(rings[0], sb->rings);
+	return ret;
+}
+
+__cold void io_uring_shared_bufs_exit(struct io_uring_shared_bufs *sb)
+{
+	unsigned i;
+
+	for (i = 0; i < sb->nr_rings; i++)
+		io_uring_free_buf_ring(sb->rings[i], sb->brs[i],
+				       sb->bufs_per_ring, sb->bgid);
+	uring_ring_free(sb->rings[0], sb->slab);
+	uring_ring_free(sb->rings[0], sb->rings);
+	sb->slab = NULL;
+	sb->rings = NULL;
+	sb->brs = NULL;
+	sb->nr_rings = 0;
+}
+
+/*
+ * Drive one listener bring-up chain on 'ring' and reap its four
+ * completions, returning the first failure. The chain is linked, so a
+ * failing step surfaces its own error and the rest complete with
+ * -ECANCELED, which is ignored.
+ */
+static int listener_bringup(struct io_uring *ring,
+			    const struct sockaddr *addr, socklen_t addrlen,
+			    int backlog, unsigned file_index,
+			    const int *reuse)
+{
+	struct io_uring_sqe *sqe;
+	struct io_uring_cqe *cqe;
+	int i, ret, err = 0;
+
+	if (io_uring_sq_space_left(ring) < 4)
+		return -EBUSY;
+
+	sqe = io_uring_get_sqe(ring);
+	io_uring_prep_socket_direct(sqe, addr->sa_family, SOCK_STREAM, 0,
+				    file_index, 0);
+	sqe->flags |= IOSQE_IO_LINK;
+
+	sqe = io_uring_get_sqe(ring);
+	io_uring_prep_cmd_sock(sqe, SOCKET_URING_OP_SETSOCKOPT,
+			       (int) file_index, SOL_SOCKET, SO_REUSEPORT,
+			       (void *) (uintptr_t) reuse, sizeof(*reuse));
+	sqe->flags |= IOSQE_FIXED_FILE | IOSQE_IO_LINK;
+
+	sqe = io_uring_get_sqe(ring);
+	io_uring_prep_bind(sqe, (int) file_index,
+			   (struct sockaddr *) (uintptr_t) addr, addrlen);
+	sqe->flags |= IOSQE_FIXED_FILE | IOSQE_IO_LINK;
+
+	sqe = io_uring_get_sqe(ring);
+	io_uring_prep_listen(sqe, (int) file_index, backlog);
+	sqe->flags |= IOSQE_FIXED_FILE;
+
+	ret = io_uring_submit_and_wait(ring, 4);
+	if (ret < 0)
+		return ret;
+	for (i = 0; i < 4; i++) {
+		ret = io_uring_wait_cqe(ring, &cqe);
+		if (ret)
+			return ret;
+		if (cqe->res < 0 && cqe->res != -ECANCELED && !err)
+			err = cqe->res;
+		io_uring_cqe_seen(ring, cqe);
+	}
+	return err;
+}
+
+/*
+ * See the declaration for the API contract. Each ring gets a sparse
+ * direct-descriptor table if it doesn't already have one; on failure,
+ * shards already brought up are closed again.
+ */
+__cold int io_uring_setup_reuseport_listeners(struct io_uring **rings,
+					      unsigned nr_rings,
+					      const struct sockaddr *addr,
+					      socklen_t addrlen, int backlog,
+					      unsigned file_index)
+{
+	struct io_uring_probe *probe;
+	struct io_uring_sqe *sqe;
+	struct io_uring_cqe *cqe;
+	const int reuse = 1;
+	unsigned i;
+	int ret;
+
+	if (!nr_rings || !addr)
+		return -EINVAL;
+
+	probe = io_uring_get_probe();
+	if (!probe)
+		return -EOPNOTSUPP;
+	ret = io_uring_opcode_supported(probe, IORING_OP_LISTEN) ? 0 :
+		-EOPNOTSUPP;
+	io_uring_free_probe(probe);
+	if (ret)
+		return ret;
+
+	for (i = 0; i < nr_rings; i++) {
+		ret = io_uring_register_files_sparse(rings[i], file_index + 1);
+		if (ret && ret != -EBUSY)
+			goto err;
+		ret = listener_bringup(rings[i], addr, addrlen, backlog,
+				       file_index, &reuse);
+		if (ret)
+			goto err;
+	}
+	return 0;
+err:
+	while (i--) {
+		sqe = io_uring_get_sqe(rings[i]);
+		if (!sqe)
+			continue;
+		io_uring_prep_close_direct(sqe, file_index);
+		if (io_uring_submit_and_wait(rings[i], 1) < 0)
+			continue;
+		if (!io_uring_wait_cqe(rings[i], &cqe))
+			io_uring_cqe_seen(rings[i], cqe);
+	}
+	return ret;
+}
+
+/* read a small sysfs file; returns bytes read or -errno */
+static int group_read_file(const char *path, char *buf, int len)
+{
+	int fd, ret;
+
+	fd = __sys_open(path, O_RDONLY, 0);
+	if (fd < 0)
+		return fd;
+	ret = (int) __sys_read(fd, buf, len - 1);
+	__sys_close(fd);
+	if (ret < 0)
+		return ret;
+	buf[ret] = '\0';
+	return ret;
+}
+
+/* largest integer appearing in 'buf' ("0-63", "0,32-63", ...) */
+static int group_parse_max(const char *buf)
+{
+	int max = -1, cur = -1;
+
+	for (; ; buf++) {
+		if (*buf >= '0' && *buf <= '9') {
+			if (cur < 0)
+				cur = 0;
+			cur = cur * 10 + (*buf - '0');
+		} else {
+			if (cur > max)
+				max = cur;
+			cur = -1;
+			if (!*buf)
+				break;
+		}
+	}
+	return max;
+}
+
+/* build "/sys/devices/system/cpu/cpu<n><tail>" without stdio */
+static void group_cpu_path(char *buf, unsigned cpu, const char *tail)
+{
+	static const char base[] = "/sys/devices/system/cpu/cpu";
+	char digits[12];
+	int n = 0;
+
+	memcpy(buf, base, sizeof(base) - 1);
+	buf += sizeof(base) - 1;
+	do {
+		digits[n++] = '0' + cpu % 10;
+		cpu /= 10;
+	} while (cpu);
+	while (n)
+		*buf++ = digits[--n];
+	while ((*buf++ = *tail++))
+		;
+}
+
+/* LLC domain id of a cpu; L3 if present, else L2, else one domain */
+static int group_llc_id(unsigned cpu)
+{
+	char path[96], buf[32];
+
+	group_cpu_path(path, cpu, "/cache/index3/id");
+	if (group_read_file(path, buf, sizeof(buf)) <= 0) {
+		group_cpu_path(path, cpu, "/cache/index2/id");
+		if (group_read_file(path, buf, sizeof(buf)) <= 0)
+			return 0;
+	}
+	return group_parse_max(buf);
+}
+
+/*
+ * Build 'rings_per_domain' rings in every LLC domain. 'flags' seeds
+ * each ring's setup flags; with IORING_SETUP_SQPOLL the sq thread is
+ * pinned to a cpu of the ring's domain via IORING_SETUP_SQ_AFF, and
+ * rings after the first in a domain attach to its io-wq (and SQPOLL
+ * thread) with IORING_SETUP_ATTACH_WQ. Every ring's io-wq workers are
+ * then affined to the domain's cpus. Unwinds fully on failure.
+ */
+__cold int io_uring_group_init(struct io_uring_group *g, unsigned entries,
+			       unsigned rings_per_domain, unsigned flags)
+{
+	int *llc, *dom_of;
+	char buf[64];
+	unsigned nr_cpus, nr_domains = 0, i, d, r, nr = 0;
+	int ret, max;
+
+	if (!rings_per_domain)
+		return -EINVAL;
+	ret = group_read_file("/sys/devices/system/cpu/online", buf,
+			      sizeof(buf));
+	max = ret > 0 ? group_parse_max(buf) : 0;
+	if (max < 0)
+		max = 0;
+	nr_cpus = (unsigned) max + 1;
+
+	llc = malloc(nr_cpus * 2 * sizeof(*llc));
+	if (!llc)
+		return -ENOMEM;
+	dom_of = llc + nr_cpus;
+	for (i = 0; i < nr_cpus; i++) {
+		int id = group_llc_id(i), j;
+
+		/* dense domain index, first-seen order */
+		dom_of[i] = -1;
+		for (j = 0; j < (int) i; j++) {
+			if (llc[j] == id) {
+				dom_of[i] = dom_of[j];
+				break;
+			}
+		}
+		llc[i] = id;
+		if (dom_of[i] < 0)
+			dom_of[i] = (int) nr_domains++;
+	}
+
+	g->rings = malloc(nr_domains * rings_per_domain * sizeof(*g->rings));
+	if (!g->rings) {
+		free(llc);
+		return -ENOMEM;
+	}
+	g->nr_domains = nr_domains;
+
+	for (d = 0; d < nr_domains; d++) {
+		int first = -1;
+		unsigned cpu_cnt = 0, pick;
+		cpu_set_t mask;
+
+		CPU_ZERO(&mask);
+		for (i = 0; i < nr_cpus; i++) {
+			if (dom_of[i] == (int) d) {
+				CPU_SET(i, &mask);
+				cpu_cnt++;
+			}
+		}
+		for (r = 0; r < rings_per_domain; r++) {
+			struct io_uring_group_ring *gr = &g->rings[nr];
+			struct io_uring_params p;
+
+			/* r-th cpu of this domain, wrapping */
+			pick = r % cpu_cnt;
+			for (i = 0; i < nr_cpus; i++) {
+				if (dom_of[i] == (int) d && !pick--)
+					break;
+			}
+			memset(&p, 0, sizeof(p));
+			p.flags = flags;
+			if (flags & IORING_SETUP_SQPOLL) {
+				p.flags |= IORING_SETUP_SQ_AFF;
+				p.sq_thread_cpu = i;
+			}
+			if (first >= 0) {
+				p.flags |= IORING_SETUP_ATTACH_WQ;
+				p.wq_fd = g->rings[first].ring.ring_fd;
+			}
+			ret = io_uring_queue_init_params(entries, &gr->ring,
+							 &p);
+			if (ret)
+				goto err;
+			gr->cpu = (int) i;
+			gr->domain = (int) d;
+			nr++;
+			if (first < 0)
+				first = (int) (nr - 1);
+			ret = io_uring_register_iowq_aff(&gr->ring,
+							 sizeof(mask), &mask);
+			if (ret && ret != -EINVAL)
+				goto err;
+		}
+	}
+	free(llc);
+	g->nr = nr;
+	return 0;
+err:
+	while (nr--)
+		io_uring_queue_exit(&g->rings[nr].ring);
+	free(g->rings);
+	free(llc);
+	g->rings = NULL;
+	return ret;
+}
+
+__cold void io_uring_group_exit(struct io_uring_group *g)
+{
+	unsigned i;
+
+	for (i = 0; i < g->nr; i++)
+		io_uring_queue_exit(&g->rings[i].ring);
+	free(g->rings);
+	g->rings = NULL;
+}
+
+/*
+ * Thread-local ring registry. Each thread's ring lives in TLS and is
+ * created on first use from a process-wide template; live rings are
+ * chained on a lock-free list for enumeration. Nodes of exited
+ * threads are marked dead and recycled by later threads.
+ */
+struct uring_tr_node {
+	struct io_uring *ring;
+	int tid;
+	struct uring_tr_node *next;
+};
+
+static struct uring_tr_node *tr_list;
+static struct io_uring_params tr_template;
+static unsigned tr_entries;
+static unsigned tr_lib_flags;
+
+/* initial-exec keeps the nolibc build free of __tls_get_addr */
+static __thread __attribute__((tls_model("initial-exec"))) struct io_uring tr_ring;
+static __thread __attribute__((tls_model("initial-exec"))) struct uring_tr_node *tr_node;
+
+/*
+ * Register the template future per-thread rings are built from;
+ * affects only rings not yet created. Pass p == NULL to keep default
+ * params and just size the sq.
+ */
+__cold int io_uring_thread_ring_config(unsigned entries,
+				       const struct io_uring_params *p,
+				       unsigned lib_flags)
+{
+	if (!entries)
+		return -EINVAL;
+	if (p)
+		memcpy(&tr_template, p, sizeof(tr_template));
+	else
+		memset(&tr_template, 0, sizeof(tr_template));
+	tr_entries = entries;
+	tr_lib_flags = lib_flags;
+	return 0;
+}
+
+/*
+ * The calling thread's ring, created on first use. Returns NULL if
+ * ring setup fails.
+ */
+struct io_uring *io_uring_thread_ring(void)
+{
+	struct io_uring_params p;
+	struct uring_tr_node *node;
+	int ret;
+
+	if (tr_node)
+		return &tr_ring;
+
+	memcpy(&p, &tr_template, sizeof(p));
+	/* the template is consumed by setup; resvd fields must be clear */
+	p.sq_entries = p.cq_entries = 0;
+	ret = io_uring_queue_init_params_lib(tr_entries ? tr_entries : 64,
+					     &tr_ring, &p, tr_lib_flags);
+	if (ret)
+		return NULL;
+
+	/* adopt a dead node or push a fresh one */
+	for (node = __atomic_load_n(&tr_list, __ATOMIC_ACQUIRE); node;
+	     node = node->next) {
+		struct io_uring *dead = NULL;
+
+		if (__atomic_load_n(&node->ring, __ATOMIC_RELAXED))
+			continue;
+		if (__atomic_compare_exchange_n(&node->ring, &dead, &tr_ring,
+						false, __ATOMIC_ACQ_REL,
+						__ATOMIC_RELAXED))
+			break;
+	}
+	if (!node) {
+		node = malloc(sizeof(*node));
+		if (!node) {
+			io_uring_queue_exit(&tr_ring);
+			return NULL;
+		}
+		node->ring = &tr_ring;
+		node->next = __atomic_load_n(&tr_list, __ATOMIC_RELAXED);
+		while (!__atomic_compare_exchange_n(&tr_list, &node->next,
+						    node, false,
+						    __ATOMIC_RELEASE,
+						    __ATOMIC_RELAXED))
+			;
+	}
+	node->tid = __sys_gettid();
+	tr_node = node;
+	return &tr_ring;
+}
+
+/*
+ * Walk every live per-thread ring. 'fn' returning non-zero stops the
+ * walk and that value is returned. Rings belong to their threads -
+ * only inspect state that is safe to read concurrently, or quiesce
+ * the pool first.
+ */
+int io_uring_thread_ring_each(int (*fn)(struct io_uring *ring, int tid,
+					void *data), void *data)
+{
+	struct uring_tr_node *node;
+	int ret;
+
+	for (node = __atomic_load_n(&tr_list, __ATOMIC_ACQUIRE); node;
+	     node = node->next) {
+		struct io_uring *ring;
+
+		ring = __atomic_load_n(&node->ring, __ATOMIC_ACQUIRE);
+		if (!ring)
+			continue;
+		ret = fn(ring, node->tid, data);
+		if (ret)
+			return ret;
+	}
+	return 0;
+}
+
+/* tear down the calling thread's ring; call before the thread exits */
+__cold void io_uring_thread_ring_close(void)
+{
+	if (!tr_node)
+		return;
+	__atomic_store_n(&tr_node->ring, NULL, __ATOMIC_RELEASE);
+	tr_node = NULL;
+	io_uring_queue_exit(&tr_ring);
+}
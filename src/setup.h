@@ -4,6 +4,35 @@
 
 int __io_uring_queue_init_params(unsigned entries, struct io_uring *ring,
 				 struct io_uring_params *p, void *buf,
-				 size_t buf_size);
+				 size_t buf_size, unsigned lib_flags);
+
+/*
+ * Internal allocations owned by a ring go through these so the alloc
+ * hooks from io_uring_set_alloc_hooks() see them; both fall back to
+ * plain malloc/free for unhooked rings.
+ */
+void *uring_ring_malloc(struct io_uring *ring, size_t len);
+void uring_ring_free(struct io_uring *ring, void *ptr);
+
+/* CLOCK_MONOTONIC in ns, or 0 if the clock read fails; lives in queue.c */
+unsigned long long uring_mono_ns(void);
+
+/* kernel has completions parked in the overflow list or deferred task work */
+static inline bool cq_ring_needs_flush(struct io_uring *ring)
+{
+	return IO_URING_READ_ONCE(*ring->sq.kflags) &
+				 (IORING_SQ_CQ_OVERFLOW | IORING_SQ_TASKRUN);
+}
+
+/* LIBURING_SETUP_SHADOW_SQ staging state, lives with the flush path */
+int io_uring_shadow_sq_init(struct io_uring *ring);
+void io_uring_shadow_sq_exit(struct io_uring *ring);
+
+/*
+ * io_uring_queue_exit() backstops: drop stale per-ring registry slots
+ * (see the slot protocol in lib.h) in queue.c and register.c.
+ */
+void uring_queue_registries_drop(struct io_uring *ring);
+void uring_register_registries_drop(struct io_uring *ring);
 
 #endif
@@ -0,0 +1,670 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * Coordination engines: multi-ring waiting, traced msg_ring hops,
+ * mailboxes and the ring mesh for cross-thread work passing, futex
+ * polling and mutexes over the ring, and the child reaper.
+ */
+#define _POSIX_C_SOURCE 200112L
+
+#include "lib.h"
+#include "syscall.h"
+#include "liburing.h"
+#include "setup.h"
+#include "trace.h"
+#include <linux/futex.h>
+
+/* futex2 interface; older uapi headers lack the size flags */
+#ifndef FUTEX2_SIZE_U32
+#define FUTEX2_SIZE_U32		0x02
+#endif
+
+/* POLLIN without dragging in poll.h for nolibc builds */
+#define MWAIT_POLLIN	0x0001
+
+static int mwait_arm(struct io_uring_mwait *mw, unsigned idx)
+{
+	struct io_uring_sqe *sqe;
+
+	sqe = io_uring_get_sqe(mw->rings[0]);
+	if (!sqe) {
+		io_uring_submit(mw->rings[0]);
+		sqe = io_uring_get_sqe(mw->rings[0]);
+		if (!sqe)
+			return -EBUSY;
+	}
+	io_uring_prep_poll_multishot(sqe, mw->rings[idx]->ring_fd,
+				     MWAIT_POLLIN);
+	sqe->user_data = LIBURING_UDATA_MWAIT | idx;
+	return 0;
+}
+
+/*
+ * Group up to IO_URING_MWAIT_MAX rings behind rings[0]'s wait: a
+ * multishot poll per other ring makes its CQ activity wake a block on
+ * rings[0]. rings[0] must not be IOPOLL (its CQEs come from reaping,
+ * not posting, so nothing would wake the sleeper); the others may be.
+ */
+__cold int io_uring_mwait_init(struct io_uring_mwait *mw,
+			       struct io_uring **rings, unsigned nr)
+{
+	unsigned i;
+	int ret;
+
+	if (!nr || nr > IO_URING_MWAIT_MAX ||
+	    (rings[0]->flags & IORING_SETUP_IOPOLL))
+		return -EINVAL;
+	for (i = 0; i < nr; i++)
+		mw->rings[i] = rings[i];
+	mw->nr = nr;
+
+	for (i = 1; i < nr; i++) {
+		ret = mwait_arm(mw, i);
+		if (ret)
+			return ret;
+	}
+	if (nr > 1) {
+		ret = io_uring_submit(rings[0]);
+		if (ret < 0)
+			return ret;
+	}
+	return 0;
+}
+
+__cold void io_uring_mwait_exit(struct io_uring_mwait *mw)
+{
+	struct io_uring_sqe *sqe;
+	unsigned i;
+
+	/*
+	 * Best effort: drop the wakeup polls; the removes and the
+	 * cancelled polls complete under the reserved tag, which
+	 * io_uring_mwait_cqe() keeps swallowing.
+	 */
+	for (i = 1; i < mw->nr; i++) {
+		sqe = io_uring_get_sqe(mw->rings[0]);
+		if (!sqe)
+			break;
+		io_uring_prep_poll_remove(sqe, LIBURING_UDATA_MWAIT | i);
+		sqe->user_data = LIBURING_UDATA_MWAIT | i;
+	}
+	if (mw->nr > 1)
+		io_uring_submit(mw->rings[0]);
+	mw->nr = 0;
+}
+
+/*
+ * Wait for any ring in the group to have completions: every ring is
+ * peeked in userspace first - IOPOLL rings harvested with
+ * io_uring_get_events() - and only an all-empty pass blocks on
+ * rings[0], with 'ts' (NULL waits forever) bounding the sleep. Returns
+ * the index of a ready ring or -ETIME. A return of 0 can mean only
+ * wakeup traffic is pending there; reap it as usual and the tag CQEs
+ * vanish into io_uring_mwait_cqe().
+ */
+int io_uring_mwait(struct io_uring_mwait *mw, struct __kernel_timespec *ts)
+{
+	struct io_uring_cqe *cqe;
+	unsigned i;
+	int ret;
+
+	for (;;) {
+		for (i = 0; i < mw->nr; i++) {
+			struct io_uring *r = mw->rings[i];
+
+			if (r->flags & IORING_SETUP_IOPOLL)
+				io_uring_get_events(r);
+			if (io_uring_cq_ready(r))
+				return (int) i;
+		}
+		ret = io_uring_wait_cqe_timeout(mw->rings[0], &cqe, ts);
+		if (ret < 0 && ret != -EAGAIN && ret != -EINTR)
+			return ret;
+	}
+}
+
+/*
+ * Swallow the group's wakeup traffic out of rings[0]'s CQ flow:
+ * returns non-zero for mwait cqes, re-arming a multishot poll that
+ * lapsed. Foreign cqes pass through with 0.
+ */
+int io_uring_mwait_cqe(struct io_uring_mwait *mw,
+		       const struct io_uring_cqe *cqe)
+{
+	unsigned idx;
+
+	if ((cqe->user_data & (0xffffULL << 48)) != LIBURING_UDATA_MWAIT)
+		return 0;
+	idx = (unsigned) cqe->user_data;
+	if (idx && idx < mw->nr && cqe->res >= 0 &&
+	    !(cqe->flags & IORING_CQE_F_MORE))
+		mwait_arm(mw, idx);
+	return 1;
+}
+
+/*
+ * Stage a traced msg_ring hop: the 12-bit correlation id is stitched
+ * into the forwarded user_data (see io_uring_msg_trace_data()) and the
+ * msg_hop USDT probe fires, so the send side of every hop lands in the
+ * trace. Returns -EBUSY on a full SQ; submit as usual.
+ */
+int io_uring_msg_ring_trace(struct io_uring *ring, int target_fd,
+			    unsigned int len, __u64 data, unsigned trace_id,
+			    unsigned int flags)
+{
+	struct io_uring_sqe *sqe;
+
+	sqe = io_uring_get_sqe(ring);
+	if (!sqe)
+		return -EBUSY;
+	data = io_uring_msg_trace_data(data, trace_id);
+	io_uring_prep_msg_ring(sqe, target_fd, len, data, flags);
+	URING_PROBE4(msg_hop, ring->enter_ring_fd, target_fd,
+		     trace_id & 0xfff, data & ((1ULL << 48) - 1));
+	return 0;
+}
+
+/*
+ * Receive side of a traced hop: pull the correlation id back out of a
+ * forwarded cqe and fire the msg_recv probe, pairing arrival with the
+ * sender's msg_hop. Returns the id.
+ */
+unsigned io_uring_msg_trace_cqe(struct io_uring *ring,
+				const struct io_uring_cqe *cqe)
+{
+	unsigned trace_id = io_uring_msg_trace_id(cqe->user_data);
+
+	URING_PROBE2(msg_recv, ring->enter_ring_fd, trace_id);
+	return trace_id;
+}
+
+__cold int io_uring_reaper_init(struct io_uring *ring,
+				struct io_uring_reaper *rp, unsigned nr_slots)
+{
+	unsigned i;
+
+	if (!nr_slots)
+		return -EINVAL;
+	rp->kids = uring_ring_malloc(ring, nr_slots * sizeof(*rp->kids));
+	rp->free_q = uring_ring_malloc(ring, nr_slots * sizeof(*rp->free_q));
+	if (!rp->kids || !rp->free_q) {
+		uring_ring_free(ring, rp->kids);
+		uring_ring_free(ring, rp->free_q);
+		return -ENOMEM;
+	}
+	for (i = 0; i < nr_slots; i++)
+		rp->free_q[i] = i;
+	rp->ring = ring;
+	rp->free_nr = nr_slots;
+	rp->nr_slots = nr_slots;
+	return 0;
+}
+
+__cold void io_uring_reaper_exit(struct io_uring_reaper *rp)
+{
+	uring_ring_free(rp->ring, rp->kids);
+	uring_ring_free(rp->ring, rp->free_q);
+	rp->kids = NULL;
+	rp->free_q = NULL;
+}
+
+/*
+ * Stage a waitid watch for one child - P_PID and a pid, or P_PIDFD
+ * and a pidfd. 'child' must stay valid until the exit is reaped.
+ * Returns -ENOSPC with all watch slots in flight, -EBUSY with the sq
+ * full after one flush; submit as usual.
+ */
+int io_uring_reaper_watch(struct io_uring_reaper *rp,
+			  struct io_uring_reap_child *child, idtype_t idtype,
+			  id_t id)
+{
+	struct io_uring_sqe *sqe;
+	unsigned slot;
+
+	if (!rp->free_nr)
+		return -ENOSPC;
+	sqe = io_uring_get_sqe(rp->ring);
+	if (!sqe) {
+		io_uring_submit(rp->ring);
+		sqe = io_uring_get_sqe(rp->ring);
+		if (!sqe)
+			return -EBUSY;
+	}
+	slot = rp->free_q[--rp->free_nr];
+	child->slot = slot;
+	child->res = 0;
+	rp->kids[slot] = child;
+
+	io_uring_prep_waitid(sqe, idtype, id, &child->info, WEXITED, 0);
+	sqe->user_data = LIBURING_UDATA_REAP | slot;
+	return 0;
+}
+
+/*
+ * Feed one reaped completion through the lane; returns 0 for foreign
+ * cqes and 2 when a watched child exited - its slot is recycled and
+ * the exit detail is in child->info (si_status, si_code).
+ */
+int io_uring_reaper_cqe(struct io_uring_reaper *rp,
+			const struct io_uring_cqe *cqe)
+{
+	struct io_uring_reap_child *child;
+	unsigned slot;
+
+	if ((cqe->user_data & (0xffffULL << 48)) != LIBURING_UDATA_REAP)
+		return 0;
+	slot = (unsigned) cqe->user_data;
+	child = rp->kids[slot];
+	child->res = cqe->res;
+	rp->free_q[rp->free_nr++] = slot;
+	return 2;
+}
+
+/*
+ * Collect exits as one batch: submit pending watches, wait for at
+ * least 'wait_nr' completions, then harvest every reaper cqe at the
+ * cq head into 'out'. Harvesting stops at the first foreign cqe so a
+ * mixed dispatch loop keeps seeing its own traffic. Returns the
+ * number of exits collected.
+ */
+int io_uring_reaper_reap(struct io_uring_reaper *rp,
+			 struct io_uring_reap_child **out, unsigned nr_out,
+			 unsigned wait_nr)
+{
+	struct io_uring_cqe *cqe;
+	unsigned got = 0;
+	int ret;
+
+	ret = io_uring_submit_and_wait(rp->ring, wait_nr);
+	if (ret < 0 && ret != -EINTR)
+		return ret;
+	while (got < nr_out && !io_uring_peek_cqe(rp->ring, &cqe)) {
+		if ((cqe->user_data & (0xffffULL << 48)) != LIBURING_UDATA_REAP)
+			break;
+		out[got++] = rp->kids[(unsigned) cqe->user_data];
+		io_uring_reaper_cqe(rp, cqe);
+		io_uring_cqe_seen(rp->ring, cqe);
+	}
+	return (int) got;
+}
+
+/*
+ * Arm "futex word changes or fd becomes ready" as one two-sqe batch.
+ * The futex side completes with 'user_data', the poll side with bit 63
+ * flipped. Returns -EBUSY if the sq cannot hold both sqes after one
+ * flush; 'fp' must stay valid until io_uring_futex_poll_cqe() reports
+ * completion.
+ */
+int io_uring_futex_poll(struct io_uring *ring, struct io_uring_futex_poll *fp,
+			__u32 *word, __u64 val, int fd, unsigned poll_mask,
+			__u64 user_data)
+{
+	struct io_uring_sqe *sqe;
+
+	if (io_uring_sq_space_left(ring) < 2) {
+		int ret = io_uring_submit(ring);
+
+		if (ret < 0)
+			return ret;
+		if (io_uring_sq_space_left(ring) < 2)
+			return -EBUSY;
+	}
+	fp->udata = user_data;
+	fp->res = 0;
+	fp->winner = -1;
+	fp->pending = 2;
+
+	sqe = io_uring_get_sqe(ring);
+	io_uring_prep_futex_wait(sqe, (uint32_t *) word, val,
+				 FUTEX_BITSET_MATCH_ANY, FUTEX2_SIZE_U32, 0);
+	sqe->user_data = user_data;
+
+	sqe = io_uring_get_sqe(ring);
+	io_uring_prep_poll_add(sqe, fd, poll_mask);
+	sqe->user_data = user_data ^ (1ULL << 63);
+	return 0;
+}
+
+/*
+ * Feed one reaped completion through the combinator; returns 0 for
+ * foreign cqes, 1 while sqes are still retiring and 2 once both sides
+ * (and the cancel of the loser) are accounted for, with fp->winner
+ * and fp->res describing the side that fired first.
+ */
+int io_uring_futex_poll_cqe(struct io_uring *ring,
+			    struct io_uring_futex_poll *fp,
+			    const struct io_uring_cqe *cqe)
+{
+	__u64 ud = cqe->user_data;
+
+	if (ud != fp->udata && ud != (fp->udata ^ (1ULL << 63)) &&
+	    ud != (fp->udata ^ (1ULL << 62)))
+		return 0;
+	fp->pending--;
+	if (ud != (fp->udata ^ (1ULL << 62)) && fp->winner < 0 &&
+	    cqe->res != -ECANCELED) {
+		fp->winner = ud == fp->udata ? 0 : 1;
+		fp->res = cqe->res;
+		/* cancel the loser if it is still out there */
+		if (fp->pending) {
+			struct io_uring_sqe *sqe;
+
+			sqe = io_uring_get_sqe(ring);
+			if (!sqe) {
+				io_uring_submit(ring);
+				sqe = io_uring_get_sqe(ring);
+			}
+			if (sqe) {
+				io_uring_prep_cancel64(sqe,
+						       ud ^ (1ULL << 63), 0);
+				sqe->user_data = fp->udata ^ (1ULL << 62);
+				fp->pending++;
+			}
+		}
+	}
+	return fp->pending ? 1 : 2;
+}
+
+/*
+ * Acquire the mutex or park on it. Returns 0 with the lock held, 1
+ * with a futex-wait sqe staged carrying 'user_data' - when its cqe
+ * arrives (wake, or -EAGAIN because the word moved) call lock again -
+ * and -EBUSY if the wait cannot be staged.
+ */
+int io_uring_mutex_lock(struct io_uring *ring, struct io_uring_mutex *m,
+			__u64 user_data)
+{
+	struct io_uring_sqe *sqe;
+	__u32 zero = 0;
+
+	if (__atomic_compare_exchange_n(&m->word, &zero, 1, false,
+					__ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+		return 0;
+	/* mark contended; the exchange may find it just got dropped */
+	if (__atomic_exchange_n(&m->word, 2, __ATOMIC_ACQUIRE) == 0)
+		return 0;
+	sqe = io_uring_get_sqe(ring);
+	if (!sqe) {
+		io_uring_submit(ring);
+		sqe = io_uring_get_sqe(ring);
+		if (!sqe)
+			return -EBUSY;
+	}
+	io_uring_prep_futex_wait(sqe, (uint32_t *) &m->word, 2,
+				 FUTEX_BITSET_MATCH_ANY, FUTEX2_SIZE_U32, 0);
+	sqe->user_data = user_data;
+	return 1;
+}
+
+/*
+ * Drop the mutex. Returns 1 when a futex-wake sqe was staged for a
+ * possibly parked waiter (submit as usual; successful wakes skip
+ * their cqe), 0 when nobody could be waiting, -EBUSY if the wake
+ * cannot be staged - the lock is released either way.
+ */
+int io_uring_mutex_unlock(struct io_uring *ring, struct io_uring_mutex *m)
+{
+	struct io_uring_sqe *sqe;
+
+	if (__atomic_exchange_n(&m->word, 0, __ATOMIC_RELEASE) != 2)
+		return 0;
+	sqe = io_uring_get_sqe(ring);
+	if (!sqe) {
+		io_uring_submit(ring);
+		sqe = io_uring_get_sqe(ring);
+		if (!sqe)
+			return -EBUSY;
+	}
+	io_uring_prep_futex_wake(sqe, (uint32_t *) &m->word, 1,
+				 FUTEX_BITSET_MATCH_ANY, FUTEX2_SIZE_U32, 0);
+	sqe->flags |= IOSQE_CQE_SKIP_SUCCESS;
+	sqe->user_data = LIBURING_UDATA_FUTEX;
+	return 1;
+}
+
+__cold int io_uring_mailbox_init(struct io_uring *ring,
+				 struct io_uring_mailbox *mb, unsigned nr)
+{
+	unsigned i;
+
+	if (!nr)
+		return -EINVAL;
+	/* round up to a power of two for the ring mask */
+	while (nr & (nr - 1))
+		nr += nr & ~(nr - 1);
+	mb->cells = uring_ring_malloc(ring, nr * sizeof(*mb->cells));
+	if (!mb->cells)
+		return -ENOMEM;
+	for (i = 0; i < nr; i++)
+		__atomic_store_n(&mb->cells[i].seq, i, __ATOMIC_RELAXED);
+	mb->ring = ring;
+	mb->head = 0;
+	mb->tail = 0;
+	mb->mask = nr - 1;
+	mb->sleeping = 0;
+	return 0;
+}
+
+__cold void io_uring_mailbox_exit(struct io_uring_mailbox *mb)
+{
+	uring_ring_free(mb->ring, mb->cells);
+	mb->cells = NULL;
+}
+
+/*
+ * Post one prepped sqe template from a non-issuer thread. Lock-free;
+ * multiple posters may race. If the issuer has parked, a msg_ring sqe
+ * is submitted on 'waker' (the poster's own ring) to rouse it - the
+ * wake surfaces on the issuer ring as a cqe tagged LIBURING_UDATA_MBOX.
+ * Returns 1 if a wake was sent, 0 if the issuer was awake, -EAGAIN
+ * with the mailbox full, -EBUSY if a needed wake cannot be staged.
+ */
+int io_uring_mailbox_post(struct io_uring_mailbox *mb,
+			  const struct io_uring_sqe *t, struct io_uring *waker)
+{
+	struct io_uring_mailbox_cell *cell;
+	__u64 pos, seq;
+
+	pos = __atomic_load_n(&mb->tail, __ATOMIC_RELAXED);
+	for (;;) {
+		cell = &mb->cells[pos & mb->mask];
+		seq = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
+		if (seq == pos) {
+			if (__atomic_compare_exchange_n(&mb->tail, &pos,
+							pos + 1, true,
+							__ATOMIC_RELAXED,
+							__ATOMIC_RELAXED))
+				break;
+		} else if (seq < pos) {
+			return -EAGAIN;
+		} else {
+			pos = __atomic_load_n(&mb->tail, __ATOMIC_RELAXED);
+		}
+	}
+	uring_sqe_copy64(&cell->sqe, t);
+	__atomic_store_n(&cell->seq, pos + 1, __ATOMIC_RELEASE);
+
+	if (__atomic_load_n(&mb->sleeping, __ATOMIC_SEQ_CST)) {
+		struct io_uring_sqe *sqe;
+		int ret;
+
+		sqe = io_uring_get_sqe(waker);
+		if (!sqe) {
+			io_uring_submit(waker);
+			sqe = io_uring_get_sqe(waker);
+			if (!sqe)
+				return -EBUSY;
+		}
+		io_uring_prep_msg_ring(sqe, mb->ring->ring_fd, 0,
+				       LIBURING_UDATA_MBOX, 0);
+		sqe->flags |= IOSQE_CQE_SKIP_SUCCESS;
+		sqe->user_data = LIBURING_UDATA_MBOX;
+		ret = io_uring_submit(waker);
+		if (ret < 0)
+			return ret;
+		return 1;
+	}
+	return 0;
+}
+
+/* copy queued templates into real sqes; issuer thread only */
+static int mailbox_pump(struct io_uring_mailbox *mb)
+{
+	struct io_uring_mailbox_cell *cell;
+	struct io_uring_sqe *sqe;
+	__u64 seq;
+	int nr = 0;
+
+	for (;;) {
+		cell = &mb->cells[mb->head & mb->mask];
+		seq = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
+		if (seq != mb->head + 1)
+			break;
+		sqe = io_uring_get_sqe(mb->ring);
+		if (!sqe) {
+			io_uring_submit(mb->ring);
+			sqe = io_uring_get_sqe(mb->ring);
+			if (!sqe)
+				break;
+		}
+		uring_sqe_copy64(sqe, &cell->sqe);
+		__atomic_store_n(&cell->seq, mb->head + mb->mask + 1,
+				 __ATOMIC_RELEASE);
+		mb->head++;
+		nr++;
+	}
+	return nr;
+}
+
+/*
+ * Drain posted templates into the sq; call from the issuer before (or
+ * as part of) each submit. Returns the number of sqes staged.
+ */
+int io_uring_mailbox_drain(struct io_uring_mailbox *mb)
+{
+	__atomic_store_n(&mb->sleeping, 0, __ATOMIC_SEQ_CST);
+	return mailbox_pump(mb);
+}
+
+/*
+ * Announce that the issuer is about to wait. The mailbox is drained
+ * once more after the flag is visible, closing the race with a poster
+ * that missed it; a non-zero return means templates arrived and the
+ * issuer should submit instead of sleeping.
+ */
+int io_uring_mailbox_park(struct io_uring_mailbox *mb)
+{
+	int nr;
+
+	__atomic_store_n(&mb->sleeping, 1, __ATOMIC_SEQ_CST);
+	nr = mailbox_pump(mb);
+	if (nr)
+		__atomic_store_n(&mb->sleeping, 0, __ATOMIC_SEQ_CST);
+	return nr;
+}
+
+__cold int io_uring_mesh_init(struct io_uring_mesh *m, struct io_uring **rings,
+			      unsigned nr)
+{
+	if (nr < 2)
+		return -EINVAL;
+	m->depth = uring_ring_malloc(rings[0], nr * sizeof(*m->depth));
+	if (!m->depth)
+		return -ENOMEM;
+	memset(m->depth, 0, nr * sizeof(*m->depth));
+	m->rings = rings;
+	m->nr = nr;
+	return 0;
+}
+
+__cold void io_uring_mesh_exit(struct io_uring_mesh *m)
+{
+	uring_ring_free(m->rings[0], m->depth);
+	m->depth = NULL;
+}
+
+/*
+ * Least-loaded node by the depth counters, preferring 'self' on ties
+ * so balanced load never pays a cross-ring hop.
+ */
+unsigned io_uring_mesh_pick(const struct io_uring_mesh *m, unsigned self)
+{
+	unsigned i, best = self;
+
+	for (i = 0; i < m->nr; i++)
+		if (m->depth[i] < m->depth[best])
+			best = i;
+	return best;
+}
+
+static struct io_uring_sqe *mesh_get_sqe(struct io_uring *ring)
+{
+	struct io_uring_sqe *sqe;
+
+	sqe = io_uring_get_sqe(ring);
+	if (!sqe) {
+		io_uring_submit(ring);
+		sqe = io_uring_get_sqe(ring);
+	}
+	return sqe;
+}
+
+/*
+ * Push one work item from node 'self'. The target is picked by load;
+ * if that is 'self' the item stays local and the caller runs it - the
+ * depth counter is charged either way. Otherwise a msg_ring sqe is
+ * staged (not submitted, so bursts batch) that posts 'user_data' into
+ * the sibling's cq; successful sends skip the source-side cqe, only
+ * failures surface tagged LIBURING_UDATA_MESH. Returns the target
+ * index, or -EBUSY with the source sq full.
+ */
+int io_uring_mesh_push(struct io_uring_mesh *m, unsigned self,
+		       __u64 user_data)
+{
+	unsigned target = io_uring_mesh_pick(m, self);
+	struct io_uring_sqe *sqe;
+
+	if (target != self) {
+		sqe = mesh_get_sqe(m->rings[self]);
+		if (!sqe)
+			return -EBUSY;
+		io_uring_prep_msg_ring(sqe, m->rings[target]->ring_fd,
+				       0, user_data, 0);
+		sqe->flags |= IOSQE_CQE_SKIP_SUCCESS;
+		sqe->user_data = LIBURING_UDATA_MESH | target;
+	}
+	m->depth[target]++;
+	return target;
+}
+
+/*
+ * As io_uring_mesh_push(), but passes a descriptor along with the work
+ * item. msg_ring moves registered files, so 'src_idx' indexes 'self's
+ * fixed file table; the file is installed into a free slot of the
+ * sibling's table and that slot index arrives as the cqe's res. Both
+ * rings therefore need fixed tables, the target's with allocation
+ * room. A pick of 'self' still stages the msg_ring - the install has
+ * no local shortcut.
+ */
+int io_uring_mesh_push_fd(struct io_uring_mesh *m, unsigned self,
+			  int src_idx, __u64 user_data)
+{
+	unsigned target = io_uring_mesh_pick(m, self);
+	struct io_uring_sqe *sqe;
+
+	sqe = mesh_get_sqe(m->rings[self]);
+	if (!sqe)
+		return -EBUSY;
+	io_uring_prep_msg_ring_fd_alloc(sqe, m->rings[target]->ring_fd,
+					src_idx, user_data, 0);
+	sqe->flags |= IOSQE_CQE_SKIP_SUCCESS;
+	sqe->user_data = LIBURING_UDATA_MESH | target;
+	m->depth[target]++;
+	return target;
+}
+
+/* a node finished one work item; rebalance the heuristic */
+void io_uring_mesh_done(struct io_uring_mesh *m, unsigned idx)
+{
+	if (m->depth[idx])
+		m->depth[idx]--;
+}
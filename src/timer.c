@@ -0,0 +1,320 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * Time-keeping over the ring: per-completion timestamp tracking and the
+ * hierarchical timer wheel, which multiplexes any number of soft timers
+ * onto a single kernel timeout.
+ */
+#define _POSIX_C_SOURCE 200112L
+
+#include "lib.h"
+#include "syscall.h"
+#include "liburing.h"
+#include "setup.h"
+
+/*
+ * The stamp table is sized at four slots per SQ entry so open addressing
+ * stays short even with a deep in-flight window.
+ */
+int io_uring_ts_init(struct io_uring *ring, struct io_uring_timestamps *ts)
+{
+	unsigned nr = ring->sq.ring_entries * 4;
+
+	ts->ring = ring;
+	ts->mask = nr - 1;
+	ts->tab = uring_ring_malloc(ring, nr * sizeof(*ts->tab));
+	if (!ts->tab)
+		return -ENOMEM;
+	memset(ts->tab, 0, nr * sizeof(*ts->tab));
+	return 0;
+}
+
+void io_uring_ts_exit(struct io_uring_timestamps *ts)
+{
+	uring_ring_free(ts->ring, ts->tab);
+	ts->tab = NULL;
+	ts->ring = NULL;
+}
+
+static void io_uring_ts_stamp(struct io_uring_timestamps *ts, __u64 user_data,
+			      unsigned long long cycles)
+{
+	unsigned idx = (user_data * 0x9e3779b97f4a7c15ULL) >> 32;
+	unsigned probes;
+
+	for (probes = 0; probes <= ts->mask; probes++, idx++) {
+		struct io_uring_ts_slot *slot = &ts->tab[idx & ts->mask];
+
+		if (slot->cycles && slot->user_data != user_data)
+			continue;
+		slot->user_data = user_data;
+		slot->cycles = cycles;
+		return;
+	}
+	/* table full: this request just won't have a stamp */
+}
+
+/*
+ * Stamp every sqe prepared since the last flush with the current cycle
+ * counter, then submit as usual. One counter read covers the whole batch,
+ * which is what the stamp granularity can honestly claim anyway.
+ */
+int io_uring_ts_submit(struct io_uring_timestamps *ts)
+{
+	struct io_uring *ring = ts->ring;
+	struct io_uring_sq *sq = &ring->sq;
+	int shift = !!(ring->flags & IORING_SETUP_SQE128);
+	unsigned long long now = uring_read_cycles();
+	unsigned i;
+
+	for (i = sq->sqe_head; i != sq->sqe_tail; i++) {
+		const struct io_uring_sqe *sqe;
+
+		sqe = &sq->sqes[(i & sq->ring_mask) << shift];
+		if (sqe->user_data != LIBURING_UDATA_TIMEOUT)
+			io_uring_ts_stamp(ts, sqe->user_data, now);
+	}
+
+	return io_uring_submit(ring);
+}
+
+/*
+ * Return the submit-to-completion delta for 'cqe' in CPU cycles (or
+ * whatever unit uring_read_cycles() counts on this arch), releasing the
+ * stamp slot. Returns 0 if no stamp was recorded for this user_data.
+ */
+unsigned long long io_uring_ts_delta(struct io_uring_timestamps *ts,
+				     const struct io_uring_cqe *cqe)
+{
+	unsigned idx = (cqe->user_data * 0x9e3779b97f4a7c15ULL) >> 32;
+	unsigned long long delta;
+	unsigned probes;
+
+	for (probes = 0; probes <= ts->mask; probes++, idx++) {
+		struct io_uring_ts_slot *slot = &ts->tab[idx & ts->mask];
+
+		if (!slot->cycles)
+			return 0;
+		if (slot->user_data != cqe->user_data)
+			continue;
+		delta = uring_read_cycles() - slot->cycles;
+		slot->cycles = 0;
+		return delta;
+	}
+
+	return 0;
+}
+
+/*
+ * Timer wheel internals. Timers are filed by the distance of their
+ * deadline from the current tick: under 64 ticks lands in level 0,
+ * under 64^2 in level 1, and so on. Only level 0 ever fires; when the
+ * wheel position wraps a level boundary, the matching upper slot is
+ * cascaded - its timers re-filed by their now-shorter distance. Slot
+ * lists are unordered; everything in a level 0 slot is due when the
+ * wheel reaches it.
+ */
+static void twheel_file(struct io_uring_twheel *w, struct io_uring_timer *t)
+{
+	__u64 delta = t->expire_tick - w->cur;
+	unsigned l, idx;
+
+	for (l = 0; l < 3; l++) {
+		if (delta < 1ULL << (6 * (l + 1)))
+			break;
+	}
+	idx = (t->expire_tick >> (6 * l)) & 63;
+	t->next = w->slots[l][idx];
+	if (t->next)
+		t->next->pprev = &t->next;
+	t->pprev = &w->slots[l][idx];
+	w->slots[l][idx] = t;
+}
+
+/*
+ * Point the single kernel timeout at tick 'tick'. The first arm posts a
+ * fresh absolute timeout; later ones update it in place, which costs an
+ * sqe but no new kernel timer. Either sqe rides the application's next
+ * submit. With the SQ full the arm is deferred and retried from the run
+ * path, which is called at the latest when the stale deadline fires.
+ */
+static void twheel_arm(struct io_uring_twheel *w, __u64 tick)
+{
+	__u64 abs_ns = w->base_ns + tick * w->tick_ns;
+	struct io_uring_sqe *sqe;
+
+	sqe = io_uring_get_sqe(w->ring);
+	if (!sqe) {
+		w->need_arm = 1;
+		return;
+	}
+	w->kts.tv_sec = abs_ns / 1000000000ULL;
+	w->kts.tv_nsec = abs_ns % 1000000000ULL;
+	if (!w->armed) {
+		io_uring_prep_timeout(sqe, &w->kts, 0, IORING_TIMEOUT_ABS);
+		sqe->user_data = LIBURING_UDATA_TWHEEL;
+		w->armed = 1;
+	} else {
+		io_uring_prep_timeout_update(sqe, &w->kts,
+					     LIBURING_UDATA_TWHEEL,
+					     IORING_TIMEOUT_ABS);
+		/* low bit marks update completions, reaped and dropped */
+		sqe->user_data = LIBURING_UDATA_TWHEEL | 1;
+	}
+	w->armed_tick = tick;
+	w->need_arm = 0;
+}
+
+/* earliest pending tick: scan the level 0 lap, else the next cascade */
+static __u64 twheel_next_tick(struct io_uring_twheel *w)
+{
+	unsigned i;
+
+	for (i = 1; i < 64; i++) {
+		if (w->slots[0][(w->cur + i) & 63])
+			return w->cur + i;
+	}
+	return w->cur + 64 - (w->cur & 63);
+}
+
+static unsigned twheel_fire(struct io_uring_twheel *w, unsigned idx)
+{
+	struct io_uring_timer *t;
+	unsigned fired = 0;
+
+	while ((t = w->slots[0][idx])) {
+		w->slots[0][idx] = t->next;
+		if (t->next)
+			t->next->pprev = &w->slots[0][idx];
+		t->next = NULL;
+		t->pprev = NULL;
+		w->nr--;
+		fired++;
+		t->cb(w, t);
+	}
+	return fired;
+}
+
+static void twheel_cascade(struct io_uring_twheel *w, unsigned l)
+{
+	unsigned idx = (w->cur >> (6 * l)) & 63;
+	struct io_uring_timer *t, *next;
+
+	t = w->slots[l][idx];
+	w->slots[l][idx] = NULL;
+	for (; t; t = next) {
+		next = t->next;
+		twheel_file(w, t);
+	}
+	if (!idx && l < 3)
+		twheel_cascade(w, l + 1);
+}
+
+int io_uring_twheel_init(struct io_uring *ring, struct io_uring_twheel *w,
+			 __u64 tick_ns)
+{
+	memset(w, 0, sizeof(*w));
+	w->ring = ring;
+	w->tick_ns = tick_ns ? tick_ns : 1000000;
+	w->base_ns = uring_mono_ns();
+	return 0;
+}
+
+/*
+ * Start timer 't' (caller-owned, zero or previously fired/deleted) to
+ * run 'cb' in 'rel_ns' nanoseconds, rounded up to a full tick. Only when
+ * this deadline beats every armed one does it cost an sqe to re-aim the
+ * kernel timeout; re-arming an idle wheel posts the timeout itself.
+ */
+void io_uring_timer_add(struct io_uring_twheel *w, struct io_uring_timer *t,
+			__u64 rel_ns, io_uring_timer_fn cb, void *data)
+{
+	__u64 ticks = (rel_ns + w->tick_ns - 1) / w->tick_ns;
+
+	t->cb = cb;
+	t->data = data;
+	t->expire_tick = w->cur + (ticks ? ticks : 1);
+	twheel_file(w, t);
+	w->nr++;
+	if (!w->armed || t->expire_tick < w->armed_tick || w->need_arm)
+		twheel_arm(w, t->expire_tick);
+}
+
+/*
+ * Cancel a pending timer; a no-op if it already fired or was never
+ * added. Purely local - the kernel timeout is left alone and lazily
+ * re-aimed when it next fires, so cancellation costs no sqe.
+ */
+void io_uring_timer_del(struct io_uring_twheel *w, struct io_uring_timer *t)
+{
+	if (!t->pprev)
+		return;
+	*t->pprev = t->next;
+	if (t->next)
+		t->next->pprev = t->pprev;
+	t->next = NULL;
+	t->pprev = NULL;
+	w->nr--;
+}
+
+/*
+ * Advance the wheel to the current time, firing every due timer in
+ * batch, then re-aim the kernel timeout at the earliest survivor.
+ * Driven from io_uring_twheel_cqe() when the timeout fires; callers
+ * that sleep for long stretches outside CQ processing may also call it
+ * directly. Returns the number of timers fired.
+ */
+unsigned io_uring_twheel_run(struct io_uring_twheel *w)
+{
+	__u64 now_tick = (uring_mono_ns() - w->base_ns) / w->tick_ns;
+	unsigned fired = 0;
+
+	while (w->cur < now_tick) {
+		w->cur++;
+		if (!(w->cur & 63))
+			twheel_cascade(w, 1);
+		fired += twheel_fire(w, w->cur & 63);
+	}
+	if (w->nr) {
+		__u64 next = twheel_next_tick(w);
+
+		if (!w->armed || next < w->armed_tick || w->need_arm)
+			twheel_arm(w, next);
+	}
+	return fired;
+}
+
+/*
+ * Offer a reaped completion to the wheel. Consumes (returns 1 for) the
+ * wheel's own tagged cqes: the timeout firing runs the due timers and
+ * re-arms, update completions are simply dropped - a -ENOENT there just
+ * means the update raced the timeout firing, which the firing path
+ * already handled. Everything else returns 0 for the caller to handle.
+ */
+int io_uring_twheel_cqe(struct io_uring_twheel *w,
+			const struct io_uring_cqe *cqe)
+{
+	if ((cqe->user_data & (0xffffULL << 48)) != LIBURING_UDATA_TWHEEL)
+		return 0;
+	if (!(cqe->user_data & 1)) {
+		w->armed = 0;
+		io_uring_twheel_run(w);
+	}
+	return 1;
+}
+
+/*
+ * Tear down the wheel, staging a removal of the kernel timeout if one is
+ * armed. Pending timers are simply forgotten; their entries are the
+ * caller's memory.
+ */
+void io_uring_twheel_exit(struct io_uring_twheel *w)
+{
+	struct io_uring_sqe *sqe;
+
+	if (w->armed && (sqe = io_uring_get_sqe(w->ring)) != NULL) {
+		io_uring_prep_timeout_remove(sqe, LIBURING_UDATA_TWHEEL, 0);
+		sqe->user_data = LIBURING_UDATA_TWHEEL | 1;
+	}
+	w->armed = 0;
+	w->nr = 0;
+}
@@ -0,0 +1,31 @@
+/* SPDX-License-Identifier: MIT */
+#ifndef LIBURING_TRACE_H
+#define LIBURING_TRACE_H
+
+/*
+ * Static USDT tracepoints on the submit/enter/reap boundaries, for
+ * bpftrace and friends. Opt-in: build with `make USDT=1` (or define
+ * CONFIG_USDT) on a system with systemtap's <sys/sdt.h>. Unprobed
+ * probes are a single nop; without CONFIG_USDT they compile away
+ * entirely.
+ *
+ * Probes, all in the "liburing" provider:
+ *   sq_flush(ring_fd, nr_sqes)           sq tail published
+ *   enter(ring_fd, submit, wait_nr, flags)  before io_uring_enter
+ *   enter_done(ring_fd, ret)             after io_uring_enter
+ *   cq_advance(ring_fd, nr_cqes)         library-internal cq reap
+ *   msg_hop(ring_fd, target_fd, trace_id, data)  traced msg_ring staged
+ *   msg_recv(ring_fd, trace_id)          traced msg_ring cqe reaped
+ */
+#ifdef CONFIG_USDT
+#include <sys/sdt.h>
+#define URING_PROBE2(name, a, b)	\
+	DTRACE_PROBE2(liburing, name, a, b)
+#define URING_PROBE4(name, a, b, c, d)	\
+	DTRACE_PROBE4(liburing, name, a, b, c, d)
+#else
+#define URING_PROBE2(name, a, b)	do { } while (0)
+#define URING_PROBE4(name, a, b, c, d)	do { } while (0)
+#endif
+
+#endif
@@ -0,0 +1,167 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * Description: test the bulk statx engine - entries resolved relative
+ * to a ring-opened directory handle must report the right sizes, and
+ * completed slots must recycle for further jobs
+ *
+ */
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "liburing.h"
+#include "helpers.h"
+
+#define NR_FILES	5
+
+static int reap_one(struct io_uring *ring, struct io_uring_bstat *b)
+{
+	struct io_uring_cqe *cqe;
+	int ret, handled = 0;
+
+	ret = io_uring_submit_and_wait(ring, 1);
+	if (ret < 0) {
+		fprintf(stderr, "submit_and_wait: %d\n", ret);
+		return ret;
+	}
+	while (!io_uring_peek_cqe(ring, &cqe)) {
+		ret = io_uring_bstat_cqe(b, cqe);
+		if (!ret) {
+			fprintf(stderr, "foreign cqe %llx\n",
+				(unsigned long long) cqe->user_data);
+			return -EINVAL;
+		}
+		io_uring_cqe_seen(ring, cqe);
+		handled += ret == 2;
+	}
+	return handled;
+}
+
+int main(int argc, char *argv[])
+{
+	struct io_uring_bstat_job jobs[NR_FILES];
+	/* 0 unsubmitted, 1 in flight, 2 consumed */
+	int state[NR_FILES] = {};
+	struct io_uring_bstat b;
+	struct io_uring ring;
+	char dir[] = ".bstat-dir";
+	char path[64], names[NR_FILES][8];
+	int ret, i, dh, done;
+
+	if (argc > 1)
+		return T_EXIT_SKIP;
+
+	ret = io_uring_queue_init(16, &ring, 0);
+	if (ret) {
+		fprintf(stderr, "queue_init: %d\n", ret);
+		return T_EXIT_FAIL;
+	}
+
+	if (mkdir(dir, 0755) && errno != EEXIST) {
+		perror("mkdir");
+		return T_EXIT_FAIL;
+	}
+	for (i = 0; i < NR_FILES; i++) {
+		snprintf(names[i], sizeof(names[i]), "f%d", i);
+		snprintf(path, sizeof(path), "%s/%s", dir, names[i]);
+		t_create_file(path, (size_t) (i + 1) * 1024);
+	}
+
+	ret = io_uring_bstat_init(&ring, &b, 0, STATX_SIZE, 4, 2);
+	if (ret) {
+		fprintf(stderr, "bstat_init: %d\n", ret);
+		goto err;
+	}
+
+	dh = io_uring_bstat_opendir(&b, dir);
+	if (dh < 0) {
+		fprintf(stderr, "opendir: %d\n", dh);
+		goto err;
+	}
+	while (!(ret = io_uring_bstat_dir_ready(&b, dh))) {
+		if (reap_one(&ring, &b) < 0)
+			goto err;
+	}
+	if (ret != 1) {
+		/* ring-issued openat or statx unsupported */
+		if (ret == -EINVAL)
+			return T_EXIT_SKIP;
+		fprintf(stderr, "dir_ready: %d\n", ret);
+		goto err;
+	}
+
+	/* more jobs than slots, so completed slots must recycle */
+	done = 0;
+	i = 0;
+	while (done < NR_FILES) {
+		while (i < NR_FILES) {
+			jobs[i].name = names[i];
+			jobs[i].dir = dh;
+			jobs[i].res = INT_MIN;
+			ret = io_uring_bstat_stat(&b, &jobs[i]);
+			if (ret == -ENOSPC)
+				break;
+			if (ret) {
+				fprintf(stderr, "bstat_stat %d: %d\n", i, ret);
+				goto err;
+			}
+			state[i] = 1;
+			i++;
+		}
+		ret = reap_one(&ring, &b);
+		if (ret < 0)
+			goto err;
+		for (ret = 0; ret < i; ret++) {
+			const struct statx *stx;
+
+			if (state[ret] != 1 || jobs[ret].res == INT_MIN)
+				continue;
+			if (jobs[ret].res < 0) {
+				if (jobs[ret].res == -EINVAL)
+					return T_EXIT_SKIP;
+				fprintf(stderr, "job %d res %d\n", ret,
+					jobs[ret].res);
+				goto err;
+			}
+			stx = io_uring_bstat_result(&b, &jobs[ret]);
+			if (stx->stx_size != (__u64) (ret + 1) * 1024) {
+				fprintf(stderr, "job %d size %llu\n", ret,
+					(unsigned long long) stx->stx_size);
+				goto err;
+			}
+			io_uring_bstat_done(&b, &jobs[ret]);
+			state[ret] = 2;
+			done++;
+		}
+	}
+
+	ret = io_uring_bstat_closedir(&b, dh);
+	if (ret) {
+		fprintf(stderr, "closedir: %d\n", ret);
+		goto err;
+	}
+	/* consume the close completion so the handle slot recycles */
+	if (reap_one(&ring, &b) < 0)
+		goto err;
+
+	io_uring_bstat_exit(&b);
+	io_uring_queue_exit(&ring);
+	for (i = 0; i < NR_FILES; i++) {
+		snprintf(path, sizeof(path), "%s/%s", dir, names[i]);
+		unlink(path);
+	}
+	rmdir(dir);
+	return T_EXIT_PASS;
+err:
+	for (i = 0; i < NR_FILES; i++) {
+		snprintf(path, sizeof(path), "%s/%s", dir, names[i]);
+		unlink(path);
+	}
+	rmdir(dir);
+	return T_EXIT_FAIL;
+}
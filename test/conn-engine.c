@@ -0,0 +1,156 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * Description: test the multishot connection engine - a loopback client
+ * connects, sends data that must surface through the data callback, and
+ * its close must surface through the close callback
+ *
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#include "liburing.h"
+#include "helpers.h"
+
+#define MSG1	"hello, engine"
+#define MSG2	"second helping"
+
+static char rx_data[256];
+static unsigned rx_len;
+static int closed_conn = -1;
+static int close_res = -2;
+
+static void on_data(struct io_uring_conn_engine *ce, unsigned conn,
+		    void *data, unsigned len)
+{
+	if (rx_len + len <= sizeof(rx_data)) {
+		memcpy(rx_data + rx_len, data, len);
+		rx_len += len;
+	}
+}
+
+static void on_close(struct io_uring_conn_engine *ce, unsigned conn, int res)
+{
+	closed_conn = (int) conn;
+	close_res = res;
+}
+
+static int reap_some(struct io_uring *ring, struct io_uring_conn_engine *ce)
+{
+	struct __kernel_timespec ts = { .tv_sec = 5, };
+	struct io_uring_cqe *cqe;
+	int ret;
+
+	ret = io_uring_submit_and_wait_timeout(ring, &cqe, 1, &ts, NULL);
+	if (ret < 0)
+		return ret;
+	while (!io_uring_peek_cqe(ring, &cqe)) {
+		if (!io_uring_conn_cqe(ce, cqe)) {
+			fprintf(stderr, "foreign cqe %llx\n",
+				(unsigned long long) cqe->user_data);
+			return -EINVAL;
+		}
+		io_uring_cqe_seen(ring, cqe);
+	}
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	struct io_uring_conn_engine ce;
+	struct sockaddr_in addr;
+	struct io_uring ring;
+	int lfd, cfd, ret;
+
+	if (argc > 1)
+		return T_EXIT_SKIP;
+
+	ret = io_uring_queue_init(32, &ring, 0);
+	if (ret) {
+		fprintf(stderr, "queue_init: %d\n", ret);
+		return T_EXIT_FAIL;
+	}
+
+	lfd = socket(AF_INET, SOCK_STREAM, 0);
+	if (lfd < 0) {
+		perror("socket");
+		return T_EXIT_FAIL;
+	}
+	ret = t_bind_ephemeral_port(lfd, &addr);
+	if (ret) {
+		fprintf(stderr, "bind: %d\n", ret);
+		return T_EXIT_FAIL;
+	}
+	if (listen(lfd, 8) < 0) {
+		perror("listen");
+		return T_EXIT_FAIL;
+	}
+
+	ret = io_uring_conn_engine_init(&ring, &ce, lfd, 8, 8, 512, 7,
+					on_data, on_close, NULL);
+	if (ret) {
+		/* multishot accept/recv or buf rings unsupported */
+		if (ret == -EINVAL || ret == -ENOTSUP)
+			return T_EXIT_SKIP;
+		fprintf(stderr, "conn_engine_init: %d\n", ret);
+		return T_EXIT_FAIL;
+	}
+
+	cfd = socket(AF_INET, SOCK_STREAM, 0);
+	if (cfd < 0 || connect(cfd, (struct sockaddr *) &addr,
+			       sizeof(addr)) < 0) {
+		perror("connect");
+		return T_EXIT_FAIL;
+	}
+	if (write(cfd, MSG1, strlen(MSG1)) != (ssize_t) strlen(MSG1)) {
+		perror("write");
+		return T_EXIT_FAIL;
+	}
+
+	while (rx_len < strlen(MSG1)) {
+		ret = reap_some(&ring, &ce);
+		if (ret) {
+			fprintf(stderr, "reap: %d\n", ret);
+			return T_EXIT_FAIL;
+		}
+	}
+
+	/* a second message exercises buffer recycling */
+	if (write(cfd, MSG2, strlen(MSG2)) != (ssize_t) strlen(MSG2)) {
+		perror("write");
+		return T_EXIT_FAIL;
+	}
+	while (rx_len < strlen(MSG1) + strlen(MSG2)) {
+		ret = reap_some(&ring, &ce);
+		if (ret) {
+			fprintf(stderr, "reap: %d\n", ret);
+			return T_EXIT_FAIL;
+		}
+	}
+	if (memcmp(rx_data, MSG1 MSG2, rx_len)) {
+		fprintf(stderr, "data mismatch: %.*s\n", rx_len, rx_data);
+		return T_EXIT_FAIL;
+	}
+
+	close(cfd);
+	while (closed_conn < 0) {
+		ret = reap_some(&ring, &ce);
+		if (ret) {
+			fprintf(stderr, "reap close: %d\n", ret);
+			return T_EXIT_FAIL;
+		}
+	}
+	if (close_res != 0) {
+		fprintf(stderr, "close res %d\n", close_res);
+		return T_EXIT_FAIL;
+	}
+
+	io_uring_conn_engine_exit(&ce);
+	close(lfd);
+	io_uring_queue_exit(&ring);
+	return T_EXIT_PASS;
+}
@@ -0,0 +1,136 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * Description: test the short-transfer continuation engine - a recv
+ * armed for more bytes than are available must be continued
+ * transparently until the full transfer accumulates, and errors must
+ * pass through as final completions
+ *
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include "liburing.h"
+#include "helpers.h"
+
+#define TOTAL_LEN	48
+#define PART1		10
+#define PART2		(TOTAL_LEN - PART1)
+
+int main(int argc, char *argv[])
+{
+	struct io_uring_cont c;
+	struct io_uring_sqe *sqe;
+	struct io_uring_cqe *cqe;
+	struct io_uring ring;
+	char sbuf[TOTAL_LEN], rbuf[TOTAL_LEN];
+	__u64 total = 0;
+	int fds[2], ret, i, final = 0;
+
+	if (argc > 1)
+		return T_EXIT_SKIP;
+
+	ret = io_uring_queue_init(8, &ring, 0);
+	if (ret) {
+		fprintf(stderr, "queue_init: %d\n", ret);
+		return T_EXIT_FAIL;
+	}
+	ret = io_uring_cont_init(&ring, &c, 4);
+	if (ret) {
+		fprintf(stderr, "cont_init: %d\n", ret);
+		return T_EXIT_FAIL;
+	}
+	if (t_create_socket_pair(fds, true)) {
+		fprintf(stderr, "socket pair failed\n");
+		return T_EXIT_FAIL;
+	}
+	for (i = 0; i < TOTAL_LEN; i++)
+		sbuf[i] = (char) i;
+
+	/* only PART1 bytes are there: the recv must complete short */
+	if (write(fds[1], sbuf, PART1) != PART1) {
+		perror("write");
+		return T_EXIT_FAIL;
+	}
+
+	sqe = io_uring_get_sqe(&ring);
+	io_uring_prep_recv(sqe, fds[0], rbuf, TOTAL_LEN, 0);
+	sqe->user_data = 0xc0417;
+	ret = io_uring_cont_arm(&c, sqe);
+	if (ret < 0) {
+		fprintf(stderr, "cont_arm: %d\n", ret);
+		return T_EXIT_FAIL;
+	}
+
+	ret = io_uring_submit(&ring);
+	if (ret != 1) {
+		fprintf(stderr, "submit: %d\n", ret);
+		return T_EXIT_FAIL;
+	}
+
+	while (!final) {
+		ret = io_uring_wait_cqe(&ring, &cqe);
+		if (ret) {
+			fprintf(stderr, "wait_cqe: %d\n", ret);
+			return T_EXIT_FAIL;
+		}
+		ret = io_uring_cont_cqe(&c, cqe, &total);
+		io_uring_cqe_seen(&ring, cqe);
+		if (ret) {
+			/* continuation staged; feed the rest and resubmit */
+			if (write(fds[1], sbuf + PART1, PART2) != PART2) {
+				perror("write");
+				return T_EXIT_FAIL;
+			}
+			ret = io_uring_cont_submit(&c);
+			if (ret < 0) {
+				fprintf(stderr, "cont_submit: %d\n", ret);
+				return T_EXIT_FAIL;
+			}
+		} else {
+			final = 1;
+		}
+	}
+
+	if (total != TOTAL_LEN) {
+		fprintf(stderr, "accumulated %llu, expected %d\n",
+			(unsigned long long) total, TOTAL_LEN);
+		return T_EXIT_FAIL;
+	}
+	if (memcmp(rbuf, sbuf, TOTAL_LEN)) {
+		fprintf(stderr, "reassembled data mismatch\n");
+		return T_EXIT_FAIL;
+	}
+
+	/* peer gone: the engine must pass the EOF through as final */
+	close(fds[1]);
+	sqe = io_uring_get_sqe(&ring);
+	io_uring_prep_recv(sqe, fds[0], rbuf, TOTAL_LEN, 0);
+	sqe->user_data = 0xc0418;
+	ret = io_uring_cont_arm(&c, sqe);
+	if (ret < 0) {
+		fprintf(stderr, "cont_arm eof: %d\n", ret);
+		return T_EXIT_FAIL;
+	}
+	io_uring_submit(&ring);
+	ret = io_uring_wait_cqe(&ring, &cqe);
+	if (ret) {
+		fprintf(stderr, "wait_cqe eof: %d\n", ret);
+		return T_EXIT_FAIL;
+	}
+	total = (__u64) -1;
+	if (io_uring_cont_cqe(&c, cqe, &total) || cqe->res != 0 || total) {
+		fprintf(stderr, "eof mishandled: res %d total %llu\n",
+			cqe->res, (unsigned long long) total);
+		return T_EXIT_FAIL;
+	}
+	io_uring_cqe_seen(&ring, cqe);
+
+	io_uring_cont_exit(&c);
+	close(fds[0]);
+	io_uring_queue_exit(&ring);
+	return T_EXIT_PASS;
+}
@@ -0,0 +1,122 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * Description: test the async copy engine - copy a patterned file with
+ * a tail block shorter than the block size and verify the destination
+ * matches byte for byte, with progress reported monotonically
+ *
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "liburing.h"
+#include "helpers.h"
+
+#define COPY_LEN	(300 * 1024 + 123)
+#define COPY_BS		16384
+#define DEPTH		4
+
+static __u64 last_progress;
+static int progress_bad;
+
+static void progress(struct io_uring_copy *cp, __u64 copied)
+{
+	if (copied <= last_progress)
+		progress_bad = 1;
+	last_progress = copied;
+}
+
+int main(int argc, char *argv[])
+{
+	struct io_uring_copy cp;
+	struct io_uring ring;
+	char src[] = ".copy-engine-src", dst[] = ".copy-engine-dst";
+	char *sbuf, *dbuf;
+	int sfd, dfd, ret, done = 0;
+
+	if (argc > 1)
+		return T_EXIT_SKIP;
+
+	ret = io_uring_queue_init(2 * DEPTH, &ring, 0);
+	if (ret) {
+		fprintf(stderr, "queue_init: %d\n", ret);
+		return T_EXIT_FAIL;
+	}
+
+	t_create_file_pattern(src, COPY_LEN, 0x5a);
+	sfd = open(src, O_RDONLY);
+	dfd = open(dst, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (sfd < 0 || dfd < 0) {
+		perror("open");
+		goto err;
+	}
+
+	ret = io_uring_copy_file_range_async(&ring, &cp, sfd, 0, dfd, 0,
+					     COPY_LEN, DEPTH, COPY_BS,
+					     progress, NULL);
+	if (ret) {
+		fprintf(stderr, "copy_file_range_async: %d\n", ret);
+		goto err;
+	}
+
+	while (!done) {
+		struct io_uring_cqe *cqe;
+
+		ret = io_uring_submit_and_wait(&ring, 1);
+		if (ret < 0) {
+			fprintf(stderr, "submit_and_wait: %d\n", ret);
+			goto err;
+		}
+		while (!io_uring_peek_cqe(&ring, &cqe)) {
+			ret = io_uring_copy_cqe(&cp, cqe);
+			if (!ret) {
+				fprintf(stderr, "foreign cqe %llx\n",
+					(unsigned long long) cqe->user_data);
+				goto err;
+			}
+			io_uring_cqe_seen(&ring, cqe);
+			if (ret == 2)
+				done = 1;
+		}
+	}
+
+	if (cp.err || cp.done != COPY_LEN) {
+		fprintf(stderr, "copy err %d done %llu\n", cp.err,
+			(unsigned long long) cp.done);
+		goto err;
+	}
+	if (progress_bad || last_progress != COPY_LEN) {
+		fprintf(stderr, "progress misreported\n");
+		goto err;
+	}
+	io_uring_copy_exit(&cp);
+
+	sbuf = t_malloc(COPY_LEN);
+	dbuf = t_malloc(COPY_LEN);
+	if (pread(sfd, sbuf, COPY_LEN, 0) != COPY_LEN)
+		goto err;
+	close(dfd);
+	dfd = open(dst, O_RDONLY);
+	if (dfd < 0 || pread(dfd, dbuf, COPY_LEN, 0) != COPY_LEN)
+		goto err;
+	if (memcmp(sbuf, dbuf, COPY_LEN)) {
+		fprintf(stderr, "destination differs from source\n");
+		goto err;
+	}
+
+	free(sbuf);
+	free(dbuf);
+	close(sfd);
+	close(dfd);
+	unlink(src);
+	unlink(dst);
+	io_uring_queue_exit(&ring);
+	return T_EXIT_PASS;
+err:
+	unlink(src);
+	unlink(dst);
+	return T_EXIT_FAIL;
+}
@@ -0,0 +1,180 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * Description: quantify CQ overflow handling under sustained NOP floods.
+ *
+ * cq-overflow.c checks that overflowed completions survive; this drives
+ * the overflow machinery hard enough to measure it. Each case floods
+ * NOPs at a fixed submit:reap ratio against a CQ sized by a multiplier
+ * of the SQ, so ratios above the multiplier force the kernel onto the
+ * overflow list and every getevents pays the flush that
+ * cq_ring_needs_flush() advertises. Per case we count overflow
+ * episodes, average the cost of the flushing enter, and time how long
+ * draining back to an empty overflow list takes - and verify that not
+ * a single CQE went missing on the way.
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "helpers.h"
+#include "liburing.h"
+
+#define ENTRIES		32
+#define LOOPS		256
+
+static int no_nodrop;
+
+static unsigned long long mono_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int submit_nops(struct io_uring *ring, unsigned nr)
+{
+	struct io_uring_sqe *sqe;
+	unsigned i;
+	int ret;
+
+	for (i = 0; i < nr; i++) {
+		sqe = io_uring_get_sqe(ring);
+		if (!sqe)
+			break;
+		io_uring_prep_nop(sqe);
+	}
+	ret = io_uring_submit(ring);
+	if (ret < 0) {
+		fprintf(stderr, "submit failed: %d\n", ret);
+		return ret;
+	}
+	return ret;
+}
+
+static unsigned reap(struct io_uring *ring, unsigned max)
+{
+	struct io_uring_cqe *cqe;
+	unsigned reaped = 0;
+	unsigned head;
+
+	io_uring_for_each_cqe(ring, head, cqe) {
+		if (cqe->res) {
+			fprintf(stderr, "nop res %d\n", cqe->res);
+			exit(T_EXIT_FAIL);
+		}
+		if (++reaped == max)
+			break;
+	}
+	io_uring_cq_advance(ring, reaped);
+	return reaped;
+}
+
+/*
+ * Submit 'ratio' SQ-sized batches of NOPs per reap of one batch, LOOPS
+ * times, then drain. With ratio > cq_mult the CQ can't keep up and the
+ * kernel overflows; the drain at the end is what flushes it back.
+ */
+static int test_ratio(unsigned ratio, unsigned cq_mult)
+{
+	unsigned long long flush_ns = 0, drain_t0, drain_ns = 0;
+	unsigned long long submitted = 0, reaped = 0;
+	unsigned overflows = 0, flushes = 0;
+	struct io_uring_params p = { };
+	struct io_uring ring;
+	unsigned i, j;
+	int ret;
+
+	p.flags = IORING_SETUP_CQSIZE;
+	p.cq_entries = ENTRIES * cq_mult;
+	ret = io_uring_queue_init_params(ENTRIES, &ring, &p);
+	if (ret) {
+		fprintf(stderr, "ring setup failed: %d\n", ret);
+		return T_EXIT_FAIL;
+	}
+	if (!(p.features & IORING_FEAT_NODROP)) {
+		no_nodrop = 1;
+		io_uring_queue_exit(&ring);
+		return T_EXIT_SKIP;
+	}
+
+	for (i = 0; i < LOOPS; i++) {
+		for (j = 0; j < ratio; j++) {
+			ret = submit_nops(&ring, ENTRIES);
+			if (ret < 0)
+				goto err;
+			submitted += ret;
+		}
+		if (io_uring_cq_has_overflow(&ring)) {
+			unsigned long long t0 = mono_ns();
+
+			overflows++;
+			/* pay the flushing enter and price it */
+			ret = io_uring_get_events(&ring);
+			if (ret < 0)
+				goto err;
+			flush_ns += mono_ns() - t0;
+			flushes++;
+		}
+		reaped += reap(&ring, ENTRIES);
+	}
+
+	/* recovery: drain until the overflow list is provably empty */
+	drain_t0 = mono_ns();
+	while (reaped < submitted) {
+		if (io_uring_cq_has_overflow(&ring)) {
+			ret = io_uring_get_events(&ring);
+			if (ret < 0)
+				goto err;
+		}
+		ret = reap(&ring, -1U);
+		if (!ret && !io_uring_cq_has_overflow(&ring))
+			break;
+		reaped += ret;
+	}
+	drain_ns = mono_ns() - drain_t0;
+
+	io_uring_queue_exit(&ring);
+	if (reaped != submitted) {
+		fprintf(stderr, "lost CQEs: submitted %llu reaped %llu "
+			"(ratio %u, cq_mult %u)\n", submitted, reaped,
+			ratio, cq_mult);
+		return T_EXIT_FAIL;
+	}
+	printf("ratio=%u cq_mult=%u nops=%llu overflows=%u "
+	       "flush_avg_ns=%llu drain_ns=%llu\n", ratio, cq_mult,
+	       submitted, overflows, flushes ? flush_ns / flushes : 0,
+	       drain_ns);
+	return T_EXIT_PASS;
+err:
+	io_uring_queue_exit(&ring);
+	return T_EXIT_FAIL;
+}
+
+int main(int argc, char *argv[])
+{
+	static const unsigned ratios[] = { 1, 2, 4, 8 };
+	static const unsigned cq_mults[] = { 1, 2, 4 };
+	unsigned i, j;
+	int ret;
+
+	if (argc > 1)
+		return T_EXIT_SKIP;
+
+	for (i = 0; i < ARRAY_SIZE(ratios); i++) {
+		for (j = 0; j < ARRAY_SIZE(cq_mults); j++) {
+			ret = test_ratio(ratios[i], cq_mults[j]);
+			if (ret == T_EXIT_FAIL) {
+				fprintf(stderr, "test_ratio %u/%u failed\n",
+					ratios[i], cq_mults[j]);
+				return T_EXIT_FAIL;
+			}
+			if (ret == T_EXIT_SKIP && no_nodrop)
+				return T_EXIT_SKIP;
+		}
+	}
+	return T_EXIT_PASS;
+}
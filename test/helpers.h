@@ -93,7 +93,7 @@ static inline int t_io_uring_init_sqarray(unsigned entries, struct io_uring *rin
 {
 	int ret;
 
-	ret = __io_uring_queue_init_params(entries, ring, p, NULL, 0);
+	ret = __io_uring_queue_init_params(entries, ring, p, NULL, 0, 0);
 	return ret >= 0 ? 0 : ret;
 }
 
@@ -0,0 +1,146 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * Description: test multi-consumer CQ claims via io_uring_mc_claim -
+ * four threads race to claim batches of nop completions and every cqe
+ * must surface exactly once
+ *
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "liburing.h"
+#include "helpers.h"
+
+#define NR_THREADS	4
+#define NR_ROUNDS	32
+#define PER_ROUND	2048
+#define NR_CQES		(NR_ROUNDS * PER_ROUND)
+#define CLAIM_BATCH	17
+
+static unsigned char seen[NR_CQES];
+static unsigned claimed;
+static int done;
+
+struct consumer {
+	struct io_uring_mc_cq *mc;
+	pthread_t thread;
+	int bad;
+};
+
+static void *consumer_fn(void *data)
+{
+	struct io_uring_cqe cqes[CLAIM_BATCH];
+	struct consumer *c = data;
+	int i, n;
+
+	while (!__atomic_load_n(&done, __ATOMIC_ACQUIRE)) {
+		n = io_uring_mc_claim(c->mc, cqes, CLAIM_BATCH);
+		if (n < 0) {
+			fprintf(stderr, "mc_claim: %d\n", n);
+			c->bad = 1;
+			break;
+		}
+		if (!n)
+			continue;
+		for (i = 0; i < n; i++) {
+			if (cqes[i].user_data >= NR_CQES ||
+			    __sync_fetch_and_add(&seen[cqes[i].user_data], 1)) {
+				fprintf(stderr, "cqe %llu claimed twice\n",
+					(unsigned long long) cqes[i].user_data);
+				c->bad = 1;
+			}
+		}
+		__sync_fetch_and_add(&claimed, n);
+	}
+
+	return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+	struct consumer cons[NR_THREADS] = { };
+	struct io_uring_mc_cq mc;
+	struct io_uring_sqe *sqe;
+	struct io_uring ring;
+	unsigned long long udata = 0;
+	int i, round, ret, bad = 0;
+
+	if (argc > 1)
+		return T_EXIT_SKIP;
+
+	ret = io_uring_queue_init(PER_ROUND / 2, &ring, 0);
+	if (ret) {
+		fprintf(stderr, "ring setup failed: %d\n", ret);
+		return T_EXIT_FAIL;
+	}
+	ret = io_uring_mc_init(&ring, &mc);
+	if (ret) {
+		fprintf(stderr, "mc_init: %d\n", ret);
+		return T_EXIT_FAIL;
+	}
+
+	for (i = 0; i < NR_THREADS; i++) {
+		cons[i].mc = &mc;
+		pthread_create(&cons[i].thread, NULL, consumer_fn, &cons[i]);
+	}
+
+	/*
+	 * Each round fits the cq exactly, so waiting for the claim count
+	 * to catch up before refilling rules out overflow while keeping
+	 * all four claimants racing on a full ring.
+	 */
+	for (round = 0; round < NR_ROUNDS; round++) {
+		for (i = 0; i < PER_ROUND; i++) {
+			sqe = io_uring_get_sqe(&ring);
+			if (!sqe) {
+				ret = io_uring_submit(&ring);
+				if (ret < 0) {
+					fprintf(stderr, "submit: %d\n", ret);
+					goto err;
+				}
+				sqe = io_uring_get_sqe(&ring);
+			}
+			io_uring_prep_nop(sqe);
+			sqe->user_data = udata++;
+		}
+		ret = io_uring_submit(&ring);
+		if (ret < 0) {
+			fprintf(stderr, "submit: %d\n", ret);
+			goto err;
+		}
+		while (__atomic_load_n(&claimed, __ATOMIC_ACQUIRE) <
+		       (round + 1U) * PER_ROUND)
+			usleep(100);
+	}
+
+	__atomic_store_n(&done, 1, __ATOMIC_RELEASE);
+	for (i = 0; i < NR_THREADS; i++) {
+		pthread_join(cons[i].thread, NULL);
+		bad |= cons[i].bad;
+	}
+
+	for (i = 0; i < NR_CQES; i++) {
+		if (seen[i] != 1) {
+			fprintf(stderr, "cqe %d seen %d times\n", i, seen[i]);
+			bad = 1;
+			break;
+		}
+	}
+	if (io_uring_cq_ready(&ring)) {
+		fprintf(stderr, "cq not drained after full claim\n");
+		bad = 1;
+	}
+
+	io_uring_queue_exit(&ring);
+	return bad ? T_EXIT_FAIL : T_EXIT_PASS;
+err:
+	__atomic_store_n(&done, 1, __ATOMIC_RELEASE);
+	for (i = 0; i < NR_THREADS; i++)
+		pthread_join(cons[i].thread, NULL);
+	io_uring_queue_exit(&ring);
+	return T_EXIT_FAIL;
+}
@@ -0,0 +1,126 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * Description: test the read-ahead orchestrator - probe reads must
+ * complete with the right data whether the probe hits the page cache
+ * or punts to the fallback read, and the stats must account for every
+ * probe
+ *
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "liburing.h"
+#include "helpers.h"
+
+#define FILE_LEN	(256 * 1024)
+#define READ_LEN	8192
+#define NR_READS	8
+
+int main(int argc, char *argv[])
+{
+	struct io_uring_ra_op ops[NR_READS];
+	struct io_uring ring;
+	struct io_uring_ra ra;
+	char bufs[NR_READS][READ_LEN];
+	char file[] = ".ra-probe";
+	int fd, ret, i, pending;
+
+	if (argc > 1)
+		return T_EXIT_SKIP;
+
+	ret = io_uring_queue_init(32, &ring, 0);
+	if (ret) {
+		fprintf(stderr, "queue_init: %d\n", ret);
+		return T_EXIT_FAIL;
+	}
+
+	t_create_file_pattern(file, FILE_LEN, 0x3c);
+	fd = open(file, O_RDONLY);
+	if (fd < 0) {
+		perror("open");
+		goto err;
+	}
+
+	ret = io_uring_ra_init(&ring, &ra, NR_READS, NULL, NULL);
+	if (ret) {
+		fprintf(stderr, "ra_init: %d\n", ret);
+		goto err;
+	}
+
+	for (i = 0; i < NR_READS; i++) {
+		ret = io_uring_ra_read(&ra, &ops[i], fd, bufs[i], READ_LEN,
+				       (__u64) i * READ_LEN);
+		if (ret) {
+			fprintf(stderr, "ra_read %d: %d\n", i, ret);
+			goto err;
+		}
+	}
+
+	pending = NR_READS;
+	while (pending) {
+		struct io_uring_cqe *cqe;
+
+		ret = io_uring_submit_and_wait(&ring, 1);
+		if (ret < 0) {
+			fprintf(stderr, "submit_and_wait: %d\n", ret);
+			goto err;
+		}
+		while (!io_uring_peek_cqe(&ring, &cqe)) {
+			ret = io_uring_ra_cqe(&ra, cqe);
+			if (!ret) {
+				fprintf(stderr, "foreign cqe %llx\n",
+					(unsigned long long) cqe->user_data);
+				goto err;
+			}
+			io_uring_cqe_seen(&ring, cqe);
+			if (ret == 2)
+				pending--;
+		}
+	}
+
+	for (i = 0; i < NR_READS; i++) {
+		int j;
+
+		/* filesystems without RWF_NOWAIT fail the probes outright */
+		if (ops[i].res == -EOPNOTSUPP || ops[i].res == -EINVAL)
+			return T_EXIT_SKIP;
+		if (ops[i].res != READ_LEN) {
+			fprintf(stderr, "op %d res %d\n", i, ops[i].res);
+			goto err;
+		}
+		for (j = 0; j < READ_LEN; j++) {
+			if (bufs[i][j] != 0x3c) {
+				fprintf(stderr, "op %d bad data\n", i);
+				goto err;
+			}
+		}
+	}
+
+	if (ra.stats.probes != NR_READS ||
+	    ra.stats.hits + ra.stats.misses != NR_READS) {
+		fprintf(stderr, "stats: probes %llu hits %llu misses %llu\n",
+			(unsigned long long) ra.stats.probes,
+			(unsigned long long) ra.stats.hits,
+			(unsigned long long) ra.stats.misses);
+		goto err;
+	}
+	/* every miss must have punted to a fallback read or a hint */
+	if (ra.stats.misses &&
+	    ra.stats.fallbacks + ra.stats.hints < ra.stats.misses) {
+		fprintf(stderr, "misses unpunted\n");
+		goto err;
+	}
+
+	io_uring_ra_exit(&ra);
+	close(fd);
+	unlink(file);
+	io_uring_queue_exit(&ring);
+	return T_EXIT_PASS;
+err:
+	unlink(file);
+	return T_EXIT_FAIL;
+}
@@ -0,0 +1,125 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * Description: test that io_uring_queue_exit() drops stale per-ring
+ * registry entries - a re-initialized ring at the same address must not
+ * inherit wait ops, watchdogs or batch policies from the dead ring, and
+ * repeated register/exit cycles without explicit teardown must not
+ * exhaust the registry slots
+ *
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "liburing.h"
+#include "helpers.h"
+
+static int test_stale_drop(struct io_uring *ring)
+{
+	struct io_uring_taskrun_stats st;
+	struct __kernel_timespec interval = { .tv_sec = 1, };
+	struct io_uring_cqe *cqe;
+	struct io_uring_sqe *sqe;
+	int ret;
+
+	ret = io_uring_queue_init(8, ring, 0);
+	if (ret) {
+		fprintf(stderr, "queue_init: %d\n", ret);
+		return T_EXIT_FAIL;
+	}
+	ret = io_uring_set_taskrun_batch(ring, 4, 0);
+	if (ret) {
+		fprintf(stderr, "set_taskrun_batch: %d\n", ret);
+		return T_EXIT_FAIL;
+	}
+	ret = io_uring_set_wait_ops(ring, &io_uring_wait_ops_yield);
+	if (ret) {
+		fprintf(stderr, "set_wait_ops: %d\n", ret);
+		return T_EXIT_FAIL;
+	}
+	ret = io_uring_watchdog_arm(ring, &interval, 0, NULL, NULL);
+	if (ret) {
+		fprintf(stderr, "watchdog_arm: %d\n", ret);
+		return T_EXIT_FAIL;
+	}
+
+	/* no disarm, no unregister: exit alone must drop the slots */
+	io_uring_queue_exit(ring);
+
+	ret = io_uring_queue_init(8, ring, 0);
+	if (ret) {
+		fprintf(stderr, "queue_init reuse: %d\n", ret);
+		return T_EXIT_FAIL;
+	}
+	ret = io_uring_taskrun_batch_stats(ring, &st);
+	if (ret != -ENOENT) {
+		fprintf(stderr, "stale taskrun batch survived: %d\n", ret);
+		return T_EXIT_FAIL;
+	}
+	ret = io_uring_watchdog_check(ring);
+	if (ret != -ENOENT) {
+		fprintf(stderr, "stale watchdog survived: %d\n", ret);
+		return T_EXIT_FAIL;
+	}
+
+	sqe = io_uring_get_sqe(ring);
+	io_uring_prep_nop(sqe);
+	ret = io_uring_submit(ring);
+	if (ret != 1) {
+		fprintf(stderr, "submit: %d\n", ret);
+		return T_EXIT_FAIL;
+	}
+	ret = io_uring_wait_cqe(ring, &cqe);
+	if (ret) {
+		fprintf(stderr, "wait_cqe: %d\n", ret);
+		return T_EXIT_FAIL;
+	}
+	io_uring_cqe_seen(ring, cqe);
+	io_uring_queue_exit(ring);
+	return T_EXIT_PASS;
+}
+
+static int test_no_slot_leak(struct io_uring *ring)
+{
+	int i, ret;
+
+	/* several times past the 8-slot registry caps */
+	for (i = 0; i < 32; i++) {
+		ret = io_uring_queue_init(8, ring, 0);
+		if (ret) {
+			fprintf(stderr, "queue_init %d: %d\n", i, ret);
+			return T_EXIT_FAIL;
+		}
+		ret = io_uring_set_taskrun_batch(ring, 4, 0);
+		if (!ret)
+			ret = io_uring_set_wait_ops(ring,
+						    &io_uring_wait_ops_yield);
+		if (!ret)
+			ret = io_uring_set_throttle(ring, IORING_OP_NOP,
+						    1000, 10);
+		if (!ret)
+			ret = io_uring_state_track(ring);
+		if (ret) {
+			fprintf(stderr, "register cycle %d leaked: %d\n",
+				i, ret);
+			return T_EXIT_FAIL;
+		}
+		io_uring_queue_exit(ring);
+	}
+	return T_EXIT_PASS;
+}
+
+int main(int argc, char *argv[])
+{
+	struct io_uring ring;
+	int ret;
+
+	if (argc > 1)
+		return T_EXIT_SKIP;
+
+	ret = test_stale_drop(&ring);
+	if (ret != T_EXIT_PASS)
+		return ret;
+	return test_no_slot_leak(&ring);
+}
@@ -0,0 +1,269 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * Description: test the ring-native DNS resolver engine - well-formed,
+ * NXDOMAIN and truncated (tcp fallback) responses, plus malformed wire
+ * data that must fail cleanly rather than over-read
+ *
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+
+#include "liburing.h"
+#include "helpers.h"
+
+enum {
+	MODE_A2,	/* two A records */
+	MODE_NX,	/* NXDOMAIN */
+	MODE_BADTXID,	/* txid flipped */
+	MODE_PTREND,	/* compression pointer as the packet's last byte */
+	MODE_RDOVER,	/* rdlen overrunning the packet */
+	MODE_TC,	/* truncated; full answer served over tcp */
+	MODE_NR
+};
+
+static int udp_srv, tcp_srv;
+
+static int mk_resp(const unsigned char *q, int qlen, unsigned char *out,
+		   int mode)
+{
+	static const unsigned char rr[] = { 0xc0, 0x0c, 0, 1, 0, 1,
+					    0, 0, 0, 60, 0, 4 };
+	int len = qlen, nr_a = 0, i;
+
+	memcpy(out, q, qlen);
+	out[2] |= 0x80;		/* QR */
+	switch (mode) {
+	case MODE_A2:
+		nr_a = 2;
+		break;
+	case MODE_NX:
+		out[3] = (out[3] & 0xf0) | 3;
+		break;
+	case MODE_BADTXID:
+		out[0] ^= 0xff;
+		nr_a = 1;
+		break;
+	case MODE_PTREND:
+		out[6] = 0;
+		out[7] = 1;
+		/* a name that is half a compression pointer, then EOF */
+		out[len++] = 0xc0;
+		return len;
+	case MODE_RDOVER:
+		out[6] = 0;
+		out[7] = 1;
+		memcpy(out + len, rr, sizeof(rr));
+		out[len + 11] = 200;	/* claims 200 rdata bytes, has 4 */
+		len += sizeof(rr);
+		out[len++] = 127;
+		out[len++] = 0;
+		out[len++] = 0;
+		out[len++] = 1;
+		return len;
+	case MODE_TC:
+		out[2] |= 0x02;
+		break;
+	}
+	out[6] = 0;
+	out[7] = nr_a;
+	for (i = 0; i < nr_a; i++) {
+		memcpy(out + len, rr, sizeof(rr));
+		len += sizeof(rr);
+		out[len++] = 10;
+		out[len++] = 0;
+		out[len++] = 0;
+		out[len++] = i + 1;
+	}
+	return len;
+}
+
+static void responder(void)
+{
+	unsigned char q[512], r[1024];
+	struct sockaddr_in cli;
+	socklen_t cl;
+	int mode, n, len;
+
+	for (mode = 0; mode < MODE_NR; mode++) {
+		cl = sizeof(cli);
+		n = recvfrom(udp_srv, q, sizeof(q), 0, (void *) &cli, &cl);
+		if (n <= 0)
+			return;
+		len = mk_resp(q, n, r, mode);
+		sendto(udp_srv, r, len, 0, (void *) &cli, cl);
+	}
+
+	/* the MODE_TC retry arrives length-prefixed over tcp */
+	n = accept(tcp_srv, NULL, NULL);
+	if (n >= 0) {
+		unsigned char pfx[2];
+		int c = n, qlen;
+
+		if (read(c, pfx, 2) != 2)
+			goto out;
+		qlen = pfx[0] << 8 | pfx[1];
+		if (read(c, q, qlen) != qlen)
+			goto out;
+		len = mk_resp(q, qlen, r + 2, MODE_A2);
+		r[0] = len >> 8;
+		r[1] = len;
+		if (write(c, r, len + 2) != len + 2)
+			fprintf(stderr, "responder tcp write failed\n");
+out:
+		close(c);
+	}
+}
+
+static int drive(struct io_uring *ring, struct io_uring_resolver *rv)
+{
+	struct __kernel_timespec to = { .tv_sec = 5 };
+	struct io_uring_cqe *cqe;
+	int ret;
+
+	for (;;) {
+		ret = io_uring_submit(ring);
+		if (ret < 0)
+			return ret;
+		ret = io_uring_wait_cqe_timeout(ring, &cqe, &to);
+		if (ret)
+			return ret;
+		ret = io_uring_resolver_cqe(rv, cqe);
+		io_uring_cqe_seen(ring, cqe);
+		if (ret <= 0) {
+			fprintf(stderr, "resolver_cqe %d\n", ret);
+			return ret ? ret : -EINVAL;
+		}
+		if (ret == 2)
+			return 0;
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	static const int exp_res[MODE_NR] = {
+		[MODE_A2]	= 2,
+		[MODE_NX]	= -ENOENT,
+		[MODE_BADTXID]	= -EIO,
+		[MODE_PTREND]	= -EIO,
+		[MODE_RDOVER]	= -EIO,
+		[MODE_TC]	= 2,
+	};
+	struct __kernel_timespec to = { .tv_sec = 3 };
+	struct io_uring_resolver_job job;
+	struct io_uring_resolver rv;
+	struct sockaddr_in saddr;
+	socklen_t sl = sizeof(saddr);
+	struct io_uring ring;
+	int mode, udp_cli, ret, one = 1;
+	pid_t pid;
+
+	if (argc > 1)
+		return T_EXIT_SKIP;
+
+	udp_srv = socket(AF_INET, SOCK_DGRAM, 0);
+	memset(&saddr, 0, sizeof(saddr));
+	saddr.sin_family = AF_INET;
+	saddr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (bind(udp_srv, (void *) &saddr, sizeof(saddr)) ||
+	    getsockname(udp_srv, (void *) &saddr, &sl)) {
+		perror("bind udp");
+		return T_EXIT_FAIL;
+	}
+	tcp_srv = socket(AF_INET, SOCK_STREAM, 0);
+	setsockopt(tcp_srv, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+	if (bind(tcp_srv, (void *) &saddr, sizeof(saddr)) ||
+	    listen(tcp_srv, 4)) {
+		perror("bind tcp");
+		return T_EXIT_FAIL;
+	}
+	udp_cli = socket(AF_INET, SOCK_DGRAM, 0);
+	if (connect(udp_cli, (void *) &saddr, sizeof(saddr))) {
+		perror("connect udp");
+		return T_EXIT_FAIL;
+	}
+
+	pid = fork();
+	if (pid < 0) {
+		perror("fork");
+		return T_EXIT_FAIL;
+	}
+	if (!pid) {
+		responder();
+		_exit(0);
+	}
+
+	ret = io_uring_queue_init(32, &ring, 0);
+	if (ret) {
+		fprintf(stderr, "ring setup failed: %d\n", ret);
+		return T_EXIT_FAIL;
+	}
+	ret = io_uring_resolver_init(&ring, &rv, udp_cli,
+				     (void *) &saddr, sizeof(saddr), &to, 4);
+	if (ret) {
+		fprintf(stderr, "resolver init: %d\n", ret);
+		return T_EXIT_FAIL;
+	}
+
+	/* names the builder must reject before anything hits the wire */
+	job.name = "";
+	job.family = AF_INET;
+	if (io_uring_resolve(&rv, &job) != -EINVAL) {
+		fprintf(stderr, "empty name accepted\n");
+		goto err;
+	}
+	job.name = "ok";
+	job.family = AF_UNIX;
+	if (io_uring_resolve(&rv, &job) != -EINVAL) {
+		fprintf(stderr, "bad family accepted\n");
+		goto err;
+	}
+
+	for (mode = 0; mode < MODE_NR; mode++) {
+		job.name = "host.example.com";
+		job.family = AF_INET;
+		ret = io_uring_resolve(&rv, &job);
+		if (ret) {
+			fprintf(stderr, "resolve mode %d: %d\n", mode, ret);
+			goto err;
+		}
+		ret = drive(&ring, &rv);
+		if (ret) {
+			fprintf(stderr, "drive mode %d: %d\n", mode, ret);
+			goto err;
+		}
+		if (job.res != exp_res[mode]) {
+			fprintf(stderr, "mode %d: res %d, expected %d\n",
+				mode, job.res, exp_res[mode]);
+			goto err;
+		}
+		if (job.res > 0 && (job.nr_addrs != (unsigned) job.res ||
+				    job.addr_len != 4 ||
+				    job.addrs[0][0] != 10 ||
+				    job.addrs[job.nr_addrs - 1][3] !=
+				    job.nr_addrs)) {
+			fprintf(stderr, "mode %d: bad addresses\n", mode);
+			goto err;
+		}
+	}
+
+	if (rv.free_nr != 4) {
+		fprintf(stderr, "slots leaked: %u of 4 free\n", rv.free_nr);
+		goto err;
+	}
+
+	waitpid(pid, &ret, 0);
+	io_uring_resolver_exit(&rv);
+	io_uring_queue_exit(&ring);
+	return T_EXIT_PASS;
+err:
+	kill(pid, 9);
+	io_uring_resolver_exit(&rv);
+	io_uring_queue_exit(&ring);
+	return T_EXIT_FAIL;
+}
@@ -0,0 +1,121 @@
+#!/usr/bin/env bash
+#
+# Class-aware parallel test runner. Plain parallel make (runtests-parallel)
+# races tests that share a machine-wide resource: loopback port binders
+# trip over each other, scratch-file writers saturate the disk and time
+# each other out, and device passthrough tests cannot share a namespace at
+# all. Each test is assigned a resource class and the scheduler only
+# co-runs tests whose classes allow it:
+#
+#   net   - binds loopback ports/addresses; one at a time
+#   disk  - heavy scratch-file I/O; limited concurrency
+#   dev   - runs against TEST_FILES/TEST_MAP devices; one at a time
+#   any   - self-contained; one slot per CPU
+#
+# The class lists can be extended from config.local by appending to
+# NET_TESTS/DISK_TESTS/DEV_TESTS before this script classifies.
+
+TESTS=("$@")
+TEST_DIR=$(dirname "$0")
+cd "$TEST_DIR" || exit 1
+
+JOBS=$(nproc 2>/dev/null || echo 4)
+DISK_SLOTS=4
+
+# Name patterns per class; first match wins, anything unmatched is 'any'.
+NET_TESTS="accept* bind* connect* listen* recv* send* shutdown* socket* napi* *msg*sock* version"
+DISK_TESTS="*file* *write* *read* *fsync* *fallocate* openat* open-* statx* *splice* truncate* ftruncate* xattr* *o-direct* io_uring_passthrough* fixed-link* link_drain*"
+DEV_TESTS=""
+
+declare -A TEST_MAP
+if [ -f "config.local" ]; then
+	# shellcheck source=/dev/null disable=SC1091
+	. "config.local"
+fi
+
+classify()
+{
+	local tst="$1" pat
+
+	if [ -n "${TEST_MAP[$tst]}" ] || [ -n "$TEST_FILES" ]; then
+		for pat in $DEV_TESTS; do
+			# shellcheck disable=SC2254
+			case "$tst" in ($pat) echo dev; return;; esac
+		done
+	fi
+	[ -n "${TEST_MAP[$tst]}" ] && { echo dev; return; }
+	for pat in $NET_TESTS; do
+		# shellcheck disable=SC2254
+		case "$tst" in ($pat) echo net; return;; esac
+	done
+	for pat in $DISK_TESTS; do
+		# shellcheck disable=SC2254
+		case "$tst" in ($pat) echo disk; return;; esac
+	done
+	echo any
+}
+
+declare -A RUNNING_CLASS	# pid -> class
+declare -A CLASS_COUNT=([net]=0 [disk]=0 [dev]=0 [any]=0)
+FAILED=()
+
+class_full()
+{
+	case "$1" in
+	net|dev)  [ "${CLASS_COUNT[$1]}" -ge 1 ] ;;
+	disk)     [ "${CLASS_COUNT[disk]}" -ge "$DISK_SLOTS" ] ;;
+	*)        false ;;
+	esac
+}
+
+reap_finished()
+{
+	local pid status
+
+	for pid in "${!RUNNING_CLASS[@]}"; do
+		if ! kill -0 "$pid" 2>/dev/null; then
+			wait "$pid"
+			status=$?
+			if [ "$status" -ne 0 ]; then
+				FAILED+=("${RUNNING_PID_TEST[$pid]}")
+			fi
+			CLASS_COUNT[${RUNNING_CLASS[$pid]}]=$((CLASS_COUNT[${RUNNING_CLASS[$pid]}] - 1))
+			unset "RUNNING_CLASS[$pid]"
+			unset "RUNNING_PID_TEST[$pid]"
+		fi
+	done
+}
+
+declare -A RUNNING_PID_TEST	# pid -> test name
+
+T_START=$(date +%s)
+for tst in "${TESTS[@]}"; do
+	cls=$(classify "$tst")
+
+	# wait for a compatible slot
+	while [ "${#RUNNING_CLASS[@]}" -ge "$JOBS" ] || class_full "$cls"; do
+		wait -n 2>/dev/null
+		reap_finished
+	done
+
+	./runtests-quiet.sh "$tst" &
+	pid=$!
+	RUNNING_CLASS[$pid]="$cls"
+	RUNNING_PID_TEST[$pid]="$tst"
+	CLASS_COUNT[$cls]=$((CLASS_COUNT[$cls] + 1))
+done
+
+# drain
+while [ "${#RUNNING_CLASS[@]}" -gt 0 ]; do
+	wait -n 2>/dev/null
+	reap_finished
+done
+T_END=$(date +%s)
+
+echo "Ran ${#TESTS[@]} tests in $((T_END - T_START))s on $JOBS slots"
+if [ "${#FAILED[@]}" -ne 0 ]; then
+	echo "Tests failed (${#FAILED[@]}): ${FAILED[*]}"
+	exit 1
+fi
+echo "All tests passed"
+exit 0
@@ -0,0 +1,124 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * Description: test the splice streaming pipeline - stream a patterned
+ * file into a destination file through the recycled pipe pool and
+ * verify every byte reached the sink in order
+ *
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "liburing.h"
+#include "helpers.h"
+
+#define STREAM_LEN	(200 * 1024 + 77)
+#define CHUNK		4096
+#define NR_PIPES	4
+
+static int top_up(struct io_uring_splicer *sp)
+{
+	int ret;
+
+	while (!sp->eof && !sp->err) {
+		ret = io_uring_splice_chunk(sp);
+		if (ret == -ENOSPC || ret == -EBUSY || ret == -ENODATA)
+			break;
+		if (ret) {
+			fprintf(stderr, "splice_chunk: %d\n", ret);
+			return ret;
+		}
+	}
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	struct io_uring_splicer sp;
+	struct io_uring ring;
+	char src[] = ".splice-pipeline-src", dst[] = ".splice-pipeline-dst";
+	char *sbuf, *dbuf;
+	int sfd, dfd, ret;
+
+	if (argc > 1)
+		return T_EXIT_SKIP;
+
+	ret = io_uring_queue_init(4 * NR_PIPES, &ring, 0);
+	if (ret) {
+		fprintf(stderr, "queue_init: %d\n", ret);
+		return T_EXIT_FAIL;
+	}
+
+	t_create_file_pattern(src, STREAM_LEN, 0xa5);
+	sfd = open(src, O_RDONLY);
+	dfd = open(dst, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (sfd < 0 || dfd < 0) {
+		perror("open");
+		goto err;
+	}
+
+	ret = io_uring_splicer_init(&ring, &sp, sfd, 0, dfd, CHUNK, NR_PIPES);
+	if (ret) {
+		fprintf(stderr, "splicer_init: %d\n", ret);
+		goto err;
+	}
+
+	if (top_up(&sp))
+		goto err;
+	while (!sp.eof || sp.free_nr != NR_PIPES) {
+		struct io_uring_cqe *cqe;
+
+		ret = io_uring_submit_and_wait(&ring, 1);
+		if (ret < 0) {
+			fprintf(stderr, "submit_and_wait: %d\n", ret);
+			goto err;
+		}
+		while (!io_uring_peek_cqe(&ring, &cqe)) {
+			ret = io_uring_splice_cqe(&sp, cqe);
+			if (!ret) {
+				fprintf(stderr, "foreign cqe %llx\n",
+					(unsigned long long) cqe->user_data);
+				goto err;
+			}
+			io_uring_cqe_seen(&ring, cqe);
+			if (ret == 2 && top_up(&sp))
+				goto err;
+		}
+	}
+
+	if (sp.err || sp.streamed != STREAM_LEN) {
+		fprintf(stderr, "err %d streamed %llu\n", sp.err,
+			(unsigned long long) sp.streamed);
+		goto err;
+	}
+	io_uring_splicer_exit(&sp);
+
+	sbuf = t_malloc(STREAM_LEN);
+	dbuf = t_malloc(STREAM_LEN);
+	if (pread(sfd, sbuf, STREAM_LEN, 0) != STREAM_LEN)
+		goto err;
+	close(dfd);
+	dfd = open(dst, O_RDONLY);
+	if (dfd < 0 || pread(dfd, dbuf, STREAM_LEN, 0) != STREAM_LEN)
+		goto err;
+	if (memcmp(sbuf, dbuf, STREAM_LEN)) {
+		fprintf(stderr, "sink differs from source\n");
+		goto err;
+	}
+
+	free(sbuf);
+	free(dbuf);
+	close(sfd);
+	close(dfd);
+	unlink(src);
+	unlink(dst);
+	io_uring_queue_exit(&ring);
+	return T_EXIT_PASS;
+err:
+	unlink(src);
+	unlink(dst);
+	return T_EXIT_FAIL;
+}
@@ -0,0 +1,109 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * Description: test multi-producer SQE reservation via io_uring_sq_mt
+ *
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "liburing.h"
+#include "helpers.h"
+
+#define NR_THREADS	4
+#define PER_THREAD	1024
+
+struct producer {
+	struct io_uring_sq_mt *mt;
+	pthread_t thread;
+	int id;
+};
+
+static void *producer_fn(void *data)
+{
+	struct producer *p = data;
+	struct io_uring_sqe *sqe;
+	int i;
+
+	for (i = 0; i < PER_THREAD; i++) {
+		do {
+			sqe = io_uring_sq_mt_get_sqe(p->mt);
+		} while (!sqe);
+		io_uring_prep_nop(sqe);
+		sqe->user_data = ((__u64) p->id << 32) | i;
+		io_uring_sq_mt_publish(p->mt, sqe);
+	}
+
+	return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+	int seen[NR_THREADS] = { };
+	struct producer p[NR_THREADS];
+	struct io_uring_cqe *cqe;
+	struct io_uring_sq_mt mt;
+	struct io_uring ring;
+	int reaped = 0;
+	int ret, i;
+
+	if (argc > 1)
+		return T_EXIT_SKIP;
+
+	ret = io_uring_queue_init(64, &ring, 0);
+	if (ret) {
+		fprintf(stderr, "ring setup failed: %d\n", ret);
+		return T_EXIT_FAIL;
+	}
+	ret = io_uring_sq_mt_init(&ring, &mt);
+	if (ret) {
+		fprintf(stderr, "sq_mt_init failed: %d\n", ret);
+		return T_EXIT_FAIL;
+	}
+
+	for (i = 0; i < NR_THREADS; i++) {
+		p[i].mt = &mt;
+		p[i].id = i;
+		pthread_create(&p[i].thread, NULL, producer_fn, &p[i]);
+	}
+
+	while (reaped < NR_THREADS * PER_THREAD) {
+		if (io_uring_sq_mt_flush(&mt)) {
+			ret = io_uring_submit(&ring);
+			if (ret < 0) {
+				fprintf(stderr, "submit %d\n", ret);
+				goto err;
+			}
+		}
+		while (!io_uring_peek_cqe(&ring, &cqe)) {
+			int tid = cqe->user_data >> 32;
+
+			if (tid < 0 || tid >= NR_THREADS) {
+				fprintf(stderr, "bad user_data\n");
+				goto err;
+			}
+			seen[tid]++;
+			reaped++;
+			io_uring_cqe_seen(&ring, cqe);
+		}
+	}
+
+	for (i = 0; i < NR_THREADS; i++) {
+		pthread_join(p[i].thread, NULL);
+		if (seen[i] != PER_THREAD) {
+			fprintf(stderr, "thread %d: %d completions\n", i,
+				seen[i]);
+			goto err;
+		}
+	}
+
+	io_uring_sq_mt_exit(&mt);
+	io_uring_queue_exit(&ring);
+	return T_EXIT_PASS;
+err:
+	io_uring_queue_exit(&ring);
+	return T_EXIT_FAIL;
+}
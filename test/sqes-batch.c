@@ -0,0 +1,111 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * Description: test batched SQE reservation via io_uring_get_sqes
+ *
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "liburing.h"
+#include "helpers.h"
+
+#define RING_SIZE	8
+
+static int submit_batch(struct io_uring *ring, unsigned nr, int offset)
+{
+	struct io_uring_sqe *sqes[RING_SIZE];
+	struct io_uring_cqe *cqe;
+	unsigned got;
+	int i, ret;
+
+	got = io_uring_get_sqes(ring, sqes, nr);
+	if (got != nr) {
+		fprintf(stderr, "get_sqes returned %u, expected %u\n", got, nr);
+		return 1;
+	}
+
+	for (i = 0; i < (int)nr; i++) {
+		io_uring_prep_nop(sqes[i]);
+		sqes[i]->user_data = i + offset;
+	}
+
+	ret = io_uring_submit(ring);
+	if (ret != (int)nr) {
+		fprintf(stderr, "submit returned %d\n", ret);
+		return 1;
+	}
+
+	for (i = 0; i < (int)nr; i++) {
+		ret = io_uring_wait_cqe(ring, &cqe);
+		if (ret) {
+			fprintf(stderr, "wait_cqe %d\n", ret);
+			return 1;
+		}
+		if (cqe->user_data != (unsigned)(i + offset)) {
+			fprintf(stderr, "user_data %d, expected %d\n",
+				(int)cqe->user_data, i + offset);
+			return 1;
+		}
+		io_uring_cqe_seen(ring, cqe);
+	}
+
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	struct io_uring_sqe *sqes[RING_SIZE + 1];
+	struct io_uring ring;
+	int ret, i;
+
+	if (argc > 1)
+		return T_EXIT_SKIP;
+
+	ret = io_uring_queue_init(RING_SIZE, &ring, 0);
+	if (ret) {
+		fprintf(stderr, "ring setup failed: %d\n", ret);
+		return T_EXIT_FAIL;
+	}
+
+	/* more than the ring holds must fail without reserving anything */
+	if (io_uring_get_sqes(&ring, sqes, RING_SIZE + 1)) {
+		fprintf(stderr, "oversized reservation succeeded\n");
+		goto err;
+	}
+	if (io_uring_sq_ready(&ring)) {
+		fprintf(stderr, "failed reservation left entries behind\n");
+		goto err;
+	}
+
+	/* full-ring reservation, then again to force a wrap */
+	for (i = 0; i < 3; i++) {
+		if (submit_batch(&ring, RING_SIZE, i * RING_SIZE))
+			goto err;
+	}
+
+	/* partial batch, then fill the remainder one at a time */
+	if (io_uring_get_sqes(&ring, sqes, RING_SIZE / 2) != RING_SIZE / 2) {
+		fprintf(stderr, "partial reservation failed\n");
+		goto err;
+	}
+	for (i = 0; i < RING_SIZE / 2; i++) {
+		io_uring_prep_nop(sqes[i]);
+		if (!io_uring_get_sqe(&ring)) {
+			fprintf(stderr, "get_sqe after get_sqes failed\n");
+			goto err;
+		}
+	}
+	if (io_uring_get_sqe(&ring)) {
+		fprintf(stderr, "got sqe from full ring\n");
+		goto err;
+	}
+
+	io_uring_queue_exit(&ring);
+	return T_EXIT_PASS;
+err:
+	io_uring_queue_exit(&ring);
+	return T_EXIT_FAIL;
+}
@@ -0,0 +1,142 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * Description: test io_uring_submit_cached - the cached-wakeup fast path
+ * must not strand submissions behind a parked SQPOLL thread when the
+ * application stops submitting and blocks for completions
+ *
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "liburing.h"
+#include "helpers.h"
+
+static int queue_nop(struct io_uring *ring, __u64 udata)
+{
+	struct io_uring_sqe *sqe;
+	int ret;
+
+	sqe = io_uring_get_sqe(ring);
+	if (!sqe) {
+		fprintf(stderr, "get_sqe failed\n");
+		return 1;
+	}
+	io_uring_prep_nop(sqe);
+	sqe->user_data = udata;
+	ret = io_uring_submit_cached(ring);
+	if (ret != 1) {
+		fprintf(stderr, "submit_cached: %d\n", ret);
+		return 1;
+	}
+	return 0;
+}
+
+static int reap_one(struct io_uring *ring, __u64 udata)
+{
+	struct __kernel_timespec to = { .tv_sec = 5 };
+	struct io_uring_cqe *cqe;
+	int ret;
+
+	ret = io_uring_wait_cqe_timeout(ring, &cqe, &to);
+	if (ret) {
+		fprintf(stderr, "wait_cqe: %d\n", ret);
+		return 1;
+	}
+	if (cqe->user_data != udata) {
+		fprintf(stderr, "unexpected cqe %llu\n",
+			(unsigned long long) cqe->user_data);
+		return 1;
+	}
+	io_uring_cqe_seen(ring, cqe);
+	return 0;
+}
+
+static int test_plain(void)
+{
+	struct io_uring ring;
+	int ret;
+
+	ret = io_uring_queue_init(8, &ring, 0);
+	if (ret) {
+		fprintf(stderr, "ring setup failed: %d\n", ret);
+		return 1;
+	}
+	ret = queue_nop(&ring, 1) || reap_one(&ring, 1);
+	io_uring_queue_exit(&ring);
+	return ret;
+}
+
+static int test_sqpoll(void)
+{
+	struct io_uring_params p = { };
+	struct io_uring ring;
+	int i, ret;
+
+	p.flags = IORING_SETUP_SQPOLL;
+	p.sq_thread_idle = 50;
+	ret = io_uring_queue_init_params(8, &ring, &p);
+	if (ret == -EPERM || ret == -EINVAL)
+		return T_EXIT_SKIP;
+	if (ret) {
+		fprintf(stderr, "sqpoll ring setup failed: %d\n", ret);
+		return 1;
+	}
+
+	/*
+	 * Prime the wakeup cache while the sq thread is provably awake,
+	 * reaping with non-blocking peeks - a blocking wait would expire
+	 * the cache, which is exactly the path under test below.
+	 */
+	for (i = 0; i < 4; i++) {
+		struct io_uring_cqe *cqe;
+		int spins = 0;
+
+		if (queue_nop(&ring, i)) {
+			ret = 1;
+			goto out;
+		}
+		while (io_uring_peek_cqe(&ring, &cqe)) {
+			if (++spins > 5000) {
+				fprintf(stderr, "prime nop %d stuck\n", i);
+				ret = 1;
+				goto out;
+			}
+			usleep(1000);
+		}
+		io_uring_cqe_seen(&ring, cqe);
+	}
+
+	/*
+	 * Let the sq thread park, then submit through the still-warm
+	 * cache - no wakeup is sent. The blocking wait must notice the
+	 * parked thread and wake it, or this nop never completes.
+	 */
+	usleep(200000);
+	ret = queue_nop(&ring, 42) || reap_one(&ring, 42);
+out:
+	io_uring_queue_exit(&ring);
+	return ret;
+}
+
+int main(int argc, char *argv[])
+{
+	int ret;
+
+	if (argc > 1)
+		return T_EXIT_SKIP;
+
+	if (test_plain()) {
+		fprintf(stderr, "test_plain failed\n");
+		return T_EXIT_FAIL;
+	}
+	ret = test_sqpoll();
+	if (ret == T_EXIT_SKIP)
+		return T_EXIT_SKIP;
+	if (ret) {
+		fprintf(stderr, "test_sqpoll failed\n");
+		return T_EXIT_FAIL;
+	}
+	return T_EXIT_PASS;
+}
@@ -0,0 +1,122 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * Description: test partial submission via io_uring_submit_limit
+ *
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "liburing.h"
+#include "helpers.h"
+
+static int prep_nops(struct io_uring *ring, int n, int offset)
+{
+	struct io_uring_sqe *sqe;
+	int i;
+
+	for (i = 0; i < n; i++) {
+		sqe = io_uring_get_sqe(ring);
+		if (!sqe) {
+			fprintf(stderr, "get sqe failed\n");
+			return 1;
+		}
+		io_uring_prep_nop(sqe);
+		sqe->user_data = i + offset;
+	}
+
+	return 0;
+}
+
+static int reap_nr(struct io_uring *ring, int n, int offset)
+{
+	struct io_uring_cqe *cqe;
+	int i, ret;
+
+	for (i = 0; i < n; i++) {
+		ret = io_uring_wait_cqe(ring, &cqe);
+		if (ret) {
+			fprintf(stderr, "wait_cqe %d\n", ret);
+			return 1;
+		}
+		if (cqe->user_data != (unsigned)(i + offset)) {
+			fprintf(stderr, "user_data %d, expected %d\n",
+				(int)cqe->user_data, i + offset);
+			return 1;
+		}
+		io_uring_cqe_seen(ring, cqe);
+	}
+
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	struct io_uring_cqe *cqe;
+	struct io_uring ring;
+	int ret;
+
+	if (argc > 1)
+		return T_EXIT_SKIP;
+
+	ret = io_uring_queue_init(8, &ring, 0);
+	if (ret) {
+		fprintf(stderr, "ring setup failed: %d\n", ret);
+		return T_EXIT_FAIL;
+	}
+
+	if (prep_nops(&ring, 8, 0))
+		goto err;
+
+	/* submit the first 3, the other 5 must stay staged */
+	ret = io_uring_submit_limit(&ring, 3);
+	if (ret != 3) {
+		fprintf(stderr, "submit_limit returned %d\n", ret);
+		goto err;
+	}
+	if (io_uring_sq_ready(&ring) != 5) {
+		fprintf(stderr, "expected 5 staged, got %u\n",
+			io_uring_sq_ready(&ring));
+		goto err;
+	}
+	if (reap_nr(&ring, 3, 0))
+		goto err;
+	ret = io_uring_peek_cqe(&ring, &cqe);
+	if (ret != -EAGAIN) {
+		fprintf(stderr, "unexpected extra completion\n");
+		goto err;
+	}
+
+	/* a limit beyond what is staged submits everything */
+	ret = io_uring_submit_limit(&ring, 32);
+	if (ret != 5) {
+		fprintf(stderr, "remainder submit returned %d\n", ret);
+		goto err;
+	}
+	if (reap_nr(&ring, 5, 3))
+		goto err;
+
+	/* limit of 0 is a no-op */
+	if (prep_nops(&ring, 1, 8))
+		goto err;
+	ret = io_uring_submit_limit(&ring, 0);
+	if (ret != 0) {
+		fprintf(stderr, "zero-limit submit returned %d\n", ret);
+		goto err;
+	}
+	ret = io_uring_submit(&ring);
+	if (ret != 1) {
+		fprintf(stderr, "final submit returned %d\n", ret);
+		goto err;
+	}
+	if (reap_nr(&ring, 1, 8))
+		goto err;
+
+	io_uring_queue_exit(&ring);
+	return T_EXIT_PASS;
+err:
+	io_uring_queue_exit(&ring);
+	return T_EXIT_FAIL;
+}
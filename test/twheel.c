@@ -0,0 +1,114 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * Description: test the hierarchical timer wheel - timers must fire in
+ * deadline order and never early, and a deleted timer must not fire
+ *
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "liburing.h"
+#include "helpers.h"
+
+static int fire_order[4];
+static unsigned long long fire_ns[4];
+static int nr_fired;
+
+static unsigned long long mono_ns(void)
+{
+	struct __kernel_timespec kts;
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	kts.tv_sec = ts.tv_sec;
+	kts.tv_nsec = ts.tv_nsec;
+	return kts.tv_sec * 1000000000ULL + kts.tv_nsec;
+}
+
+static void fired(struct io_uring_twheel *w, struct io_uring_timer *t)
+{
+	fire_order[nr_fired] = (int) (uintptr_t) t->data;
+	fire_ns[nr_fired] = mono_ns();
+	nr_fired++;
+}
+
+static void never(struct io_uring_twheel *w, struct io_uring_timer *t)
+{
+	fprintf(stderr, "deleted timer fired\n");
+	exit(T_EXIT_FAIL);
+}
+
+int main(int argc, char *argv[])
+{
+	struct io_uring_timer timers[3] = {}, doomed = {};
+	struct io_uring_twheel w;
+	struct io_uring ring;
+	unsigned long long start, rel[3] = {
+		20 * 1000000ULL, 5 * 1000000ULL, 10 * 1000000ULL,
+	};
+	int expect[3] = { 1, 2, 0 };
+	int ret, i;
+
+	if (argc > 1)
+		return T_EXIT_SKIP;
+
+	ret = io_uring_queue_init(8, &ring, 0);
+	if (ret) {
+		fprintf(stderr, "queue_init: %d\n", ret);
+		return T_EXIT_FAIL;
+	}
+	ret = io_uring_twheel_init(&ring, &w, 1000000);
+	if (ret) {
+		fprintf(stderr, "twheel_init: %d\n", ret);
+		return T_EXIT_FAIL;
+	}
+
+	start = mono_ns();
+	for (i = 0; i < 3; i++)
+		io_uring_timer_add(&w, &timers[i], rel[i], fired,
+				   (void *) (uintptr_t) i);
+	io_uring_timer_add(&w, &doomed, 50 * 1000000ULL, never, NULL);
+	io_uring_timer_del(&w, &doomed);
+
+	while (w.nr) {
+		struct io_uring_cqe *cqe;
+
+		ret = io_uring_submit_and_wait(&ring, 1);
+		if (ret < 0) {
+			fprintf(stderr, "submit_and_wait: %d\n", ret);
+			return T_EXIT_FAIL;
+		}
+		while (!io_uring_peek_cqe(&ring, &cqe)) {
+			if (!io_uring_twheel_cqe(&w, cqe)) {
+				fprintf(stderr, "foreign cqe %llx\n",
+					(unsigned long long) cqe->user_data);
+				return T_EXIT_FAIL;
+			}
+			io_uring_cqe_seen(&ring, cqe);
+		}
+	}
+
+	if (nr_fired != 3) {
+		fprintf(stderr, "fired %d timers, expected 3\n", nr_fired);
+		return T_EXIT_FAIL;
+	}
+	for (i = 0; i < 3; i++) {
+		if (fire_order[i] != expect[i]) {
+			fprintf(stderr, "fire %d was timer %d, expected %d\n",
+				i, fire_order[i], expect[i]);
+			return T_EXIT_FAIL;
+		}
+		/* never early; the wheel rounds deadlines up to a tick */
+		if (fire_ns[i] < start + rel[fire_order[i]] - 1000000ULL) {
+			fprintf(stderr, "timer %d fired early\n",
+				fire_order[i]);
+			return T_EXIT_FAIL;
+		}
+	}
+
+	io_uring_twheel_exit(&w);
+	io_uring_queue_exit(&ring);
+	return T_EXIT_PASS;
+}
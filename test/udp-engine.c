@@ -0,0 +1,139 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * Description: test the UDP request/response engine - a loopback client
+ * sends a request, the packet callback rewrites it in place, and the
+ * engine's reply must come back to the client from the bound address
+ *
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+
+#include "liburing.h"
+#include "helpers.h"
+
+#define NR_PACKETS	4
+
+static int packets;
+
+static int on_packet(struct io_uring_udp_engine *ue, void *data, unsigned len,
+		     struct sockaddr *src, socklen_t srclen)
+{
+	if (len != 4 || memcmp(data, "ping", 4))
+		return 0;
+	packets++;
+	memcpy(data, "pong", 4);
+	return 4;
+}
+
+static int reap_some(struct io_uring *ring, struct io_uring_udp_engine *ue)
+{
+	struct __kernel_timespec ts = { .tv_sec = 5, };
+	struct io_uring_cqe *cqe;
+	int ret;
+
+	ret = io_uring_submit_and_wait_timeout(ring, &cqe, 1, &ts, NULL);
+	if (ret < 0)
+		return ret;
+	while (!io_uring_peek_cqe(ring, &cqe)) {
+		ret = io_uring_udp_cqe(ue, cqe);
+		if (ret <= 0) {
+			fprintf(stderr, "udp_cqe: %d (udata %llx)\n", ret,
+				(unsigned long long) cqe->user_data);
+			return ret ? ret : -EINVAL;
+		}
+		io_uring_cqe_seen(ring, cqe);
+	}
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	struct io_uring_udp_engine ue;
+	struct sockaddr_in addr;
+	struct io_uring ring;
+	struct timeval tv = { .tv_sec = 5, };
+	char buf[32];
+	int sfd, cfd, ret, i;
+
+	if (argc > 1)
+		return T_EXIT_SKIP;
+
+	ret = io_uring_queue_init(32, &ring, 0);
+	if (ret) {
+		fprintf(stderr, "queue_init: %d\n", ret);
+		return T_EXIT_FAIL;
+	}
+
+	sfd = socket(AF_INET, SOCK_DGRAM, 0);
+	if (sfd < 0) {
+		perror("socket");
+		return T_EXIT_FAIL;
+	}
+	ret = t_bind_ephemeral_port(sfd, &addr);
+	if (ret) {
+		fprintf(stderr, "bind: %d\n", ret);
+		return T_EXIT_FAIL;
+	}
+
+	ret = io_uring_udp_engine_init(&ring, &ue, sfd, 8, 2048, 3,
+				       on_packet, NULL);
+	if (ret) {
+		/* multishot recvmsg or buf rings unsupported */
+		if (ret == -EINVAL || ret == -ENOTSUP)
+			return T_EXIT_SKIP;
+		fprintf(stderr, "udp_engine_init: %d\n", ret);
+		return T_EXIT_FAIL;
+	}
+
+	cfd = socket(AF_INET, SOCK_DGRAM, 0);
+	if (cfd < 0) {
+		perror("socket");
+		return T_EXIT_FAIL;
+	}
+	setsockopt(cfd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+	/* several round trips so reply buffers demonstrably recycle */
+	for (i = 0; i < NR_PACKETS; i++) {
+		ret = (int) sendto(cfd, "ping", 4, 0,
+				   (struct sockaddr *) &addr, sizeof(addr));
+		if (ret != 4) {
+			perror("sendto");
+			return T_EXIT_FAIL;
+		}
+		while (packets <= i) {
+			ret = reap_some(&ring, &ue);
+			if (ret) {
+				fprintf(stderr, "reap: %d\n", ret);
+				return T_EXIT_FAIL;
+			}
+		}
+		/* the reply send is staged; publish it */
+		io_uring_submit(&ring);
+		ret = (int) recv(cfd, buf, sizeof(buf), 0);
+		if (ret != 4 || memcmp(buf, "pong", 4)) {
+			fprintf(stderr, "bad reply %d\n", ret);
+			return T_EXIT_FAIL;
+		}
+	}
+
+	/* drain the send completions so their buffers recycle */
+	while (io_uring_cq_ready(&ring)) {
+		ret = reap_some(&ring, &ue);
+		if (ret) {
+			fprintf(stderr, "drain: %d\n", ret);
+			return T_EXIT_FAIL;
+		}
+	}
+
+	io_uring_udp_engine_exit(&ue);
+	close(cfd);
+	close(sfd);
+	io_uring_queue_exit(&ring);
+	return T_EXIT_PASS;
+}
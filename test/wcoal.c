@@ -0,0 +1,160 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * Description: test the write coalescer - contiguous buffered writes
+ * must merge into single writev sqes per run, the watermark must
+ * trigger an automatic flush, and the written file must match
+ *
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "liburing.h"
+#include "helpers.h"
+
+#define WCOAL_UDATA	0x77636f616cULL
+#define FSYNC_UDATA	0x6673796eULL
+#define CHUNK		1024
+
+static char chunks[12][CHUNK];
+
+static int reap_writes(struct io_uring *ring, int nr, __u64 udata)
+{
+	struct io_uring_cqe *cqe;
+	int i, ret;
+
+	for (i = 0; i < nr; i++) {
+		ret = io_uring_wait_cqe(ring, &cqe);
+		if (ret) {
+			fprintf(stderr, "wait_cqe: %d\n", ret);
+			return ret;
+		}
+		if (cqe->user_data != udata || cqe->res < 0) {
+			fprintf(stderr, "cqe udata %llx res %d\n",
+				(unsigned long long) cqe->user_data, cqe->res);
+			return -EINVAL;
+		}
+		io_uring_cqe_seen(ring, cqe);
+	}
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	struct io_uring_wcoal wc;
+	struct io_uring ring;
+	char file[] = ".wcoal";
+	char rbuf[12 * CHUNK];
+	int fd, ret, i;
+
+	if (argc > 1)
+		return T_EXIT_SKIP;
+
+	ret = io_uring_queue_init(32, &ring, 0);
+	if (ret) {
+		fprintf(stderr, "queue_init: %d\n", ret);
+		return T_EXIT_FAIL;
+	}
+
+	ret = io_uring_wcoal_init(&ring, &wc, 4, 16, 8, WCOAL_UDATA);
+	if (ret) {
+		fprintf(stderr, "wcoal_init: %d\n", ret);
+		return T_EXIT_FAIL;
+	}
+
+	fd = open(file, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		perror("open");
+		goto err;
+	}
+	for (i = 0; i < 12; i++)
+		memset(chunks[i], 'a' + i, CHUNK);
+
+	/*
+	 * Four contiguous chunks and one disjoint: exactly two runs, so
+	 * the flush must stage exactly two writev sqes.
+	 */
+	for (i = 0; i < 4; i++) {
+		ret = io_uring_wcoal_write(&wc, fd, chunks[i], CHUNK,
+					   (__u64) i * CHUNK);
+		if (ret) {
+			fprintf(stderr, "wcoal_write %d: %d\n", i, ret);
+			goto err;
+		}
+	}
+	ret = io_uring_wcoal_write(&wc, fd, chunks[4], CHUNK, 8 * CHUNK);
+	if (ret) {
+		fprintf(stderr, "wcoal_write gap: %d\n", ret);
+		goto err;
+	}
+	ret = io_uring_wcoal_flush(&wc, fd);
+	if (ret != 2) {
+		fprintf(stderr, "flush staged %d sqes, expected 2\n", ret);
+		goto err;
+	}
+	if (reap_writes(&ring, 2, WCOAL_UDATA))
+		goto err;
+
+	/* the eighth buffered iovec tips the watermark: one merged run */
+	for (i = 0; i < 7; i++) {
+		ret = io_uring_wcoal_write(&wc, fd, chunks[i], CHUNK,
+					   (__u64) (12 + i) * CHUNK);
+		if (ret) {
+			fprintf(stderr, "buffered write %d: %d\n", i, ret);
+			goto err;
+		}
+	}
+	ret = io_uring_wcoal_write(&wc, fd, chunks[7], CHUNK, 19 * CHUNK);
+	if (ret != 1) {
+		fprintf(stderr, "watermark flush staged %d, expected 1\n",
+			ret);
+		goto err;
+	}
+	if (reap_writes(&ring, 1, WCOAL_UDATA))
+		goto err;
+
+	/* durability point: one linked writev run plus the fsync */
+	ret = io_uring_wcoal_write(&wc, fd, chunks[8], CHUNK, 20 * CHUNK);
+	if (ret) {
+		fprintf(stderr, "pre-fsync write: %d\n", ret);
+		goto err;
+	}
+	ret = io_uring_wcoal_fsync(&wc, fd, 0, FSYNC_UDATA);
+	if (ret != 2) {
+		fprintf(stderr, "wcoal_fsync staged %d, expected 2\n", ret);
+		goto err;
+	}
+	if (reap_writes(&ring, 1, WCOAL_UDATA) ||
+	    reap_writes(&ring, 1, FSYNC_UDATA))
+		goto err;
+
+	io_uring_wcoal_exit(&wc);
+	close(fd);
+
+	fd = open(file, O_RDONLY);
+	if (fd < 0 || pread(fd, rbuf, sizeof(rbuf), 0) < 0) {
+		perror("readback");
+		goto err;
+	}
+	for (i = 0; i < 4; i++) {
+		if (memcmp(rbuf + (size_t) i * CHUNK, chunks[i], CHUNK)) {
+			fprintf(stderr, "run 1 chunk %d mismatch\n", i);
+			goto err;
+		}
+	}
+	if (memcmp(rbuf + 8 * CHUNK, chunks[4], CHUNK)) {
+		fprintf(stderr, "run 2 mismatch\n");
+		goto err;
+	}
+
+	close(fd);
+	unlink(file);
+	io_uring_queue_exit(&ring);
+	return T_EXIT_PASS;
+err:
+	unlink(file);
+	return T_EXIT_FAIL;
+}